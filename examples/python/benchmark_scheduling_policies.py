@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+
+"""
+librepo - benchmark of scheduling policies
+
+Downloads a batch of one large and many small files from a local HTTP
+server which limits the speed of each connection (as a lot of mirrors
+do) and prints total wall time of the download for each scheduling
+policy. With the FIFO policy the large file (passed as the last one)
+is started at the end and becomes the "long pole" of the download.
+"""
+
+import os
+import sys
+import time
+import shutil
+import tempfile
+import threading
+
+try:
+    from http.server import HTTPServer, SimpleHTTPRequestHandler
+    from socketserver import ThreadingMixIn
+except ImportError:
+    from BaseHTTPServer import HTTPServer
+    from SimpleHTTPServer import SimpleHTTPRequestHandler
+    from SocketServer import ThreadingMixIn
+
+import librepo
+
+SPEED_PER_CONNECTION = 1024 * 1024  # bytes/s
+LARGE_FILE_SIZE = 8 * 1024 * 1024
+SMALL_FILE_SIZE = 256 * 1024
+SMALL_FILES = 30
+PARALLEL_DOWNLOADS = 4
+
+POLICIES = [("FIFO", librepo.SCHEDULING_FIFO),
+            ("LARGESTFIRST", librepo.SCHEDULING_LARGESTFIRST),
+            ("BALANCED", librepo.SCHEDULING_BALANCED)]
+
+
+class ThrottledHandler(SimpleHTTPRequestHandler):
+    """Serve files with a limited speed per connection"""
+
+    def copyfile(self, source, outputfile):
+        chunk = SPEED_PER_CONNECTION // 10
+        while True:
+            buf = source.read(chunk)
+            if not buf:
+                break
+            outputfile.write(buf)
+            time.sleep(0.1)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def prepare_files(directory):
+    files = []
+    for x in range(SMALL_FILES):
+        files.append(("small-%02d" % x, SMALL_FILE_SIZE))
+    files.append(("large", LARGE_FILE_SIZE))
+
+    for name, size in files:
+        with open(os.path.join(directory, name), "wb") as f:
+            f.write(os.urandom(size))
+
+    return files
+
+
+def download(url, files, policy, destdir):
+    h = librepo.Handle()
+    h.urls = [url]
+    h.repotype = librepo.YUMREPO
+    h.maxparalleldownloads = PARALLEL_DOWNLOADS
+    h.maxdownloadspermirror = PARALLEL_DOWNLOADS
+    h.schedulingpolicy = policy
+
+    packages = []
+    for name, size in files:
+        packages.append(librepo.PackageTarget(name,
+                                              handle=h,
+                                              dest=os.path.join(destdir, name),
+                                              expectedsize=size))
+
+    start = time.time()
+    librepo.download_packages(packages)
+    elapsed = time.time() - start
+
+    for target in packages:
+        if target.err:
+            print("Error: %s: %s" % (target.relative_url, target.err))
+            sys.exit(1)
+
+    return elapsed
+
+
+if __name__ == "__main__":
+
+    srcdir = tempfile.mkdtemp(prefix="librepo-bench-src-")
+    destdir = tempfile.mkdtemp(prefix="librepo-bench-dest-")
+    cwd = os.getcwd()
+
+    try:
+        files = prepare_files(srcdir)
+
+        # Serve the files
+        os.chdir(srcdir)
+        server = ThreadedHTTPServer(("127.0.0.1", 0), ThrottledHandler)
+        thread = threading.Thread(target=server.serve_forever)
+        thread.daemon = True
+        thread.start()
+        url = "http://127.0.0.1:%d/" % server.server_address[1]
+
+        print("%d files (%d x %d KiB + 1 x %d KiB), %d parallel downloads, "
+              "%d KiB/s per connection" % (len(files), SMALL_FILES,
+              SMALL_FILE_SIZE // 1024, LARGE_FILE_SIZE // 1024,
+              PARALLEL_DOWNLOADS, SPEED_PER_CONNECTION // 1024))
+
+        for name, policy in POLICIES:
+            elapsed = download(url, files, policy, destdir)
+            print("%-14s %6.2f s" % (name, elapsed))
+
+        server.shutdown()
+    finally:
+        os.chdir(cwd)
+        shutil.rmtree(srcdir)
+        shutil.rmtree(destdir)
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -31,6 +32,8 @@
 
 #include "cleanup.h"
 #include "checksum.h"
+#include "checksum_internal.h"
+#include "logqueue_internal.h"
 #include "rcodes.h"
 #include "util.h"
 
@@ -100,18 +103,19 @@ lr_checksum_type_to_str(LrChecksumType type)
     return NULL;
 }
 
-char *
-lr_checksum_fd(LrChecksumType type, int fd, GError **err)
+struct _LrChecksumCtx {
+    LrChecksumType type; /*!<
+        Checksum type */
+    EVP_MD_CTX *ctx; /*!<
+        OpenSSL digest context */
+};
+
+LrChecksumCtx *
+lr_checksumctx_new(LrChecksumType type, GError **err)
 {
-    unsigned int len;
-    ssize_t readed;
-    char buf[BUFFER_SIZE];
-    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
-    char *checksum;
-    EVP_MD_CTX *ctx;
+    LrChecksumCtx *ctx;
     const EVP_MD *ctx_type;
 
-    assert(fd > -1);
     assert(!err || *err == NULL);
 
     switch (type) {
@@ -123,61 +127,184 @@ lr_checksum_fd(LrChecksumType type, int fd, GError **err)
         case LR_CHECKSUM_SHA512:    ctx_type = EVP_sha512(); break;
         case LR_CHECKSUM_UNKNOWN:
         default:
-            g_debug("%s: Unknown checksum type", __func__);
-            assert(0);
+            lr_log_debug("%s: Unknown checksum type", __func__);
             g_set_error(err, LR_CHECKSUM_ERROR, LRE_BADFUNCARG,
                         "Unknown checksum type: %d", type);
             return NULL;
     }
 
-    ctx = EVP_MD_CTX_create();
-    if (!ctx) {
+    ctx = lr_malloc0(sizeof(*ctx));
+    ctx->type = type;
+    ctx->ctx = EVP_MD_CTX_create();
+    if (!ctx->ctx) {
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
                     "EVP_MD_CTX_create() failed");
+        lr_free(ctx);
         return NULL;
     }
 
-    if (!EVP_DigestInit_ex(ctx, ctx_type, NULL)) {
+    if (!EVP_DigestInit_ex(ctx->ctx, ctx_type, NULL)) {
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
                     "EVP_DigestInit_ex() failed");
-        EVP_MD_CTX_destroy(ctx);
+        lr_checksumctx_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+LrChecksumType
+lr_checksumctx_type(LrChecksumCtx *ctx)
+{
+    assert(ctx);
+    return ctx->type;
+}
+
+gboolean
+lr_checksumctx_update(LrChecksumCtx *ctx,
+                      const void *buf,
+                      size_t len,
+                      GError **err)
+{
+    assert(ctx);
+    assert(!err || *err == NULL);
+
+    if (!EVP_DigestUpdate(ctx->ctx, buf, len)) {
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestUpdate() failed");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+char *
+lr_checksumctx_final(LrChecksumCtx *ctx, GError **err)
+{
+    unsigned int len;
+    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
+    char *checksum;
+
+    assert(ctx);
+    assert(!err || *err == NULL);
+
+    if (!EVP_DigestFinal_ex(ctx->ctx, raw_checksum, &len)) {
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestFinal_ex() failed");
+        return NULL;
+    }
+
+    checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
+    for (size_t x = 0; x < len; x++)
+        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+
+    return checksum;
+}
+
+void
+lr_checksumctx_free(LrChecksumCtx *ctx)
+{
+    if (!ctx)
+        return;
+    if (ctx->ctx)
+        EVP_MD_CTX_destroy(ctx->ctx);
+    lr_free(ctx);
+}
+
+/** Add the data read by the io_uring to the checksum.
+ */
+static gboolean
+checksum_update_cb(void *data, const char *buf, size_t len, GError **err)
+{
+    return lr_checksumctx_update(data, buf, len, err);
+}
+
+/** Calculate checksum of the whole file. If the ring is not NULL,
+ * the file is read by the io_uring. If keep_position is TRUE, the file
+ * is read by pread(). The position of the file descriptor is not changed
+ * in both cases, otherwise the function seeks to the begin of the file.
+ */
+static char *
+checksum_fd(LrChecksumType type,
+            int fd,
+            LrIoUring *ring,
+            gboolean keep_position,
+            GError **err)
+{
+    ssize_t readed;
+    off_t offset = 0;
+    char buf[BUFFER_SIZE];
+    char *checksum;
+    LrChecksumCtx *ctx;
+
+    assert(fd > -1);
+    assert(!err || *err == NULL);
+
+    ctx = lr_checksumctx_new(type, err);
+    if (!ctx)
         return NULL;
+
+    if (ring) {
+        if (!lr_iouring_read_file(ring, fd, checksum_update_cb, ctx,
+                                  LR_CHECKSUM_ERROR, err)) {
+            lr_checksumctx_free(ctx);
+            return NULL;
+        }
+
+        checksum = lr_checksumctx_final(ctx, err);
+        lr_checksumctx_free(ctx);
+        return checksum;
     }
 
-    if (lseek(fd, 0, SEEK_SET) == -1) {
+    if (!keep_position && lseek(fd, 0, SEEK_SET) == -1) {
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_IO,
                     "Cannot seek to the begin of the file. "
                     "lseek(%d, 0, SEEK_SET) error: %s", fd, strerror(errno));
+        lr_checksumctx_free(ctx);
         return NULL;
     }
 
-    while ((readed = read(fd, buf, BUFFER_SIZE)) > 0)
-        if (!EVP_DigestUpdate(ctx, buf, readed)) {
-            g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
-                        "EVP_DigestUpdate() failed");
+    while ((readed = keep_position ? pread(fd, buf, BUFFER_SIZE, offset)
+                                   : read(fd, buf, BUFFER_SIZE)) > 0)
+    {
+        offset += readed;
+        if (!lr_checksumctx_update(ctx, buf, readed, err)) {
+            lr_checksumctx_free(ctx);
             return NULL;
         }
+    }
 
     if (readed == -1) {
-        EVP_MD_CTX_destroy(ctx);
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_IO,
-                    "read(%d) failed: %s", fd, strerror(errno));
+                    "%s(%d) failed: %s", keep_position ? "pread" : "read",
+                    fd, strerror(errno));
+        lr_checksumctx_free(ctx);
         return NULL;
     }
 
-    if (!EVP_DigestFinal_ex(ctx, raw_checksum, &len)) {
-        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
-                    "EVP_DigestFinal_ex() failed");
-        return NULL;
-    }
+    checksum = lr_checksumctx_final(ctx, err);
+    lr_checksumctx_free(ctx);
+
+    return checksum;
+}
 
-    EVP_MD_CTX_destroy(ctx);
+char *
+lr_checksum_fd(LrChecksumType type, int fd, GError **err)
+{
+    return checksum_fd(type, fd, NULL, FALSE, err);
+}
 
-    checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
-    for (size_t x = 0; x < len; x++)
-        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+void
+lr_checksum_cache_store(int fd, const char *checksum)
+{
+    struct stat st;
 
-    return checksum;
+    if (fstat(fd, &st) == 0) {
+        _cleanup_free_ gchar *key = NULL;
+        key = g_strdup_printf("user.Zif.MdChecksum[%llu]",
+                              (unsigned long long) st.st_mtime);
+        fsetxattr(fd, key, checksum, strlen(checksum)+1, 0);
+    }
 }
 
 
@@ -194,14 +321,20 @@ lr_checksum_fd_cmp(LrChecksumType type,
 }
 
 
-gboolean
-lr_checksum_fd_compare(LrChecksumType type,
-                       int fd,
-                       const char *expected,
-                       gboolean caching,
-                       gboolean *matches,
-                       gchar **calculated,
-                       GError **err)
+/** See ::lr_checksum_fd_compare_ring.
+ * @param keep_position     Do not change the position of the file
+ *                          descriptor (see checksum_fd()).
+ */
+static gboolean
+checksum_fd_compare(LrChecksumType type,
+                    int fd,
+                    const char *expected,
+                    gboolean caching,
+                    gboolean *matches,
+                    gchar **calculated,
+                    LrIoUring *ring,
+                    gboolean keep_position,
+                    GError **err)
 {
     _cleanup_free_ gchar *checksum = NULL;
 
@@ -229,33 +362,55 @@ lr_checksum_fd_compare(LrChecksumType type,
             attr_ret = fgetxattr(fd, key, &buf, 256);
             if (attr_ret != -1) {
                 // Cached checksum found
-                g_debug("%s: Using checksum cached in xattr: [%s] %s",
-                        __func__, key, buf);
+                lr_log_debug("%s: Using checksum cached in xattr: [%s] %s",
+                             __func__, key, buf);
                 *matches = strcmp(expected, buf) ? FALSE : TRUE;
                 return TRUE;
             }
         }
     }
 
-    checksum = lr_checksum_fd(type, fd, err);
+    checksum = checksum_fd(type, fd, ring, keep_position, err);
     if (!checksum)
         return FALSE;
 
     *matches = (strcmp(expected, checksum)) ? FALSE : TRUE;
 
-    if (caching && *matches) {
+    if (caching && *matches)
         // Store checksum as extended file attribute if caching is enabled
-        struct stat st;
-        if (fstat(fd, &st) == 0) {
-            _cleanup_free_ gchar *key = NULL;
-            key = g_strdup_printf("user.Zif.MdChecksum[%llu]",
-                                  (unsigned long long) st.st_mtime);
-            fsetxattr(fd, key, checksum, strlen(checksum)+1, 0);
-        }
-    }
+        lr_checksum_cache_store(fd, checksum);
 
     if (calculated)
         *calculated = g_strdup(checksum);
 
     return TRUE;
 }
+
+
+gboolean
+lr_checksum_fd_compare(LrChecksumType type,
+                       int fd,
+                       const char *expected,
+                       gboolean caching,
+                       gboolean *matches,
+                       gchar **calculated,
+                       GError **err)
+{
+    return checksum_fd_compare(type, fd, expected, caching,
+                               matches, calculated, NULL, FALSE, err);
+}
+
+
+gboolean
+lr_checksum_fd_compare_ring(LrChecksumType type,
+                            int fd,
+                            const char *expected,
+                            gboolean caching,
+                            gboolean *matches,
+                            gchar **calculated,
+                            LrIoUring *ring,
+                            GError **err)
+{
+    return checksum_fd_compare(type, fd, expected, caching,
+                               matches, calculated, ring, TRUE, err);
+}
@@ -0,0 +1,103 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#ifndef __LR_CHECKSUM_INTERNAL_H__
+#define __LR_CHECKSUM_INTERNAL_H__
+
+#include <glib.h>
+
+#include "checksum.h"
+#include "iouring_internal.h"
+
+G_BEGIN_DECLS
+
+/** Context of an incremental checksum calculation.
+ */
+typedef struct _LrChecksumCtx LrChecksumCtx;
+
+/** Create new checksum context.
+ * @param type      Checksum type
+ * @param err       GError **
+ * @return          New context or NULL if err is set
+ */
+LrChecksumCtx *
+lr_checksumctx_new(LrChecksumType type, GError **err);
+
+/** Type of the checksum calculated by the context.
+ * @param ctx       Checksum context
+ * @return          Checksum type
+ */
+LrChecksumType
+lr_checksumctx_type(LrChecksumCtx *ctx);
+
+/** Add data to the checksum.
+ * @param ctx       Checksum context
+ * @param buf       Data
+ * @param len       Length of the data
+ * @param err       GError **
+ * @return          TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_checksumctx_update(LrChecksumCtx *ctx,
+                      const void *buf,
+                      size_t len,
+                      GError **err);
+
+/** Finish the calculation. No more data could be added to the context.
+ * @param ctx       Checksum context
+ * @param err       GError **
+ * @return          Malloced checksum string or NULL if err is set
+ */
+char *
+lr_checksumctx_final(LrChecksumCtx *ctx, GError **err);
+
+/** Free the context.
+ * @param ctx       Checksum context or NULL
+ */
+void
+lr_checksumctx_free(LrChecksumCtx *ctx);
+
+/** Cache checksum of the file as an extended file attribute.
+ * The cached checksum is used by ::lr_checksum_fd_compare when
+ * caching is enabled.
+ * @param fd        File descriptor
+ * @param checksum  Checksum of the whole file
+ */
+void
+lr_checksum_cache_store(int fd, const char *checksum);
+
+/** Same as ::lr_checksum_fd_compare, but the file is read by the ring
+ * (see LRO_IOURING) if it is not NULL, or by pread() otherwise.
+ * The position of the file descriptor is never changed, so a descriptor
+ * dup'd from one that is in use by another thread may be passed.
+ * @param ring      Ring or NULL
+ */
+gboolean
+lr_checksum_fd_compare_ring(LrChecksumType type,
+                            int fd,
+                            const char *expected,
+                            gboolean caching,
+                            gboolean *matches,
+                            gchar **calculated,
+                            LrIoUring *ring,
+                            GError **err);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,378 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <curl/curl.h>
+
+#include "cleanup.h"
+#include "util.h"
+#include "dnsprefetch_internal.h"
+
+/** Max number of threads resolving hosts in parallel */
+#define LR_DNS_PREFETCH_MAX_THREADS     16
+/** Max time (in milliseconds) to wait for the host of the first URL */
+#define LR_DNS_PREFETCH_TIMEOUT         2000
+
+/** Prefetch shared by the caller and the resolving threads. The caller
+ * could stop waiting before all hosts are resolved, the object is freed
+ * by the last of them. */
+typedef struct {
+    gint refcount; /*!<
+        Number of references */
+    gint cancelled; /*!<
+        The caller doesn't wait for the results anymore */
+    GAsyncQueue *results; /*!<
+        Resolved jobs (LrDnsPrefetchJob *) */
+} LrDnsPrefetch;
+
+typedef struct {
+    LrDnsPrefetch *prefetch; /*!<
+        Prefetch the job belongs to */
+    gchar *host; /*!<
+        Host to resolve */
+    gchar *port; /*!<
+        Port */
+    gboolean first; /*!<
+        Host of the first URL, the caller waits for it */
+    int family; /*!<
+        Wanted address family (AF_UNSPEC, AF_INET, AF_INET6) */
+    gchar *entry; /*!<
+        Resulting entry for CURLOPT_RESOLVE or NULL */
+    const char *error; /*!<
+        Error message (gai_strerror()) if the host cannot be resolved */
+} LrDnsPrefetchJob;
+
+static void
+lr_dns_prefetch_job_free(LrDnsPrefetchJob *job)
+{
+    if (!job)
+        return;
+    g_free(job->host);
+    g_free(job->port);
+    g_free(job->entry);
+    g_free(job);
+}
+
+static void
+lr_dns_prefetch_unref(LrDnsPrefetch *prefetch)
+{
+    if (!g_atomic_int_dec_and_test(&prefetch->refcount))
+        return;
+    g_async_queue_unref(prefetch->results);
+    g_free(prefetch);
+}
+
+/** Get host and port of the URL.
+ * @return          FALSE if the URL doesn't have a host which has
+ *                  to be resolved (local URL, IP address, ...)
+ */
+static gboolean
+lr_dns_prefetch_parse_url(const char *url, gchar **host, gchar **port)
+{
+    const char *default_port;
+    const char *start, *end, *at;
+
+    if (!g_ascii_strncasecmp(url, "http://", 7))
+        default_port = "80";
+    else if (!g_ascii_strncasecmp(url, "https://", 8))
+        default_port = "443";
+    else if (!g_ascii_strncasecmp(url, "ftp://", 6))
+        default_port = "21";
+    else
+        return FALSE;
+
+    start = strstr(url, "://") + 3;
+    end = start + strcspn(start, "/?#");
+
+    // Skip user info
+    at = memchr(start, '@', end - start);
+    if (at)
+        start = at + 1;
+
+    if (*start == '[')  // IPv6 address
+        return FALSE;
+
+    const char *colon = memchr(start, ':', end - start);
+    *host = g_strndup(start, (colon ? colon : end) - start);
+    if (colon && colon + 1 < end)
+        *port = g_strndup(colon + 1, end - colon - 1);
+    else
+        *port = g_strdup(default_port);
+
+    unsigned char buf[sizeof(struct in6_addr)];
+    if (**host == '\0' || inet_pton(AF_INET, *host, buf) == 1) {
+        g_free(*host);
+        g_free(*port);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/** Resolve the host of the job. Called by the threads of the pool
+ * (nothing is logged from them).
+ */
+static void
+lr_dns_prefetch_worker(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    LrDnsPrefetchJob *job = data;
+    LrDnsPrefetch *prefetch = job->prefetch;
+    struct addrinfo hints, *res = NULL;
+    int rc;
+
+    if (g_atomic_int_get(&prefetch->cancelled))
+        goto done;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = job->family;
+    hints.ai_socktype = SOCK_STREAM;
+
+    rc = getaddrinfo(job->host, job->port, &hints, &res);
+    if (rc != 0) {
+        job->error = gai_strerror(rc);
+        goto done;
+    }
+
+    // The entry times out from the DNS cache like a resolved one
+    // (supported since curl 7.75.0, see lr_dns_prefetch())
+    GString *entry = g_string_new("+");
+    g_string_append_printf(entry, "%s:%s:", job->host, job->port);
+    gsize prefix_len = entry->len;
+
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        char addr[INET6_ADDRSTRLEN];
+        const void *src;
+
+        if (ai->ai_family == AF_INET)
+            src = &((struct sockaddr_in *) ai->ai_addr)->sin_addr;
+        else if (ai->ai_family == AF_INET6)
+            src = &((struct sockaddr_in6 *) ai->ai_addr)->sin6_addr;
+        else
+            continue;
+
+        if (!inet_ntop(ai->ai_family, src, addr, sizeof(addr)))
+            continue;
+
+        _cleanup_free_ gchar *formatted = ai->ai_family == AF_INET6
+                                          ? g_strdup_printf("[%s]", addr)
+                                          : g_strdup(addr);
+        if (strstr(entry->str + prefix_len, formatted))
+            continue;  // Duplicate (other socktype/protocol)
+        if (entry->len > prefix_len)
+            g_string_append_c(entry, ',');
+        g_string_append(entry, formatted);
+    }
+
+    freeaddrinfo(res);
+
+    if (entry->len > prefix_len)
+        job->entry = g_string_free(entry, FALSE);
+    else
+        g_string_free(entry, TRUE);
+
+done:
+    g_async_queue_push(prefetch->results, job);
+    lr_dns_prefetch_unref(prefetch);
+}
+
+/** Is the host already in the list of CURLOPT_RESOLVE entries? */
+static gboolean
+lr_dns_prefetch_listed(struct curl_slist *resolve,
+                       const char *host,
+                       const char *port)
+{
+    _cleanup_free_ gchar *prefix = g_strdup_printf("%s:%s:", host, port);
+
+    for (struct curl_slist *elem = resolve; elem; elem = elem->next) {
+        const char *data = elem->data;
+        if (*data == '+')
+            data++;
+        if (g_str_has_prefix(data, prefix))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+guint
+lr_dns_prefetch(GSList *urls,
+                LrIpResolveType ipresolve,
+                struct curl_slist **resolve)
+{
+    LrDnsPrefetch *prefetch;
+    GThreadPool *pool = NULL;
+    GHashTable *hosts;
+    guint jobs = 0, resolved = 0;
+    gboolean waiting = FALSE;
+    int family = AF_UNSPEC;
+
+    assert(resolve);
+
+#if LIBCURL_VERSION_NUM < 0x074B00  // 7.75.0
+    // Older curl keeps the entries of CURLOPT_RESOLVE in its DNS cache
+    // for the whole lifetime of the handle, so the addresses would never
+    // be refreshed
+    g_debug("%s: Not supported by curl older than 7.75.0", __func__);
+    return 0;
+#endif
+
+    if (ipresolve == LR_IPRESOLVE_V4)
+        family = AF_INET;
+    else if (ipresolve == LR_IPRESOLVE_V6)
+        family = AF_INET6;
+
+    prefetch = g_new0(LrDnsPrefetch, 1);
+    prefetch->refcount = 1;
+    prefetch->results = g_async_queue_new_full(
+                            (GDestroyNotify) lr_dns_prefetch_job_free);
+    hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (GSList *elem = urls; elem; elem = g_slist_next(elem)) {
+        gchar *host, *port;
+
+        if (!lr_dns_prefetch_parse_url(elem->data, &host, &port))
+            continue;
+
+        gchar *key = g_strconcat(host, ":", port, NULL);
+        if (g_hash_table_contains(hosts, key)
+            || lr_dns_prefetch_listed(*resolve, host, port))
+        {
+            g_free(key);
+            g_free(host);
+            g_free(port);
+            continue;
+        }
+        g_hash_table_add(hosts, key);
+
+        if (!pool)
+            pool = g_thread_pool_new(lr_dns_prefetch_worker,
+                                     NULL,
+                                     LR_DNS_PREFETCH_MAX_THREADS,
+                                     FALSE,
+                                     NULL);
+
+        LrDnsPrefetchJob *job = g_new0(LrDnsPrefetchJob, 1);
+        job->prefetch = prefetch;
+        job->host = host;
+        job->port = port;
+        job->first = (elem == urls);
+        job->family = family;
+        waiting = waiting || job->first;
+        g_atomic_int_inc(&prefetch->refcount);
+        g_thread_pool_push(pool, job, NULL);
+        jobs++;
+    }
+
+    g_hash_table_destroy(hosts);
+
+    if (jobs)
+        g_debug("%s: Resolving %u hosts", __func__, jobs);
+
+    // Only the host of the first URL (the first mirror, which is tried
+    // first) is waited for, the results of the other hosts are taken
+    // if they are already available. The download isn't delayed by
+    // slow hosts of mirrors which may not be needed at all.
+    gint64 deadline = g_get_monotonic_time()
+                      + (gint64) LR_DNS_PREFETCH_TIMEOUT * 1000;
+    for (guint done = 0; done < jobs; done++) {
+        gint64 remaining = deadline - g_get_monotonic_time();
+        LrDnsPrefetchJob *job = NULL;
+
+        if (waiting && remaining > 0)
+            job = g_async_queue_timeout_pop(prefetch->results, remaining);
+        else
+            job = g_async_queue_try_pop(prefetch->results);
+        if (!job) {
+            g_debug("%s: %u hosts are left to curl", __func__, jobs - done);
+            break;
+        }
+        if (job->first)
+            waiting = FALSE;
+
+        if (job->entry) {
+            g_debug("%s: %s", __func__, job->entry);
+            *resolve = curl_slist_append(*resolve, job->entry);
+            resolved++;
+        } else if (job->error) {
+            g_debug("%s: Cannot resolve %s: %s",
+                    __func__, job->host, job->error);
+        }
+        lr_dns_prefetch_job_free(job);
+    }
+
+    // Jobs which are still queued or running finish in the background
+    g_atomic_int_set(&prefetch->cancelled, 1);
+    if (pool)
+        g_thread_pool_free(pool, FALSE, FALSE);
+    lr_dns_prefetch_unref(prefetch);
+
+    return resolved;
+}
+
+void
+lr_dns_prefetch_filter(struct curl_slist *resolved,
+                       LrIpResolveType ipresolve,
+                       struct curl_slist **resolve)
+{
+    assert(resolve);
+
+    for (struct curl_slist *elem = resolved; elem; elem = elem->next) {
+        const char *data = elem->data;
+
+        if (ipresolve == LR_IPRESOLVE_WHATEVER) {
+            *resolve = curl_slist_append(*resolve, data);
+            continue;
+        }
+
+        // "+host:port:" is followed by the addresses, IPv6 ones
+        // are enclosed in brackets
+        const char *addresses = strchr(data, ':');
+        if (addresses)
+            addresses = strchr(addresses + 1, ':');
+        if (!addresses)
+            continue;
+        addresses++;
+
+        GString *entry = g_string_new_len(data, addresses - data);
+        gsize prefix_len = entry->len;
+        gchar **list = g_strsplit(addresses, ",", -1);
+        for (gchar **addr = list; *addr; addr++) {
+            gboolean v6 = (**addr == '[');
+            if (v6 != (ipresolve == LR_IPRESOLVE_V6))
+                continue;
+            if (entry->len > prefix_len)
+                g_string_append_c(entry, ',');
+            g_string_append(entry, *addr);
+        }
+        g_strfreev(list);
+
+        if (entry->len > prefix_len)
+            *resolve = curl_slist_append(*resolve, entry->str);
+        g_string_free(entry, TRUE);
+    }
+}
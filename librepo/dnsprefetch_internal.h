@@ -0,0 +1,68 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_DNSPREFETCH_INTERNAL_H__
+#define __LR_DNSPREFETCH_INTERNAL_H__
+
+#include <glib.h>
+#include <curl/curl.h>
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+/** Time (in seconds) the prefetched addresses are considered valid.
+ * The same as the default timeout of the DNS cache of curl
+ * (CURLOPT_DNS_CACHE_TIMEOUT), the entries expire from it as well. */
+#define LR_DNS_PREFETCH_VALIDITY    60
+
+/** Resolve hosts of the URLs in parallel (see LRO_DNSPREFETCH).
+ * Each distinct host is resolved by a thread of a pool. The function
+ * waits (for a limited time) only for the host of the first URL and
+ * takes the results of the other hosts which are already resolved,
+ * the rest is left to curl. Hosts of local URLs, IP addresses
+ * and hosts which are already in the list are skipped. Nothing is
+ * resolved with curl older than 7.75.0, which cannot expire the entries.
+ * @param urls          List of URLs (char *)
+ * @param ipresolve     Type of the wanted addresses
+ * @param resolve       List of the entries for CURLOPT_RESOLVE
+ *                      ("host:port:address,..."), entries of the newly
+ *                      resolved hosts are appended to it
+ * @return              Number of the newly resolved hosts
+ */
+guint
+lr_dns_prefetch(GSList *urls,
+                LrIpResolveType ipresolve,
+                struct curl_slist **resolve);
+
+/** Append entries of the list, with only the addresses of the wanted
+ * type, to another list. Entries without such addresses are skipped.
+ * @param resolved      Entries returned by ::lr_dns_prefetch
+ * @param ipresolve     Type of the wanted addresses
+ * @param resolve       List of the entries for CURLOPT_RESOLVE
+ */
+void
+lr_dns_prefetch_filter(struct curl_slist *resolved,
+                       LrIpResolveType ipresolve,
+                       struct curl_slist **resolve);
+
+G_END_DECLS
+
+#endif
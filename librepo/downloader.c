@@ -18,9 +18,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
-#define _XOPEN_SOURCE   500 // Because of fdopen() and ftruncate()
+#define _XOPEN_SOURCE   700 // Because of ftruncate(), pwrite() and stat.st_mtim
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <assert.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -41,6 +42,16 @@
 #include "handle_internal.h"
 #include "cleanup.h"
 #include "url_substitution.h"
+#include "checksum_internal.h"
+#include "eventloop_internal.h"
+#include "downloadsession_internal.h"
+#include "filewriter_internal.h"
+#include "ratelimiter_internal.h"
+#include "share_internal.h"
+#include "workerpool_internal.h"
+#include "iouring_internal.h"
+#include "mirrorranking_internal.h"
+#include "logqueue_internal.h"
 
 volatile sig_atomic_t lr_interrupt = 0;
 
@@ -59,6 +70,15 @@ typedef enum {
         The transfer is successfully finished. */
     LR_DS_FAILED, /*!<
         The transfer is finished without success. */
+    LR_DS_SEGMENTED, /*!<
+        The target is being downloaded by its segments. */
+    LR_DS_VERIFYING, /*!<
+        The transfer is finished (or the file is being copied from
+        a local mirror) and its checksum is being verified by a thread
+        of the verification pool. */
+    LR_DS_HEDGED, /*!<
+        The transfer failed and the target is being downloaded
+        by its hedged transfer. */
 } LrDownloadState;
 
 typedef enum {
@@ -76,23 +96,41 @@ typedef enum {
 typedef struct {
     LrHandle *handle; /*!<
         Handle (could be NULL) */
-    GSList *lrmirrors; /*!<
-        List of LrMirrors created from the handle internal mirrorlist
-        (could be NULL) */
+    GPtrArray *lrmirrors; /*!<
+        Array of LrMirrors created from the handle internal mirrorlist
+        ordered by their score (could be NULL) */
+    GQueue waiting_targets; /*!<
+        Queue of waiting targets (LrTarget *) which will be downloaded
+        from the lrmirrors and didn't try any of them yet */
+    gboolean no_free_mirror; /*!<
+        Used by select_next_target() - no free mirror was found
+        for the first waiting target */
 } LrHandleMirrors;
 
+/** Coalescing of progress reports (see LRO_PROGRESSINTERVAL
+ * and LRO_PROGRESSDELTA) */
 typedef struct {
-    LrInternalMirror *mirror; /*!<
-        Mirror */
-    int running_transfers; /*!<
-        How many transfers from this mirror are currently in progres. */
-    int successful_transfers; /*!<
-        How many transfers was finished successfully from the mirror. */
-    int failed_transfers; /*!<
-        How many transfers failed. */
-} LrMirror;
-
-typedef struct {
+    gint64 interval; /*!<
+        Minimal time between two reports (in microseconds) or 0 */
+    double delta; /*!<
+        Minimal number of bytes downloaded between two reports or 0 */
+    gboolean reported; /*!<
+        At least one report was passed to the callback */
+    gint64 last_time; /*!<
+        Time (monotonic) of the last report passed to the callback */
+    double last_total; /*!<
+        Total size of the last report passed to the callback */
+    double last_now; /*!<
+        Downloaded size of the last report passed to the callback */
+    gboolean pending; /*!<
+        The latest report was skipped */
+    double pending_total; /*!<
+        Total size of the skipped report */
+    double pending_now; /*!<
+        Downloaded size of the skipped report */
+} LrProgressThrottle;
+
+typedef struct _LrTarget {
     LrDownloadState state; /*!<
         State of the download (transfer). */
     LrDownloadTarget *target; /*!<
@@ -112,14 +150,37 @@ typedef struct {
         Current protocol */
     CURL *curl_handle; /*!<
         Used curl handle or NULL */
-    FILE *f; /*!<
-        fdopened file descriptor from LrDownloadTarget and used
-        in curl_handle. */
+    guint curl_handle_generation; /*!<
+        Generation of the curl handle taken from the pool of the handle
+        (see lr_handle_curl_handle_acquire()) */
+    int fd; /*!<
+        File descriptor of the target file used by the current transfer
+        (dup()ed fd from LrDownloadTarget or opened file) or -1. */
+    LrFileWriter *writer; /*!<
+        Buffered writer of the downloaded data to the fd or NULL. */
     char errorbuffer[CURL_ERROR_SIZE]; /*!<
         Error buffer used in curl handle */
-    GSList *tried_mirrors; /*!<
-        List of already tried mirrors (LrMirror *).
-        This mirrors won't be tried again. */
+    guint8 *tried_mirrors; /*!<
+        Bitset of already tried mirrors (indexed by LrMirror.index)
+        or NULL. This mirrors won't be tried again. */
+    guint tried_mirrors_count; /*!<
+        Number of finished tries (transfers) of the target. */
+    GQueue *waiting_queue; /*!<
+        Queue of waiting targets in which the target is or NULL. */
+    GList *waiting_link; /*!<
+        Link of the target in the waiting_queue or NULL. */
+    GList *running_link; /*!<
+        Link of the target in the queue of running transfers or NULL. */
+    guint rank; /*!<
+        Position of the target in the schedule (see schedule_targets()).
+        Targets with lower rank are started first. */
+    LrRateLimiter *ratelimiter; /*!<
+        Limiter of the speed of the download or NULL */
+    LrRateLimiter *shared_ratelimiter; /*!<
+        Limiter of the speed shared with other downloads or NULL */
+    gboolean paused; /*!<
+        The transfer was paused by the write callback because of
+        a speed limit and waits for resume. */
     gboolean resume; /*!<
         Is resume enabled? Download target may state that resume is True
         but Librepo can decide that resuming won't be done.
@@ -129,12 +190,14 @@ typedef struct {
         the downloading. If resume is not enabled, then value is -1. */
     gint resume_count; /*!<
         How many resumes were done */
-    GSList *lrmirrors; /*!<
-        List of all available mirors (LrMirror *).
+    GPtrArray *lrmirrors; /*!<
+        Array of all available mirors (LrMirror *).
         This list is generated from LrHandle related to this target
         and is common for all targets that uses the handle. */
     LrHandle *handle; /*!<
         LrHandle associated with this target */
+    LrHandleMirrors *handle_mirrors; /*!<
+        Mirrors of the handle (the owner of lrmirrors) or NULL */
     LrHeaderCbState headercb_state; /*!<
         State of the header callback for current transfer */
     gchar *headercb_interrupt_reason; /*!<
@@ -145,10 +208,115 @@ typedef struct {
     gboolean writecb_required_range_written; /*!<
         If a byte range was specified to download and the
         range was downloaded, it is TRUE. Otherwise FALSE. */
+    gboolean range_requested; /*!<
+        The byte range of the current transfer is requested from the
+        server (CURLOPT_RANGE), so only the range is received. */
     LrCbReturnCode cb_return_code; /*!<
         Last cb return code. */
+    double progress_total; /*!<
+        Total size reported by curl to the progress function on a worker
+        thread (protected by the lr_worker_progress lock). */
+    double progress_now; /*!<
+        Downloaded size reported by curl to the progress function on
+        a worker thread (protected by the lr_worker_progress lock). */
+    gboolean progress_changed; /*!<
+        Progress reported on a worker thread was not delivered to the
+        progress callback of the target yet (protected by the
+        lr_worker_progress lock). */
+    LrProgressThrottle progress_throttle; /*!<
+        Coalescing of the reports passed to the progress callback
+        of the target. */
+    GSList *checksum_ctxs; /*!<
+        Incremental checksums (LrChecksumCtx *) of the target file,
+        one for each type of the expected checksums. Data are added
+        by the write callback as they arrive. NULL if not used. */
+    gint64 checksum_hashed; /*!<
+        Number of bytes (from the begin of the file) already added
+        to the checksum_ctxs. */
+    struct _LrTarget *parent; /*!<
+        If this target is a segment of a segmented download, this is
+        the segmented target. Otherwise NULL.
+        Segment has its own private LrDownloadTarget with byte range. */
+    GSList *segments; /*!<
+        Segments (LrTarget *) of a segmented target (state
+        LR_DS_SEGMENTED) or NULL. */
+    int segments_fd; /*!<
+        File descriptor shared by all segments of a segmented target
+        or -1. */
+    double segment_downloaded; /*!<
+        Number of bytes downloaded by the segment (for progress
+        reporting of the segmented target). */
+    gint64 adaptive_accounted; /*!<
+        Number of bytes of writecb_recieved already accounted by
+        the adaptive concurrency controller. */
+    gint64 transfer_start; /*!<
+        Monotonic time (in microseconds) when the current transfer
+        was started. */
+    struct _LrTarget *hedge; /*!<
+        Hedged (duplicate) transfer of this target which is waiting
+        or running or NULL (see LRO_HEDGEDREQUESTS). */
+    struct _LrTarget *hedge_of; /*!<
+        If this target is a hedged transfer, this is the original
+        target. Otherwise NULL. Hedged transfer has its own private
+        LrDownloadTarget which downloads to a temporary file. */
+    gint64 transfer_offset; /*!<
+        Offset in the file (the same as the offset in the downloaded
+        file) where the current transfer started to write or -1 if the
+        offsets differ (e.g. a segment or a file descriptor with some
+        other content before the current position). */
+    gchar *etag; /*!<
+        ETag of the file as reported by the server of the current
+        HTTP transfer or NULL. */
+    gchar *lastmodified; /*!<
+        Last-Modified of the file as reported by the server of the current
+        HTTP transfer or NULL. */
+    gboolean conditional; /*!<
+        The current transfer is a conditional request. The existing content
+        of the file is kept until the first data arrive (see
+        target_write()). */
+    gboolean notmodified; /*!<
+        The server of the current conditional transfer replied that
+        the file was not modified. */
+    gint64 migrate_offset; /*!<
+        If > 0, the next transfer continues from this offset, because
+        the previous transfer was migrated from a slow mirror
+        (see LRO_MIGRATESLOWTRANSFERS). */
+    gchar *migrate_validator; /*!<
+        Validator of the already downloaded data used in If-Range header
+        by the next transfer which continues a migrated one or NULL. */
+    gboolean migrated; /*!<
+        The current transfer continues a migrated transfer. */
+    struct curl_slist *curl_httpheader; /*!<
+        HTTP headers of the current transfer if they differ from
+        the headers of the handle or NULL. */
 } LrTarget;
 
+/** State of the adaptive concurrency controller (see
+ * LRO_ADAPTIVECONCURRENCY).
+ */
+typedef struct {
+    gint64 last_update; /*!<
+        Monotonic time (in microseconds) of the last evaluation. */
+    gint64 received; /*!<
+        Bytes received since the last evaluation. */
+    int failures; /*!<
+        Number of transfers failed by a timeout or a network error
+        since the last evaluation. */
+    double last_goodput; /*!<
+        Goodput (bytes per second) of the last evaluation when
+        the number of transfers was the limiting factor, or 0. */
+} LrAdaptiveConcurrency;
+
+/** State of the hedged requests (see LRO_HEDGEDREQUESTS).
+ */
+typedef struct {
+    gint64 last_check; /*!<
+        Monotonic time (in microseconds) of the last check. */
+    GArray *durations; /*!<
+        Durations (double, in seconds) of successfully finished
+        transfers. */
+} LrHedging;
+
 typedef struct {
 
     // Configuration
@@ -168,25 +336,144 @@ typedef struct {
     gint64 max_speed; /*!<
         Maximal speed in bytes per sec */
 
+    LrRateLimiter *ratelimiter; /*!<
+        Limiter of the aggregate speed of this download (max_speed)
+        or NULL if the speed is not limited */
+
+    LrRateLimiter *shared_ratelimiter; /*!<
+        Limiter of the aggregate speed of all downloads which use
+        the share object (see lr_share_set_maxspeed()) or NULL */
+
     long allowed_mirror_failures; /*!<
         See LRO_ALLOWEDMIRRORFAILURES */
 
     long adaptivemirrorsorting; /*!<
         See LRO_ADAPTIVEMIRRORSORTING */
 
+    LrEventEngine eventengine; /*!<
+        See LRO_EVENTENGINE */
+
+    gboolean http2; /*!<
+        See LRO_HTTP2 */
+
+    int max_streams_per_mirror; /*!<
+        See LRO_MAXSTREAMSPERMIRROR */
+
+    int max_running_transfers; /*!<
+        Maximal number of running transfers. Without HTTP/2 it equals
+        to max_parallel_connections. If the adaptive concurrency is
+        enabled, the value is tuned during the download. */
+
+    int max_segments; /*!<
+        See LRO_MAXSEGMENTS */
+
+    gint64 min_segment_size; /*!<
+        See LRO_MINSEGMENTSIZE */
+
+    size_t write_buffer_size; /*!<
+        See LRO_WRITEBUFFERSIZE */
+
+    gboolean adaptive_concurrency; /*!<
+        See LRO_ADAPTIVECONCURRENCY */
+
+    int adaptive_max_running_transfers; /*!<
+        See LRO_ADAPTIVEMAXPARALLELDOWNLOADS */
+
+    LrSchedulingPolicy scheduling_policy; /*!<
+        See LRO_SCHEDULINGPOLICY */
+
+    gboolean hedged_requests; /*!<
+        See LRO_HEDGEDREQUESTS */
+
+    gboolean migrate_slow_transfers; /*!<
+        See LRO_MIGRATESLOWTRANSFERS */
+
+    int worker_threads; /*!<
+        See LRO_WORKERTHREADS */
+
+    gboolean iouring; /*!<
+        See LRO_IOURING (FALSE if io_uring is not available) */
+
+    gint64 progress_interval; /*!<
+        See LRO_PROGRESSINTERVAL (in microseconds) */
+
+    gint64 progress_delta; /*!<
+        See LRO_PROGRESSDELTA */
+
     // Data
 
     CURLM *multi_handle; /*!<
         Curl Multi handle */
 
+    LrWorkerPool *workers; /*!<
+        Worker threads which perform the transfers (each with its own
+        multi handle) or NULL if the transfers are performed by
+        the multi_handle (see LRO_WORKERTHREADS) */
+
+    LrIoUring *ring; /*!<
+        Ring which writes and closes the files of the transfers or NULL
+        if the plain system calls are used (see LRO_IOURING) */
+
+    LrDownloadSession *session; /*!<
+        Download session which owns the multi_handle or NULL if
+        the multi_handle is private for this download */
+
     GSList *handle_mirrors; /*!<
         All mirrors (list of pointers to LrHandleMirrors structures) */
 
     GSList *targets; /*!<
         List of all targets (list of pointers to LrTarget stuctures) */
 
-    GSList *running_transfers; /*!<
-        List of running transfers (list of pointer to LrTarget structures) */
+    GQueue running_transfers; /*!<
+        Queue of running transfers (pointers to LrTarget structures) */
+
+    GQueue waiting_targets; /*!<
+        Queue of targets in the LR_DS_WAITING state (pointers to
+        LrTarget structures) which are not in a queue of
+        LrHandleMirrors - retries, targets with a base URL, etc. */
+
+    LrAdaptiveConcurrency adaptive; /*!<
+        State of the adaptive concurrency controller */
+
+    LrHedging hedging; /*!<
+        State of the hedged requests */
+
+    gint64 migrate_last_check; /*!<
+        Monotonic time (in microseconds) of the last check for slow
+        transfers to migrate */
+
+    guint next_rank; /*!<
+        Rank of the next scheduled target (see schedule_targets()) */
+
+    GQueue *finished_targets; /*!<
+        Queue where finished and failed targets (LrDownloadTarget *)
+        are put or NULL (see LrAsyncDownload) */
+
+    GThreadPool *verify_pool; /*!<
+        Threads which verify checksums of finished transfers or NULL
+        if no verification was needed yet */
+
+    GAsyncQueue *verified; /*!<
+        Finished transfers (LrFinishedTransfer) verified by
+        the verify_pool, waiting to be processed by the download loop */
+
+    int verified_pipe[2]; /*!<
+        Pipe written by the verify_pool when a transfer is pushed to
+        the verified queue. Its read end is watched by the download loop,
+        so the loop wakes up without polling the queue. */
+
+    int verifying; /*!<
+        Number of targets in the LR_DS_VERIFYING state */
+
+    int copying; /*!<
+        Number of local copies performed by the verify_pool (see
+        start_local_copy()). They occupy slots of the running transfers. */
+
+    LrLogQueue *log; /*!<
+        Debug messages of the verify_pool and of the worker threads.
+        They are logged by the download loop, because the log handler
+        (e.g. the one of the Python bindings) may be called only from
+        the thread which called librepo. */
 
 } LrDownload;
 
@@ -197,19 +484,19 @@ typedef struct {
  * +------------------------------+
  * | int max_parallel_connections |
  * | int max_connection_par_host  |
- * | int max_mirrors_to_try       |      +-------------------+
- * |                              |   /->|  LrHandleMirrors  |
- * |                              |  |   +-------------------+
- * | CURLM *multi_handle          |  |   | LrHandle *handle  |
- * |                              |  |   | GSList *lrmirrors --\
- * | GSList *handle_mirrors      ---/    +-------------------+ |
- * | GSList *targets             --\                           |
- * | GSList *running_transfers   ---\                          |
- * +------------------------------+  |                         |
- *                                   |                         |
- *   /------------------------------/                          |
- *  |                                                          |
- *  |                         /--------------------------------/
+ * | int max_mirrors_to_try       |      +----------------------+
+ * |                              |   /->|   LrHandleMirrors    |
+ * |                              |  |   +----------------------+
+ * | CURLM *multi_handle          |  |   | LrHandle *handle     |
+ * |                              |  |   | GPtrArray *lrmirrors --\
+ * | GSList *handle_mirrors      ---/    +----------------------+ |
+ * | GSList *targets             --\                              |
+ * | GQueue running_transfers    ---\                             |
+ * +------------------------------+  |                            |
+ *                                   |                            |
+ *   /------------------------------/                             |
+ *  |                                                             |
+ *  |                         /-----------------------------------/
  *  |                        \/
  *  |          +---------------------------+
  *  |          |         LrMirror          |
@@ -236,17 +523,17 @@ typedef struct {
  *       | LrDownloadTarget *target  ----------/   | int fd                   |
  *       | LrMirror *mirror          -------/      | LrChecksumType checks..  |
  *       | CURL *curl_handle          |-+          | char *checksum           |
- *       | FILE *f                    |            | int resume               |
- *       | GSList *tried_mirrors      |            | LrProgressCb progresscb  |
+ *       | int fd                     |            | int resume               |
+ *       | guint8 *tried_mirrors      |            | LrProgressCb progresscb  |
  *       | gint64 original_offset     |            | void *cbdata             |
- *       | GSlist *lrmirrors         ---\          | GStringChunk *chunk      |
+ *       | GPtrArray *lrmirrors      ---\          | GStringChunk *chunk      |
  *       +----------------------------+  |         | int rcode                |
  *                                       |         | char *err                |
- *      Points to list of LrMirrors <---/          +--------------------------+
+ *     Points to array of LrMirrors <---/          +--------------------------+
  */
 
 
-/** Create GSList of LrMirrors (if it doesn't exist) for a handle.
+/** Create GPtrArray of LrMirrors (if it doesn't exist) for a handle.
  * If the list already exists (if more targets use the same handle)
  * then just set the list to the current target.
  * If the list doesn't exist yet, create it then create a mapping between
@@ -254,7 +541,7 @@ typedef struct {
  * the current target.
  */
 static GSList *
-lr_prepare_lrmirrors(GSList *list, LrTarget *target)
+lr_prepare_lrmirrors(GSList *list, LrTarget *target, gboolean http2)
 {
     LrHandle *handle = target->handle;
 
@@ -263,11 +550,12 @@ lr_prepare_lrmirrors(GSList *list, LrTarget *target)
         if (handle_mirrors->handle == handle) {
             // List of LrMirrors for this handle is already created
             target->lrmirrors = handle_mirrors->lrmirrors;
+            target->handle_mirrors = handle_mirrors;
             return list;
         }
     }
 
-    GSList *lrmirrors = NULL;
+    GPtrArray *lrmirrors = NULL;
 
     if (handle && handle->internal_mirrorlist) {
         g_debug("%s: Preparing internal mirror list for handle id: %p", __func__, handle);
@@ -287,7 +575,13 @@ lr_prepare_lrmirrors(GSList *list, LrTarget *target)
 
             LrMirror *mirror = lr_malloc0(sizeof(*mirror));
             mirror->mirror = imirror;
-            lrmirrors = g_slist_append(lrmirrors, mirror);
+            // Only https could be multiplexed without an upgrade
+            mirror->multiplexed = http2
+                        && g_str_has_prefix(imirror->url, "https://");
+            if (!lrmirrors)
+                lrmirrors = g_ptr_array_new();
+            mirror->index = mirror->position = lrmirrors->len;
+            g_ptr_array_add(lrmirrors, mirror);
         }
     }
 
@@ -296,14 +590,87 @@ lr_prepare_lrmirrors(GSList *list, LrTarget *target)
     handle_mirrors->lrmirrors = lrmirrors;
 
     target->lrmirrors = lrmirrors;
+    target->handle_mirrors = handle_mirrors;
     list = g_slist_append(list, handle_mirrors);
 
     return list;
 }
 
 
+/** Prepare coalescing of progress reports.
+ * @param interval  Minimal time between two reports (microseconds)
+ * @param delta     Minimal number of bytes between two reports
+ */
+static void
+progress_throttle_init(LrProgressThrottle *pt, gint64 interval, gint64 delta)
+{
+    memset(pt, 0, sizeof(*pt));
+    pt->interval = interval;
+    pt->delta = (double) delta;
+}
+
+/** Should the report be passed to the progress callback?
+ * The first report, the final report (force or the whole file
+ * downloaded) and a report of a changed or restarted transfer
+ * are always passed. A skipped report is remembered and could
+ * be passed later by progress_throttle_flush().
+ */
+static gboolean
+progress_throttle_due(LrProgressThrottle *pt,
+                      double total,
+                      double now,
+                      gboolean force)
+{
+    gint64 time = 0;
+
+    if (pt->interval <= 0 && pt->delta <= 0)
+        return TRUE;
+
+    if (pt->interval > 0)
+        time = g_get_monotonic_time();
+
+    if (force
+        || !pt->reported
+        || (total > 0 && now >= total)
+        || total != pt->last_total
+        || now < pt->last_now
+        || ((pt->interval <= 0 || time - pt->last_time >= pt->interval)
+            && now - pt->last_now >= pt->delta))
+    {
+        pt->reported = TRUE;
+        pt->last_time = time;
+        pt->last_total = total;
+        pt->last_now = now;
+        pt->pending = FALSE;
+        return TRUE;
+    }
+
+    pt->pending = TRUE;
+    pt->pending_total = total;
+    pt->pending_now = now;
+    return FALSE;
+}
+
+/** Get the last skipped report (if there is any) to pass it to
+ * the progress callback at the end of the transfer.
+ * @return          TRUE if there was a skipped report
+ */
+static gboolean
+progress_throttle_flush(LrProgressThrottle *pt, double *total, double *now)
+{
+    if (!pt->pending)
+        return FALSE;
+
+    pt->pending = FALSE;
+    pt->reported = TRUE;
+    pt->last_total = *total = pt->pending_total;
+    pt->last_now = *now = pt->pending_now;
+    return TRUE;
+}
+
 /** Progress callback for CURL handles.
  * progress callback set by the user of librepo.
+ * Reports are coalesced (see progress_throttle_due()).
  */
 static int
 lr_progresscb(void *ptr,
@@ -322,6 +689,11 @@ lr_progresscb(void *ptr,
         return ret;
     if (!target->target->progresscb)
         return ret;
+    if (!progress_throttle_due(&target->progress_throttle,
+                               total_to_download,
+                               now_downloaded,
+                               FALSE))
+        return target->cb_return_code;
 
     ret = target->target->progresscb(target->target->cbdata,
                                      total_to_download,
@@ -332,14 +704,124 @@ lr_progresscb(void *ptr,
     return ret;
 }
 
+/** Lock of the progress of targets whose transfers are performed
+ * by worker threads */
+G_LOCK_DEFINE_STATIC(lr_worker_progress);
+
+/** Progress callback for CURL handles performed by worker threads.
+ * The progress is only stored to the target, the progress callback set
+ * by the user of librepo is called from the thread which started the
+ * download (see deliver_progress()).
+ */
+static int
+lr_worker_progresscb(void *ptr,
+                     double total_to_download,
+                     double now_downloaded,
+                     G_GNUC_UNUSED double total_to_upload,
+                     G_GNUC_UNUSED double now_uploaded)
+{
+    int ret;
+    LrTarget *target = ptr;
+
+    G_LOCK(lr_worker_progress);
+    target->progress_total = total_to_download;
+    target->progress_now = now_downloaded;
+    target->progress_changed = TRUE;
+    ret = target->cb_return_code;
+    G_UNLOCK(lr_worker_progress);
+
+    return ret;
+}
+
+/** Call the progress callback of the target with the progress
+ * reported by curl on a worker thread (if there is any new).
+ */
+static void
+deliver_progress(LrTarget *target)
+{
+    int ret;
+    double total, now;
+    gboolean changed;
+
+    G_LOCK(lr_worker_progress);
+    total = target->progress_total;
+    now = target->progress_now;
+    changed = target->progress_changed;
+    target->progress_changed = FALSE;
+    G_UNLOCK(lr_worker_progress);
+
+    if (!changed
+        || target->state != LR_DS_RUNNING
+        || !target->target->progresscb
+        || !progress_throttle_due(&target->progress_throttle,
+                                  total, now, FALSE))
+        return;
+
+    ret = target->target->progresscb(target->target->cbdata, total, now);
+
+    // The transfer is aborted by the progress function on the worker
+    G_LOCK(lr_worker_progress);
+    target->cb_return_code = ret;
+    G_UNLOCK(lr_worker_progress);
+}
+
 #define STRLEN(s) (sizeof(s)/sizeof(s[0]) - 1)
 
+/** Remember validators (ETag and Last-Modified) of the file from
+ * the HTTP header. The validators are used to check that the data
+ * are still valid when a migrated transfer is continued and they are
+ * stored with the file of a conditional target for the next request.
+ */
+static void
+headercb_validators(LrTarget *lrtarget, const char *header)
+{
+    const char *value;
+
+    if (g_str_has_prefix(header, "HTTP/")) {
+        // A new response (e.g. after redirection)
+        g_free(lrtarget->etag);
+        lrtarget->etag = NULL;
+        g_free(lrtarget->lastmodified);
+        lrtarget->lastmodified = NULL;
+    } else if (!g_ascii_strncasecmp(header, "ETag:", STRLEN("ETag:"))) {
+        value = header + STRLEN("ETag:");
+        while (g_ascii_isspace(*value))
+            value++;
+        if (*value) {
+            g_free(lrtarget->etag);
+            lrtarget->etag = g_strdup(value);
+        }
+    } else if (!g_ascii_strncasecmp(header, "Last-Modified:",
+                                    STRLEN("Last-Modified:"))) {
+        value = header + STRLEN("Last-Modified:");
+        while (g_ascii_isspace(*value))
+            value++;
+        if (*value) {
+            g_free(lrtarget->lastmodified);
+            lrtarget->lastmodified = g_strdup(value);
+        }
+    }
+}
+
+/** Validator of the data of the current HTTP transfer which could be
+ * used in If-Range header (strong ETag or Last-Modified) or NULL.
+ */
+static const gchar *
+target_range_validator(LrTarget *target)
+{
+    // Weak ETag cannot be used in If-Range
+    if (target->etag && !g_str_has_prefix(target->etag, "W/"))
+        return target->etag;
+    return target->lastmodified;
+}
+
 
 /** Header callback for CURL handles.
  * It parses HTTP and FTP headers and try to find length of the content
  * (file size of the target). If the size is different then the expected
  * size, then the transfer is interrupted.
- * This callback is used only if the expected size is specified.
+ * This callback is used only if the expected size is specified or
+ * the target is conditional.
  */
 static size_t
 lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
@@ -350,8 +832,16 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
     LrTarget *lrtarget = userdata;
     LrHeaderCbState state = lrtarget->headercb_state;
 
-    if (state == LR_HCS_DONE || state == LR_HCS_INTERRUPTED) {
-        // Nothing to do
+    if (lrtarget->protocol == LR_PROTOCOL_HTTP) {
+        _cleanup_free_ gchar *line = g_strstrip(g_strndup(ptr, size*nmemb));
+        headercb_validators(lrtarget, line);
+    }
+
+    if (state == LR_HCS_DONE
+        || state == LR_HCS_INTERRUPTED
+        || lrtarget->target->expectedsize <= 0)
+    {
+        // Nothing to do (the size is not checked)
         return ret;
     }
 
@@ -367,7 +857,8 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
             } else {
                 // Do nothing (do not change the state)
                 // in case of redirection, 200 OK still could come
-                g_debug("%s: Non OK HTTP header status: %s", __func__, header);
+                lr_log_debug("%s: Non OK HTTP header status: %s",
+                             __func__, header);
             }
         } else if (lrtarget->protocol == LR_PROTOCOL_FTP) {
             // Headers of a FTP protocol
@@ -375,16 +866,16 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
                 // Code 213 shoud keep the file size
                 gint64 content_length = g_ascii_strtoll(header+4, NULL, 0);
 
-                g_debug("%s: Server returned size: \"%s\" "
-                        "(converted %"G_GINT64_FORMAT"/%"G_GINT64_FORMAT
-                        " expected)",
-                        __func__, header+4, content_length, expected);
+                lr_log_debug("%s: Server returned size: \"%s\" "
+                             "(converted %"G_GINT64_FORMAT"/%"G_GINT64_FORMAT
+                             " expected)",
+                             __func__, header+4, content_length, expected);
 
                 // Compare expected size and size reported by a FTP server
                 if (content_length > 0 && content_length != expected) {
-                    g_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
-                            " != %"G_GINT64_FORMAT")",
-                            __func__, content_length, expected);
+                    lr_log_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
+                                 " != %"G_GINT64_FORMAT")",
+                                 __func__, content_length, expected);
                     lrtarget->headercb_state = LR_HCS_INTERRUPTED;
                     lrtarget->headercb_interrupt_reason = g_strdup_printf(
                         "FTP server reports size: %"G_GINT64_FORMAT" "
@@ -407,15 +898,16 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
             char *content_length_str = header + STRLEN("Content-Length: ");
             gint64 content_length = g_ascii_strtoll(content_length_str,
                                                     NULL, 0);
-            g_debug("%s: Server returned Content-Length: \"%s\" "
-                    "(converted %"G_GINT64_FORMAT"/%"G_GINT64_FORMAT" expected)",
-                    __func__, content_length_str, content_length, expected);
+            lr_log_debug("%s: Server returned Content-Length: \"%s\" "
+                         "(converted %"G_GINT64_FORMAT"/%"G_GINT64_FORMAT
+                         " expected)",
+                         __func__, content_length_str, content_length, expected);
 
             // Compare expected size and size reported by a HTTP server
             if (content_length > 0 && content_length != expected) {
-                g_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
-                        " != %"G_GINT64_FORMAT")",
-                        __func__, content_length, expected);
+                lr_log_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
+                             " != %"G_GINT64_FORMAT")",
+                             __func__, content_length, expected);
                 lrtarget->headercb_state = LR_HCS_INTERRUPTED;
                 lrtarget->headercb_interrupt_reason = g_strdup_printf(
                     "Server reports Content-Length: %"G_GINT64_FORMAT" but "
@@ -434,6 +926,217 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
 }
 
 
+/** Size of the buffer used to checksum already existing part of file */
+#define LR_CHECKSUM_PREFIX_BUFFER_SIZE  65536
+
+/** Free incremental checksums of the target.
+ */
+static void
+target_checksums_free(LrTarget *target)
+{
+    g_slist_free_full(target->checksum_ctxs,
+                      (GDestroyNotify) lr_checksumctx_free);
+    target->checksum_ctxs = NULL;
+    target->checksum_hashed = 0;
+}
+
+/** Add data to all incremental checksums of the target.
+ * On error the incremental checksums are dropped and the file
+ * is checksummed the usual way after the transfer.
+ */
+static void
+target_checksums_update(LrTarget *target, const void *buf, size_t len)
+{
+    for (GSList *elem = target->checksum_ctxs; elem; elem = g_slist_next(elem)) {
+        LrChecksumCtx *ctx = elem->data;
+        if (!lr_checksumctx_update(ctx, buf, len, NULL)) {
+            lr_log_debug("%s: Cannot update checksum, the file will be "
+                         "checksummed after the transfer", __func__);
+            target_checksums_free(target);
+            return;
+        }
+    }
+    target->checksum_hashed += len;
+}
+
+/** Prepare incremental checksums for the transfer of the target.
+ * Data already present in the file before the current write position
+ * (resumed download) are checksummed right now, the rest is added by
+ * the write callback.
+ */
+static void
+target_checksums_prepare(LrTarget *target)
+{
+    gint64 prefix;
+    int fd;
+
+    target_checksums_free(target);
+
+    for (GSList *elem = target->target->checksums; elem; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *chksum = elem->data;
+        gboolean exists = FALSE;
+
+        if (!chksum || !chksum->value || chksum->type == LR_CHECKSUM_UNKNOWN)
+            continue;  // Bad checksum
+
+        for (GSList *el = target->checksum_ctxs; el; el = g_slist_next(el))
+            if (lr_checksumctx_type(el->data) == chksum->type)
+                exists = TRUE;
+        if (exists)
+            continue;
+
+        LrChecksumCtx *ctx = lr_checksumctx_new(chksum->type, NULL);
+        if (!ctx) {
+            target_checksums_free(target);
+            return;
+        }
+        target->checksum_ctxs = g_slist_append(target->checksum_ctxs, ctx);
+    }
+
+    if (!target->checksum_ctxs)
+        return;
+
+    // Checksum the part of the file which is already downloaded
+    prefix = lr_filewriter_offset(target->writer);
+    if (prefix == 0)
+        return;
+
+    g_debug("%s: Checksumming first %"G_GINT64_FORMAT" bytes of already "
+            "existing data", __func__, prefix);
+
+    fd = target->fd;
+    _cleanup_free_ char *buf = g_malloc(LR_CHECKSUM_PREFIX_BUFFER_SIZE);
+    while (target->checksum_ctxs && target->checksum_hashed < prefix) {
+        size_t len = MIN(prefix - target->checksum_hashed,
+                         LR_CHECKSUM_PREFIX_BUFFER_SIZE);
+        ssize_t readed = pread(fd, buf, len, target->checksum_hashed);
+        if (readed <= 0) {
+            g_debug("%s: pread() failed: %s", __func__,
+                    readed ? strerror(errno) : "Unexpected end of file");
+            target_checksums_free(target);
+            return;
+        }
+        target_checksums_update(target, buf, readed);
+    }
+}
+
+/** Finish incremental checksums of the target.
+ * @return      List of calculated checksums (LrDownloadTargetChecksum *)
+ *              or NULL if the incremental checksums cannot be used
+ *              (e.g. the file was modified by someone else).
+ */
+static GSList *
+target_checksums_final(LrTarget *target, int fd)
+{
+    GSList *calculated = NULL;
+    struct stat st;
+
+    if (!target->checksum_ctxs)
+        return NULL;
+
+    if (fstat(fd, &st) == -1 || st.st_size != target->checksum_hashed) {
+        g_debug("%s: Size of the file doesn't match the checksummed data, "
+                "the whole file will be checksummed", __func__);
+        target_checksums_free(target);
+        return NULL;
+    }
+
+    for (GSList *elem = target->checksum_ctxs; elem; elem = g_slist_next(elem)) {
+        LrChecksumCtx *ctx = elem->data;
+        _cleanup_free_ char *value = lr_checksumctx_final(ctx, NULL);
+        if (!value)
+            continue;
+        calculated = g_slist_append(calculated,
+                lr_downloadtargetchecksum_new(lr_checksumctx_type(ctx), value));
+    }
+
+    target_checksums_free(target);
+    return calculated;
+}
+
+/** Close the file of the current transfer of the target.
+ * Data which are still buffered in the writer are lost.
+ */
+static void
+target_close_file(LrDownload *dd, LrTarget *target)
+{
+    if (target->writer && target->target->fd != -1 && !target->parent) {
+        // Leave the position of the user's file descriptor behind
+        // the written data
+        if (lseek(target->fd, lr_filewriter_offset(target->writer),
+                  SEEK_SET) == -1)
+            g_debug("%s: lseek() failed: %s", __func__, strerror(errno));
+    }
+
+    lr_filewriter_free(target->writer);
+    target->writer = NULL;
+
+    if (target->fd != -1) {
+        if (dd->ring)
+            lr_iouring_close(dd->ring, target->fd);
+        else
+            close(target->fd);
+    }
+    target->fd = -1;
+}
+
+/** Write data to the target file (through the buffered writer)
+ * and add them to the incremental checksums.
+ * @return      TRUE if everything is ok, FALSE otherwise
+ */
+static gboolean
+target_write(LrTarget *target, const char *buf, size_t len)
+{
+    GError *tmp_err = NULL;
+
+    if (target->conditional) {
+        // The server sends a new content of the conditional target,
+        // the existing one is not needed anymore
+        target->conditional = FALSE;
+        if (ftruncate(target->fd, lr_filewriter_offset(target->writer)) == -1) {
+            lr_log_debug("%s: ftruncate() failed: %s",
+                         __func__, strerror(errno));
+            return FALSE;
+        }
+    }
+
+    if (!lr_filewriter_write(target->writer, buf, len, &tmp_err)) {
+        lr_log_debug("%s: Error while writting out file: %s",
+                     __func__, tmp_err->message);
+        g_error_free(tmp_err);
+        return FALSE;
+    }
+
+    if (target->checksum_ctxs)
+        target_checksums_update(target, buf, len);
+
+    return TRUE;
+}
+
+/** Check the speed limits before the data are taken by the write
+ * callback and take tokens for the data.
+ * @return          TRUE if the data could be taken, FALSE if the
+ *                  transfer should be paused
+ */
+static gboolean
+target_ratelimit(LrTarget *target, size_t len)
+{
+    if ((target->ratelimiter && lr_ratelimiter_delay(target->ratelimiter))
+        || (target->shared_ratelimiter
+            && lr_ratelimiter_delay(target->shared_ratelimiter)))
+    {
+        target->paused = TRUE;
+        return FALSE;
+    }
+
+    if (target->ratelimiter)
+        lr_ratelimiter_consume(target->ratelimiter, len);
+    if (target->shared_ratelimiter)
+        lr_ratelimiter_consume(target->shared_ratelimiter, len);
+
+    return TRUE;
+}
+
 /** Write callback for CURL handles.
  * This callback handles situation when an user wants only specified
  * byte range of the target file.
@@ -442,16 +1145,34 @@ size_t
 lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
     size_t cur_written_expected = nmemb;
-    size_t cur_written;
     LrTarget *target = (LrTarget *) userdata;
     gint64 all = size * nmemb;  // Total number of bytes from curl
     gint64 range_start = target->target->byterangestart;
     gint64 range_end = target->target->byterangeend;
 
+    // Pause the transfer if the speed limit is reached. Curl passes
+    // the same data again when the transfer is resumed.
+    if (!target_ratelimit(target, all))
+        return CURL_WRITEFUNC_PAUSE;
+
+    if (target->range_requested && target->writecb_recieved == 0) {
+        // A server which doesn't support ranges sends the whole file
+        long code = 0;
+        curl_easy_getinfo(target->curl_handle, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 206) {
+            target->headercb_state = LR_HCS_INTERRUPTED;
+            target->headercb_interrupt_reason = g_strdup_printf(
+                "Server doesn't support byte ranges (status code %ld)", code);
+            return 0;
+        }
+    }
+
     if (range_start <= 0 && range_end <= 0) {
         // Write everything curl give to you
         target->writecb_recieved += all;
-        return fwrite(ptr, size, nmemb, target->f);
+        if (!target_write(target, ptr, all))
+            return 0; // There was an error
+        return nmemb;
     }
 
     /* Deal with situation when user wants only specific byte range of the
@@ -485,7 +1206,6 @@ lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
         return 0;
     }
 
-    size = 1;
     nmemb = all;
 
     if (cur_range_start >= range_start) {
@@ -516,16 +1236,84 @@ lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
     }
 
     assert(nmemb > 0);
-    cur_written = fwrite(ptr, size, nmemb, target->f);
-    if (cur_written != nmemb) {
-        g_debug("%s: Error while writting out file: %s",
-                __func__, strerror(errno));
+    if (!target_write(target, ptr, nmemb))
         return 0; // There was an error
-    }
 
     return cur_written_expected;
 }
 
+/** Change state of the target and keep the queues of waiting targets
+ * up to date. Targets which are done are put to the queue of finished
+ * targets (if used).
+ */
+static void
+target_set_state(LrDownload *dd, LrTarget *target, LrDownloadState state)
+{
+    if (state == LR_DS_WAITING && !target->waiting_link) {
+        GQueue *queue = &dd->waiting_targets;
+        if (target->handle_mirrors
+            && target->lrmirrors
+            && target->tried_mirrors_count == 0
+            && !target->target->baseurl
+            && !strstr(target->target->path, "://"))
+            queue = &target->handle_mirrors->waiting_targets;
+        g_queue_push_tail(queue, target);
+        target->waiting_queue = queue;
+        target->waiting_link = g_queue_peek_tail_link(queue);
+    } else if (state != LR_DS_WAITING && target->waiting_link) {
+        g_queue_delete_link(target->waiting_queue, target->waiting_link);
+        target->waiting_queue = NULL;
+        target->waiting_link = NULL;
+    }
+
+    if ((state == LR_DS_FINISHED || state == LR_DS_FAILED)
+        && target->state != state
+        && dd->finished_targets
+        && !target->parent
+        && !target->hedge_of)
+        g_queue_push_tail(dd->finished_targets, target->target);
+
+    target->state = state;
+}
+
+/** Was the mirror already tried for the target?
+ */
+static gboolean
+target_mirror_tried(LrTarget *target, LrMirror *mirror)
+{
+    if (!target->tried_mirrors)
+        return FALSE;
+    return (target->tried_mirrors[mirror->index / 8] >> (mirror->index % 8)) & 1;
+}
+
+/** Add the mirror to the tried mirrors of the target.
+ * @param target    Target
+ * @param mirror    Mirror or NULL if no mirror was used
+ */
+static void
+target_add_tried_mirror(LrTarget *target, LrMirror *mirror)
+{
+    target->tried_mirrors_count++;
+
+    if (!mirror)
+        return;
+
+    if (!target->tried_mirrors)
+        target->tried_mirrors = g_new0(guint8, (target->lrmirrors->len + 7) / 8);
+    target->tried_mirrors[mirror->index / 8] |= 1 << (mirror->index % 8);
+}
+
+/** Maximal number of parallel transfers from the mirror
+ * @return      Limit or -1 if there is no limit
+ */
+static int
+mirror_max_running_transfers(LrDownload *dd, LrMirror *mirror)
+{
+    if (mirror->multiplexed)
+        return dd->max_streams_per_mirror;
+    return dd->max_connection_per_host;
+}
+
 /** Select a suitable mirror
  */
 static gboolean
@@ -546,12 +1334,16 @@ select_suitable_mirror(LrDownload *dd,
 
     *selected_mirror = NULL;
 
-    // Iterate over mirror for the target
-    for (GSList *elem = target->lrmirrors; elem; elem = g_slist_next(elem)) {
-        LrMirror *c_mirror = elem->data;
+    LrMirror *busy_mirror = NULL;
+    //  ^^^ Suitable mirror which already serves some other transfer.
+    // Segments of a segmented download prefer idle mirrors.
+
+    // Iterate over mirror for the target (from the best one)
+    for (guint i = 0; target->lrmirrors && i < target->lrmirrors->len; i++) {
+        LrMirror *c_mirror = g_ptr_array_index(target->lrmirrors, i);
         gchar *mirrorurl = c_mirror->mirror->url; // shortcut
 
-        if (g_slist_find(target->tried_mirrors, c_mirror)) {
+        if (target_mirror_tried(target, c_mirror)) {
             // This mirror was already tried for this target
             continue;
         }
@@ -584,16 +1376,17 @@ select_suitable_mirror(LrDownload *dd,
 
         at_least_one_suitable_mirror_found = TRUE;
 
-        // Number of transfers which are downloading from the mirror
-        // should always be lower or equal than maximum allowed number
-        // of connection to a single host.
-        assert(dd->max_connection_per_host == -1 ||
-               c_mirror->running_transfers <= dd->max_connection_per_host);
+        // Check number of connections (or HTTP/2 streams) to the mirror
+        // Note: The number could be temporarily higher than the limit
+        // if the mirror was found not to support HTTP/2 multiplexing.
+        int max_running = mirror_max_running_transfers(dd, c_mirror);
+        if (max_running != -1 && c_mirror->running_transfers >= max_running)
+            continue;
 
-        // Check number of connections to the mirror
-        if (dd->max_connection_per_host != -1 &&
-            c_mirror->running_transfers >= dd->max_connection_per_host)
-        {
+        if (target->parent && c_mirror->running_transfers > 0) {
+            // Spread segments among mirrors
+            if (!busy_mirror)
+                busy_mirror = c_mirror;
             continue;
         }
 
@@ -602,10 +1395,22 @@ select_suitable_mirror(LrDownload *dd,
         return TRUE;
     }
 
+    if (busy_mirror) {
+        *selected_mirror = busy_mirror;
+        return TRUE;
+    }
+
     if (!at_least_one_suitable_mirror_found) {
         // No suitable mirror even exists => Set transfer as failed
         g_debug("%s: All mirrors were tried without success", __func__);
-        target->state = LR_DS_FAILED;
+        target_set_state(dd, target, LR_DS_FAILED);
+
+        if (target->hedge_of) {
+            // Hedged transfer is just dropped, the original
+            // transfer still runs
+            target->hedge_of->hedge = NULL;
+            return TRUE;
+        }
 
         lr_downloadtarget_set_error(target->target, LRE_NOURL,
                     "Cannot download, all mirrors were already tried "
@@ -642,132 +1447,200 @@ select_suitable_mirror(LrDownload *dd,
 }
 
 
-/** Select next target
+/** Find URL for the waiting target.
+ * If a mirror is used, it is set as the target->mirror.
+ * The target could be marked as failed (e.g. there is no usable
+ * mirror at all).
+ * @param full_url      Full URL of the target or NULL if the target
+ *                      cannot be started right now
  */
 static gboolean
-select_next_target(LrDownload *dd,
-                   LrTarget **selected_target,
-                   char **selected_full_url,
-                   GError **err)
+select_target_url(LrDownload *dd,
+                  LrTarget *target,
+                  char **full_url,
+                  GError **err)
 {
-    assert(dd);
-    assert(selected_target);
-    assert(selected_full_url);
-    assert(!err || *err == NULL);
+    LrMirror *mirror = NULL;
+    int complete_url_in_path = 0;
 
-    *selected_target = NULL;
-    *selected_full_url = NULL;
+    assert(target->state == LR_DS_WAITING);
 
-    for (GSList *elem = dd->targets; elem; elem = g_slist_next(elem)) {
-        LrTarget *target = elem->data;
-        LrMirror *mirror = NULL;
-        char *full_url = NULL;
-        int complete_url_in_path = 0;
+    *full_url = NULL;
 
-        if (target->state != LR_DS_WAITING)  // Pick only waiting targets
-            continue;
+    // Determine if path is a complete URL
 
-        // Determine if path is a complete URL
+    complete_url_in_path = strstr(target->target->path, "://") ? 1 : 0;
 
-        complete_url_in_path = strstr(target->target->path, "://") ? 1 : 0;
+    // Sanity check
 
-        // Sanity check
+    if (!target->target->baseurl
+        && !target->lrmirrors
+        && !complete_url_in_path)
+    {
+        // Used relative path with empty internal mirrorlist
+        // and no basepath specified!
+        g_debug("%s: Empty mirrorlist and no basepath specified", __func__);
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_NOURL,
+                    "Empty mirrorlist and no basepath specified!");
+        return FALSE;
+    }
 
-        if (!target->target->baseurl
-            && !target->lrmirrors
-            && !complete_url_in_path)
-        {
-            // Used relative path with empty internal mirrorlist
-            // and no basepath specified!
-            g_debug("%s: Empty mirrorlist and no basepath specified", __func__);
-            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_NOURL,
-                        "Empty mirrorlist and no basepath specified!");
-            return FALSE;
-        }
+    g_debug("%s: Selecting mirror for: %s", __func__, target->target->path);
 
-        g_debug("%s: Selecting mirror for: %s", __func__, target->target->path);
+    // Prepare full target URL
 
-        // Prepare full target URL
+    if (complete_url_in_path) {
+        // Path is a complete URL (do not use mirror nor base URL)
+        *full_url = g_strdup(target->target->path);
+    } else if (target->target->baseurl) {
+        // Base URL is specified
+        *full_url = lr_pathconcat(target->target->baseurl,
+                                  target->target->path,
+                                  NULL);
+    } else {
+        // Find a suitable mirror
+        if (!select_suitable_mirror(dd, target, &mirror , err))
+            return FALSE;
 
-        if (complete_url_in_path) {
-            // Path is a complete URL (do not use mirror nor base URL)
-            full_url = g_strdup(target->target->path);
-        } else if (target->target->baseurl) {
-            // Base URL is specified
-            full_url = lr_pathconcat(target->target->baseurl,
-                                     target->target->path,
-                                     NULL);
+        if (mirror) {
+            // A mirror was found
+            *full_url = lr_pathconcat(mirror->mirror->url,
+                                      target->target->path,
+                                      NULL);
         } else {
-            // Find a suitable mirror
-            if (!select_suitable_mirror(dd, target, &mirror , err))
-                return FALSE;
-
-            if (mirror) {
-                // A mirror was found
-                full_url = lr_pathconcat(mirror->mirror->url,
-                                         target->target->path,
-                                         NULL);
-            } else {
-                // No free mirror
-                g_debug("%s: Currently there is no free mirror for: %s",
-                        __func__, target->target->path);
-            }
+            // No free mirror
+            g_debug("%s: Currently there is no free mirror for: %s",
+                    __func__, target->target->path);
         }
+    }
 
-        // If LRO_OFFLINE is specified, check if the obtained full_url
-        // is local or not
-        // This condition should never be true for a full_url built
-        // from a mirror, because select_suitable_mirror() checks if
-        // the URL is local if LRO_OFFLINE is enabled by itself.
-        if (full_url
-            && target->handle
-            && target->handle->offline
-            && !lr_is_local_path(full_url))
-        {
-            g_debug("%s: Skipping %s because LRO_OFFLINE is specified",
-                    __func__, full_url);
+    // If LRO_OFFLINE is specified, check if the obtained full_url
+    // is local or not
+    // This condition should never be true for a full_url built
+    // from a mirror, because select_suitable_mirror() checks if
+    // the URL is local if LRO_OFFLINE is enabled by itself.
+    if (*full_url
+        && target->handle
+        && target->handle->offline
+        && !lr_is_local_path(*full_url))
+    {
+        g_debug("%s: Skipping %s because LRO_OFFLINE is specified",
+                __func__, *full_url);
+        lr_free(*full_url);
+        *full_url = NULL;
 
-            // Mark the target as failed
-            target->state = LR_DS_FAILED;
-            lr_downloadtarget_set_error(target->target, LRE_NOURL,
-                    "Cannot download, offline mode is specified and no "
-                    "local URL is available");
+        // Mark the target as failed
+        target_set_state(dd, target, LR_DS_FAILED);
+        lr_downloadtarget_set_error(target->target, LRE_NOURL,
+                "Cannot download, offline mode is specified and no "
+                "local URL is available");
 
-            // Call end callback
-            LrEndCb end_cb =  target->target->endcb;
-            if (end_cb) {
-                int ret = end_cb(target->target->cbdata,
-                                 LR_TRANSFER_ERROR,
-                                "Cannot download: Offline mode is specified "
-                                "and no local URL is available");
-                if (ret == LR_CB_ERROR) {
-                    target->cb_return_code = LR_CB_ERROR;
-                    g_debug("%s: Downloading was aborted by LR_CB_ERROR "
-                            "from end callback", __func__);
-                    g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
-                            "Interupted by LR_CB_ERROR from end callback");
-                    return FALSE;
-                }
-            }
-
-            if (dd->failfast) {
-                // Fail immediately
-                g_set_error(err, LR_DOWNLOADER_ERROR, LRE_NOURL,
-                            "Cannot download %s: Offline mode is specified "
-                            "and no local URL is available",
-                            target->target->path);
+        // Call end callback
+        LrEndCb end_cb =  target->target->endcb;
+        if (end_cb) {
+            int ret = end_cb(target->target->cbdata,
+                             LR_TRANSFER_ERROR,
+                            "Cannot download: Offline mode is specified "
+                            "and no local URL is available");
+            if (ret == LR_CB_ERROR) {
+                target->cb_return_code = LR_CB_ERROR;
+                g_debug("%s: Downloading was aborted by LR_CB_ERROR "
+                        "from end callback", __func__);
+                g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
+                        "Interupted by LR_CB_ERROR from end callback");
                 return FALSE;
             }
         }
 
-        if (full_url) {  // A waiting target found
-            target->mirror = mirror;  // Note: mirror is NULL if baseurl is used
+        if (dd->failfast) {
+            // Fail immediately
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_NOURL,
+                        "Cannot download %s: Offline mode is specified "
+                        "and no local URL is available",
+                        target->target->path);
+            return FALSE;
+        }
+    }
+
+    if (*full_url)
+        target->mirror = mirror;  // Note: mirror is NULL if baseurl is used
+
+    return TRUE;
+}
 
+/** Select next target
+ * Targets from the common queue of waiting targets (retries, targets
+ * with a base URL, ...) are tried first. Then the first targets from
+ * queues of the handles are tried (the one with the lowest rank first).
+ * All targets in a queue of a handle use the same mirrors and none
+ * of them tried any mirror yet, so if there is no free mirror for
+ * the first one, there is no free mirror for the rest of them either.
+ */
+static gboolean
+select_next_target(LrDownload *dd,
+                   LrTarget **selected_target,
+                   char **selected_full_url,
+                   GError **err)
+{
+    assert(dd);
+    assert(selected_target);
+    assert(selected_full_url);
+    assert(!err || *err == NULL);
+
+    *selected_target = NULL;
+    *selected_full_url = NULL;
+
+    GList *next = NULL;
+    for (GList *elem = dd->waiting_targets.head; elem; elem = next) {
+        LrTarget *target = elem->data;
+        char *full_url = NULL;
+
+        // The target could leave the queue in select_target_url()
+        next = g_list_next(elem);
+
+        if (!select_target_url(dd, target, &full_url, err))
+            return FALSE;
+
+        if (full_url) {  // A waiting target found
             *selected_target = target;
             *selected_full_url = full_url;
+            return TRUE;
+        }
+    }
+
+    for (GSList *elem = dd->handle_mirrors; elem; elem = g_slist_next(elem))
+        ((LrHandleMirrors *) elem->data)->no_free_mirror = FALSE;
+
+    while (1) {
+        LrHandleMirrors *best = NULL;
+        LrTarget *target = NULL;
+        char *full_url = NULL;
+
+        for (GSList *elem = dd->handle_mirrors; elem; elem = g_slist_next(elem)) {
+            LrHandleMirrors *handle_mirrors = elem->data;
+            LrTarget *head = g_queue_peek_head(&handle_mirrors->waiting_targets);
+            if (!head || handle_mirrors->no_free_mirror)
+                continue;
+            if (!target || head->rank < target->rank) {
+                best = handle_mirrors;
+                target = head;
+            }
+        }
+
+        if (!target)
+            break;
 
+        if (!select_target_url(dd, target, &full_url, err))
+            return FALSE;
+
+        if (full_url) {  // A waiting target found
+            *selected_target = target;
+            *selected_full_url = full_url;
             return TRUE;
         }
+
+        if (target->state == LR_DS_WAITING)
+            best->no_free_mirror = TRUE;
     }
 
     // No suitable target found
@@ -822,39 +1695,206 @@ remove_librepo_xattr(int fd)
 }
 
 
-/** Prepares next transfer
+#define XATTR_VALIDATORS                "user.Librepo.Validators"
+#define VALIDATORS_SUFFIX               ".validators"
+#define VALIDATORS_GROUP                "validators"
+#define VALIDATORS_KEY_ETAG             "etag"
+#define VALIDATORS_KEY_LASTMODIFIED     "lastmodified"
+#define VALIDATORS_KEY_SIZE             "size"
+#define VALIDATORS_KEY_MTIME            "mtime"
+
+/** Name of the file where validators of the target file are stored
+ * if the filesystem doesn't support extended attributes or NULL if
+ * the name of the target file is unknown.
  */
-static gboolean
-prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
+static gchar *
+validators_filename(LrTarget *target, int fd)
 {
-    LrTarget *target;
-    char *full_url = NULL;
-    LrProtocol protocol = LR_PROTOCOL_OTHER;
-    gboolean ret;
+    _cleanup_free_ gchar *fn = NULL;
 
-    assert(dd);
-    assert(!err || *err == NULL);
+    if (target->target->fn) {
+        fn = g_strdup(target->target->fn);
+    } else {
+        // Find out the file of the user's file descriptor
+        _cleanup_free_ gchar *link = g_strdup_printf("/proc/self/fd/%d", fd);
+        fn = g_file_read_link(link, NULL);
+        if (!fn || fn[0] != '/')
+            return NULL;
+    }
+
+    return g_strconcat(fn, VALIDATORS_SUFFIX, NULL);
+}
+
+/** Modification time of the file in microseconds.
+ */
+static gint64
+validators_mtime(struct stat *st)
+{
+    return (gint64) st->st_mtim.tv_sec * G_USEC_PER_SEC
+           + st->st_mtim.tv_nsec / 1000;
+}
+
+/** Load validators (ETag and Last-Modified) stored with the file
+ * by store_validators(). The validators are used only if the file
+ * wasn't changed since they were stored.
+ * @return      TRUE if at least one validator was found
+ */
+static gboolean
+load_validators(int fd,
+                const gchar *filename,
+                gchar **etag,
+                gchar **lastmodified)
+{
+    struct stat st;
+    gboolean loaded = FALSE;
 
-    *candidatefound = FALSE;
+    *etag = NULL;
+    *lastmodified = NULL;
 
-    ret = select_next_target(dd, &target, &full_url, err);
-    if (!ret)  // Error
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
         return FALSE;
 
-    if (!target)  // Nothing to do
-        return TRUE;
+    GKeyFile *keyfile = g_key_file_new();
+
+    ssize_t len = fgetxattr(fd, XATTR_VALIDATORS, NULL, 0);
+    if (len > 0) {
+        _cleanup_free_ gchar *data = g_malloc0(len + 1);
+        len = fgetxattr(fd, XATTR_VALIDATORS, data, len);
+        if (len > 0)
+            loaded = g_key_file_load_from_data(keyfile, data, len,
+                                               G_KEY_FILE_NONE, NULL);
+    } else if (filename) {
+        loaded = g_key_file_load_from_file(keyfile, filename,
+                                           G_KEY_FILE_NONE, NULL);
+    }
+
+    if (loaded
+        && g_key_file_get_int64(keyfile, VALIDATORS_GROUP,
+                                VALIDATORS_KEY_SIZE, NULL) == st.st_size
+        && g_key_file_get_int64(keyfile, VALIDATORS_GROUP,
+                                VALIDATORS_KEY_MTIME, NULL) == validators_mtime(&st))
+    {
+        *etag = g_key_file_get_string(keyfile, VALIDATORS_GROUP,
+                                      VALIDATORS_KEY_ETAG, NULL);
+        *lastmodified = g_key_file_get_string(keyfile, VALIDATORS_GROUP,
+                                              VALIDATORS_KEY_LASTMODIFIED,
+                                              NULL);
+    } else if (loaded) {
+        g_debug("%s: Stored validators are outdated", __func__);
+    }
+
+    g_key_file_free(keyfile);
+
+    return *etag || *lastmodified;
+}
+
+/** Store validators of the downloaded file in an extended attribute
+ * of the file or in the file with the specified filename if the
+ * extended attributes are not supported. Previously stored validators
+ * are removed if there are no validators.
+ */
+static void
+store_validators(int fd,
+                 const gchar *filename,
+                 const gchar *etag,
+                 const gchar *lastmodified)
+{
+    struct stat st;
+    GError *tmp_err = NULL;
+
+    if ((!etag && !lastmodified) || fstat(fd, &st) == -1) {
+        fremovexattr(fd, XATTR_VALIDATORS);
+        if (filename)
+            unlink(filename);
+        return;
+    }
+
+    GKeyFile *keyfile = g_key_file_new();
+    if (etag)
+        g_key_file_set_string(keyfile, VALIDATORS_GROUP,
+                              VALIDATORS_KEY_ETAG, etag);
+    if (lastmodified)
+        g_key_file_set_string(keyfile, VALIDATORS_GROUP,
+                              VALIDATORS_KEY_LASTMODIFIED, lastmodified);
+    g_key_file_set_int64(keyfile, VALIDATORS_GROUP,
+                         VALIDATORS_KEY_SIZE, st.st_size);
+    g_key_file_set_int64(keyfile, VALIDATORS_GROUP,
+                         VALIDATORS_KEY_MTIME, validators_mtime(&st));
+
+    gsize len = 0;
+    _cleanup_free_ gchar *data = g_key_file_to_data(keyfile, &len, NULL);
+    g_key_file_free(keyfile);
+
+    if (fsetxattr(fd, XATTR_VALIDATORS, data, len, 0) != -1) {
+        // Drop validators stored by a previous download (if any)
+        if (filename)
+            unlink(filename);
+        return;
+    }
+
+    g_debug("%s: Cannot set xattr %s: %s",
+            __func__, XATTR_VALIDATORS, strerror(errno));
+
+    if (filename && !g_file_set_contents(filename, data, len, &tmp_err)) {
+        g_debug("%s: Cannot store validators: %s", __func__, tmp_err->message);
+        g_error_free(tmp_err);
+    }
+}
+
+/** Add the HTTP header to the headers of the current transfer.
+ * The headers of the handle are used by default.
+ */
+static void
+target_add_httpheader(LrTarget *target, const char *name, const char *value)
+{
+    _cleanup_free_ gchar *header = g_strdup_printf("%s: %s", name, value);
+
+    if (!target->curl_httpheader && target->handle)
+        for (struct curl_slist *elem = target->handle->curl_httpheader;
+             elem;
+             elem = elem->next)
+            target->curl_httpheader = curl_slist_append(
+                                    target->curl_httpheader, elem->data);
+    target->curl_httpheader = curl_slist_append(target->curl_httpheader,
+                                                header);
+}
+
+/** Free the easy handle of a transfer which couldn't be prepared.
+ */
+static void
+discard_curl_handle(LrTarget *target, CURL *h)
+{
+    if (target->handle)
+        lr_handle_curl_handle_discard(target->handle, h);
+    else
+        curl_easy_cleanup(h);
+}
+
+/** Prepares transfer of the selected target from the full_url
+ * (the url is freed by the function)
+ */
+static gboolean
+prepare_next_transfer(LrDownload *dd,
+                      LrTarget *target,
+                      char *full_url,
+                      GError **err)
+{
+    LrProtocol protocol = LR_PROTOCOL_OTHER;
 
-    *candidatefound = TRUE;
+    assert(dd);
+    assert(!err || *err == NULL);
 
     g_debug("%s: URL: %s", __func__, full_url);
 
     protocol = lr_detect_protocol(full_url);
 
-    // Prepare CURL easy handle
+    // Prepare CURL easy handle (reuse an easy handle of a finished
+    // transfer of the same handle if possible)
     CURLcode c_rc;
     CURL *h;
     if (target->handle)
-        h = curl_easy_duphandle(target->handle->curl_handle);
+        h = lr_handle_curl_handle_acquire(target->handle,
+                                          &target->curl_handle_generation);
     else
         h = lr_get_curl_handle();
     if (!h) {
@@ -871,7 +1911,7 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
                     "curl_easy_setopt(h, CURLOPT_URL, %s) failed: %s",
                     full_url, curl_easy_strerror(c_rc));
         lr_free(full_url);
-        curl_easy_cleanup(h);
+        discard_curl_handle(target, h);
         return FALSE;
     }
 
@@ -883,14 +1923,27 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
                     "curl_easy_setopt(h, CURLOPT_ERRORBUFFER, %s) failed: %s",
                     full_url, curl_easy_strerror(c_rc));
         lr_free(full_url);
-        curl_easy_cleanup(h);
+        discard_curl_handle(target, h);
         return FALSE;
     }
 
+    // HTTP/2 multiplexing (only https URLs)
+    if (dd->http2 && g_str_has_prefix(full_url, "https://")) {
+#if LIBCURL_VERSION_NUM >= 0x072F00  // 7.47.0
+        curl_easy_setopt(h, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#else
+        curl_easy_setopt(h, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+#endif
+        // Rather wait for a connection which could be multiplexed
+        // than open a new one
+        curl_easy_setopt(h, CURLOPT_PIPEWAIT, 1L);
+    }
+
     lr_free(full_url);
 
-    // Prepare FILE
+    // Prepare file
     int fd;
+    gint64 offset = -1;  // Where to write the data in the file
 
     if (target->target->fd != -1) {
         // Use supplied filedescriptor
@@ -899,13 +1952,15 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
                         "dup(%d) failed: %s",
                         target->target->fd, strerror(errno));
-            curl_easy_cleanup(h);
+            discard_curl_handle(target, h);
             return FALSE;
         }
     } else {
         // Use supplied filename
         int open_flags = O_CREAT|O_TRUNC|O_RDWR;
-        if (target->resume)
+        if (target->resume
+            || target->migrate_offset > 0
+            || target->target->conditional)
             open_flags &= ~O_TRUNC;
 
         fd = open(target->target->fn, open_flags, 0666);
@@ -913,22 +1968,14 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
                         "Cannot open %s: %s",
                         target->target->fn, strerror(errno));
-            curl_easy_cleanup(h);
+            discard_curl_handle(target, h);
             return FALSE;
         }
     }
 
-    FILE *f = fdopen(fd, "w+b");
-    if (!f) {
-        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
-                    "fdopen(%d) failed: %s",
-                    fd, strerror(errno));
-        curl_easy_cleanup(h);
-        return FALSE;
-    }
-
-    target->f = f;
     target->writecb_recieved = 0;
+    target->adaptive_accounted = 0;
+    target->transfer_start = g_get_monotonic_time();
     target->writecb_required_range_written = FALSE;
 
     // Allow resume only for files that were originaly being
@@ -940,8 +1987,11 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
         if (ftruncate(fd, 0) == -1) {
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
                         "ftruncate() failed: %s", strerror(errno));
+            close(fd);
+            discard_curl_handle(target, h);
             return FALSE;
         }
+        offset = 0;
     }
 
     if (target->resume && target->resume_count >= LR_DOWNLOADER_MAXIMAL_RESUME_COUNT) {
@@ -956,8 +2006,7 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
 
         if (target->original_offset == -1) {
             // Determine offset
-            fseek(f, 0L, SEEK_END);
-            gint64 determined_offset = ftell(f);
+            gint64 determined_offset = lseek(fd, 0, SEEK_END);
             if (determined_offset == -1) {
                 // An error while determining offset =>
                 // Download the whole file again
@@ -977,12 +2026,131 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
                         "curl_easy_setopt(h, LR_DOWNLOADER_ERROR, %"
                         G_GINT64_FORMAT") failed: %s",
                         used_offset, curl_easy_strerror(c_rc));
-            fclose(f);
-            curl_easy_cleanup(h);
+            close(fd);
+            discard_curl_handle(target, h);
+            return FALSE;
+        }
+
+        // Always write at the resume offset (the file could be already
+        // used by a previous unsuccessful try)
+        offset = used_offset;
+        if (used_offset > 0)
+            target->target->resumes++;
+    }
+
+    // Continue the transfer migrated from a slow mirror. The data already
+    // downloaded are kept if the file on the mirror is the same (If-Range),
+    // otherwise the server sends the whole file and the transfer fails
+    // with CURLE_RANGE_ERROR (see check_transfer_statuses()).
+    target->migrated = FALSE;
+    if (target->migrate_offset > 0) {
+        g_debug("%s: Continuing migrated transfer at offset %"G_GINT64_FORMAT
+                " (If-Range: %s)", __func__, target->migrate_offset,
+                target->migrate_validator ? target->migrate_validator : "-");
+
+        c_rc = curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE,
+                                (curl_off_t) target->migrate_offset);
+        if (c_rc != CURLE_OK) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURL,
+                        "curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE, %"
+                        G_GINT64_FORMAT") failed: %s",
+                        target->migrate_offset, curl_easy_strerror(c_rc));
+            close(fd);
+            discard_curl_handle(target, h);
+            return FALSE;
+        }
+
+        if (target->migrate_validator && protocol == LR_PROTOCOL_HTTP)
+            target_add_httpheader(target, "If-Range",
+                                  target->migrate_validator);
+
+        offset = target->migrate_offset;
+        target->migrated = TRUE;
+        target->target->resumes++;
+        target->migrate_offset = 0;
+        g_free(target->migrate_validator);
+        target->migrate_validator = NULL;
+    }
+
+    if (target->parent) {
+        // Segment writes directly to its place in the file shared
+        // by all segments
+        offset = target->target->byterangestart;
+    } else if (offset == -1) {
+        // Continue at the current position of the file descriptor
+        offset = lseek(fd, 0, SEEK_CUR);
+        if (offset == -1)
+            offset = 0;
+    }
+
+    // Conditional request - the existing file is kept if it wasn't
+    // modified on the server. Otherwise the file is downloaded
+    // from the scratch.
+    target->conditional = FALSE;
+    target->notmodified = FALSE;
+    if (target->target->conditional
+        && !target->resume
+        && !target->migrated
+        && !target->parent)
+    {
+        _cleanup_free_ gchar *validators_fn = validators_filename(target, fd);
+        _cleanup_free_ gchar *etag = NULL;
+        _cleanup_free_ gchar *lastmodified = NULL;
+
+        if (protocol == LR_PROTOCOL_HTTP
+            && offset == 0
+            && load_validators(fd, validators_fn, &etag, &lastmodified))
+        {
+            g_debug("%s: Conditional request (ETag: %s, Last-Modified: %s)",
+                    __func__, etag ? etag : "-",
+                    lastmodified ? lastmodified : "-");
+            if (etag)
+                target_add_httpheader(target, "If-None-Match", etag);
+            if (lastmodified)
+                target_add_httpheader(target, "If-Modified-Since",
+                                      lastmodified);
+            target->conditional = TRUE;
+        } else if (ftruncate(fd, offset) == -1) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "ftruncate() failed: %s", strerror(errno));
+            close(fd);
+            discard_curl_handle(target, h);
             return FALSE;
         }
     }
 
+    // Could the transfer be migrated to another mirror later?
+    if (target->parent
+        || target->target->byterangestart > 0
+        || target->target->byterangeend > 0)
+        target->transfer_offset = -1;
+    else if (target->resume || target->migrated)
+        target->transfer_offset = offset;
+    else
+        target->transfer_offset = (offset == 0) ? 0 : -1;
+
+    // Preallocate space for the whole file to keep it contiguous
+    if (!target->parent
+        && !target->conditional
+        && target->target->byterangestart <= 0
+        && target->target->byterangeend <= 0
+        && target->target->expectedsize > offset)
+        lr_file_preallocate(fd, offset, target->target->expectedsize - offset);
+
+    // Buffer doesn't need to be bigger than the expected data
+    size_t bufsize = dd->write_buffer_size;
+    gint64 expected = target->target->expectedsize;
+    if (target->target->byterangeend > 0)
+        expected = target->target->byterangeend
+                   - MAX(target->target->byterangestart, 0) + 1;
+    if (expected > 0 && (gint64) bufsize > expected)
+        bufsize = (size_t) expected;
+
+    target->fd = fd;
+    target->writer = lr_filewriter_new(fd, offset, bufsize);
+    if (dd->ring)
+        lr_filewriter_set_iouring(target->writer, dd->ring);
+
     // Add librepo extended attribute to the file
     // This xattr states that file is being downloaded by librepo
     // This xattr is removed once the file is completly downloaded
@@ -991,7 +2159,20 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     // downloaded again.
     add_librepo_xattr(fd, target->target->fn);
 
-    if (target->target->byterangestart > 0) {
+    target->range_requested = FALSE;
+    if (protocol == LR_PROTOCOL_HTTP
+        && target->target->byterangeend > target->target->byterangestart)
+    {
+        // Ask for exactly the range, the response ends with the range
+        // and the connection can be reused by the next transfer
+        _cleanup_free_ gchar *range = NULL;
+        range = g_strdup_printf("%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
+                                MAX(target->target->byterangestart, 0),
+                                target->target->byterangeend);
+        g_debug("%s: Requesting byte range %s", __func__, range);
+        c_rc = curl_easy_setopt(h, CURLOPT_RANGE, range);
+        target->range_requested = TRUE;
+    } else if (target->target->byterangestart > 0) {
         assert(!target->target->resume);
         g_debug("%s: byterangestart is specified -> resume is set to %"
                 G_GINT64_FORMAT, __func__, target->target->byterangestart);
@@ -999,16 +2180,25 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
                                 (curl_off_t) target->target->byterangestart);
     }
 
+    // Prepare incremental checksums (data are checksummed as they arrive,
+    // so the file doesn't need to be read again after the download)
+    target_checksums_prepare(target);
+
     // Prepare progress callback
     target->cb_return_code = LR_CB_OK;
+    target->progress_changed = FALSE;
+    progress_throttle_init(&target->progress_throttle,
+                           dd->progress_interval,
+                           dd->progress_delta);
     if (target->target->progresscb) {
-        curl_easy_setopt(h, CURLOPT_PROGRESSFUNCTION, lr_progresscb);
+        curl_easy_setopt(h, CURLOPT_PROGRESSFUNCTION,
+                         dd->workers ? lr_worker_progresscb : lr_progresscb);
         curl_easy_setopt(h, CURLOPT_NOPROGRESS, 0);
         curl_easy_setopt(h, CURLOPT_PROGRESSDATA, target);
     }
 
     // Prepare header callback
-    if (target->target->expectedsize > 0) {
+    if (target->target->expectedsize > 0 || target->target->conditional) {
         curl_easy_setopt(h, CURLOPT_HEADERFUNCTION, lr_headercb);
         curl_easy_setopt(h, CURLOPT_HEADERDATA, target);
     }
@@ -1017,20 +2207,35 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, lr_writecb);
     curl_easy_setopt(h, CURLOPT_WRITEDATA, target);
 
+    // Map the handle to the target (see check_transfer_statuses())
+    curl_easy_setopt(h, CURLOPT_PRIVATE, target);
+
+    // Signals cannot be used for timeouts in multi-threaded programs
+    if (dd->workers)
+        curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+
     // Set http headers if handle is available and headers are specified
-    if (target->handle)
+    if (target->curl_httpheader)
+        curl_easy_setopt(h, CURLOPT_HTTPHEADER, target->curl_httpheader);
+    else if (target->handle)
         curl_easy_setopt(h, CURLOPT_HTTPHEADER, target->handle->curl_httpheader);
 
-    // Add the new handle to the curl multi handle
-    curl_multi_add_handle(dd->multi_handle, h);
-
     // Set the state of transfer as running
-    target->state = LR_DS_RUNNING;
+    target_set_state(dd, target, LR_DS_RUNNING);
 
     // Set the state of header callback for this transfer
     target->headercb_state = LR_HCS_DEFAULT;
+
+    // Speed limits are enforced by the write callback
+    target->ratelimiter = dd->ratelimiter;
+    target->shared_ratelimiter = dd->shared_ratelimiter;
+    target->paused = FALSE;
     g_free(target->headercb_interrupt_reason);
     target->headercb_interrupt_reason = NULL;
+    g_free(target->etag);
+    target->etag = NULL;
+    g_free(target->lastmodified);
+    target->lastmodified = NULL;
 
     // Set protocol of the target
     target->protocol = protocol;
@@ -1038,103 +2243,595 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     // Save curl handle for the current transfer
     target->curl_handle = h;
 
-    // Add the transfer to the list of running transfers
-    dd->running_transfers = g_slist_append(dd->running_transfers, target);
+    // Add the transfer to the queue of running transfers
+    g_queue_push_tail(&dd->running_transfers, target);
+    target->running_link = g_queue_peek_tail_link(&dd->running_transfers);
+    if (target->mirror)
+        target->mirror->running_transfers++;
+
+    // Add the new handle to the curl multi handle. A worker thread
+    // could start the transfer right away, so the target has to be
+    // completely prepared at this point.
+    if (dd->workers)
+        lr_workerpool_add_handle(dd->workers, h);
+    else
+        curl_multi_add_handle(dd->multi_handle, h);
 
     return TRUE;
 }
 
+/** Check if the speed of the download is limited right now.
+ * The limiter of the share is always attached, because its rate could
+ * be changed during the download, rate 0 means unlimited.
+ * @return          TRUE if a speed limit is set
+ */
 static gboolean
-set_max_speeds_to_transfers(LrDownload *dd, GError **err)
+ratelimit_active(LrDownload *dd)
 {
-    guint length;
-    gint64 single_target_speed;
+    return dd->ratelimiter
+           || (dd->shared_ratelimiter
+               && lr_ratelimiter_get_rate(dd->shared_ratelimiter) > 0);
+}
 
-    assert(!err || *err == NULL);
+/** Time until the speed limits allow to take more data.
+ * @return          0 or time in microseconds
+ */
+static gint64
+ratelimit_delay(LrDownload *dd)
+{
+    gint64 delay = 0;
 
-    if (!dd->max_speed)  // Nothing to do
-        return TRUE;
+    if (dd->ratelimiter)
+        delay = lr_ratelimiter_delay(dd->ratelimiter);
+    if (dd->shared_ratelimiter)
+        delay = MAX(delay, lr_ratelimiter_delay(dd->shared_ratelimiter));
 
-    length = g_slist_length(dd->running_transfers);
-    if (!length)  // Nothing to do
-        return TRUE;
+    return delay;
+}
 
-    // Calculate a max speed (rounded up) per target
-    single_target_speed = (dd->max_speed + (length - 1)) / length;
-
-    for (GSList *elem = dd->running_transfers; elem; elem = g_slist_next(elem)) {
-        LrTarget *ltarget = elem->data;
-        CURL *curl_handle = ltarget->curl_handle;
-        CURLcode code = curl_easy_setopt(curl_handle,
-                                         CURLOPT_MAX_RECV_SPEED_LARGE,
-                                         (curl_off_t) single_target_speed);
-        if (code != CURLE_OK) {
-            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLSETOPT,
-                        "Cannot set CURLOPT_MAX_RECV_SPEED_LARGE option: %s",
-                        curl_easy_strerror(code));
-            return FALSE;
+/** Resume transfers paused because of the speed limits if the limits
+ * allow it. Resumed transfers are moved to the end of the queue of
+ * running transfers, so the paused transfers are resumed in round-robin
+ * order and the bandwidth unused by slow transfers goes to the others.
+ * @return          0 if no transfer is paused or time in microseconds
+ *                  after which the function should be called again
+ */
+static gint64
+ratelimit_resume_transfers(LrDownload *dd)
+{
+    gboolean paused = FALSE;
+    GList *elem = dd->running_transfers.head;
+    guint length = dd->running_transfers.length;
+
+    if (!dd->ratelimiter && !dd->shared_ratelimiter)
+        return 0;
+
+    if (dd->workers)
+        // Paused transfers are resumed by the workers (see worker_tick())
+        return 0;
+
+    for (guint x = 0; x < length && elem; x++) {
+        LrTarget *target = elem->data;
+        GList *next = g_list_next(elem);
+
+        if (target->paused) {
+            if (ratelimit_delay(dd))
+                return ratelimit_delay(dd);
+
+            target->paused = FALSE;
+            g_queue_unlink(&dd->running_transfers, elem);
+            g_queue_push_tail_link(&dd->running_transfers, elem);
+
+            // Note: Curl could call the write callback (and the transfer
+            // could be paused again) right from the curl_easy_pause()
+            CURLcode code = curl_easy_pause(target->curl_handle, CURLPAUSE_CONT);
+            if (code != CURLE_OK)
+                g_debug("%s: curl_easy_pause() failed: %s",
+                        __func__, curl_easy_strerror(code));
+
+            if (target->paused)
+                paused = TRUE;
         }
+
+        elem = next;
     }
 
-    return TRUE;
+    return paused ? ratelimit_delay(dd) : 0;
 }
 
+/** Is there any target waiting for a free slot?
+ */
 static gboolean
-prepare_next_transfers(LrDownload *dd, GError **err)
+have_waiting_targets(LrDownload *dd)
 {
-    guint length = g_slist_length(dd->running_transfers);
-    guint free_slots = dd->max_parallel_connections - length;
+    if (!g_queue_is_empty(&dd->waiting_targets))
+        return TRUE;
 
-    assert(!err || *err == NULL);
+    for (GSList *elem = dd->handle_mirrors; elem; elem = g_slist_next(elem))
+        if (!g_queue_is_empty(&((LrHandleMirrors *) elem->data)->waiting_targets))
+            return TRUE;
 
-    gboolean candidatefound = TRUE;
-    while (free_slots > 0 && candidatefound) {
-        gboolean ret = prepare_next_transfer(dd, &candidatefound, err);
-        if (!ret)
-            return FALSE;
-        free_slots--;
-    }
+    return FALSE;
+}
 
-    // Set maximal speed for each target
-    if (dd->max_speed)
-        if (!set_max_speeds_to_transfers(dd, err))
-            return FALSE;
+/** Interval (in microseconds) of evaluations of the adaptive
+ * concurrency controller */
+#define LR_ADAPTIVE_INTERVAL            500000
+/** Goodput lower than this fraction of the previous goodput is
+ * considered as a congestion */
+#define LR_ADAPTIVE_COLLAPSE_RATIO      0.75
 
-    return TRUE;
+/** Account bytes received by the transfer to the adaptive
+ * concurrency controller.
+ */
+static void
+adaptive_account_transfer(LrDownload *dd, LrTarget *target)
+{
+    dd->adaptive.received += target->writecb_recieved
+                             - target->adaptive_accounted;
+    target->adaptive_accounted = target->writecb_recieved;
 }
 
-
-/** Check the finished transfer
- * Evaluate CURL return code and status code of protocol if needed.
- * @param serious_error     Serious error is an error that isn't fatal,
- *                          but mirror that generate it should be penalized.
- *                          E.g.: Connection timeout - a mirror we are unable
- *                          to connect at is pretty useless for us, but
- *                          this could be only temporary state.
- *                          No fatal but also no good.
- * @param fatal_error       An error that cannot be recovered - e.g.
- *                          we cannot write to a socket, we cannot write
- *                          data to disk, bad function argument, ...
+/** Is the curl error a sign of an overloaded link or mirror?
  */
 static gboolean
-check_finished_transfer_status(CURLMsg *msg,
-                               LrTarget *target,
-                               gboolean *serious_error,
-                               gboolean *fatal_error,
-                               GError **transfer_err,
-                               GError **err)
+adaptive_is_congestion_error(CURLcode code)
 {
-    long code = 0;
-    char *effective_url = NULL;
+    switch (code) {
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SSL_CONNECT_ERROR:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
 
-    assert(msg);
-    assert(target);
-    assert(!transfer_err || *transfer_err == NULL);
-    assert(!err || *err == NULL);
+/** Additive increase / multiplicative decrease of the number
+ * of running transfers based on the goodput and the failures
+ * measured since the last evaluation.
+ */
+static void
+adaptive_concurrency_update(LrDownload *dd)
+{
+    LrAdaptiveConcurrency *ac = &dd->adaptive;
+    gint64 now = g_get_monotonic_time();
+    int limit = dd->max_running_transfers;
+    int new_limit = limit;
+    const char *reason = "out of bounds";
+    gboolean waiting = FALSE;
+
+    if (!dd->adaptive_concurrency)
+        return;
+
+    if (now - ac->last_update < LR_ADAPTIVE_INTERVAL)
+        return;
+
+    // Bytes received by transfers running on worker threads are
+    // accounted when the transfers finish
+    if (!dd->workers)
+        for (GList *elem = dd->running_transfers.head; elem; elem = g_list_next(elem))
+            adaptive_account_transfer(dd, elem->data);
+
+    waiting = have_waiting_targets(dd);
+    guint running = dd->running_transfers.length;
+    double goodput = ac->received * (double) G_USEC_PER_SEC
+                     / (now - ac->last_update);
+
+    if (ac->failures > 0) {
+        new_limit = limit / 2;
+        reason = "transfers failed";
+        ac->last_goodput = 0;
+    } else if (!waiting || running < (guint) limit) {
+        // Number of transfers doesn't limit the download
+        ;
+    } else if (ac->last_goodput > 0
+               && goodput < ac->last_goodput * LR_ADAPTIVE_COLLAPSE_RATIO) {
+        new_limit = limit * 3 / 4;
+        reason = "goodput collapsed";
+        ac->last_goodput = 0;
+    } else {
+        new_limit = limit + 1;
+        reason = "goodput holds";
+        ac->last_goodput = goodput;
+    }
 
-    *fatal_error = FALSE;
+    new_limit = CLAMP(new_limit, 1, dd->adaptive_max_running_transfers);
 
-    curl_easy_getinfo(msg->easy_handle,
+    if (new_limit != limit)
+        g_debug("%s: Goodput %.0f B/s, %d failures, %u running: "
+                "parallel transfers %d -> %d (%s)", __func__, goodput,
+                ac->failures, running, limit, new_limit, reason);
+
+    dd->max_running_transfers = new_limit;
+    ac->last_update = now;
+    ac->received = 0;
+    ac->failures = 0;
+}
+
+/** Return the curl easy handle of the finished transfer to the pool
+ * of the handle. The options which are set by prepare_next_transfer()
+ * only for some transfers are reset to the values of the handle.
+ */
+static void
+target_release_curl_handle(LrTarget *target)
+{
+    CURL *h = target->curl_handle;
+
+    target->curl_handle = NULL;
+
+    if (!target->handle) {
+        curl_easy_cleanup(h);
+        return;
+    }
+
+    curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) 0);
+    curl_easy_setopt(h, CURLOPT_RANGE, NULL);
+    curl_easy_setopt(h, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(h, CURLOPT_PROGRESSFUNCTION, NULL);
+    curl_easy_setopt(h, CURLOPT_PROGRESSDATA, NULL);
+    curl_easy_setopt(h, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(h, CURLOPT_HEADERDATA, NULL);
+    curl_easy_setopt(h, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_NONE);
+    curl_easy_setopt(h, CURLOPT_PIPEWAIT, 0L);
+    curl_easy_setopt(h, CURLOPT_HTTPHEADER, target->handle->curl_httpheader);
+    curl_easy_setopt(h, CURLOPT_ERRORBUFFER, NULL);
+    curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, NULL);
+    curl_easy_setopt(h, CURLOPT_WRITEDATA, NULL);
+    curl_easy_setopt(h, CURLOPT_PRIVATE, NULL);
+    curl_easy_setopt(h, CURLOPT_NOSIGNAL, 0L);
+
+    lr_handle_curl_handle_release(target->handle, h,
+                                  target->curl_handle_generation);
+}
+
+/** Stop the running transfer of the target and release its resources.
+ * The state of the target is not changed.
+ */
+static void
+target_stop_transfer(LrDownload *dd, LrTarget *target)
+{
+    if (dd->workers)
+        lr_workerpool_remove_handle(dd->workers, target->curl_handle);
+    else
+        curl_multi_remove_handle(dd->multi_handle, target->curl_handle);
+    target_release_curl_handle(target);
+    g_free(target->headercb_interrupt_reason);
+    target->headercb_interrupt_reason = NULL;
+    curl_slist_free_all(target->curl_httpheader);
+    target->curl_httpheader = NULL;
+    target_close_file(dd, target);
+    target_checksums_free(target);
+    if (dd->adaptive_concurrency)
+        adaptive_account_transfer(dd, target);
+
+    g_queue_delete_link(&dd->running_transfers, target->running_link);
+    target->running_link = NULL;
+    if (target->mirror)
+        target->mirror->running_transfers--;
+}
+
+/** Interval (in microseconds) of checks for transfers to hedge */
+#define LR_HEDGE_INTERVAL               500000
+/** Transfer is hedged if its projected duration is this many times
+ * longer than the median duration of the transfers */
+#define LR_HEDGE_RATIO                  3.0
+/** Minimal time (in seconds) the transfer has to run before it could
+ * be hedged (its speed is not known well before) */
+#define LR_HEDGE_MIN_ELAPSED            2.0
+/** Minimal projected remaining time (in seconds) of the transfer
+ * which is hedged (almost finished transfers are not hedged) */
+#define LR_HEDGE_MIN_REMAINING          2.0
+
+/** Projected duration of the running transfer (in seconds) based
+ * on its average speed.
+ * @param elapsed       Time elapsed since the start of the transfer
+ * @param remaining     Projected time to the end of the transfer
+ * @return              Projected duration or G_MAXDOUBLE if nothing
+ *                      was received yet
+ */
+static double
+hedge_projected_duration(LrTarget *target,
+                         gint64 now,
+                         double *elapsed,
+                         double *remaining)
+{
+    gint64 left = target->target->expectedsize
+                  - MAX(target->transfer_offset, 0)
+                  - target->writecb_recieved;
+
+    *elapsed = (now - target->transfer_start) / (double) G_USEC_PER_SEC;
+
+    if (left <= 0) {
+        *remaining = 0.0;
+    } else if (target->writecb_recieved <= 0 || *elapsed <= 0.0) {
+        *remaining = G_MAXDOUBLE;
+        return G_MAXDOUBLE;
+    } else {
+        *remaining = left * *elapsed / target->writecb_recieved;
+    }
+
+    return *elapsed + *remaining;
+}
+
+/** Could be the running transfer of the target hedged?
+ * Only targets downloaded to a file specified by its name are hedged,
+ * because the result of the hedged transfer is moved to its place
+ * by rename(). Conditional targets are not hedged, their existing
+ * file could be kept.
+ */
+static gboolean
+hedge_target_eligible(LrTarget *target)
+{
+    LrDownloadTarget *dtarget = target->target;
+
+    return !target->hedge
+        && !target->hedge_of
+        && !target->parent
+        && target->mirror
+        && dtarget->fn
+        && !dtarget->conditional
+        && dtarget->expectedsize > 0
+        && !target->resume
+        && dtarget->byterangestart <= 0
+        && dtarget->byterangeend <= 0
+        && !dtarget->baseurl
+        && !strstr(dtarget->path, "://")
+        && !(target->handle && target->handle->offline);
+}
+
+/** Find the best free mirror which could be used by another transfer
+ * of the running target (a hedged or a migrated one). The rules are
+ * the same as in select_suitable_mirror().
+ * @return      Mirror or NULL
+ */
+static LrMirror *
+target_free_mirror(LrDownload *dd, LrTarget *target)
+{
+    for (guint i = 0; i < target->lrmirrors->len; i++) {
+        LrMirror *c_mirror = g_ptr_array_index(target->lrmirrors, i);
+
+        if (c_mirror == target->mirror
+            || target_mirror_tried(target, c_mirror)
+            || c_mirror->mirror->protocol == LR_PROTOCOL_RSYNC)
+            continue;
+
+        if (c_mirror->successful_transfers == 0 &&
+            dd->allowed_mirror_failures > 0 &&
+            c_mirror->failed_transfers >= dd->allowed_mirror_failures)
+            continue;
+
+        int max_running = mirror_max_running_transfers(dd, c_mirror);
+        if (max_running != -1 && c_mirror->running_transfers >= max_running)
+            continue;
+
+        return c_mirror;
+    }
+
+    return NULL;
+}
+
+/** Create a hedged transfer of the target. The hedged transfer
+ * downloads the same file from another mirror to a temporary file.
+ */
+static void
+hedge_start(LrDownload *dd, LrTarget *target)
+{
+    LrDownloadTarget *dtarget = target->target;
+    GSList *checksums = NULL;
+    _cleanup_free_ gchar *fn = NULL;
+    int fd;
+
+    fn = g_strconcat(dtarget->fn, ".hedge.XXXXXX", NULL);
+    fd = g_mkstemp(fn);
+    if (fd == -1) {
+        g_debug("%s: Cannot create temporary file %s: %s",
+                __func__, fn, g_strerror(errno));
+        return;
+    }
+    close(fd);
+
+    for (GSList *elem = dtarget->checksums; elem; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *dtch = elem->data;
+        checksums = g_slist_prepend(checksums,
+                        lr_downloadtargetchecksum_new(dtch->type, dtch->value));
+    }
+    checksums = g_slist_reverse(checksums);
+
+    // Note: The path is already substituted, so no handle is passed
+    LrDownloadTarget *hdtarget;
+    hdtarget = lr_downloadtarget_new(NULL,
+                                     dtarget->path,
+                                     NULL,
+                                     -1,
+                                     fn,
+                                     checksums,
+                                     dtarget->expectedsize,
+                                     FALSE,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     0,
+                                     0);
+
+    LrTarget *hedge = lr_malloc0(sizeof(*hedge));
+    hedge->state           = LR_DS_WAITING;
+    hedge->target          = hdtarget;
+    hedge->original_offset = -1;
+    hedge->resume          = FALSE;
+    hedge->handle          = target->handle;
+    hedge->lrmirrors       = target->lrmirrors;
+    hedge->handle_mirrors  = target->handle_mirrors;
+    hedge->hedge_of        = target;
+    hedge->rank            = target->rank;
+    hedge->segments_fd     = -1;
+    hedge->fd              = -1;
+    hdtarget->rcode        = LRE_UNFINISHED;
+    hdtarget->err          = "Not finished";
+    hdtarget->priority     = dtarget->priority;
+
+    // Do not use the mirrors already used by the original target
+    hedge->tried_mirrors = g_new0(guint8, (target->lrmirrors->len + 7) / 8);
+    if (target->tried_mirrors)
+        memcpy(hedge->tried_mirrors, target->tried_mirrors,
+               (target->lrmirrors->len + 7) / 8);
+    hedge->tried_mirrors_count = target->tried_mirrors_count;
+    target_add_tried_mirror(hedge, target->mirror);
+
+    g_debug("%s: Hedging transfer of %s from %s", __func__,
+            dtarget->path, target->mirror->mirror->url);
+
+    target->hedge = hedge;
+    dd->targets = g_slist_prepend(dd->targets, hedge);
+    target_set_state(dd, hedge, LR_DS_WAITING);
+}
+
+/** Cancel the hedged transfer of the target (if any).
+ * Its temporary file is removed at the end of the download.
+ */
+static void
+hedge_discard(LrDownload *dd, LrTarget *target)
+{
+    LrTarget *hedge = target->hedge;
+
+    if (!hedge)
+        return;
+
+    g_debug("%s: Discarding hedged transfer of %s",
+            __func__, target->target->path);
+
+    if (hedge->curl_handle)
+        target_stop_transfer(dd, hedge);
+    target_set_state(dd, hedge, LR_DS_FAILED);
+    target->hedge = NULL;
+}
+
+static gint
+double_cmp(gconstpointer a, gconstpointer b)
+{
+    double da = *((const double *) a);
+    double db = *((const double *) b);
+    return (da > db) - (da < db);
+}
+
+/** Start hedged transfers of the running transfers which are much
+ * slower than the rest of the transfers (e.g. because of a slow
+ * or stalled mirror). Free slots at the tail of the download, when
+ * there are no more waiting targets, are used for the hedged transfers.
+ * The transfer which finishes first wins, the other one is cancelled.
+ */
+static void
+hedge_transfers(LrDownload *dd)
+{
+    gint64 now = g_get_monotonic_time();
+    guint length = dd->running_transfers.length + dd->copying;
+    guint free_slots;
+
+    if (!dd->hedged_requests)
+        return;
+
+    // A duplicate transfer doesn't help if the bandwidth is limited
+    if (ratelimit_active(dd))
+        return;
+
+    if (now - dd->hedging.last_check < LR_HEDGE_INTERVAL)
+        return;
+    dd->hedging.last_check = now;
+
+    if ((guint) dd->max_running_transfers <= length
+        || have_waiting_targets(dd))
+        return;
+    free_slots = dd->max_running_transfers - length;
+
+    // Median of the durations of finished transfers and of the projected
+    // durations of the running transfers
+    GArray *durations = g_array_sized_new(FALSE, FALSE, sizeof(double),
+                                          dd->hedging.durations->len + length);
+    g_array_append_vals(durations, dd->hedging.durations->data,
+                        dd->hedging.durations->len);
+    for (GList *elem = dd->running_transfers.head; elem; elem = g_list_next(elem)) {
+        LrTarget *target = elem->data;
+        double elapsed, remaining;
+        if (target->hedge_of || target->parent)
+            continue;
+        double projected = hedge_projected_duration(target, now,
+                                                    &elapsed, &remaining);
+        g_array_append_val(durations, projected);
+    }
+
+    if (durations->len < 2) {
+        g_array_free(durations, TRUE);
+        return;
+    }
+
+    g_array_sort(durations, double_cmp);
+    double median = g_array_index(durations, double, (durations->len - 1) / 2);
+    g_array_free(durations, TRUE);
+
+    for (GList *elem = dd->running_transfers.head;
+         elem && free_slots > 0;
+         elem = g_list_next(elem))
+    {
+        LrTarget *target = elem->data;
+        double elapsed, remaining, projected;
+
+        if (!hedge_target_eligible(target))
+            continue;
+
+        projected = hedge_projected_duration(target, now, &elapsed, &remaining);
+        if (elapsed < LR_HEDGE_MIN_ELAPSED
+            || remaining < LR_HEDGE_MIN_REMAINING
+            || projected <= median * LR_HEDGE_RATIO)
+            continue;
+
+        if (!target_free_mirror(dd, target))
+            continue;
+
+        g_debug("%s: Transfer of %s is slow (projected %.1f s, median "
+                "%.1f s)", __func__, target->target->path, projected, median);
+        hedge_start(dd, target);
+        if (target->hedge)
+            free_slots--;
+    }
+}
+
+/** Check the finished transfer
+ * Evaluate CURL return code and status code of protocol if needed.
+ * @param serious_error     Serious error is an error that isn't fatal,
+ *                          but mirror that generate it should be penalized.
+ *                          E.g.: Connection timeout - a mirror we are unable
+ *                          to connect at is pretty useless for us, but
+ *                          this could be only temporary state.
+ *                          No fatal but also no good.
+ * @param fatal_error       An error that cannot be recovered - e.g.
+ *                          we cannot write to a socket, we cannot write
+ *                          data to disk, bad function argument, ...
+ */
+static gboolean
+check_finished_transfer_status(CURLMsg *msg,
+                               LrTarget *target,
+                               gboolean *serious_error,
+                               gboolean *fatal_error,
+                               GError **transfer_err,
+                               GError **err)
+{
+    long code = 0;
+    char *effective_url = NULL;
+
+    assert(msg);
+    assert(target);
+    assert(!transfer_err || *transfer_err == NULL);
+    assert(!err || *err == NULL);
+
+    *fatal_error = FALSE;
+
+    curl_easy_getinfo(msg->easy_handle,
                       CURLINFO_EFFECTIVE_URL,
                       &effective_url);
 
@@ -1215,7 +2912,11 @@ check_finished_transfer_status(CURLMsg *msg,
         // Check status codes for some protocols
         if (effective_url && g_str_has_prefix(effective_url, "http")) {
             // Check HTTP(S) code
-            if (code/100 != 2) {
+            if (code == 304 && target->conditional) {
+                // The existing file of the conditional target is kept
+                g_debug("%s: Not modified: %s", __func__, effective_url);
+                target->notmodified = TRUE;
+            } else if (code/100 != 2) {
                 g_set_error(transfer_err,
                             LR_DOWNLOADER_ERROR,
                             LRE_BADSTATUS,
@@ -1272,12 +2973,15 @@ list_of_checksums_to_str(GSList *checksums)
 static gboolean
 check_finished_trasfer_checksum(int fd,
                                 GSList *checksums,
+                                GSList *streamed_checksums,
+                                gboolean iouring,
                                 gboolean *checksum_matches,
                                 GError **transfer_err,
                                 GError **err)
 {
     gboolean matches = TRUE;
     GSList *calculated_chksums = NULL;
+    LrIoUring *ring = NULL;
 
     for (GSList *elem = checksums; elem; elem = g_slist_next(elem)) {
         LrDownloadTargetChecksum *chksum = elem->data;
@@ -1287,16 +2991,36 @@ check_finished_trasfer_checksum(int fd,
         if (!chksum || !chksum->value || chksum->type == LR_CHECKSUM_UNKNOWN)
             continue;  // Bad checksum
 
-        lseek(fd, 0, SEEK_SET);
-        gboolean ret = lr_checksum_fd_compare(chksum->type,
-                                              fd,
-                                              chksum->value,
-                                              1,
-                                              &matches,
-                                              &calculated,
-                                              err);
-        if (!ret)
-            return FALSE;
+        // Use the checksum calculated during the transfer if available
+        LrDownloadTargetChecksum *streamed = NULL;
+        for (GSList *el = streamed_checksums; el; el = g_slist_next(el)) {
+            LrDownloadTargetChecksum *s_chksum = el->data;
+            if (s_chksum->type == chksum->type)
+                streamed = s_chksum;
+        }
+
+        if (streamed) {
+            calculated = g_strdup(streamed->value);
+            matches = strcmp(chksum->value, calculated) ? FALSE : TRUE;
+            if (matches)
+                lr_checksum_cache_store(fd, calculated);
+        } else {
+            // The file is read by the io_uring of this thread (if enabled)
+            if (iouring && !ring)
+                ring = lr_iouring_new();
+            gboolean ret = lr_checksum_fd_compare_ring(chksum->type,
+                                                       fd,
+                                                       chksum->value,
+                                                       1,
+                                                       &matches,
+                                                       &calculated,
+                                                       ring,
+                                                       err);
+            if (!ret) {
+                lr_iouring_free(ring);
+                return FALSE;
+            }
+        }
 
         // Store calculated checksum
         calculated_chksum = lr_downloadtargetchecksum_new(chksum->type,
@@ -1307,13 +3031,15 @@ check_finished_trasfer_checksum(int fd,
 
         if (matches) {
             // At least one checksum matches
-            g_debug("%s: Checksum (%s) %s is OK", __func__,
-                    lr_checksum_type_to_str(chksum->type),
-                    chksum->value);
+            lr_log_debug("%s: Checksum (%s) %s is OK", __func__,
+                         lr_checksum_type_to_str(chksum->type),
+                         chksum->value);
             break;
         }
     }
 
+    lr_iouring_free(ring);
+
     *checksum_matches = matches;
 
     if (!matches) {
@@ -1349,6 +3075,16 @@ truncate_transfer_file(LrTarget *target, GError **err)
 
     assert(!err || *err == NULL);
 
+    if (target->parent)
+        // The file is shared by all segments, a failed segment is just
+        // downloaded (and written) again
+        return TRUE;
+
+    if (target->conditional)
+        // Nothing was written, the existing file of the conditional
+        // target is kept for the next conditional request
+        return TRUE;
+
     if (target->original_offset > -1)
         // If resume is enabled -> truncate file to its original position
         original_offset = target->original_offset;
@@ -1377,359 +3113,1747 @@ truncate_transfer_file(LrTarget *target, GError **err)
 }
 
 
-/** Return mirror rank or -1.0 if the rank cannot be determined
- * (e.g. when is too early)
- * Rank is currently just success rate for the mirror
+/** Interval (in microseconds) of checks for slow transfers to migrate */
+#define LR_MIGRATE_INTERVAL             1000000
+/** Minimal time (in seconds) the transfer has to run before its speed
+ * is compared with the other transfers */
+#define LR_MIGRATE_MIN_ELAPSED          5.0
+/** Transfer is migrated if its speed is lower than this fraction of the
+ * throughput of the free mirror or, if the throughput is not known yet,
+ * of the median speed of the running transfers */
+#define LR_MIGRATE_RATIO                0.25
+/** Minimal projected remaining time (in seconds) of the transfer
+ * which is migrated (almost finished transfers are not migrated) */
+#define LR_MIGRATE_MIN_REMAINING        5.0
+
+/** Could be the running transfer of the target migrated to another
+ * mirror? The transfer is continued from the current offset, so the
+ * offset in the file has to match the offset in the downloaded file.
+ * HTTP transfer is migrated only if a validator of the downloaded
+ * data (ETag or Last-Modified) is known.
+ */
+static gboolean
+migrate_target_eligible(LrDownload *dd, LrTarget *target)
+{
+    LrDownloadTarget *dtarget = target->target;
+
+    return target->state == LR_DS_RUNNING
+        && !target->paused
+        && !target->parent
+        && !target->hedge
+        && !target->hedge_of
+        && target->mirror
+        && target->transfer_offset >= 0
+        && dtarget->expectedsize > 0
+        && !dtarget->baseurl
+        && !strstr(dtarget->path, "://")
+        && !(target->handle && target->handle->offline)
+        && (target->protocol != LR_PROTOCOL_HTTP
+            || target_range_validator(target))
+        && (dd->max_mirrors_to_try <= 0
+            || target->tried_mirrors_count + 1 < (guint) dd->max_mirrors_to_try);
+}
+
+/** Stop the running transfer of the target and let it continue from
+ * the current offset on another mirror. The data already written to
+ * the file are kept.
  */
-static gdouble
-mirror_rank(LrMirror *mirror)
+static void
+migrate_target(LrDownload *dd, LrTarget *target)
 {
-    gdouble rank = -1.0;
+    LrMirror *mirror = target->mirror;
+    GError *tmp_err = NULL;
+    double size_download = 0.0, starttransfer_time = -1.0, total_time = 0.0;
+
+    if (!lr_filewriter_flush(target->writer, &tmp_err)) {
+        g_debug("%s: Cannot migrate transfer of %s: %s",
+                __func__, target->target->path, tmp_err->message);
+        g_error_free(tmp_err);
+        return;
+    }
 
-    int successful = mirror->successful_transfers;
-    int failed = mirror->failed_transfers;
-    int finished_transfers = successful + failed;
+    // The slow transfer is taken into account by the mirror statistics
+    curl_easy_getinfo(target->curl_handle, CURLINFO_SIZE_DOWNLOAD,
+                      &size_download);
+    curl_easy_getinfo(target->curl_handle, CURLINFO_STARTTRANSFER_TIME,
+                      &starttransfer_time);
+    curl_easy_getinfo(target->curl_handle, CURLINFO_TOTAL_TIME, &total_time);
+    lr_mirror_update_stats(mirror, size_download, starttransfer_time, total_time);
 
-    if (finished_transfers < 3)
-        return rank; // Do not judge too early
+    target->migrate_offset = lr_filewriter_offset(target->writer);
+    target->migrate_validator = g_strdup(target_range_validator(target));
 
-    rank = successful / (double) finished_transfers;
+    g_debug("%s: Migrating transfer of %s from %s at offset %"
+            G_GINT64_FORMAT, __func__, target->target->path,
+            mirror->mirror->url, target->migrate_offset);
 
-    return rank;
-}
+    target_stop_transfer(dd, target);
+    target_add_tried_mirror(target, mirror);
+    if (dd->adaptivemirrorsorting)
+        lr_mirrors_sort(target->lrmirrors, mirror, TRUE, FALSE);
 
+    target_set_state(dd, target, LR_DS_WAITING);
+}
 
-/** Sort mirrors. Penalize the error ones.
- * In fact only move the current finished mirror forward or backward
- * by one position.
- * @param mirrors   GSList of mirrors (order of list elements won't be
- *                  changed, only data pointers)
- * @param mirror    Mirror of just finished transfer
- * @param success   Was download from the mirror successful
- * @param serious   If success is FALSE, serious mean that error was serious
- *                  (like connection timeout), and the mirror should be
- *                  penalized more that usual.
+/** Migrate running transfers which are much slower than a free mirror
+ * is known to be (or than the other transfers if the throughput of the
+ * mirror is not known) to the free mirror. A stalled transfer is migrated
+ * even if there is nothing to compare it with. The migrated transfer
+ * doesn't start from the beginning, it continues at the current offset.
  */
-static gboolean
-sort_mirrors(GSList *mirrors, LrMirror *mirror, gboolean success, gboolean serious)
+static void
+migrate_transfers(LrDownload *dd)
 {
-    GSList *elem = mirrors;
-    GSList *prev = NULL;
-    GSList *next = NULL;
-    gdouble rank_cur;
+    gint64 now = g_get_monotonic_time();
+    double median = 0.0;
+
+    if (!dd->migrate_slow_transfers)
+        return;
 
-    assert(mirrors);
-    assert(mirror);
+    // Transfers are slow because of the speed limit
+    if (ratelimit_active(dd))
+        return;
 
-    for (; elem && elem->data != mirror; elem = g_slist_next(elem))
-        prev = elem;
+    if (now - dd->migrate_last_check < LR_MIGRATE_INTERVAL)
+        return;
+    dd->migrate_last_check = now;
 
-    assert(elem);  // Mirror should always exists in the list of mirrors
+    // Median speed of the running transfers
+    GArray *speeds = g_array_new(FALSE, FALSE, sizeof(double));
+    for (GList *elem = dd->running_transfers.head; elem; elem = g_list_next(elem)) {
+        LrTarget *target = elem->data;
+        double elapsed = (now - target->transfer_start) / (double) G_USEC_PER_SEC;
+        if (target->paused || elapsed < LR_MIGRATE_MIN_ELAPSED)
+            continue;
+        double speed = target->writecb_recieved / elapsed;
+        g_array_append_val(speeds, speed);
+    }
+    if (speeds->len > 1) {
+        g_array_sort(speeds, double_cmp);
+        median = g_array_index(speeds, double, speeds->len / 2);
+    }
+    g_array_free(speeds, TRUE);
 
-    next = g_slist_next(elem);
+    GList *next = NULL;
+    for (GList *elem = dd->running_transfers.head; elem; elem = next) {
+        LrTarget *target = elem->data;
+        LrMirror *mirror;
+        double elapsed, speed, reference;
+        gint64 remaining;
 
-    if (!success && !next)
-        goto exit; // Penalization not needed - Mirror is already the last one
-    if (success && !prev)
-        goto exit; // Bonus not needed - Mirror is already the first one
+        // The target could leave the queue in migrate_target()
+        next = g_list_next(elem);
 
-    // Serious errors
-    if (serious && mirror->successful_transfers == 0) {
-        // Mirror that encounter a serious error and has no successfull
-        // transfers should be moved at the end of the list
-        // (such mirror is probably down/broken/buggy)
-        GSList *last = g_slist_last(elem);
-        elem->data = last->data;
-        last->data = (gpointer) mirror;
-        g_debug("%s: Mirror %s was moved at the end", __func__, mirror->mirror->url);
-        goto exit; // No more hadling needed
-    }
+        if (!migrate_target_eligible(dd, target))
+            continue;
 
-    // Calculate ranks
-    rank_cur  = mirror_rank(mirror);
-    if (rank_cur < 0.0)
-        goto exit; // Too early to judge
+        elapsed = (now - target->transfer_start) / (double) G_USEC_PER_SEC;
+        if (elapsed < LR_MIGRATE_MIN_ELAPSED)
+            continue;
 
+        speed = target->writecb_recieved / elapsed;
+        remaining = target->target->expectedsize - target->transfer_offset
+                    - target->writecb_recieved;
+        if (remaining <= 0 || (speed > 0.0
+                               && remaining / speed < LR_MIGRATE_MIN_REMAINING))
+            continue;
 
-    if (!success) {
-        // Penalize
-        gdouble rank_next = mirror_rank(next->data);
-        if (rank_next < 0.0 || rank_next > rank_cur) {
-            elem->data = next->data;
-            next->data = (gpointer) mirror;
-            g_debug("%s: Mirror %s was penalized", __func__, mirror->mirror->url);
-        }
-    } else {
-        // Bonus
-        gdouble rank_prev = mirror_rank(prev->data);
-        if (rank_prev < rank_cur) {
-            elem->data = prev->data;
-            prev->data = mirror;
-            g_debug("%s: Mirror %s was awarded", __func__, mirror->mirror->url);
-        }
+        mirror = target_free_mirror(dd, target);
+        if (!mirror)
+            continue;
+
+        // Known throughput of the free mirror is what the transfer
+        // could get, the median is used until the mirror is measured
+        reference = mirror->throughput > 0.0 ? mirror->throughput : median;
+        if (reference > 0.0 ? speed >= reference * LR_MIGRATE_RATIO
+                            : speed > 0.0)
+            continue;
+
+        g_debug("%s: Transfer of %s is slow (%.0f B/s, %s %.0f B/s, "
+                "median %.0f B/s)", __func__, target->target->path, speed,
+                mirror->mirror->url, mirror->throughput, median);
+        migrate_target(dd, target);
     }
+}
 
-exit:
-    if (g_getenv("LIBREPO_DEBUG_ADAPTIVEMIRRORSORTING")) {
-        // Debug
-        g_debug("%s: Updated order of mirrors (for %p):", __func__, mirrors);
-        for (GSList *elem = mirrors; elem; elem = g_slist_next(elem)) {
-            LrMirror *m = elem->data;
-            g_debug(" %s (s: %d f: %d)", m->mirror->url,
-                   m->successful_transfers, m->failed_transfers);
-        }
+/** Progress callback of a segment.
+ * Reports progress of the whole segmented target.
+ */
+static int
+lr_segment_progresscb(void *clientp,
+                      G_GNUC_UNUSED double total_to_download,
+                      double now_downloaded)
+{
+    LrTarget *segment = clientp;
+    LrTarget *parent = segment->parent;
+    double downloaded = 0.0;
+
+    segment->segment_downloaded = now_downloaded;
+
+    if (parent->state != LR_DS_SEGMENTED)
+        return LR_CB_OK;
+
+    for (GSList *elem = parent->segments; elem; elem = g_slist_next(elem)) {
+        LrTarget *seg = elem->data;
+        downloaded += seg->segment_downloaded;
     }
 
-    return TRUE;
+    if (!progress_throttle_due(&parent->progress_throttle,
+                               (double) parent->target->expectedsize,
+                               downloaded,
+                               FALSE))
+        return LR_CB_OK;
+
+    return parent->target->progresscb(parent->target->cbdata,
+                                      (double) parent->target->expectedsize,
+                                      downloaded);
 }
 
+/** Mirror failure callback of a segment.
+ */
+static int
+lr_segment_mirrorfailurecb(void *clientp, const char *msg, const char *url)
+{
+    LrTarget *segment = clientp;
+    LrTarget *parent = segment->parent;
+
+    return parent->target->mirrorfailurecb(parent->target->cbdata, msg, url);
+}
 
+/** Split the target into segments if it is suitable for
+ * a segmented download. Segments are prepended to the dd->targets.
+ */
 static gboolean
-check_transfer_statuses(LrDownload *dd, GError **err)
+prepare_segments(LrDownload *dd, LrTarget *target, GError **err)
 {
-    assert(dd);
-    assert(!err || *err == NULL);
+    LrDownloadTarget *dtarget = target->target;
+    gint64 size = dtarget->expectedsize;
+    guint usable_mirrors = 0;
+    gint64 num_of_segments, segment_size;
+    int fd;
 
-    int msgs_in_queue;
-    CURLMsg *msg;
+    assert(!err || *err == NULL);
 
-    while ((msg = curl_multi_info_read(dd->multi_handle, &msgs_in_queue))) {
-        LrTarget *target = NULL;
-        char *effective_url = NULL;
-        int fd;
-        gboolean matches = TRUE;
-        GError *transfer_err = NULL;
-        GError *tmp_err = NULL;
-        gboolean ret;
-        gboolean serious_error = FALSE;
-        gboolean fatal_error = FALSE;
-        GError *fail_fast_error = NULL;
+    if (dd->max_segments < 2 || size < 2 * dd->min_segment_size)
+        return TRUE;
 
-        if (msg->msg != CURLMSG_DONE) {
-            // We are only interested in messages about finished transfers
-            continue;
-        }
+    if (!target->handle
+        || dtarget->baseurl
+        || strstr(dtarget->path, "://")
+        || dtarget->resume
+        || dtarget->byterangestart > 0
+        || dtarget->byterangeend > 0)
+        return TRUE;
 
-        // Find the target with this curl easy handle
-        for (GSList *elem = dd->running_transfers; elem; elem = g_slist_next(elem)) {
-            LrTarget *ltarget = elem->data;
-            if (ltarget->curl_handle == msg->easy_handle)
-                target = ltarget;
-        }
+    // Segments write at absolute offsets from the beginning of the file,
+    // so the supplied file descriptor has to be at its beginning
+    // and must not be opened for appending
+    if (dtarget->fd != -1
+        && (lseek(dtarget->fd, 0, SEEK_CUR) != 0
+            || (fcntl(dtarget->fd, F_GETFL) & O_APPEND)))
+        return TRUE;
 
-        assert(target);  // Each easy handle used in the multi handle
-                         // should always belong to some target from
-                         // the running_transfers list
+    for (guint i = 0; target->lrmirrors && i < target->lrmirrors->len; i++) {
+        LrMirror *mirror = g_ptr_array_index(target->lrmirrors, i);
+        LrProtocol protocol = mirror->mirror->protocol;
+        if (protocol == LR_PROTOCOL_HTTP
+            || protocol == LR_PROTOCOL_FTP
+            || protocol == LR_PROTOCOL_FILE)
+            usable_mirrors++;
+    }
 
-        curl_easy_getinfo(msg->easy_handle,
-                          CURLINFO_EFFECTIVE_URL,
-                          &effective_url);
+    if (usable_mirrors < 2)
+        return TRUE;
 
-        effective_url = g_strdup(effective_url); // Make the effetive url
-                                                  // persistent to survive
-                                                  // the curl_easy_cleanup()
+    num_of_segments = MIN(dd->max_segments, size / dd->min_segment_size);
+    segment_size = size / num_of_segments;
 
-        g_debug("%s: Transfer finished: %s (Effective url: %s)",
-                __func__, target->target->path, effective_url);
+    g_debug("%s: Downloading %s (%"G_GINT64_FORMAT" bytes) in %"
+            G_GINT64_FORMAT" segments", __func__, dtarget->path, size,
+            num_of_segments);
 
-        //
-        // Check status of finished transfer
-        //
-        ret = check_finished_transfer_status(msg, target, &serious_error,
-                                             &fatal_error, &transfer_err, err);
-        if (!ret)  // Error
+    // Prepare the file shared by all segments
+    if (dtarget->fd != -1) {
+        fd = dup(dtarget->fd);
+        if (fd == -1) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "dup(%d) failed: %s", dtarget->fd, strerror(errno));
             return FALSE;
-
-        if (transfer_err)  // Transfer was unsuccessful
-            goto transfer_error;
-
-        //
-        // Checksum checking
-        //
-        fflush(target->f);
-        fd = fileno(target->f);
-        ret = check_finished_trasfer_checksum(fd,
-                                              target->target->checksums,
-                                              &matches,
-                                              &transfer_err,
-                                              &tmp_err);
-        if (!ret) { // Error
-            g_propagate_prefixed_error(err, tmp_err, "Downloading from %s"
-                    "was successful but error encountered while "
-                    "checksuming: ", effective_url);
+        }
+    } else {
+        fd = open(dtarget->fn, O_CREAT|O_TRUNC|O_RDWR, 0666);
+        if (fd < 0) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "Cannot open %s: %s", dtarget->fn, strerror(errno));
             return FALSE;
         }
+    }
 
-        if (transfer_err)  // Checksum doesn't match
-            goto transfer_error;
+    lr_file_preallocate(fd, 0, size);
+    if (ftruncate(fd, (off_t) size) == -1) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "ftruncate() failed: %s", strerror(errno));
+        close(fd);
+        return FALSE;
+    }
 
-        //
-        // Any other checks should go here
-        //
+    target->segments_fd = fd;
+    target_set_state(dd, target, LR_DS_SEGMENTED);
+    progress_throttle_init(&target->progress_throttle,
+                           dd->progress_interval,
+                           dd->progress_delta);
+
+    for (gint64 x = 0; x < num_of_segments; x++) {
+        gint64 start = x * segment_size;
+        gint64 end = (x == num_of_segments - 1) ? size - 1
+                                                : start + segment_size - 1;
+        LrDownloadTarget *sdtarget;
+        sdtarget = lr_downloadtarget_new(target->handle,
+                        dtarget->path,
+                        NULL,
+                        fd,
+                        NULL,
+                        NULL,
+                        0,
+                        FALSE,
+                        dtarget->progresscb ? lr_segment_progresscb : NULL,
+                        NULL,
+                        NULL,
+                        dtarget->mirrorfailurecb ? lr_segment_mirrorfailurecb : NULL,
+                        NULL,
+                        start,
+                        end);
+
+        LrTarget *segment = lr_malloc0(sizeof(*segment));
+        segment->state           = LR_DS_WAITING;
+        segment->target          = sdtarget;
+        segment->original_offset = -1;
+        segment->resume          = FALSE;
+        segment->handle          = target->handle;
+        segment->lrmirrors       = target->lrmirrors;
+        segment->handle_mirrors  = target->handle_mirrors;
+        segment->parent          = target;
+        segment->segments_fd     = -1;
+        segment->fd              = -1;
+        sdtarget->rcode          = LRE_UNFINISHED;
+        sdtarget->err            = "Not finished";
+        sdtarget->cbdata         = segment;
+        sdtarget->priority       = dtarget->priority;
+
+        target->segments = g_slist_append(target->segments, segment);
+        dd->targets = g_slist_prepend(dd->targets, segment);
+    }
 
-transfer_error:
+    return TRUE;
+}
 
-        //
-        // Cleanup
-        //
-        curl_multi_remove_handle(dd->multi_handle, target->curl_handle);
-        curl_easy_cleanup(target->curl_handle);
-        target->curl_handle = NULL;
-        g_free(target->headercb_interrupt_reason);
-        target->headercb_interrupt_reason = NULL;
-        fclose(target->f);
-        target->f = NULL;
-
-        dd->running_transfers = g_slist_remove(dd->running_transfers,
-                                               (gconstpointer) target);
-        target->tried_mirrors = g_slist_append(target->tried_mirrors,
-                                               target->mirror);
-
-        if (transfer_err) {  // There was an error during transfer
-            int complete_url_in_path = strstr(target->target->path, "://") ? 1 : 0;
-            guint num_of_tried_mirrors = g_slist_length(target->tried_mirrors);
-
-            g_debug("%s: Error during transfer: %s", __func__, transfer_err->message);
-
-            // Update mirror statistics
-            if (target->mirror) {
-                target->mirror->failed_transfers++;
-                if (dd->adaptivemirrorsorting)
-                    sort_mirrors(target->lrmirrors, target->mirror, FALSE, serious_error);
-            }
+/** Size of the target used for scheduling or 0 if it is unknown.
+ */
+static gint64
+target_schedule_size(LrTarget *target)
+{
+    LrDownloadTarget *dtarget = target->target;
 
-            // Call mirrorfailure callback
-            LrMirrorFailureCb mf_cb =  target->target->mirrorfailurecb;
-            if (mf_cb) {
-                int rc = mf_cb(target->target->cbdata,
-                               transfer_err->message,
-                               effective_url);
-                if (rc == LR_CB_ABORT) {
-                    // User wants to abort this download, so make the error fatal
-                    fatal_error = TRUE;
-                } else if (rc == LR_CB_ERROR) {
-                    gchar *original_err_msg = g_strdup(transfer_err->message);
-                    g_clear_error(&transfer_err);
-                    g_debug("%s: Downloading was aborted by LR_CB_ERROR from "
-                            "mirror failure callback. Original error was: "
-                            "%s", __func__, original_err_msg);
-                    g_set_error(&transfer_err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
-                                "Downloading was aborted by LR_CB_ERROR from "
-                                "mirror failure callback. Original error was: "
-                                "%s", original_err_msg);
-                    g_free(original_err_msg);
-                    fatal_error = TRUE;
-                    target->cb_return_code = LR_CB_ERROR;
-                }
-            }
+    if (dtarget->byterangeend > dtarget->byterangestart)
+        return dtarget->byterangeend - dtarget->byterangestart + 1;
+    return dtarget->expectedsize;
+}
 
-            if (!fatal_error &&
-                !complete_url_in_path &&
-                !target->target->baseurl &&
-                (dd->max_mirrors_to_try <= 0 ||
-                 num_of_tried_mirrors < dd->max_mirrors_to_try))
-            {
-                // Try another mirror
-                g_debug("%s: Ignore error - Try another mirror", __func__);
-                target->state = LR_DS_WAITING;
-                g_error_free(transfer_err);  // Ignore the error
+static gint
+target_schedule_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const LrTarget *ta = a;
+    const LrTarget *tb = b;
+    LrSchedulingPolicy policy = GPOINTER_TO_INT(user_data);
 
-                // Truncate file - remove downloaded garbage (error html page etc.)
-                if (!truncate_transfer_file(target, err))
-                    return FALSE;
-            } else {
-                // No more mirrors to try or baseurl used or fatal error
-                g_debug("%s: No more retries (tried: %d)",
-                        __func__, num_of_tried_mirrors);
-                target->state = LR_DS_FAILED;
-
-                // Call end callback
-                LrEndCb end_cb =  target->target->endcb;
-                if (end_cb) {
-                    int rc = end_cb(target->target->cbdata,
-                                    LR_TRANSFER_ERROR,
-                                    transfer_err->message);
-                    if (rc == LR_CB_ERROR) {
-                        target->cb_return_code = LR_CB_ERROR;
-                        g_debug("%s: Downloading was aborted by LR_CB_ERROR "
-                                "from end callback", __func__);
-                    }
-                }
+    // Higher priority first
+    if (ta->target->priority != tb->target->priority)
+        return (ta->target->priority > tb->target->priority) ? -1 : 1;
 
-                lr_downloadtarget_set_error(target->target,
-                                            transfer_err->code,
-                                            "Download failed: %s",
-                                            transfer_err->message);
-                if (dd->failfast) {
-                    // Fail fast is enabled, fail on any error
-                    g_propagate_error(&fail_fast_error, transfer_err);
-                } else if (target->cb_return_code == LR_CB_ERROR) {
-                    // Callback returned LR_CB_ERROR, abort the downloading
-                    g_debug("%s: Downloading was aborted by LR_CB_ERROR", __func__);
-                    g_propagate_error(&fail_fast_error, transfer_err);
-                } else {
-                    // Fail fast is disabled and callback doesn't repor serious
-                    // error, so this download is aborted, but other download
-                    // can continue (do not abort whole downloading)
-                    g_error_free(transfer_err);
-                }
+    if (policy == LR_SCHEDULING_FIFO)
+        return 0;
+
+    // Larger first
+    gint64 size_a = target_schedule_size((LrTarget *) ta);
+    gint64 size_b = target_schedule_size((LrTarget *) tb);
+    if (size_a != size_b)
+        return (size_a > size_b) ? -1 : 1;
+
+    return 0;
+}
+
+/** Put the waiting targets to the queues of waiting targets in order
+ * given by their priority and by the scheduling policy and set their
+ * rank. Segments of a segmented target take its place. Targets
+ * scheduled later are queued behind the already scheduled ones.
+ */
+static void
+schedule_targets(LrDownload *dd, GSList *targets)
+{
+    GSList *waiting = NULL;
+
+    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
+        LrTarget *target = elem->data;
+
+        if (target->parent)
+            continue;  // Segments are added together with their parent
+
+        if (target->state == LR_DS_SEGMENTED) {
+            for (GSList *s = target->segments; s; s = g_slist_next(s))
+                waiting = g_slist_prepend(waiting, s->data);
+        } else if (target->state == LR_DS_WAITING) {
+            waiting = g_slist_prepend(waiting, target);
+        }
+    }
+
+    waiting = g_slist_reverse(waiting);
+
+    // The sort is stable - targets with the same priority (and size)
+    // keep the order in which they were passed
+    waiting = g_slist_sort_with_data(waiting,
+                                     target_schedule_cmp,
+                                     GINT_TO_POINTER(dd->scheduling_policy));
+
+    if (dd->scheduling_policy == LR_SCHEDULING_BALANCED) {
+        // Alternate the largest and the smallest targets
+        // among the targets with the same priority
+        GSList *balanced = NULL;
+        GSList *elem = waiting;
+
+        while (elem) {
+            GPtrArray *group = g_ptr_array_new();
+            int priority = ((LrTarget *) elem->data)->target->priority;
+
+            for (; elem; elem = g_slist_next(elem)) {
+                LrTarget *target = elem->data;
+                if (target->target->priority != priority)
+                    break;
+                g_ptr_array_add(group, target);
+            }
+
+            guint lo = 0, hi = group->len;
+            while (lo < hi) {
+                balanced = g_slist_prepend(balanced,
+                                           g_ptr_array_index(group, lo++));
+                if (lo < hi)
+                    balanced = g_slist_prepend(balanced,
+                                               g_ptr_array_index(group, --hi));
+            }
+
+            g_ptr_array_free(group, TRUE);
+        }
+
+        g_slist_free(waiting);
+        waiting = g_slist_reverse(balanced);
+    }
+
+    for (GSList *elem = waiting; elem; elem = g_slist_next(elem)) {
+        LrTarget *target = elem->data;
+        target->rank = dd->next_rank++;
+        target_set_state(dd, target, LR_DS_WAITING);
+    }
+
+    g_slist_free(waiting);
+}
+
+/** Report statistics of the segments in the download target of the
+ * segmented target. Timing of the first segment is used, the total time
+ * is the time of the longest segment.
+ */
+static void
+segments_stats_record(LrTarget *target)
+{
+    LrDownloadTarget *dtarget = target->target;
+    LrDownloadTarget *first = ((LrTarget *) target->segments->data)->target;
+
+    dtarget->namelookup_time = first->namelookup_time;
+    dtarget->connect_time = first->connect_time;
+    dtarget->appconnect_time = first->appconnect_time;
+    dtarget->starttransfer_time = first->starttransfer_time;
+    dtarget->total_time = 0.0;
+    dtarget->bytes_received = 0;
+    dtarget->mirrors_tried = 0;
+
+    for (GSList *elem = target->segments; elem; elem = g_slist_next(elem)) {
+        LrDownloadTarget *sdtarget = ((LrTarget *) elem->data)->target;
+        dtarget->total_time = MAX(dtarget->total_time, sdtarget->total_time);
+        dtarget->bytes_received += sdtarget->bytes_received;
+        dtarget->mirrors_tried = MAX(dtarget->mirrors_tried,
+                                     sdtarget->mirrors_tried);
+    }
+
+    dtarget->average_speed = dtarget->total_time > 0.0
+                             ? dtarget->bytes_received / dtarget->total_time
+                             : 0.0;
+}
+
+/** Finish the segmented target if all its segments are finished
+ * or some of them failed.
+ */
+static gboolean
+check_segmented_target(LrDownload *dd, LrTarget *target, GError **err)
+{
+    LrTarget *failed_segment = NULL;
+    gboolean all_finished = TRUE;
+    GError *transfer_err = NULL;
+    gboolean matches = TRUE;
+
+    assert(!err || *err == NULL);
+
+    if (target->state != LR_DS_SEGMENTED)
+        return TRUE;  // Already finished
+
+    for (GSList *elem = target->segments; elem; elem = g_slist_next(elem)) {
+        LrTarget *segment = elem->data;
+        if (segment->state == LR_DS_FAILED && !failed_segment)
+            failed_segment = segment;
+        if (segment->state != LR_DS_FINISHED)
+            all_finished = FALSE;
+    }
+
+    if (!failed_segment && !all_finished)
+        return TRUE;  // Some segments are still being downloaded
+
+    segments_stats_record(target);
+
+    if (failed_segment) {
+        // Other segments are not needed anymore, stop the running
+        // ones so they don't write to the file of the failed target
+        for (GSList *elem = target->segments; elem; elem = g_slist_next(elem)) {
+            LrTarget *segment = elem->data;
+            if (segment->state == LR_DS_WAITING
+                || segment->state == LR_DS_RUNNING)
+            {
+                if (segment->running_link)
+                    target_stop_transfer(dd, segment);
+                target_set_state(dd, segment, LR_DS_FAILED);
+                lr_downloadtarget_set_error(segment->target, LRE_UNFINISHED,
+                                            "Not finished - another segment "
+                                            "failed");
+            }
+        }
+
+        g_set_error(&transfer_err, LR_DOWNLOADER_ERROR,
+                    failed_segment->target->rcode,
+                    "Segment %"G_GINT64_FORMAT"-%"G_GINT64_FORMAT" failed: %s",
+                    failed_segment->target->byterangestart,
+                    failed_segment->target->byterangeend,
+                    failed_segment->target->err);
+    } else {
+        // All segments are downloaded - check the whole file
+        GError *tmp_err = NULL;
+        if (!check_finished_trasfer_checksum(target->segments_fd,
+                                             target->target->checksums,
+                                             NULL,
+                                             dd->iouring,
+                                             &matches,
+                                             &transfer_err,
+                                             &tmp_err))
+        {
+            g_propagate_prefixed_error(err, tmp_err, "Segmented download of "
+                    "%s was successful but error encountered while "
+                    "checksuming: ", target->target->path);
+            return FALSE;
+        }
+    }
+
+    if (transfer_err) {
+        target_set_state(dd, target, LR_DS_FAILED);
+
+        LrEndCb end_cb = target->target->endcb;
+        if (end_cb) {
+            int rc = end_cb(target->target->cbdata,
+                            LR_TRANSFER_ERROR,
+                            transfer_err->message);
+            if (rc == LR_CB_ERROR) {
+                target->cb_return_code = LR_CB_ERROR;
+                g_debug("%s: Downloading was aborted by LR_CB_ERROR "
+                        "from end callback", __func__);
             }
+        }
+
+        lr_downloadtarget_set_error(target->target,
+                                    transfer_err->code,
+                                    "Download failed: %s",
+                                    transfer_err->message);
+
+        if (dd->failfast || target->cb_return_code == LR_CB_ERROR) {
+            g_propagate_error(err, transfer_err);
+            return FALSE;
+        }
+
+        g_error_free(transfer_err);
+        return TRUE;
+    }
+
+    // Success
+    LrTarget *first_segment = target->segments->data;
+    target_set_state(dd, target, LR_DS_FINISHED);
+    lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
+    if (first_segment->target->usedmirror)
+        lr_downloadtarget_set_usedmirror(target->target,
+                                         first_segment->target->usedmirror);
+    if (first_segment->target->effectiveurl)
+        lr_downloadtarget_set_effectiveurl(target->target,
+                                           first_segment->target->effectiveurl);
+
+    remove_librepo_xattr(target->segments_fd);
+
+    LrEndCb end_cb = target->target->endcb;
+    if (end_cb) {
+        int rc = end_cb(target->target->cbdata,
+                        LR_TRANSFER_SUCCESSFUL,
+                        NULL);
+        if (rc == LR_CB_ERROR) {
+            target->cb_return_code = LR_CB_ERROR;
+            g_debug("%s: Downloading was aborted by LR_CB_ERROR "
+                    "from end callback", __func__);
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
+                        "Interupted by LR_CB_ERROR from end callback");
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/** Get the next message about a finished transfer from the multi handle
+ * or from the worker threads.
+ * @param buf       Buffer for the message from the worker threads
+ * @return          Message or NULL if no transfer is finished
+ */
+static CURLMsg *
+next_transfer_message(LrDownload *dd, CURLMsg *buf)
+{
+    int msgs_in_queue;
+    LrTarget *target = NULL;
+
+    if (!dd->workers)
+        return curl_multi_info_read(dd->multi_handle, &msgs_in_queue);
+
+    memset(buf, 0, sizeof(*buf));
+    if (!lr_workerpool_pop_finished(dd->workers,
+                                    &buf->easy_handle,
+                                    &buf->data.result))
+        return NULL;
+    buf->msg = CURLMSG_DONE;
+
+    // The last progress of the transfer was reported by the worker
+    // before it finished the transfer
+    curl_easy_getinfo(buf->easy_handle, CURLINFO_PRIVATE, (char **) &target);
+    if (target)
+        deliver_progress(target);
+
+    return buf;
+}
+
+/** Max number of threads which verify checksums of finished transfers */
+#define LR_VERIFY_MAX_THREADS           4
+
+/** Result of a finished transfer. If the checksum of the transfer has
+ * to be calculated from the whole file, the structure is passed to
+ * the verification pool and processed later by finish_transfer().
+ */
+typedef struct {
+    LrTarget *target; /*!<
+        Target of the transfer */
+    CURLcode result; /*!<
+        Result of the transfer reported by curl */
+    char *effective_url; /*!<
+        Effective URL of the transfer */
+    double size_download; /*!<
+        Downloaded bytes (CURLINFO_SIZE_DOWNLOAD) */
+    double namelookup_time; /*!<
+        Time to resolve the host (CURLINFO_NAMELOOKUP_TIME) */
+    double connect_time; /*!<
+        Time to connect (CURLINFO_CONNECT_TIME) */
+    double appconnect_time; /*!<
+        Time to finish the TLS handshake (CURLINFO_APPCONNECT_TIME) */
+    double starttransfer_time; /*!<
+        Time to the first byte (CURLINFO_STARTTRANSFER_TIME) */
+    double total_time; /*!<
+        Duration of the transfer (CURLINFO_TOTAL_TIME) */
+    gboolean serious_error; /*!<
+        See check_finished_transfer_status() */
+    gboolean fatal_error; /*!<
+        See check_finished_transfer_status() */
+    int fd; /*!<
+        Descriptor of the downloaded file used by the verification
+        pool or -1 if the checksum was verified by the download loop.
+        Descriptor of the source file of a local copy. */
+    gchar *source_path; /*!<
+        Path of the source file of a local copy, which is opened by
+        the verification pool, or NULL */
+    gboolean local; /*!<
+        The file was copied from a local mirror (see start_local_copy()) */
+    GSList *streamed_checksums; /*!<
+        Checksums calculated during the transfer */
+    gboolean iouring; /*!<
+        The file is read by io_uring (see LRO_IOURING) */
+    gboolean matches; /*!<
+        The checksum matches */
+    GError *transfer_err; /*!<
+        Error of the transfer (a failed transfer, a bad checksum) */
+    GError *err; /*!<
+        Error encountered while checksuming */
+} LrFinishedTransfer;
+
+static void
+finished_transfer_free(LrFinishedTransfer *ft)
+{
+    if (!ft)
+        return;
+    if (ft->fd != -1)
+        close(ft->fd);
+    g_free(ft->source_path);
+    g_free(ft->effective_url);
+    g_slist_free_full(ft->streamed_checksums,
+                      (GDestroyNotify) lr_downloadtargetchecksum_free);
+    if (ft->transfer_err)
+        g_error_free(ft->transfer_err);
+    if (ft->err)
+        g_error_free(ft->err);
+    g_free(ft);
+}
+
+/** Pass the verified transfer to the download loop and wake the loop up.
+ * Called by the threads of the verification pool.
+ */
+static void
+verified_push(LrDownload *dd, LrFinishedTransfer *ft)
+{
+    g_async_queue_push(dd->verified, ft);
+
+    // Errors are ignored, the pipe is non-blocking and a full pipe
+    // wakes up the loop as well (no logging, this is a foreign thread)
+    ssize_t G_GNUC_UNUSED written = write(dd->verified_pipe[1], "x", 1);
+
+    if (dd->workers)
+        lr_workerpool_wakeup(dd->workers);
+}
+
+/** Copy the file of a local mirror to the target. The source file is
+ * left open in ft->fd for the verification of its checksum.
+ * Called by the threads of the verification pool.
+ * @return          TRUE if the file was copied, FALSE if
+ *                  ft->transfer_err is set
+ */
+static gboolean
+copy_local_file(LrFinishedTransfer *ft)
+{
+    LrDownloadTarget *dtarget = ft->target->target;
+    struct stat st;
+    int fd;
+
+    ft->fd = open(ft->source_path, O_RDONLY|O_CLOEXEC);
+    if (ft->fd == -1) {
+        // Not fatal, the next mirror is tried
+        g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "Cannot open %s: %s",
+                    ft->source_path, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (dtarget->fd != -1) {
+        // Use supplied filedescriptor
+        fd = fcntl(dtarget->fd, F_DUPFD_CLOEXEC, 0);
+        if (fd == -1) {
+            g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "dup(%d) failed: %s", dtarget->fd, g_strerror(errno));
+            ft->fatal_error = TRUE;
+            return FALSE;
+        }
+    } else {
+        // Use supplied filename
+        fd = open(dtarget->fn, O_CREAT|O_TRUNC|O_RDWR|O_CLOEXEC, 0666);
+        if (fd == -1) {
+            g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "Cannot open %s: %s", dtarget->fn, g_strerror(errno));
+            ft->fatal_error = TRUE;
+            return FALSE;
+        }
+    }
+
+    if (ftruncate(fd, 0) == -1) {
+        g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "ftruncate() failed: %s", g_strerror(errno));
+        ft->fatal_error = TRUE;
+        close(fd);
+        return FALSE;
+    }
+
+    // The same as add_librepo_xattr(), but without logging
+    // from this thread
+    fsetxattr(fd, XATTR_LIBREPO, "", 1, 0);
+
+    if (lr_copy_content(ft->fd, fd) == -1) {
+        g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "Cannot copy %s: %s",
+                    ft->effective_url, g_strerror(errno));
+        ft->fatal_error = TRUE;
+        close(fd);
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) == 0)
+        ft->size_download = (double) st.st_size;
+    close(fd);
+
+    return TRUE;
+}
+
+/** Verify checksum of the finished transfer (copy the file first in case
+ * of a local copy). Called by the threads of the verification pool.
+ */
+static void
+verify_worker(gpointer data, gpointer user_data)
+{
+    LrFinishedTransfer *ft = data;
+    LrDownload *dd = user_data;
+
+    // The threads of the pool are shared, attach the queue only
+    // for this transfer
+    lr_logqueue_attach(dd->log);
+
+    if (ft->local) {
+        gboolean copied = copy_local_file(ft);
+
+        ft->total_time = (g_get_monotonic_time() - ft->target->transfer_start)
+                         / (double) G_USEC_PER_SEC;
+
+        if (!copied) {
+            lr_logqueue_attach(NULL);
+            verified_push(dd, ft);
+            return;
+        }
+    }
+
+    // Checksum of a local copy is calculated from the source file,
+    // so a checksum cached in its extended attributes is used
+    check_finished_trasfer_checksum(ft->fd,
+                                    ft->target->target->checksums,
+                                    ft->streamed_checksums,
+                                    ft->iouring,
+                                    &ft->matches,
+                                    &ft->transfer_err,
+                                    &ft->err);
+    lr_logqueue_attach(NULL);
+    verified_push(dd, ft);
+}
+
+/** Does the verification of the checksums need to read the whole file?
+ * (Some of the checksums wasn't calculated during the transfer.)
+ */
+static gboolean
+checksums_need_file(GSList *checksums, GSList *streamed_checksums)
+{
+    for (GSList *elem = checksums; elem; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *chksum = elem->data;
+        gboolean streamed = FALSE;
+
+        if (!chksum || !chksum->value || chksum->type == LR_CHECKSUM_UNKNOWN)
+            continue;  // Bad checksum
+
+        for (GSList *el = streamed_checksums; el; el = g_slist_next(el)) {
+            LrDownloadTargetChecksum *s_chksum = el->data;
+            if (s_chksum->type == chksum->type)
+                streamed = TRUE;
+        }
+
+        if (!streamed)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/** Pass the finished transfer (or the local copy) to the verification
+ * pool. The result is processed by check_transfer_statuses().
+ */
+static void
+verify_pool_push(LrDownload *dd, LrFinishedTransfer *ft)
+{
+    if (!dd->verify_pool) {
+        dd->verified = g_async_queue_new();
+        dd->verify_pool = g_thread_pool_new(verify_worker,
+                                            dd,
+                                            LR_VERIFY_MAX_THREADS,
+                                            FALSE,
+                                            NULL);
+    }
+
+    target_set_state(dd, ft->target, LR_DS_VERIFYING);
+    dd->verifying++;
+    g_thread_pool_push(dd->verify_pool, ft, NULL);
+}
+
+/** Pass the finished transfer to the verification pool if its checksum
+ * has to be calculated from the whole file. The transfer is stopped,
+ * so its slot could be used by a waiting target in the meantime.
+ * @return          TRUE if the transfer was passed to the pool,
+ *                  FALSE if the checksum should be verified directly
+ */
+static gboolean
+verify_in_background(LrDownload *dd, LrFinishedTransfer *ft)
+{
+    LrTarget *target = ft->target;
+
+    if (target->hedge_of
+        || !checksums_need_file(target->target->checksums,
+                                ft->streamed_checksums))
+        return FALSE;
+
+    // The file is read by pread() (or io_uring) from a duplicate of
+    // the user's descriptor, so its position is not changed
+    ft->fd = fcntl(target->fd, F_DUPFD_CLOEXEC, 0);
+    if (ft->fd == -1) {
+        g_debug("%s: Cannot duplicate fd %d: %s",
+                __func__, target->fd, g_strerror(errno));
+        return FALSE;
+    }
+
+    g_debug("%s: Verifying checksum of %s", __func__, target->target->path);
+
+    // Original transfer finished before the hedged one
+    hedge_discard(dd, target);
+
+    target_stop_transfer(dd, target);
+    verify_pool_push(dd, ft);
+
+    return TRUE;
+}
+
+/** Report statistics of the finished transfer in the download target.
+ * Timing is of the last transfer, received bytes are summed up.
+ * @param dtarget       Download target
+ * @param ft            Finished transfer
+ * @param tried_mirrors Number of mirrors tried so far
+ */
+static void
+transfer_stats_record(LrDownloadTarget *dtarget,
+                      LrFinishedTransfer *ft,
+                      guint tried_mirrors)
+{
+    dtarget->namelookup_time = ft->namelookup_time;
+    dtarget->connect_time = ft->connect_time;
+    dtarget->appconnect_time = ft->appconnect_time;
+    dtarget->starttransfer_time = MAX(ft->starttransfer_time, 0.0);
+    dtarget->total_time = ft->total_time;
+    dtarget->average_speed = ft->total_time > 0.0
+                             ? ft->size_download / ft->total_time : 0.0;
+    dtarget->bytes_received += (gint64) ft->size_download;
+    dtarget->mirrors_tried = (int) tried_mirrors;
+}
+
+/** Process the result of the finished transfer - retry the target
+ * from another mirror or finish it.
+ * @return          FALSE if the whole download has to be interrupted
+ */
+static gboolean
+finish_transfer(LrDownload *dd, LrFinishedTransfer *ft, GError **err)
+{
+    LrTarget *target = ft->target;
+    char *effective_url = ft->effective_url;
+    gboolean fatal_error = ft->fatal_error;
+    GError *transfer_err = ft->transfer_err;
+    GError *fail_fast_error = NULL;
+
+    ft->transfer_err = NULL;
+
+    if (ft->err) {
+        g_propagate_prefixed_error(err, ft->err, "Downloading from %s"
+                "was successful but error encountered while "
+                "checksuming: ", effective_url);
+        ft->err = NULL;
+        if (transfer_err)
+            g_error_free(transfer_err);
+        return FALSE;
+    }
+
+    // Store validators of the new content of the conditional
+    // target for the next conditional request
+    if (!transfer_err
+        && target->target->conditional
+        && !target->notmodified
+        && !target->parent
+        && !target->hedge_of)
+    {
+        int fd = ft->fd != -1 ? ft->fd : target->fd;
+        _cleanup_free_ gchar *validators_fn = validators_filename(target, fd);
+        store_validators(fd, validators_fn,
+                         target->etag, target->lastmodified);
+    }
+
+    //
+    // Cleanup
+    //
+    if (target->running_link)
+        target_stop_transfer(dd, target);
+    if (dd->adaptive_concurrency
+        && adaptive_is_congestion_error(ft->result))
+        dd->adaptive.failures++;
+
+    if (transfer_err
+        && target->migrated
+        && ft->result == CURLE_RANGE_ERROR)
+    {
+        // The file on the mirror doesn't match the data downloaded
+        // before the migration (If-Range) or the mirror doesn't
+        // support ranges. It's not a failure of the mirror,
+        // download the whole file again.
+        g_debug("%s: Migrated transfer of %s cannot continue: %s",
+                __func__, target->target->path, transfer_err->message);
+        g_clear_error(&transfer_err);
+        target_set_state(dd, target, LR_DS_WAITING);
+        return truncate_transfer_file(target, err);
+    }
 
+    if (transfer_err && target->notmodified) {
+        // The existing file of the conditional target doesn't match
+        // (e.g. it was modified localy). It's not a failure of the
+        // mirror, download the whole file again.
+        g_debug("%s: Not modified file %s cannot be used: %s",
+                __func__, target->target->path, transfer_err->message);
+        g_clear_error(&transfer_err);
+        target_set_state(dd, target, LR_DS_WAITING);
+        target->conditional = FALSE;
+        return truncate_transfer_file(target, err);
+    }
+
+    target_add_tried_mirror(target, target->mirror);
+    if (!target->hedge_of)
+        transfer_stats_record(target->target, ft, target->tried_mirrors_count);
+
+    if (target->hedge_of) {
+        // Hedged transfer finished before the original one
+        LrTarget *original = target->hedge_of;
+
+        // Replace the file of the original target
+        if (!transfer_err
+            && rename(target->target->fn, original->target->fn) == -1)
+            g_set_error(&transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "Cannot rename %s to %s: %s",
+                        target->target->fn, original->target->fn,
+                        g_strerror(errno));
+
+        if (transfer_err && original->state != LR_DS_HEDGED) {
+            // Just drop the hedged transfer, the original continues
+            g_debug("%s: Hedged transfer failed: %s",
+                    __func__, transfer_err->message);
+            if (target->mirror)
+                target->mirror->failed_transfers++;
+            g_error_free(transfer_err);
+            hedge_discard(dd, original);
+            return TRUE;
+        }
+
+        if (transfer_err) {
+            // The original transfer failed before, so the failure
+            // of the hedged one is the failure of the target
+            LrMirror *mirror = target->mirror;
+            hedge_discard(dd, original);
+            target_add_tried_mirror(original, mirror);
+            transfer_stats_record(original->target, ft,
+                                  original->tried_mirrors_count);
+            original->mirror = mirror;
+            target = original;
         } else {
-            // No error encountered, transfer finished successfully
-            target->state = LR_DS_FINISHED;
+            // Cancel the original transfer (if it still runs) and finish
+            // the original target as it was downloaded from the mirror
+            // of the hedge
+            g_debug("%s: Hedged transfer of %s won",
+                    __func__, original->target->path);
+            target_set_state(dd, target, LR_DS_FINISHED);
             lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
-            if (target->mirror)
-                lr_downloadtarget_set_usedmirror(target->target,
-                                                 target->mirror->mirror->url);
-            lr_downloadtarget_set_effectiveurl(target->target,
-                                               effective_url);
+            if (original->running_link)
+                target_stop_transfer(dd, original);
+            transfer_stats_record(original->target, ft,
+                                  target->tried_mirrors_count);
+            original->mirror = target->mirror;
+            original->hedge = NULL;
+            target = original;
+        }
+    } else if (target->hedge && !transfer_err) {
+        // Original transfer finished before the hedged one
+        hedge_discard(dd, target);
+    }
+
+    if (transfer_err) {  // There was an error during transfer
+        int complete_url_in_path = strstr(target->target->path, "://") ? 1 : 0;
+        guint num_of_tried_mirrors = target->tried_mirrors_count;
+
+        g_debug("%s: Error during transfer: %s", __func__, transfer_err->message);
+
+        // Update mirror statistics
+        if (target->mirror) {
+            target->mirror->failed_transfers++;
+            if (dd->adaptivemirrorsorting)
+                lr_mirrors_sort(target->lrmirrors, target->mirror, FALSE, ft->serious_error);
+        }
+
+        // Call mirrorfailure callback
+        LrMirrorFailureCb mf_cb =  target->target->mirrorfailurecb;
+        if (mf_cb) {
+            int rc = mf_cb(target->target->cbdata,
+                           transfer_err->message,
+                           effective_url);
+            if (rc == LR_CB_ABORT) {
+                // User wants to abort this download, so make the error fatal
+                fatal_error = TRUE;
+            } else if (rc == LR_CB_ERROR) {
+                gchar *original_err_msg = g_strdup(transfer_err->message);
+                g_clear_error(&transfer_err);
+                g_debug("%s: Downloading was aborted by LR_CB_ERROR from "
+                        "mirror failure callback. Original error was: "
+                        "%s", __func__, original_err_msg);
+                g_set_error(&transfer_err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
+                            "Downloading was aborted by LR_CB_ERROR from "
+                            "mirror failure callback. Original error was: "
+                            "%s", original_err_msg);
+                g_free(original_err_msg);
+                fatal_error = TRUE;
+                target->cb_return_code = LR_CB_ERROR;
+            }
+        }
 
-            // Remove xattr that states that the file is being downloaded
-            // by librepo, because the file is now completly downloaded
-            // and the xattr is not needed (is is useful only for resuming)
-            remove_librepo_xattr(target->target->fd);
+        if (target->hedge
+            && target->hedge->state == LR_DS_RUNNING
+            && !fatal_error)
+        {
+            // The hedged transfer continues as the transfer of the target,
+            // the data it downloaded so far are not thrown away
+            g_debug("%s: Hedged transfer of %s continues",
+                    __func__, target->target->path);
+            target_set_state(dd, target, LR_DS_HEDGED);
+            g_error_free(transfer_err);
+            return TRUE;
+        }
+        hedge_discard(dd, target);
+
+        if (!fatal_error &&
+            !complete_url_in_path &&
+            !target->target->baseurl &&
+            (dd->max_mirrors_to_try <= 0 ||
+             num_of_tried_mirrors < dd->max_mirrors_to_try))
+        {
+            // Try another mirror
+            g_debug("%s: Ignore error - Try another mirror", __func__);
+            target_set_state(dd, target, LR_DS_WAITING);
+            g_error_free(transfer_err);  // Ignore the error
+
+            // Truncate file - remove downloaded garbage (error html page etc.)
+            if (!truncate_transfer_file(target, err))
+                return FALSE;
+        } else {
+            // No more mirrors to try or baseurl used or fatal error
+            g_debug("%s: No more retries (tried: %d)",
+                    __func__, num_of_tried_mirrors);
+            target_set_state(dd, target, LR_DS_FAILED);
 
             // Call end callback
-            LrEndCb end_cb = target->target->endcb;
+            LrEndCb end_cb =  target->target->endcb;
             if (end_cb) {
                 int rc = end_cb(target->target->cbdata,
-                                LR_TRANSFER_SUCCESSFUL,
-                                NULL);
+                                LR_TRANSFER_ERROR,
+                                transfer_err->message);
                 if (rc == LR_CB_ERROR) {
                     target->cb_return_code = LR_CB_ERROR;
                     g_debug("%s: Downloading was aborted by LR_CB_ERROR "
                             "from end callback", __func__);
-                    g_set_error(&fail_fast_error, LR_DOWNLOADER_ERROR,
-                                LRE_CBINTERRUPTED,
-                                "Interupted by LR_CB_ERROR from end callback");
                 }
             }
 
-            // Update mirror statistics
-            if (target->mirror) {
-                target->mirror->successful_transfers++;
-                if (dd->adaptivemirrorsorting)
-                    sort_mirrors(target->lrmirrors, target->mirror, TRUE, serious_error);
+            lr_downloadtarget_set_error(target->target,
+                                        transfer_err->code,
+                                        "Download failed: %s",
+                                        transfer_err->message);
+            if (dd->failfast) {
+                // Fail fast is enabled, fail on any error
+                g_propagate_error(&fail_fast_error, transfer_err);
+            } else if (target->cb_return_code == LR_CB_ERROR) {
+                // Callback returned LR_CB_ERROR, abort the downloading
+                g_debug("%s: Downloading was aborted by LR_CB_ERROR", __func__);
+                g_propagate_error(&fail_fast_error, transfer_err);
+            } else {
+                // Fail fast is disabled and callback doesn't repor serious
+                // error, so this download is aborted, but other download
+                // can continue (do not abort whole downloading)
+                g_error_free(transfer_err);
             }
         }
 
-        lr_free(effective_url);
+    } else {
+        // No error encountered, transfer finished successfully
+        double progress_total, progress_now;
+
+        // Pass the last report skipped by the coalescing of reports
+        if (target->target->progresscb
+            && progress_throttle_flush(&target->progress_throttle,
+                                       &progress_total,
+                                       &progress_now))
+            target->target->progresscb(target->target->cbdata,
+                                       progress_total,
+                                       progress_now);
+
+        target_set_state(dd, target, LR_DS_FINISHED);
+        if (dd->hedged_requests && !target->parent) {
+            double duration = (g_get_monotonic_time() - target->transfer_start)
+                              / (double) G_USEC_PER_SEC;
+            g_array_append_val(dd->hedging.durations, duration);
+        }
+        lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
+        target->target->notmodified = target->notmodified;
+        if (target->mirror)
+            lr_downloadtarget_set_usedmirror(target->target,
+                                             target->mirror->mirror->url);
+        lr_downloadtarget_set_effectiveurl(target->target,
+                                           effective_url);
+
+        // Remove xattr that states that the file is being downloaded
+        // by librepo, because the file is now completly downloaded
+        // and the xattr is not needed (is is useful only for resuming)
+        remove_librepo_xattr(target->target->fd);
+
+        // Call end callback
+        LrEndCb end_cb = target->target->endcb;
+        if (end_cb) {
+            int rc = end_cb(target->target->cbdata,
+                            LR_TRANSFER_SUCCESSFUL,
+                            NULL);
+            if (rc == LR_CB_ERROR) {
+                target->cb_return_code = LR_CB_ERROR;
+                g_debug("%s: Downloading was aborted by LR_CB_ERROR "
+                        "from end callback", __func__);
+                g_set_error(&fail_fast_error, LR_DOWNLOADER_ERROR,
+                            LRE_CBINTERRUPTED,
+                            "Interupted by LR_CB_ERROR from end callback");
+            }
+        }
+
+        // Update mirror statistics
+        if (target->mirror) {
+            target->mirror->successful_transfers++;
+            lr_mirror_update_stats(target->mirror, ft->size_download,
+                                   ft->starttransfer_time, ft->total_time);
+            if (dd->adaptivemirrorsorting)
+                lr_mirrors_sort(target->lrmirrors, target->mirror, TRUE, ft->serious_error);
+        }
+    }
+
+    // The segment could be the last one of a segmented target
+    if (target->parent
+        && (target->state == LR_DS_FINISHED
+            || target->state == LR_DS_FAILED))
+    {
+        GError *segment_err = NULL;
+        if (!check_segmented_target(dd, target->parent, &segment_err)) {
+            if (!fail_fast_error)
+                g_propagate_error(&fail_fast_error, segment_err);
+            else
+                g_error_free(segment_err);
+        }
+    }
+
+    if (fail_fast_error) {
+        // Interrupt whole downloading
+        // A fatal error occured or interrupted by callback
+        g_propagate_error(err, fail_fast_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/** Path of the file of a local (file://) mirror if the target could be
+ * copied from it directly instead of downloading it by curl.
+ * Transfers which need features of the curl transfer (ranges, resume,
+ * speed limits, ...) and files which are not regular files are left
+ * to curl, so its error reporting is kept.
+ * @return          Path of the source file (to be freed by g_free())
+ *                  or NULL
+ */
+static gchar *
+local_source_path(LrDownload *dd, LrTarget *target, const char *full_url)
+{
+    LrDownloadTarget *dtarget = target->target;
+    gchar *path;
+    struct stat st;
+
+    if (lr_detect_protocol(full_url) != LR_PROTOCOL_FILE
+        || target->parent
+        || target->hedge_of
+        || target->resume
+        || target->migrate_offset > 0
+        || target->conditional
+        || dtarget->byterangestart > 0
+        || dtarget->byterangeend > 0
+        || ratelimit_active(dd))
+        return NULL;
 
-        if (fail_fast_error) {
-            // Interrupt whole downloading
-            // A fatal error occured or interrupted by callback
-            g_propagate_error(err, fail_fast_error);
+    // The supplied file descriptor has to be at its beginning
+    if (dtarget->fd != -1 && lseek(dtarget->fd, 0, SEEK_CUR) != 0)
+        return NULL;
+
+    path = g_filename_from_uri(full_url, NULL, NULL);
+    if (!path)
+        return NULL;
+
+    if (stat(path, &st) == -1
+        || !S_ISREG(st.st_mode)
+        || (dtarget->expectedsize > 0 && st.st_size != dtarget->expectedsize))
+    {
+        g_free(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+/** Copy the target from the local mirror. The files are opened and
+ * copied (reflink, copy_file_range(), ...) and the checksum of the source
+ * file is verified by the verification pool, the result is processed by
+ * finish_transfer() like a result of a curl transfer. The copy occupies
+ * a slot of the running transfers until it is finished.
+ * @param source    Path returned by local_source_path() (the function
+ *                  takes its ownership)
+ */
+static void
+start_local_copy(LrDownload *dd,
+                 LrTarget *target,
+                 gchar *source,
+                 const char *full_url)
+{
+    LrFinishedTransfer *ft;
+
+    g_debug("%s: Copying %s", __func__, full_url);
+
+    target->transfer_start = g_get_monotonic_time();
+    target->cb_return_code = LR_CB_OK;
+    target->protocol = LR_PROTOCOL_FILE;
+
+    ft = g_new0(LrFinishedTransfer, 1);
+    ft->target = target;
+    ft->result = CURLE_OK;
+    ft->effective_url = g_strdup(full_url);
+    ft->starttransfer_time = 0.0;
+    ft->fd = -1;
+    ft->source_path = source;
+    ft->local = TRUE;
+    ft->matches = TRUE;
+    ft->iouring = dd->iouring;
+
+    dd->copying++;
+    verify_pool_push(dd, ft);
+}
+
+static gboolean
+prepare_next_transfers(LrDownload *dd, GError **err)
+{
+    guint length = dd->running_transfers.length + dd->copying;
+    guint free_slots = 0;
+
+    // Adaptive concurrency could lower the limit under the number
+    // of already running transfers
+    if ((guint) dd->max_running_transfers > length)
+        free_slots = dd->max_running_transfers - length;
+
+    assert(!err || *err == NULL);
+
+    while (free_slots > 0) {
+        LrTarget *target = NULL;
+        char *full_url = NULL;
+        gboolean ret;
+        gchar *source;
+
+        ret = select_next_target(dd, &target, &full_url, err);
+        if (!ret)  // Error
             return FALSE;
+
+        if (!target)  // Nothing to do
+            break;
+
+        // Files from local mirrors are copied without curl
+        source = local_source_path(dd, target, full_url);
+        if (source) {
+            start_local_copy(dd, target, source, full_url);
+            lr_free(full_url);
+        } else {
+            ret = prepare_next_transfer(dd, target, full_url, err);
+            if (!ret)
+                return FALSE;
         }
+        free_slots--;
     }
 
+    return TRUE;
+}
+
+static gboolean
+check_transfer_statuses(LrDownload *dd, GError **err)
+{
+    assert(dd);
+    assert(!err || *err == NULL);
+
+    CURLMsg *msg, msg_buf;
+    LrFinishedTransfer *ft;
+
+    // Pass the writes queued by the transfers since the last call
+    // to the kernel in one batch
+    if (dd->ring)
+        lr_iouring_submit(dd->ring);
+
+    // Messages of the worker threads and of the verification pool
+    lr_logqueue_flush(dd->log);
+
+    while ((msg = next_transfer_message(dd, &msg_buf))) {
+        LrTarget *target = NULL;
+        char *effective_url = NULL;
+        int fd;
+        gboolean ret;
+
+        if (msg->msg != CURLMSG_DONE) {
+            // We are only interested in messages about finished transfers
+            continue;
+        }
+
+        // Find the target with this curl easy handle
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &target);
+
+        assert(target);  // Each easy handle used in the multi handle
+                         // should always belong to some target from
+                         // the running_transfers queue
+        assert(target->curl_handle == msg->easy_handle);
+
+        curl_easy_getinfo(msg->easy_handle,
+                          CURLINFO_EFFECTIVE_URL,
+                          &effective_url);
+
+        ft = g_new0(LrFinishedTransfer, 1);
+        ft->target = target;
+        ft->result = msg->data.result;
+        ft->fd = -1;
+        ft->matches = TRUE;
+        ft->iouring = dd->iouring;
+        ft->effective_url = g_strdup(effective_url); // Make the effetive url
+                                                     // persistent to survive
+                                                     // the curl_easy_cleanup()
+
+        // Statistics of the transfer (used to score the mirror
+        // and reported in the download target)
+        ft->starttransfer_time = -1.0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_SIZE_DOWNLOAD,
+                          &ft->size_download);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_NAMELOOKUP_TIME,
+                          &ft->namelookup_time);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_CONNECT_TIME,
+                          &ft->connect_time);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_APPCONNECT_TIME,
+                          &ft->appconnect_time);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_STARTTRANSFER_TIME,
+                          &ft->starttransfer_time);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_TOTAL_TIME,
+                          &ft->total_time);
+
+        g_debug("%s: Transfer finished: %s (Effective url: %s)",
+                __func__, target->target->path, ft->effective_url);
+
+#if LIBCURL_VERSION_NUM >= 0x073200  // 7.50.0
+        // Mirrors which don't speak HTTP/2 are limited by number
+        // of connections again
+        if (target->mirror && target->mirror->multiplexed) {
+            long http_version = 0;
+            curl_easy_getinfo(msg->easy_handle,
+                              CURLINFO_HTTP_VERSION,
+                              &http_version);
+            if (http_version != 0 && http_version != CURL_HTTP_VERSION_2_0) {
+                g_debug("%s: Mirror %s doesn't support HTTP/2 multiplexing",
+                        __func__, target->mirror->mirror->url);
+                target->mirror->multiplexed = FALSE;
+            }
+        }
+#endif
+
+        //
+        // Check status of finished transfer
+        //
+        ret = check_finished_transfer_status(msg, target, &ft->serious_error,
+                                             &ft->fatal_error,
+                                             &ft->transfer_err, err);
+        if (!ret) {  // Error
+            finished_transfer_free(ft);
+            return FALSE;
+        }
+
+        if (ft->transfer_err)  // Transfer was unsuccessful
+            goto transfer_done;
+
+        //
+        // Checksum checking
+        //
+        if (!lr_filewriter_flush(target->writer, &ft->transfer_err))
+            goto transfer_done;
+        fd = target->fd;
+        if (target->conditional && !target->notmodified) {
+            // The server sent an empty file instead of the existing one
+            target->conditional = FALSE;
+            if (ftruncate(fd, lr_filewriter_offset(target->writer)) == -1) {
+                g_set_error(&ft->transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                            "ftruncate() failed: %s", strerror(errno));
+                goto transfer_done;
+            }
+        }
+        ft->streamed_checksums = target_checksums_final(target, fd);
+
+        // Checksum which is not known from the transfer is calculated
+        // by the verification pool, the result is processed later
+        if (verify_in_background(dd, ft))
+            continue;
+
+        check_finished_trasfer_checksum(fd,
+                                        target->target->checksums,
+                                        ft->streamed_checksums,
+                                        dd->iouring,
+                                        &ft->matches,
+                                        &ft->transfer_err,
+                                        &ft->err);
+
+        //
+        // Any other checks should go here
+        //
+
+transfer_done:
+
+        ret = finish_transfer(dd, ft, err);
+        finished_transfer_free(ft);
+        if (!ret)
+            return FALSE;
+    }
+
+    // Process transfers verified by the verification pool
+    if (dd->verified) {
+        char buf[64];
+        while (read(dd->verified_pipe[0], buf, sizeof(buf)) > 0)
+            ;
+        // Log the messages of the verifications before their results
+        lr_logqueue_flush(dd->log);
+    }
+    while (dd->verified && (ft = g_async_queue_try_pop(dd->verified))) {
+        LrDownloadTarget *dtarget = ft->target->target;
+        gboolean ret;
+
+        dd->verifying--;
+        if (ft->local)
+            dd->copying--;
+
+        // The whole local copy is done at once
+        if (ft->local && !ft->transfer_err && dtarget->progresscb)
+            dtarget->progresscb(dtarget->cbdata,
+                                ft->size_download,
+                                ft->size_download);
+
+        ret = finish_transfer(dd, ft, err);
+        finished_transfer_free(ft);
+        if (!ret)
+            return FALSE;
+    }
+
+    // Tune number of parallel transfers
+    adaptive_concurrency_update(dd);
+
+    // Move slow transfers to faster mirrors
+    migrate_transfers(dd);
+
+    // Duplicate slow transfers to free slots
+    hedge_transfers(dd);
+
     // At this point, after handles of finished transfers were removed
     // from the multi_handle, we could add new waiting transfers.
     return prepare_next_transfers(dd, err);
 }
 
 
+/** Main download loop driven by epoll and curl_multi_socket_action().
+ * Unlike the select() based loop, only sockets with some activity
+ * are serviced and number of transfers is not limited by FD_SETSIZE.
+ */
+static gboolean
+lr_perform_epoll(LrDownload *dd, GError **err)
+{
+    gboolean ret = TRUE;
+    int still_running;
+    LrEventLoop *loop;
+
+    assert(dd);
+    assert(!err || *err == NULL);
+
+    loop = lr_eventloop_new(dd->multi_handle, LR_DOWNLOADER_ERROR, err);
+    if (!loop)
+        return FALSE;
+
+    // Wake up when the verification pool finishes a transfer
+    if (!lr_eventloop_watch_fd(loop, dd->verified_pipe[0], err)) {
+        lr_eventloop_free(loop);
+        return FALSE;
+    }
+
+    while (dd->running_transfers.length || dd->verifying) {
+        // Wait at most 1sec (the same as the select() based loop does)
+        // to check the interrupt flag regularly
+        int timeout = 1000;
+
+        // Resume transfers paused because of speed limits and wake up
+        // when the limits allow to take more data
+        gint64 ratelimit_timeout = ratelimit_resume_transfers(dd);
+        if (ratelimit_timeout > 0)
+            timeout = MIN(timeout, ratelimit_timeout / 1000 + 1);
+
+        ret = lr_eventloop_run_once(loop, timeout, &still_running, err);
+        if (!ret)
+            break;
+
+        if (lr_interrupt) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                        "Interrupted by signal");
+            ret = FALSE;
+            break;
+        }
+
+        // Check if any handle finished and potentialy add one or more
+        // waiting downloads to the multi_handle. Newly added handles
+        // set curl's timer, so they are started in the next iteration.
+        ret = check_transfer_statuses(dd, err);
+        if (!ret)
+            break;
+    }
+
+    if (ret)
+        ret = check_transfer_statuses(dd, err);
+
+    lr_eventloop_free(loop);
+
+    return ret;
+}
+
+
+/** Set options of the multi handle which performs the transfers
+ * (the multi handle of the download or of a worker thread).
+ */
+static void
+setup_multi_handle(CURLM *multi_handle, void *data)
+{
+    LrDownload *dd = data;
+
+    if (dd->http2) {
+        // Limit of connections is split among the worker threads
+        long connections = dd->max_parallel_connections;
+        if (dd->worker_threads > 1)
+            connections = MAX(1, connections / dd->worker_threads);
+
+        curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING,
+                          CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi_handle, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                          connections);
+        curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS,
+                          (long) MAX(dd->max_connection_per_host, 0));
+#if LIBCURL_VERSION_NUM >= 0x074300  // 7.67.0
+        curl_multi_setopt(multi_handle, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                          (long) dd->max_streams_per_mirror);
+#endif
+    } else {
+#if LIBCURL_VERSION_NUM >= 0x073E00  // 7.62.0
+        // Default value since 7.62.0
+        curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING,
+                          CURLPIPE_MULTIPLEX);
+#else
+        curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING,
+                          CURLPIPE_NOTHING);
+#endif
+        curl_multi_setopt(multi_handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, 0L);
+        curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, 0L);
+    }
+}
+
+/** Called by the worker threads for each of their transfers.
+ * Resumes the transfer if it was paused because of the speed limits
+ * and the limits allow to take more data.
+ * @return          Time in milliseconds after which the function should
+ *                  be called again or -1
+ */
+static long
+worker_tick(CURL *handle, G_GNUC_UNUSED void *data)
+{
+    LrTarget *target = NULL;
+    gint64 delay = 0;
+
+    curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char **) &target);
+    if (!target || !target->paused)
+        return -1;
+
+    if (target->ratelimiter)
+        delay = lr_ratelimiter_delay(target->ratelimiter);
+    if (target->shared_ratelimiter)
+        delay = MAX(delay, lr_ratelimiter_delay(target->shared_ratelimiter));
+    if (delay)
+        return (long) (delay / 1000 + 1);
+
+    target->paused = FALSE;
+
+    // Note: Curl could call the write callback (and the transfer
+    // could be paused again) right from the curl_easy_pause()
+    CURLcode code = curl_easy_pause(handle, CURLPAUSE_CONT);
+    if (code != CURLE_OK)
+        g_debug("%s: curl_easy_pause() failed: %s",
+                __func__, curl_easy_strerror(code));
+
+    return -1;
+}
+
+/** Interval (in milliseconds) of progress reports of transfers
+ * performed by worker threads */
+#define LR_WORKERS_PROGRESS_INTERVAL    100
+
+/** Download loop used when the transfers are performed by worker
+ * threads. Finished transfers, progress callbacks and everything else
+ * is handled by the calling thread, so the callbacks of the targets
+ * are called from the same thread as without worker threads.
+ */
+static gboolean
+lr_perform_workers(LrDownload *dd, GError **err)
+{
+    gboolean ret = TRUE;
+
+    assert(dd);
+    assert(dd->workers);
+    assert(!err || *err == NULL);
+
+    while (dd->running_transfers.length || dd->verifying) {
+        // Wake up regularly to report progress of the transfers
+        // (the verification pool wakes up the wait when it finishes
+        // a transfer)
+        ret = lr_workerpool_wait(dd->workers, LR_WORKERS_PROGRESS_INTERVAL,
+                                 err);
+        if (!ret)
+            break;
+
+        for (GList *elem = dd->running_transfers.head; elem; elem = g_list_next(elem))
+            deliver_progress(elem->data);
+
+        if (lr_interrupt) {
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                        "Interrupted by signal");
+            ret = FALSE;
+            break;
+        }
+
+        // Check finished transfers and start the waiting ones
+        ret = check_transfer_statuses(dd, err);
+        if (!ret)
+            break;
+    }
+
+    return ret;
+}
+
 static gboolean
 lr_perform(LrDownload *dd, GError **err)
 {
@@ -1739,6 +4863,12 @@ lr_perform(LrDownload *dd, GError **err)
     assert(dd);
     assert(!err || *err == NULL);
 
+    if (dd->workers)
+        return lr_perform_workers(dd, err);
+
+    if (dd->eventengine == LR_EVENTENGINE_EPOLL)
+        return lr_perform_epoll(dd, err);
+
     do { // Before version 7.20.0 CURLM_CALL_MULTI_PERFORM can appear
         cm_rc = curl_multi_perform(dd->multi_handle, &still_running);
     } while (cm_rc == CURLM_CALL_MULTI_PERFORM);
@@ -1757,7 +4887,7 @@ lr_perform(LrDownload *dd, GError **err)
         return FALSE;
     }
 
-    while (dd->running_transfers) {
+    while (dd->running_transfers.length || dd->verifying) {
         int rc;
         int maxfd = -1;
         long curl_timeout = -1;
@@ -1768,6 +4898,9 @@ lr_perform(LrDownload *dd, GError **err)
         FD_ZERO(&fdwrite);
         FD_ZERO(&fdexcep);
 
+        // Resume transfers paused because of speed limits
+        gint64 ratelimit_timeout = ratelimit_resume_transfers(dd);
+
         // Set suitable timeout to play around with
         timeout.tv_sec  = 1;
         timeout.tv_usec = 0;
@@ -1788,6 +4921,15 @@ lr_perform(LrDownload *dd, GError **err)
                 timeout.tv_usec = (curl_timeout % 1000) * 1000;
         }
 
+        // Wake up when the speed limits allow to take more data
+        if (ratelimit_timeout > 0
+            && ratelimit_timeout < timeout.tv_sec * G_USEC_PER_SEC
+                                   + timeout.tv_usec)
+        {
+            timeout.tv_sec  = ratelimit_timeout / G_USEC_PER_SEC;
+            timeout.tv_usec = ratelimit_timeout % G_USEC_PER_SEC;
+        }
+
         // Get file descriptors from the transfers
         cm_rc = curl_multi_fdset(dd->multi_handle, &fdread, &fdwrite,
                                  &fdexcep, &maxfd);
@@ -1798,6 +4940,10 @@ lr_perform(LrDownload *dd, GError **err)
             return FALSE;
         }
 
+        // Wake up when the verification pool finishes a transfer
+        FD_SET(dd->verified_pipe[0], &fdread);
+        maxfd = MAX(maxfd, dd->verified_pipe[0]);
+
         rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
         if (rc < 0) {
             if (errno == EINTR) {
@@ -1843,75 +4989,245 @@ lr_perform(LrDownload *dd, GError **err)
             } while (cm_rc == CURLM_CALL_MULTI_PERFORM);
 
             if (cm_rc != CURLM_OK) {
-                g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
-                            "curl_multi_perform() error: %s",
-                            curl_multi_strerror(cm_rc));
-                return FALSE;
-            }
-        } while (still_running == 0 && dd->running_transfers);
-    }
-
-    return check_transfer_statuses(dd, err);
-}
-
-gboolean
-lr_download(GSList *targets,
-            gboolean failfast,
-            GError **err)
-{
-    gboolean ret = FALSE;
-    LrDownload dd;             // dd stands for Download Data
-    GError *tmp_err = NULL;
-
-    assert(!err || *err == NULL);
-
-    if (lr_interrupt) {
-        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
-                    "Interrupted by signal");
-        return FALSE;
+                g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
+                            "curl_multi_perform() error: %s",
+                            curl_multi_strerror(cm_rc));
+                return FALSE;
+            }
+        } while (still_running == 0 && dd->running_transfers.length);
     }
 
-    if (!targets) {
-        g_debug("%s: No targets", __func__);
-        return TRUE;
-    }
+    return check_transfer_statuses(dd, err);
+}
 
-    // XXX: Downloader configuration (max parallel connections etc.)
-    // is taken from the handle of the first target.
-    LrHandle *lr_handle = ((LrDownloadTarget *) targets->data)->handle;
+/** Prepare the download data. Configuration of the download
+ * (max parallel connections etc.) is taken from the handle.
+ */
+static gboolean
+lr_download_init(LrDownload *dd,
+                 LrHandle *lr_handle,
+                 gboolean failfast,
+                 GError **err)
+{
+    assert(!err || *err == NULL);
+
+    memset(dd, 0, sizeof(*dd));
 
     // Prepare download data
-    dd.failfast = failfast;
+    dd->failfast = failfast;
+
+    // Pipe signalled by the verification pool (see verified_push())
+    GError *tmp_err = NULL;
+    dd->verified_pipe[0] = dd->verified_pipe[1] = -1;
+    if (!g_unix_open_pipe(dd->verified_pipe, FD_CLOEXEC, &tmp_err)
+        || !g_unix_set_fd_nonblocking(dd->verified_pipe[0], TRUE, &tmp_err)
+        || !g_unix_set_fd_nonblocking(dd->verified_pipe[1], TRUE, &tmp_err))
+    {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "Cannot create a pipe: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        if (dd->verified_pipe[0] != -1) {
+            close(dd->verified_pipe[0]);
+            close(dd->verified_pipe[1]);
+        }
+        return FALSE;
+    }
 
     if (lr_handle) {
-        dd.max_parallel_connections = lr_handle->maxparalleldownloads;
-        dd.max_connection_per_host = lr_handle->maxdownloadspermirror;
-        dd.max_mirrors_to_try = lr_handle->maxmirrortries;
-        dd.max_speed = lr_handle->maxspeed;
-        dd.allowed_mirror_failures = lr_handle->allowed_mirror_failures;
-        dd.adaptivemirrorsorting = lr_handle->adaptivemirrorsorting;
+        dd->max_parallel_connections = lr_handle->maxparalleldownloads;
+        dd->max_connection_per_host = lr_handle->maxdownloadspermirror;
+        dd->max_mirrors_to_try = lr_handle->maxmirrortries;
+        dd->max_speed = lr_handle->maxspeed;
+        dd->allowed_mirror_failures = lr_handle->allowed_mirror_failures;
+        dd->adaptivemirrorsorting = lr_handle->adaptivemirrorsorting;
+        dd->eventengine = lr_handle->eventengine;
+        dd->http2 = lr_handle->http2;
+        dd->max_streams_per_mirror = lr_handle->maxstreamspermirror;
+        dd->max_segments = lr_handle->maxsegments;
+        dd->min_segment_size = lr_handle->minsegmentsize;
+        dd->write_buffer_size = (size_t) lr_handle->writebuffersize;
+        dd->adaptive_concurrency = lr_handle->adaptiveconcurrency;
+        dd->adaptive_max_running_transfers = lr_handle->adaptivemaxparalleldownloads;
+        dd->scheduling_policy = lr_handle->schedulingpolicy;
+        dd->hedged_requests = lr_handle->hedgedrequests;
+        dd->migrate_slow_transfers = lr_handle->migrateslowtransfers;
+        dd->worker_threads = lr_handle->workerthreads;
+        dd->iouring = lr_handle->iouring;
+        dd->progress_interval = (gint64) lr_handle->progressinterval * 1000;
+        dd->progress_delta = lr_handle->progressdelta;
     } else {
         // No handle, this is allowed when a complete URL is passed
         // via relative_url param.
-        dd.max_parallel_connections = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
-        dd.max_connection_per_host = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
-        dd.max_mirrors_to_try = LRO_MAXMIRRORTRIES_DEFAULT;
-        dd.max_speed = LRO_MAXSPEED_DEFAULT;
-        dd.allowed_mirror_failures = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
-        dd.adaptivemirrorsorting = LRO_ADAPTIVEMIRRORSORTING_DEFAULT;
+        dd->max_parallel_connections = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
+        dd->max_connection_per_host = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
+        dd->max_mirrors_to_try = LRO_MAXMIRRORTRIES_DEFAULT;
+        dd->max_speed = LRO_MAXSPEED_DEFAULT;
+        dd->allowed_mirror_failures = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
+        dd->adaptivemirrorsorting = LRO_ADAPTIVEMIRRORSORTING_DEFAULT;
+        dd->eventengine = LRO_EVENTENGINE_DEFAULT;
+        dd->http2 = LRO_HTTP2_DEFAULT;
+        dd->max_streams_per_mirror = LRO_MAXSTREAMSPERMIRROR_DEFAULT;
+        dd->max_segments = LRO_MAXSEGMENTS_DEFAULT;
+        dd->min_segment_size = LRO_MINSEGMENTSIZE_DEFAULT;
+        dd->write_buffer_size = LRO_WRITEBUFFERSIZE_DEFAULT;
+        dd->adaptive_concurrency = LRO_ADAPTIVECONCURRENCY_DEFAULT;
+        dd->adaptive_max_running_transfers = LRO_ADAPTIVEMAXPARALLELDOWNLOADS_DEFAULT;
+        dd->scheduling_policy = LRO_SCHEDULINGPOLICY_DEFAULT;
+        dd->hedged_requests = LRO_HEDGEDREQUESTS_DEFAULT;
+        dd->migrate_slow_transfers = LRO_MIGRATESLOWTRANSFERS_DEFAULT;
+        dd->worker_threads = LRO_WORKERTHREADS_DEFAULT;
+        dd->iouring = LRO_IOURING_DEFAULT;
+        dd->progress_interval = LRO_PROGRESSINTERVAL_DEFAULT * 1000;
+        dd->progress_delta = LRO_PROGRESSDELTA_DEFAULT;
+    }
+
+    // Use the multi handle of the download session (if available)
+    // to reuse connections from previous downloads.
+    dd->session = NULL;
+    dd->multi_handle = NULL;
+    if (lr_handle && lr_handle->downloadsession) {
+        // Real transfers begin, connections opened in advance
+        // (LRO_PREWARMMIRRORS) are parked in the cache
+        lr_downloadsession_prewarm_stop(lr_handle->downloadsession);
+        if (!lr_handle->downloadsession->in_use) {
+            dd->session = lr_handle->downloadsession;
+            dd->session->in_use = TRUE;
+            dd->multi_handle = dd->session->multi_handle;
+        } else {
+            g_debug("%s: Download session is already in use, "
+                    "using a private multi handle", __func__);
+        }
     }
 
-    dd.multi_handle = curl_multi_init();
-    if (!dd.multi_handle) {
+    if (!dd->multi_handle)
+        dd->multi_handle = curl_multi_init();
+    if (!dd->multi_handle) {
         // Something went wrong
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
                     "curl_multi_init() call failed");
+        close(dd->verified_pipe[0]);
+        close(dd->verified_pipe[1]);
         return FALSE;
     }
 
+    dd->log = lr_logqueue_new();
+
+    if (dd->http2 && !(curl_version_info(CURLVERSION_NOW)->features
+                      & CURL_VERSION_HTTP2))
+    {
+        g_debug("%s: HTTP/2 is not supported by libcurl", __func__);
+        dd->http2 = FALSE;
+    }
+
+    if (dd->http2)
+        // Transfers are multiplexed, limit number of connections
+        // rather than number of transfers
+        dd->max_running_transfers = dd->max_parallel_connections
+                                   * dd->max_streams_per_mirror;
+    else
+        dd->max_running_transfers = dd->max_parallel_connections;
+
+    // The multi handle could be reused from a previous download,
+    // so always set all the options
+    setup_multi_handle(dd->multi_handle, dd);
+
+    // Adaptive concurrency starts from the configured value
+    memset(&dd->adaptive, 0, sizeof(dd->adaptive));
+    if (dd->adaptive_concurrency) {
+        dd->max_running_transfers = MIN(dd->max_running_transfers,
+                                       dd->adaptive_max_running_transfers);
+        dd->adaptive.last_update = g_get_monotonic_time();
+        g_debug("%s: Adaptive concurrency enabled (%d - %d parallel "
+                "transfers)", __func__, dd->max_running_transfers,
+                dd->adaptive_max_running_transfers);
+    }
+
+    // Migration of slow transfers
+    dd->migrate_last_check = g_get_monotonic_time();
+
+    // The ring is used by a single thread, so it cannot be used
+    // by the worker threads. The availability of io_uring is detected
+    // here, so the threads of the verification pool create their rings
+    // only if it is available (and do not log the failure).
+    dd->ring = NULL;
+    if (dd->iouring) {
+        dd->ring = lr_iouring_new();
+        if (!dd->ring) {
+            g_debug("%s: io_uring is not available, plain system calls "
+                    "are used", __func__);
+            dd->iouring = FALSE;
+        } else {
+            g_debug("%s: File I/O is performed by io_uring", __func__);
+            if (dd->worker_threads > 1) {
+                lr_iouring_free(dd->ring);
+                dd->ring = NULL;
+            }
+        }
+    }
+
+    // Hedged requests
+    dd->hedging.last_check = g_get_monotonic_time();
+    dd->hedging.durations = g_array_new(FALSE, FALSE, sizeof(double));
+
+    // Speed limits
+    dd->ratelimiter = dd->max_speed ? lr_ratelimiter_new(dd->max_speed) : NULL;
+    dd->shared_ratelimiter = (lr_handle && lr_handle->share)
+                             ? lr_handle->share->ratelimiter : NULL;
+
     // Prepare list of LrTargets and LrHandleMirrors
-    dd.handle_mirrors = NULL;
-    dd.targets = NULL;
+    dd->handle_mirrors = NULL;
+    dd->targets = NULL;
+    dd->next_rank = 0;
+    dd->finished_targets = NULL;
+    g_queue_init(&dd->running_transfers);
+    g_queue_init(&dd->waiting_targets);
+
+    return TRUE;
+}
+
+/** Start worker threads which perform the transfers (see
+ * LRO_WORKERTHREADS). Features which need to inspect the running
+ * transfers from the calling thread are not used with worker threads.
+ */
+static gboolean
+lr_download_start_workers(LrDownload *dd, GError **err)
+{
+    assert(!err || *err == NULL);
+
+    if (dd->hedged_requests || dd->migrate_slow_transfers) {
+        g_debug("%s: Hedged requests and migration of slow transfers "
+                "are disabled with worker threads", __func__);
+        dd->hedged_requests = FALSE;
+        dd->migrate_slow_transfers = FALSE;
+    }
+
+    dd->workers = lr_workerpool_new(dd->worker_threads,
+                                    setup_multi_handle,
+                                    worker_tick,
+                                    dd,
+                                    dd->log,
+                                    LR_DOWNLOADER_ERROR,
+                                    err);
+    if (!dd->workers)
+        return FALSE;
+
+    g_debug("%s: Transfers are performed by %d worker threads",
+            __func__, dd->worker_threads);
+
+    return TRUE;
+}
+
+/** Add the targets to the download, schedule them and start
+ * as many transfers as possible. Targets could be added even if
+ * some transfers are already running.
+ */
+static gboolean
+lr_download_add_targets(LrDownload *dd, GSList *targets, GError **err)
+{
+    GSList *new_targets = NULL;
+
+    assert(!err || *err == NULL);
+
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
         LrDownloadTarget *dtarget = elem->data;
 
@@ -1935,85 +5251,137 @@ lr_download(GSList *targets,
         target->target->rcode   = LRE_UNFINISHED;
         target->target->err     = "Not finished";
         target->handle          = dtarget->handle;
-        dd.targets = g_slist_append(dd.targets, target);
+        target->segments_fd     = -1;
+        target->fd              = -1;
+        new_targets = g_slist_prepend(new_targets, target);
         // Add list of handle internal mirrors to dd.handle_mirrors
         // if doesn't exists yet and set the list reference
         // to the target.
-        dd.handle_mirrors = lr_prepare_lrmirrors(dd.handle_mirrors, target);
+        dd->handle_mirrors = lr_prepare_lrmirrors(dd->handle_mirrors,
+                                                  target,
+                                                  dd->http2);
     }
 
-    dd.running_transfers = NULL;
+    new_targets = g_slist_reverse(new_targets);
+    dd->targets = g_slist_concat(dd->targets, g_slist_copy(new_targets));
 
-    // Prepare the first set of transfers
-    if (!prepare_next_transfers(&dd, &tmp_err))
-        goto lr_download_cleanup;
+    // Split large targets into segments (segments are prepended
+    // to the dd->targets)
+    for (GSList *elem = new_targets; elem; elem = g_slist_next(elem)) {
+        if (!prepare_segments(dd, elem->data, err)) {
+            g_slist_free(new_targets);
+            return FALSE;
+        }
+    }
 
-    // Perform!
-    g_debug("%s: Downloading started", __func__);
-    ret = lr_perform(&dd, &tmp_err);
+    // Put the waiting targets to the queues
+    schedule_targets(dd, new_targets);
+    g_slist_free(new_targets);
 
-    assert(ret || tmp_err);
+    // Prepare the next set of transfers
+    return prepare_next_transfers(dd, err);
+}
 
-lr_download_cleanup:
+/** Report the target as not finished because of the error.
+ */
+static void
+target_set_unfinished(LrTarget *target, GError *error)
+{
+    // Call end callback
+    LrEndCb end_cb =  target->target->endcb;
+    if (end_cb) {
+        gchar *msg = g_strdup_printf("Not finished - interrupted by "
+                                     "error: %s", error->message);
+        end_cb(target->target->cbdata, LR_TRANSFER_ERROR, msg);
+        // No need to check end_cb return value, because there
+        // already was an error
+        g_free(msg);
+    }
 
-    if (tmp_err) {
-        // If there was an error, stop all transfers that are in progress.
-        g_debug("%s: Error while downloading: %s", __func__, tmp_err->message);
+    lr_downloadtarget_set_error(target->target, LRE_UNFINISHED,
+            "Not finished - interrupted by error: %s",
+            error->message);
+}
 
-        for (GSList *elem = dd.running_transfers; elem; elem = g_slist_next(elem)){
-            LrTarget *target = elem->data;
+/** Stop all running transfers because of the error.
+ */
+static void
+lr_download_abort(LrDownload *dd, GError *error)
+{
+    g_debug("%s: Error while downloading: %s", __func__, error->message);
 
-            curl_multi_remove_handle(dd.multi_handle, target->curl_handle);
-            curl_easy_cleanup(target->curl_handle);
-            target->curl_handle = NULL;
-            fclose(target->f);
-            target->f = NULL;
-            g_free(target->headercb_interrupt_reason);
-            target->headercb_interrupt_reason = NULL;
+    LrTarget *target;
+    while ((target = g_queue_peek_head(&dd->running_transfers))) {
+        target_stop_transfer(dd, target);
+        target_set_unfinished(target, error);
+    }
 
-            // Call end callback
-            LrEndCb end_cb =  target->target->endcb;
-            if (end_cb) {
-                gchar *msg = g_strdup_printf("Not finished - interrupted by "
-                                             "error: %s", tmp_err->message);
-                end_cb(target->target->cbdata, LR_TRANSFER_ERROR, msg);
-                // No need to check end_cb return value, because there
-                // already was an error
-                g_free(msg);
-            }
+    // Targets being verified are not finished either, results
+    // of the verification pool are dropped by lr_download_clear().
+    // The same holds for targets downloaded by their hedged transfers.
+    for (GSList *elem = dd->targets; elem; elem = g_slist_next(elem)) {
+        target = elem->data;
+        if (target->state == LR_DS_VERIFYING
+            || target->state == LR_DS_HEDGED)
+            target_set_unfinished(target, error);
+    }
+}
 
-            lr_downloadtarget_set_error(target->target, LRE_UNFINISHED,
-                    "Not finished - interrupted by error: %s",
-                    tmp_err->message);
-        }
+/** Release all resources of the download data. Files of targets
+ * which were not downloaded successfully are removed.
+ */
+static void
+lr_download_clear(LrDownload *dd)
+{
+    assert(g_queue_is_empty(&dd->running_transfers));
+
+    // Wait for the verification pool, the targets, the worker pool
+    // and the pipe are used by its threads
+    if (dd->verify_pool)
+        g_thread_pool_free(dd->verify_pool, FALSE, TRUE);
+    if (dd->verified) {
+        LrFinishedTransfer *ft;
+        while ((ft = g_async_queue_try_pop(dd->verified)))
+            finished_transfer_free(ft);
+        g_async_queue_unref(dd->verified);
+    }
+    close(dd->verified_pipe[0]);
+    close(dd->verified_pipe[1]);
 
-        g_slist_free(dd.running_transfers);
-        dd.running_transfers = NULL;
+    lr_workerpool_free(dd->workers);
+    lr_iouring_free(dd->ring);
 
-        g_propagate_error(err, tmp_err);
-    }
+    // No thread could log to the queue anymore
+    lr_logqueue_free(dd->log);
 
-    assert(dd.running_transfers == NULL);
+    g_queue_clear(&dd->waiting_targets);
+    lr_ratelimiter_free(dd->ratelimiter);
+    g_array_free(dd->hedging.durations, TRUE);
 
-    curl_multi_cleanup(dd.multi_handle);
+    if (dd->session)
+        // Keep the multi handle (and its connection cache) for next downloads
+        dd->session->in_use = FALSE;
+    else
+        curl_multi_cleanup(dd->multi_handle);
 
-    // Clean up dd.handle_mirrors
-    for (GSList *elem = dd.handle_mirrors; elem; elem = g_slist_next(elem)) {
+    // Clean up dd->handle_mirrors
+    for (GSList *elem = dd->handle_mirrors; elem; elem = g_slist_next(elem)) {
         LrHandleMirrors *handle_mirrors = elem->data;
-        for (GSList *el = handle_mirrors->lrmirrors; el; el = g_slist_next(el)) {
-            LrMirror *mirror = el->data;
-            lr_free(mirror);
+        g_queue_clear(&handle_mirrors->waiting_targets);
+        if (handle_mirrors->lrmirrors) {
+            for (guint i = 0; i < handle_mirrors->lrmirrors->len; i++)
+                lr_free(g_ptr_array_index(handle_mirrors->lrmirrors, i));
+            g_ptr_array_free(handle_mirrors->lrmirrors, TRUE);
         }
-        g_slist_free(handle_mirrors->lrmirrors);
         lr_free(handle_mirrors);
     }
-    g_slist_free(dd.handle_mirrors);
+    g_slist_free(dd->handle_mirrors);
 
     // Clean up targets
-    for (GSList *elem = dd.targets; elem; elem = g_slist_next(elem)) {
+    for (GSList *elem = dd->targets; elem; elem = g_slist_next(elem)) {
         LrTarget *target = elem->data;
         assert(target->curl_handle == NULL);
-        assert(target->f == NULL);
+        assert(target->writer == NULL);
 
         // Remove file created for the target if download was
         // unsuccessful and the file doesn't exists before or
@@ -2032,14 +5400,285 @@ lr_download_cleanup:
             }
         }
 
-        g_slist_free(target->tried_mirrors);
+        if (target->parent || target->hedge_of)
+            // Private download target of a segment or a hedged transfer
+            lr_downloadtarget_free(target->target);
+        g_slist_free(target->segments);
+        if (target->segments_fd != -1)
+            close(target->segments_fd);
+
+        g_free(target->tried_mirrors);
+        g_free(target->etag);
+        g_free(target->lastmodified);
+        g_free(target->migrate_validator);
+        curl_slist_free_all(target->curl_httpheader);
         lr_free(target);
     }
-    g_slist_free(dd.targets);
+    g_slist_free(dd->targets);
+}
+
+gboolean
+lr_download(GSList *targets,
+            gboolean failfast,
+            GError **err)
+{
+    gboolean ret = FALSE;
+    LrDownload dd;             // dd stands for Download Data
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (lr_interrupt) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                    "Interrupted by signal");
+        return FALSE;
+    }
+
+    if (!targets) {
+        g_debug("%s: No targets", __func__);
+        return TRUE;
+    }
+
+    // XXX: Downloader configuration (max parallel connections etc.)
+    // is taken from the handle of the first target.
+    LrHandle *lr_handle = ((LrDownloadTarget *) targets->data)->handle;
+
+    if (!lr_download_init(&dd, lr_handle, failfast, err))
+        return FALSE;
+
+    if (dd.worker_threads > 1 && !lr_download_start_workers(&dd, &tmp_err))
+        goto lr_download_cleanup;
+
+    if (!lr_download_add_targets(&dd, targets, &tmp_err))
+        goto lr_download_cleanup;
+
+    // Perform!
+    g_debug("%s: Downloading started", __func__);
+    ret = lr_perform(&dd, &tmp_err);
+
+    assert(ret || tmp_err);
+
+lr_download_cleanup:
+
+    if (tmp_err) {
+        // If there was an error, stop all transfers that are in progress.
+        lr_download_abort(&dd, tmp_err);
+        g_propagate_error(err, tmp_err);
+    }
+
+    lr_download_clear(&dd);
+
+    return ret;
+}
+
+struct _LrAsyncDownload {
+    LrDownload dd;          /*!<
+        Download data shared with the blocking lr_download() */
+    LrEventLoop *loop;      /*!<
+        Epoll event loop driving the multi handle */
+    GQueue finished;        /*!<
+        Finished and failed targets (LrDownloadTarget *) which were
+        not popped by lr_asyncdownload_pop_finished() yet */
+    gint64 ratelimit_timeout; /*!<
+        Time (in microseconds) after which the transfers paused because
+        of the speed limits should be resumed or 0 */
+    gboolean failed;        /*!<
+        The download was aborted because of an error */
+};
+
+LrAsyncDownload *
+lr_asyncdownload_new(LrHandle *handle, gboolean failfast, GError **err)
+{
+    LrAsyncDownload *ad;
+
+    assert(!err || *err == NULL);
+
+    ad = lr_malloc0(sizeof(*ad));
+    if (!lr_download_init(&ad->dd, handle, failfast, err)) {
+        lr_free(ad);
+        return NULL;
+    }
+
+    g_queue_init(&ad->finished);
+    ad->dd.finished_targets = &ad->finished;
+
+    // The epoll loop is used regardless of the LRO_EVENTENGINE,
+    // its fd is the only one the caller has to watch
+    ad->loop = lr_eventloop_new(ad->dd.multi_handle, LR_DOWNLOADER_ERROR, err);
+    if (!ad->loop) {
+        lr_download_clear(&ad->dd);
+        lr_free(ad);
+        return NULL;
+    }
+
+    // The fd of the loop becomes readable also when the verification
+    // pool finishes a transfer
+    if (!lr_eventloop_watch_fd(ad->loop, ad->dd.verified_pipe[0], err)) {
+        lr_eventloop_free(ad->loop);
+        lr_download_clear(&ad->dd);
+        lr_free(ad);
+        return NULL;
+    }
+
+    return ad;
+}
+
+/** Abort the download because of the error. All running transfers are
+ * stopped and all not yet finished targets are marked as failed (and
+ * thus put to the queue of finished targets).
+ */
+static void
+lr_asyncdownload_abort(LrAsyncDownload *ad, GError *error)
+{
+    lr_download_abort(&ad->dd, error);
+
+    for (GSList *elem = ad->dd.targets; elem; elem = g_slist_next(elem)) {
+        LrTarget *target = elem->data;
+
+        if (target->parent || target->hedge_of)
+            continue;
+        if (target->state == LR_DS_FINISHED || target->state == LR_DS_FAILED)
+            continue;
+
+        lr_downloadtarget_set_error(target->target, LRE_UNFINISHED,
+                "Not finished - interrupted by error: %s",
+                error->message);
+        target_set_state(&ad->dd, target, LR_DS_FAILED);
+    }
+
+    ad->failed = TRUE;
+}
+
+gboolean
+lr_asyncdownload_add_target(LrAsyncDownload *ad,
+                            LrDownloadTarget *target,
+                            GError **err)
+{
+    gboolean ret;
+    GSList *list;
+    GError *tmp_err = NULL;
+
+    assert(ad);
+    assert(target);
+    assert(!err || *err == NULL);
+
+    if (ad->failed) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_BADFUNCARG,
+                    "Download was already aborted");
+        return FALSE;
+    }
+
+    list = g_slist_prepend(NULL, target);
+    ret = lr_download_add_targets(&ad->dd, list, &tmp_err);
+    g_slist_free(list);
+
+    if (!ret) {
+        lr_asyncdownload_abort(ad, tmp_err);
+        g_propagate_error(err, tmp_err);
+    }
 
     return ret;
 }
 
+int
+lr_asyncdownload_get_fd(LrAsyncDownload *ad)
+{
+    assert(ad);
+    return lr_eventloop_get_fd(ad->loop);
+}
+
+gboolean
+lr_asyncdownload_is_running(LrAsyncDownload *ad)
+{
+    assert(ad);
+    return !ad->failed
+           && (ad->dd.running_transfers.length
+               || ad->dd.verifying
+               || have_waiting_targets(&ad->dd));
+}
+
+long
+lr_asyncdownload_get_timeout(LrAsyncDownload *ad)
+{
+    assert(ad);
+
+    if (!lr_asyncdownload_is_running(ad))
+        return -1;
+
+    // Wake up at least once per second (the same as lr_download() does)
+    // to check the interrupt flag and the slow transfers
+    long timeout = lr_eventloop_get_timeout(ad->loop, 1000);
+
+    // Wake up when the speed limits allow to take more data
+    if (ad->ratelimit_timeout > 0)
+        timeout = MIN(timeout, (long) (ad->ratelimit_timeout / 1000 + 1));
+
+    return timeout;
+}
+
+gboolean
+lr_asyncdownload_process(LrAsyncDownload *ad, GError **err)
+{
+    int still_running;
+    GError *tmp_err = NULL;
+
+    assert(ad);
+    assert(!err || *err == NULL);
+
+    if (!lr_asyncdownload_is_running(ad))
+        return TRUE;
+
+    // Resume transfers paused because of speed limits
+    ad->ratelimit_timeout = ratelimit_resume_transfers(&ad->dd);
+
+    if (!lr_eventloop_run_once(ad->loop, 0, &still_running, &tmp_err))
+        goto lr_asyncdownload_process_error;
+
+    if (lr_interrupt) {
+        g_set_error(&tmp_err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                    "Interrupted by signal");
+        goto lr_asyncdownload_process_error;
+    }
+
+    if (!check_transfer_statuses(&ad->dd, &tmp_err))
+        goto lr_asyncdownload_process_error;
+
+    return TRUE;
+
+lr_asyncdownload_process_error:
+
+    lr_asyncdownload_abort(ad, tmp_err);
+    g_propagate_error(err, tmp_err);
+    return FALSE;
+}
+
+LrDownloadTarget *
+lr_asyncdownload_pop_finished(LrAsyncDownload *ad)
+{
+    assert(ad);
+    return g_queue_pop_head(&ad->finished);
+}
+
+void
+lr_asyncdownload_free(LrAsyncDownload *ad)
+{
+    if (!ad)
+        return;
+
+    if (ad->dd.running_transfers.length) {
+        GError *tmp_err = NULL;
+        g_set_error(&tmp_err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                    "Download was freed");
+        lr_asyncdownload_abort(ad, tmp_err);
+        g_error_free(tmp_err);
+    }
+
+    lr_eventloop_free(ad->loop);
+    g_queue_clear(&ad->finished);
+    lr_download_clear(&ad->dd);
+    lr_free(ad);
+}
+
 gboolean
 lr_download_target(LrDownloadTarget *target,
                    GError **err)
@@ -2103,6 +5742,15 @@ typedef struct {
     GSList *singlecbdata; /*!<
         List of LrCallbackData */
 
+    double totalsize; /*!<
+        Sum of total sizes of all targets */
+
+    double downloaded; /*!<
+        Sum of downloaded bytes of all targets */
+
+    LrProgressThrottle throttle; /*!<
+        Coalescing of the aggregate reports */
+
 } LrSharedCallbackData;
 
 typedef struct {
@@ -2126,6 +5774,7 @@ lr_multi_progress_func(void* ptr,
         // Reset counters
         // This is not first mirror for the transfer,
         // we have already downloaded some data
+        shared_cbdata->totalsize += total_to_download - cbdata->total;
         cbdata->total = total_to_download;
 
         // Call progress cb with zeroized params
@@ -2136,21 +5785,25 @@ lr_multi_progress_func(void* ptr,
             return ret;
     }
 
+    shared_cbdata->downloaded += now_downloaded - cbdata->downloaded;
     cbdata->downloaded = now_downloaded;
 
     // Prepare values for the user callback
-    double totalsize = 0.0;
-    double downloaded = 0.0;
-
-    for (GSList *elem = shared_cbdata->singlecbdata; elem; elem = g_slist_next(elem)) {
-        LrCallbackData *singlecbdata = elem->data;
-        totalsize += singlecbdata->total;
-        downloaded += singlecbdata->downloaded;
-    }
+    double totalsize = shared_cbdata->totalsize;
+    double downloaded = shared_cbdata->downloaded;
 
     if (downloaded > totalsize)
         totalsize = downloaded;
 
+    // Reports of all targets are coalesced, but the final report
+    // of each target is passed
+    if (!progress_throttle_due(&shared_cbdata->throttle,
+                               totalsize,
+                               downloaded,
+                               total_to_download > 0
+                               && now_downloaded >= total_to_download))
+        return LR_CB_OK;
+
     // Call user callback
     return shared_cbdata->cb(cbdata->userdata,
                              totalsize,
@@ -2180,11 +5833,23 @@ lr_download_single_cb(GSList *targets,
     shared_cbdata.cb                 = cb;
     shared_cbdata.mfcb               = mfcb;
     shared_cbdata.singlecbdata       = NULL;
+    shared_cbdata.totalsize          = 0.0;
+    shared_cbdata.downloaded         = 0.0;
+    progress_throttle_init(&shared_cbdata.throttle,
+                           LRO_PROGRESSINTERVAL_DEFAULT * 1000,
+                           LRO_PROGRESSDELTA_DEFAULT);
 
     // "Inject" callbacks and callback data to the targets
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
         LrDownloadTarget *target = elem->data;
 
+        // Coalescing of the aggregate reports is configured
+        // by the handle of the targets
+        if (target->handle && elem == targets)
+            progress_throttle_init(&shared_cbdata.throttle,
+                    (gint64) target->handle->progressinterval * 1000,
+                    target->handle->progressdelta);
+
         LrCallbackData *lrcbdata = lr_malloc0(sizeof(*lrcbdata));
         lrcbdata->downloaded        = 0.0;
         lrcbdata->total             = 0.0;
@@ -2195,8 +5860,8 @@ lr_download_single_cb(GSList *targets,
         target->mirrorfailurecb = (mfcb) ? lr_multi_mf_func : NULL;
         target->cbdata          = lrcbdata;
 
-        shared_cbdata.singlecbdata = g_slist_append(shared_cbdata.singlecbdata,
-                                                    lrcbdata);
+        shared_cbdata.singlecbdata = g_slist_prepend(shared_cbdata.singlecbdata,
+                                                     lrcbdata);
     }
 
     ret = lr_download(targets, failfast, err);
@@ -102,6 +102,94 @@ lr_download_single_cb(GSList *targets,
                       LrMirrorFailureCb mfcb,
                       GError **err);
 
+/** Non-blocking download which could be driven by an external event
+ * loop. Usage:
+ *
+ *  1. Create the download by ::lr_asyncdownload_new.
+ *  2. Add targets by ::lr_asyncdownload_add_target (targets could be
+ *     added at any time, even if other transfers are already running).
+ *  3. Wait until the fd returned by ::lr_asyncdownload_get_fd is readable
+ *     or until the timeout returned by ::lr_asyncdownload_get_timeout
+ *     expires and call ::lr_asyncdownload_process.
+ *  4. Collect finished targets by ::lr_asyncdownload_pop_finished.
+ *  5. Repeat 3. and 4. while ::lr_asyncdownload_is_running returns TRUE.
+ *  6. Free the download by ::lr_asyncdownload_free.
+ */
+typedef struct _LrAsyncDownload LrAsyncDownload;
+
+/** Create a new asynchronous download.
+ * @param handle    Handle the download configuration (max parallel
+ *                  connections etc.) is taken from or NULL.
+ * @param failfast  See ::lr_download
+ * @param err       GError **
+ * @return          New download or NULL if err is set
+ */
+LrAsyncDownload *
+lr_asyncdownload_new(LrHandle *handle, gboolean failfast, GError **err);
+
+/** Add the target to the download. Its transfer is started immediately
+ * if the limits of parallel transfers allow it.
+ * @param ad        Download
+ * @param target    ::LrDownloadTarget (it has to live until it is
+ *                  returned by ::lr_asyncdownload_pop_finished or until
+ *                  the download is freed)
+ * @param err       GError **
+ * @return          If FALSE then err is set and the download is aborted
+ */
+gboolean
+lr_asyncdownload_add_target(LrAsyncDownload *ad,
+                            LrDownloadTarget *target,
+                            GError **err);
+
+/** File descriptor which becomes readable when the download needs
+ * to be processed by ::lr_asyncdownload_process. The fd is valid
+ * until the download is freed.
+ * @param ad        Download
+ * @return          File descriptor
+ */
+int
+lr_asyncdownload_get_fd(LrAsyncDownload *ad);
+
+/** Max time the caller could wait for the fd of the download before
+ * ::lr_asyncdownload_process has to be called.
+ * @param ad        Download
+ * @return          Time in milliseconds or -1 if nothing is running
+ */
+long
+lr_asyncdownload_get_timeout(LrAsyncDownload *ad);
+
+/** Process the ready sockets and expired timers of the download, check
+ * finished transfers and start the waiting ones. It never blocks.
+ * @param ad        Download
+ * @param err       GError **
+ * @return          If FALSE then err is set and the download is aborted
+ *                  (all not finished targets are marked as failed)
+ */
+gboolean
+lr_asyncdownload_process(LrAsyncDownload *ad, GError **err);
+
+/** Pop the next finished (successfully or not) target. The result of
+ * the download is in rcode and err of the target.
+ * @param ad        Download
+ * @return          ::LrDownloadTarget or NULL if no target is finished
+ */
+LrDownloadTarget *
+lr_asyncdownload_pop_finished(LrAsyncDownload *ad);
+
+/** Are there some running or waiting transfers?
+ * @param ad        Download
+ * @return          TRUE if the download has to be processed further
+ */
+gboolean
+lr_asyncdownload_is_running(LrAsyncDownload *ad);
+
+/** Free the download. Running transfers are aborted and files of
+ * targets which were not downloaded successfully are removed.
+ * @param ad        Download or NULL
+ */
+void
+lr_asyncdownload_free(LrAsyncDownload *ad);
+
 /** @} */
 
 G_END_DECLS
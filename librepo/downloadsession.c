@@ -0,0 +1,160 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <curl/curl.h>
+
+#include "rcodes.h"
+#include "util.h"
+#include "downloadsession.h"
+#include "downloadsession_internal.h"
+
+/** How often (in milliseconds) the pre-warm thread checks whether
+ * it should stop. */
+#define LR_PREWARM_POLL_INTERVAL    50
+
+LrDownloadSession *
+lr_downloadsession_new(GError **err)
+{
+    LrDownloadSession *session;
+
+    assert(!err || *err == NULL);
+
+    lr_global_init();
+
+    CURLM *multi_handle = curl_multi_init();
+    if (!multi_handle) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
+                    "curl_multi_init() call failed");
+        return NULL;
+    }
+
+    session = lr_malloc0(sizeof(*session));
+    session->multi_handle = multi_handle;
+    session->in_use = FALSE;
+    session->prewarm_thread = NULL;
+    session->prewarm_handles = NULL;
+
+    return session;
+}
+
+/** Drive the pre-warm requests until all of them finish or the thread
+ * is asked to stop. The thread doesn't log anything, log handlers
+ * (e.g. of the Python bindings) expect to be called from the thread
+ * which called librepo.
+ */
+static gpointer
+prewarm_thread_func(gpointer data)
+{
+    LrDownloadSession *session = data;
+    int running = 0;
+
+    for (GSList *elem = session->prewarm_handles;
+         elem;
+         elem = g_slist_next(elem))
+        curl_multi_add_handle(session->multi_handle, elem->data);
+
+    while (!g_atomic_int_get(&session->prewarm_stop)) {
+        if (curl_multi_perform(session->multi_handle, &running) != CURLM_OK
+            || !running)
+            break;
+        curl_multi_wait(session->multi_handle, NULL, 0,
+                        LR_PREWARM_POLL_INTERVAL, NULL);
+    }
+
+    return NULL;
+}
+
+void
+lr_downloadsession_prewarm(LrDownloadSession *session, GSList *handles)
+{
+    GError *tmp_err = NULL;
+
+    if (!handles)
+        return;
+
+    if (session->in_use || session->prewarm_thread) {
+        g_slist_free_full(handles, (GDestroyNotify) curl_easy_cleanup);
+        return;
+    }
+
+    g_debug("%s: Opening %u connections", __func__, g_slist_length(handles));
+
+    session->prewarm_handles = handles;
+    g_atomic_int_set(&session->prewarm_stop, 0);
+    session->prewarm_thread = g_thread_try_new("librepo-prewarm",
+                                               prewarm_thread_func,
+                                               session,
+                                               &tmp_err);
+    if (!session->prewarm_thread) {
+        g_debug("%s: Cannot start thread: %s", __func__, tmp_err->message);
+        g_error_free(tmp_err);
+        g_slist_free_full(handles, (GDestroyNotify) curl_easy_cleanup);
+        session->prewarm_handles = NULL;
+    }
+}
+
+void
+lr_downloadsession_prewarm_stop(LrDownloadSession *session)
+{
+    CURLMsg *msg;
+    int msgs_left, established = 0;
+
+    if (!session || !session->prewarm_thread)
+        return;
+
+    g_atomic_int_set(&session->prewarm_stop, 1);
+    g_thread_join(session->prewarm_thread);
+    session->prewarm_thread = NULL;
+
+    while ((msg = curl_multi_info_read(session->multi_handle, &msgs_left)))
+        if (msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK)
+            established++;
+
+    // Connections of the finished requests stay in the cache,
+    // unfinished ones are closed
+    for (GSList *elem = session->prewarm_handles;
+         elem;
+         elem = g_slist_next(elem))
+    {
+        curl_multi_remove_handle(session->multi_handle, elem->data);
+        curl_easy_cleanup(elem->data);
+    }
+
+    g_debug("%s: %d of %u connections were established", __func__,
+            established, g_slist_length(session->prewarm_handles));
+
+    g_slist_free(session->prewarm_handles);
+    session->prewarm_handles = NULL;
+}
+
+void
+lr_downloadsession_free(LrDownloadSession *session)
+{
+    if (!session)
+        return;
+
+    assert(!session->in_use);
+
+    lr_downloadsession_prewarm_stop(session);
+    curl_multi_cleanup(session->multi_handle);
+    lr_free(session);
+}
@@ -0,0 +1,68 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_DOWNLOADSESSION_H__
+#define __LR_DOWNLOADSESSION_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** \defgroup   downloadsession    Download session
+ *  \addtogroup downloadsession
+ *  @{
+ */
+
+/** Download session.
+ * Session keeps a curl multi handle (and thus a cache of live
+ * connections) across several ::lr_download calls. Subsequent downloads
+ * from the same host (mirrorlist, metalink, repomd.xml, metadata,
+ * packages, ...) reuse already established TCP and TLS connections.
+ *
+ * Each ::LrHandle owns its own session by default. A session could be
+ * also created by ::lr_downloadsession_new and shared by several
+ * handles via LRO_DOWNLOADSESSION option.
+ *
+ * Note: A session must not be used from more threads at the same time.
+ * If the session is already used by a running download (e.g. lr_download
+ * is called from a callback), the nested download uses its own temporary
+ * curl multi handle.
+ */
+typedef struct _LrDownloadSession LrDownloadSession;
+
+/** Create new download session.
+ * @param err       GError **
+ * @return          New session or NULL if err is set
+ */
+LrDownloadSession *
+lr_downloadsession_new(GError **err);
+
+/** Free the session and close all its cached connections.
+ * The session must not be attached to any ::LrHandle at this moment.
+ * @param session   Download session or NULL
+ */
+void
+lr_downloadsession_free(LrDownloadSession *session);
+
+/** @} */
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,75 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_DOWNLOADSESSION_INTERNAL_H__
+#define __LR_DOWNLOADSESSION_INTERNAL_H__
+
+#include <glib.h>
+#include <curl/curl.h>
+
+#include "downloadsession.h"
+
+G_BEGIN_DECLS
+
+struct _LrDownloadSession {
+
+    CURLM *multi_handle; /*!<
+        Curl multi handle which outlives single downloads and
+        keeps the cache of connections. */
+
+    gboolean in_use; /*!<
+        TRUE if the multi handle is currently used by a download. */
+
+    GThread *prewarm_thread; /*!<
+        Thread which opens connections in advance (LRO_PREWARMMIRRORS)
+        or NULL. While it runs, the multi handle is used only by it. */
+
+    GSList *prewarm_handles; /*!<
+        Easy handles of the pre-warm requests (CURL *) */
+
+    gint prewarm_stop; /*!<
+        Set (atomically) to ask the pre-warm thread to stop */
+};
+
+/** Open connections of the easy handles in a background thread on the
+ * multi handle of the session, so they are kept in its connection cache
+ * for the next downloads. The easy handles are expected to perform
+ * a cheap request (e.g. HEAD) and they are freed by the session.
+ * Nothing is done (the handles are just freed) if the session is in use
+ * or connections are already being opened.
+ * @param session       Download session
+ * @param handles       List of easy handles (CURL *), the list and
+ *                      the handles are taken over
+ */
+void
+lr_downloadsession_prewarm(LrDownloadSession *session, GSList *handles);
+
+/** Stop opening of the connections started by lr_downloadsession_prewarm()
+ * and wait for the thread. The connections which were already
+ * established stay in the cache. Must be called before the multi
+ * handle is used.
+ * @param session       Download session or NULL
+ */
+void
+lr_downloadsession_prewarm_stop(LrDownloadSession *session);
+
+G_END_DECLS
+
+#endif
@@ -120,6 +120,16 @@ lr_downloadtarget_reset(LrDownloadTarget *target)
     target->effectiveurl = NULL;
     target->rcode = LRE_OK;
     target->err = NULL;
+    target->notmodified = FALSE;
+    target->namelookup_time = 0.0;
+    target->connect_time = 0.0;
+    target->appconnect_time = 0.0;
+    target->starttransfer_time = 0.0;
+    target->total_time = 0.0;
+    target->average_speed = 0.0;
+    target->bytes_received = 0;
+    target->resumes = 0;
+    target->mirrors_tried = 0;
 }
 
 void
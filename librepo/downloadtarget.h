@@ -130,6 +130,66 @@ typedef struct {
         User data - This data are not used by lr_downloader or touched
         by lr_downloadtarget_free. */
 
+    // Items added later are appended, so the layout of the items above
+    // stays compatible with existing binaries
+
+    int priority; /*!<
+        Targets with higher priority are downloaded first
+        (see LRO_SCHEDULINGPOLICY). 0 is default. The priority is not
+        a param of lr_downloadtarget_new(), set it directly. */
+
+    gboolean conditional; /*!<
+        Download the target only if it was modified on the server.
+        If the file already contains a copy downloaded by Librepo,
+        a HTTP conditional request (If-None-Match, If-Modified-Since)
+        is used and the copy is kept untouched if the server replies
+        304 Not Modified (see notmodified). The ETag and Last-Modified
+        of a downloaded copy are stored with the file (in an extended
+        attribute or in "<file>.validators" if the filesystem doesn't
+        support them). The conditional is not a param of
+        lr_downloadtarget_new(), set it directly. */
+
+    // Filled by downloader
+
+    gboolean notmodified; /*!<
+        TRUE if the transfer of a conditional target was successful,
+        because the server reported that the existing copy of the file
+        was not modified. The file was not touched. */
+
+    // Timing of the last transfer of the target (in seconds from its
+    // start). Phases which were skipped thanks to a reused connection
+    // are reported as 0.
+
+    double namelookup_time; /*!<
+        Host name was resolved (CURLINFO_NAMELOOKUP_TIME) */
+
+    double connect_time; /*!<
+        Connection was established (CURLINFO_CONNECT_TIME) */
+
+    double appconnect_time; /*!<
+        TLS handshake was done (CURLINFO_APPCONNECT_TIME), 0 if TLS
+        was not used */
+
+    double starttransfer_time; /*!<
+        First byte was received (CURLINFO_STARTTRANSFER_TIME) */
+
+    double total_time; /*!<
+        Transfer was finished (CURLINFO_TOTAL_TIME) */
+
+    double average_speed; /*!<
+        Average speed of the last transfer in bytes per second */
+
+    gint64 bytes_received; /*!<
+        Bytes received by all transfers of the target, including
+        the unsuccessful ones */
+
+    int resumes; /*!<
+        Number of transfers which continued a partially downloaded file
+        (see resume and LRO_MIGRATESLOWTRANSFERS) */
+
+    int mirrors_tried; /*!<
+        Number of mirrors the target was tried from */
+
 } LrDownloadTarget;
 
 /** Create new empty ::LrDownloadTarget.
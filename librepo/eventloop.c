@@ -0,0 +1,324 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <curl/curl.h>
+
+#include "rcodes.h"
+#include "util.h"
+#include "eventloop_internal.h"
+
+/** Max number of events processed by a single epoll_wait() call */
+#define LR_EVENTLOOP_MAXEVENTS  64
+
+struct _LrEventLoop {
+    CURLM *multi_handle; /*!<
+        Multi handle driven by this loop */
+    GQuark domain; /*!<
+        Error domain for errors reported by the loop */
+    int epfd; /*!<
+        Epoll file descriptor */
+    gint64 timer_deadline; /*!<
+        Monotonic time (in microseconds) when curl wants to be called
+        with CURL_SOCKET_TIMEOUT or -1 if there is no timer. */
+    int socket_errno; /*!<
+        Errno of the last failed epoll_ctl() call from the socket
+        callback or 0. */
+    int wakeup_fd; /*!<
+        File descriptor watched by lr_eventloop_watch_fd() or -1 */
+};
+
+/** CURLMOPT_SOCKETFUNCTION callback.
+ * Keeps the set of sockets watched by epoll in sync with curl.
+ */
+static int
+lr_eventloop_socketcb(G_GNUC_UNUSED CURL *easy,
+                      curl_socket_t s,
+                      int what,
+                      void *userp,
+                      void *socketp)
+{
+    LrEventLoop *loop = userp;
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+
+    if (what == CURL_POLL_REMOVE) {
+        // Curl doesn't want to watch the socket anymore
+        // (Non NULL event is required by kernels older than 2.6.9)
+        if (socketp)
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, s, &ev);
+        return 0;
+    }
+
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = s;
+
+    if (socketp) {
+        // The socket is already watched
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev) == 0)
+            return 0;
+
+        if (errno != ENOENT) {
+            g_debug("%s: epoll_ctl(EPOLL_CTL_MOD, %d) failed: %s",
+                    __func__, s, strerror(errno));
+            loop->socket_errno = errno;
+            return 0;
+        }
+
+        // The socket was marked by a loop used for a previous
+        // lr_download() call on the same (persistent) multi handle,
+        // but it is not watched by this loop yet.
+    }
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, s, &ev) == -1) {
+        g_debug("%s: epoll_ctl(EPOLL_CTL_ADD, %d) failed: %s",
+                __func__, s, strerror(errno));
+        loop->socket_errno = errno;
+        return 0;
+    }
+
+    // Mark the socket as watched
+    curl_multi_assign(loop->multi_handle, s, loop);
+
+    return 0;
+}
+
+/** CURLMOPT_TIMERFUNCTION callback.
+ */
+static int
+lr_eventloop_timercb(G_GNUC_UNUSED CURLM *multi,
+                     long timeout_ms,
+                     void *userp)
+{
+    LrEventLoop *loop = userp;
+
+    if (timeout_ms < 0)
+        loop->timer_deadline = -1;
+    else
+        loop->timer_deadline = g_get_monotonic_time() + timeout_ms * 1000;
+
+    return 0;
+}
+
+LrEventLoop *
+lr_eventloop_new(CURLM *multi_handle, GQuark domain, GError **err)
+{
+    LrEventLoop *loop;
+
+    assert(multi_handle);
+    assert(!err || *err == NULL);
+
+    loop = lr_malloc0(sizeof(*loop));
+    loop->multi_handle = multi_handle;
+    loop->domain = domain;
+
+    // Easy handles could be already added to the multi handle,
+    // so let curl process them in the first iteration.
+    loop->timer_deadline = g_get_monotonic_time();
+    loop->wakeup_fd = -1;
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd == -1) {
+        g_set_error(err, domain, LRE_SELECT,
+                    "epoll_create1() failed: %s", strerror(errno));
+        lr_free(loop);
+        return NULL;
+    }
+
+    curl_multi_setopt(multi_handle, CURLMOPT_SOCKETFUNCTION,
+                      lr_eventloop_socketcb);
+    curl_multi_setopt(multi_handle, CURLMOPT_SOCKETDATA, loop);
+    curl_multi_setopt(multi_handle, CURLMOPT_TIMERFUNCTION,
+                      lr_eventloop_timercb);
+    curl_multi_setopt(multi_handle, CURLMOPT_TIMERDATA, loop);
+
+    return loop;
+}
+
+void
+lr_eventloop_free(LrEventLoop *loop)
+{
+    if (!loop)
+        return;
+
+    curl_multi_setopt(loop->multi_handle, CURLMOPT_SOCKETFUNCTION, NULL);
+    curl_multi_setopt(loop->multi_handle, CURLMOPT_SOCKETDATA, NULL);
+    curl_multi_setopt(loop->multi_handle, CURLMOPT_TIMERFUNCTION, NULL);
+    curl_multi_setopt(loop->multi_handle, CURLMOPT_TIMERDATA, NULL);
+
+    close(loop->epfd);
+    lr_free(loop);
+}
+
+static gboolean
+lr_eventloop_socket_action(LrEventLoop *loop,
+                           curl_socket_t s,
+                           int ev_bitmask,
+                           int *still_running,
+                           GError **err)
+{
+    CURLMcode cm_rc;
+
+    do { // Before version 7.20.0 CURLM_CALL_MULTI_PERFORM can appear
+        cm_rc = curl_multi_socket_action(loop->multi_handle, s,
+                                         ev_bitmask, still_running);
+    } while (cm_rc == CURLM_CALL_MULTI_PERFORM);
+
+    if (cm_rc != CURLM_OK) {
+        g_set_error(err, loop->domain, LRE_CURLM,
+                    "curl_multi_socket_action() error: %s",
+                    curl_multi_strerror(cm_rc));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+lr_eventloop_watch_fd(LrEventLoop *loop, int fd, GError **err)
+{
+    struct epoll_event ev;
+
+    assert(loop);
+    assert(loop->wakeup_fd == -1);
+    assert(!err || *err == NULL);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        g_set_error(err, loop->domain, LRE_SELECT,
+                    "epoll_ctl(EPOLL_CTL_ADD, %d) failed: %s",
+                    fd, strerror(errno));
+        return FALSE;
+    }
+
+    loop->wakeup_fd = fd;
+    return TRUE;
+}
+
+int
+lr_eventloop_get_fd(LrEventLoop *loop)
+{
+    assert(loop);
+    return loop->epfd;
+}
+
+long
+lr_eventloop_get_timeout(LrEventLoop *loop, long max_wait_ms)
+{
+    long timeout = max_wait_ms;
+
+    assert(loop);
+
+    if (loop->timer_deadline >= 0) {
+        gint64 remaining = loop->timer_deadline - g_get_monotonic_time();
+        remaining = (remaining > 0) ? (remaining + 999) / 1000 : 0;
+        if (remaining < timeout)
+            timeout = (long) remaining;
+    }
+
+    return timeout;
+}
+
+gboolean
+lr_eventloop_run_once(LrEventLoop *loop,
+                      long max_wait_ms,
+                      int *still_running,
+                      GError **err)
+{
+    struct epoll_event events[LR_EVENTLOOP_MAXEVENTS];
+    long timeout;
+    int nfds;
+    int serviced = 0;
+
+    assert(loop);
+    assert(still_running);
+    assert(!err || *err == NULL);
+
+    *still_running = 0;
+
+    // Do not sleep longer than curl wants
+    timeout = lr_eventloop_get_timeout(loop, max_wait_ms);
+
+    nfds = epoll_wait(loop->epfd, events, LR_EVENTLOOP_MAXEVENTS, (int) timeout);
+    if (nfds < 0) {
+        if (errno == EINTR) {
+            g_debug("%s: epoll_wait() interrupted by signal", __func__);
+            nfds = 0;
+        } else {
+            g_set_error(err, loop->domain, LRE_SELECT,
+                        "epoll_wait() error: %s", strerror(errno));
+            return FALSE;
+        }
+    }
+
+    // Service only the sockets with some activity
+    for (int x = 0; x < nfds; x++) {
+        int ev_bitmask = 0;
+
+        // The watched fd is drained by its owner
+        if (events[x].data.fd == loop->wakeup_fd)
+            continue;
+
+        if (events[x].events & EPOLLIN)
+            ev_bitmask |= CURL_CSELECT_IN;
+        if (events[x].events & EPOLLOUT)
+            ev_bitmask |= CURL_CSELECT_OUT;
+        if (events[x].events & (EPOLLERR|EPOLLHUP))
+            ev_bitmask |= CURL_CSELECT_ERR;
+
+        if (!lr_eventloop_socket_action(loop, events[x].data.fd, ev_bitmask,
+                                        still_running, err))
+            return FALSE;
+        serviced++;
+    }
+
+    // Handle expired timer (or just obtain number of running handles
+    // if no socket was serviced)
+    if (serviced == 0 || (loop->timer_deadline >= 0
+                      && loop->timer_deadline <= g_get_monotonic_time()))
+    {
+        loop->timer_deadline = -1;
+        if (!lr_eventloop_socket_action(loop, CURL_SOCKET_TIMEOUT, 0,
+                                        still_running, err))
+            return FALSE;
+    }
+
+    if (loop->socket_errno) {
+        int socket_errno = loop->socket_errno;
+        loop->socket_errno = 0;
+        g_set_error(err, loop->domain, LRE_SELECT,
+                    "epoll_ctl() error: %s", strerror(socket_errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,100 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_EVENTLOOP_INTERNAL_H__
+#define __LR_EVENTLOOP_INTERNAL_H__
+
+#include <glib.h>
+#include <curl/curl.h>
+
+G_BEGIN_DECLS
+
+/** Event loop driving a curl multi handle via epoll and
+ * curl_multi_socket_action(). Only sockets with some activity
+ * (and expired curl timers) are serviced in each iteration.
+ */
+typedef struct _LrEventLoop LrEventLoop;
+
+/** Create a new event loop and attach it to the multi handle.
+ * CURLMOPT_SOCKETFUNCTION and CURLMOPT_TIMERFUNCTION of the multi handle
+ * are set by this function. Easy handles could be added to the multi
+ * handle before or after the loop is created.
+ * @param multi_handle      Curl multi handle
+ * @param domain            Error domain used for errors reported by the loop
+ * @param err               GError **
+ * @return                  New event loop or NULL if err is set
+ */
+LrEventLoop *
+lr_eventloop_new(CURLM *multi_handle, GQuark domain, GError **err);
+
+/** Detach the loop from its multi handle and free it.
+ * @param loop              Event loop or NULL
+ */
+void
+lr_eventloop_free(LrEventLoop *loop);
+
+/** Wait for activity on sockets of the multi handle (at most
+ * max_wait_ms milliseconds or until a curl timer expires) and let
+ * curl process the ready sockets and expired timers.
+ * @param loop              Event loop
+ * @param max_wait_ms       Max time to wait in milliseconds
+ * @param still_running     Number of still running easy handles
+ * @param err               GError **
+ * @return                  TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_eventloop_run_once(LrEventLoop *loop,
+                      long max_wait_ms,
+                      int *still_running,
+                      GError **err);
+
+/** Watch also the fd (for EPOLLIN), so lr_eventloop_run_once() returns
+ * and the fd of the loop becomes readable when the fd is readable.
+ * The loop doesn't read from the fd, its owner has to drain it.
+ * Only one fd could be watched.
+ * @param loop              Event loop
+ * @param fd                File descriptor (e.g. read end of a pipe)
+ * @param err               GError **
+ * @return                  TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_eventloop_watch_fd(LrEventLoop *loop, int fd, GError **err);
+
+/** File descriptor which becomes readable when some socket of the multi
+ * handle needs to be serviced. It could be watched by an external event
+ * loop (epoll, poll, GMainContext, ...) which then calls
+ * lr_eventloop_run_once() with zero max_wait_ms.
+ * @param loop              Event loop
+ * @return                  Epoll file descriptor of the loop
+ */
+int
+lr_eventloop_get_fd(LrEventLoop *loop);
+
+/** Time until curl wants to be called because of its timers.
+ * @param loop              Event loop
+ * @param max_wait_ms       Max time in milliseconds
+ * @return                  Time in milliseconds (at most max_wait_ms)
+ */
+long
+lr_eventloop_get_timeout(LrEventLoop *loop, long max_wait_ms);
+
+G_END_DECLS
+
+#endif
@@ -31,6 +31,7 @@
 #include "rcodes.h"
 #include "fastestmirror.h"
 #include "fastestmirror_internal.h"
+#include "eventloop_internal.h"
 
 #define LENGTH_OF_MEASUREMENT        2.0    // Number of seconds (float point!)
 #define HALF_OF_SECOND_IN_MICROS    500000
@@ -382,9 +383,78 @@ lr_fastestmirror_prepare(LrHandle *handle,
     return ret;
 }
 
+/** One iteration of the select() based measurement loop.
+ */
+static gboolean
+lr_fastestmirror_select_once(CURLM *multihandle,
+                             int *still_running,
+                             GError **err)
+{
+    struct timeval timeout;
+    int rc, cm_rc;
+    int maxfd = -1;
+    long curl_timeout = -1;
+    fd_set fdread, fdwrite, fdexcep;
+
+    FD_ZERO(&fdread);
+    FD_ZERO(&fdwrite);
+    FD_ZERO(&fdexcep);
+
+    // Set suitable timeout to play around with
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
+
+    cm_rc = curl_multi_timeout(multihandle, &curl_timeout);
+    if (cm_rc != CURLM_OK) {
+        g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_CURLM,
+                    "curl_multi_timeout() error: %s",
+                    curl_multi_strerror(cm_rc));
+        return FALSE;
+    }
+
+    // Set timeout to a reasonable value
+    if (curl_timeout >= 0) {
+        timeout.tv_sec = curl_timeout / 1000;
+        if (timeout.tv_sec >= 1) {
+            timeout.tv_sec = 0;
+            timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
+        } else {
+            timeout.tv_usec = (curl_timeout % 1000) * 1000;
+            if (timeout.tv_usec > HALF_OF_SECOND_IN_MICROS)
+                timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
+        }
+    }
+
+    // Get file descriptors from the transfers
+    cm_rc = curl_multi_fdset(multihandle, &fdread, &fdwrite,
+                             &fdexcep, &maxfd);
+    if (cm_rc != CURLM_OK) {
+        g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_CURLM,
+                    "curl_multi_fdset() error: %s",
+                    curl_multi_strerror(cm_rc));
+        return FALSE;
+    }
+
+    rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
+    if (rc < 0) {
+        if (errno == EINTR) {
+            g_debug("%s: select() interrupted by signal", __func__);
+        } else {
+            g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_SELECT,
+                        "select() error: %s", strerror(errno));
+            return FALSE;
+        }
+    }
+
+    curl_multi_perform(multihandle, still_running);
+
+    return TRUE;
+}
+
 static gboolean
 lr_fastestmirror_perform(GSList *list,
                          gdouble length_of_measurement,
+                         LrEventEngine eventengine,
                          LrFastestMirrorCb cb,
                          void *cbdata,
                          GError **err)
@@ -416,79 +486,46 @@ lr_fastestmirror_perform(GSList *list,
         return TRUE;
     }
 
+    LrEventLoop *loop = NULL;
+    if (eventengine == LR_EVENTENGINE_EPOLL) {
+        loop = lr_eventloop_new(multihandle, LR_FASTESTMIRROR_ERROR, err);
+        if (!loop) {
+            curl_multi_cleanup(multihandle);
+            return FALSE;
+        }
+    }
+
     cb(cbdata, LR_FMSTAGE_DETECTION, (void *) &handles_added);
 
     int still_running;
+    gboolean ret;
     gdouble elapsed_time = 0.0;
     GTimer *timer = g_timer_new();
     g_timer_start(timer);
 
     do {
-        struct timeval timeout;
-        int rc, cm_rc;
-        int maxfd = -1;
-        long curl_timeout = -1;
-        fd_set fdread, fdwrite, fdexcep;
-
-        FD_ZERO(&fdread);
-        FD_ZERO(&fdwrite);
-        FD_ZERO(&fdexcep);
-
-        // Set suitable timeout to play around with
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
-
-        cm_rc = curl_multi_timeout(multihandle, &curl_timeout);
-        if (cm_rc != CURLM_OK) {
-            g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_CURLM,
-                        "curl_multi_timeout() error: %s",
-                        curl_multi_strerror(cm_rc));
-            curl_multi_cleanup(multihandle);
-            return FALSE;
-        }
-
-        // Set timeout to a reasonable value
-        if (curl_timeout >= 0) {
-            timeout.tv_sec = curl_timeout / 1000;
-            if (timeout.tv_sec >= 1) {
-                timeout.tv_sec = 0;
-                timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
-            } else {
-                timeout.tv_usec = (curl_timeout % 1000) * 1000;
-                if (timeout.tv_usec > HALF_OF_SECOND_IN_MICROS)
-                    timeout.tv_usec = HALF_OF_SECOND_IN_MICROS;
-            }
-        }
-
-        // Get file descriptors from the transfers
-        cm_rc = curl_multi_fdset(multihandle, &fdread, &fdwrite,
-                                 &fdexcep, &maxfd);
-        if (cm_rc != CURLM_OK) {
-            g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_CURLM,
-                        "curl_multi_fdset() error: %s",
-                        curl_multi_strerror(cm_rc));
+        if (loop)
+            ret = lr_eventloop_run_once(loop,
+                                        HALF_OF_SECOND_IN_MICROS / 1000,
+                                        &still_running,
+                                        err);
+        else
+            ret = lr_fastestmirror_select_once(multihandle,
+                                               &still_running,
+                                               err);
+        if (!ret) {
+            g_timer_destroy(timer);
+            lr_eventloop_free(loop);
             return FALSE;
         }
 
-        rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
-        if (rc < 0) {
-            if (errno == EINTR) {
-                g_debug("%s: select() interrupted by signal", __func__);
-            } else {
-                g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_SELECT,
-                            "select() error: %s", strerror(errno));
-                return FALSE;
-            }
-        }
-
-        curl_multi_perform(multihandle, &still_running);
-
         // Break loop after some reasonable amount of time
         elapsed_time = g_timer_elapsed(timer, NULL);
 
     } while(still_running && elapsed_time < length_of_measurement);
 
     g_timer_destroy(timer);
+    lr_eventloop_free(loop);
 
     // Remove curl easy handles from multi handle
     // and calculate plain_connect_time
@@ -584,6 +621,7 @@ lr_fastestmirror_detailed(LrHandle *handle,
     gdouble length_of_measurement = LENGTH_OF_MEASUREMENT;
     LrFastestMirrorCb cb = null_cb;
     void *cbdata = NULL;
+    LrEventEngine eventengine = LRO_EVENTENGINE_DEFAULT;
 
     if (handle) {
         fastestmirrorcache = handle->fastestmirrorcache;
@@ -591,6 +629,7 @@ lr_fastestmirror_detailed(LrHandle *handle,
             cb = handle->fastestmirrorcb;
         cbdata = handle->fastestmirrordata;
         length_of_measurement = handle->fastestmirrortimeout;
+        eventengine = handle->eventengine;
 
         if (handle->offline) {
             g_debug("%s: Fastest mirror determination "
@@ -632,6 +671,7 @@ lr_fastestmirror_detailed(LrHandle *handle,
 
     ret = lr_fastestmirror_perform(lrfastestmirrors,
                                    length_of_measurement,
+                                   eventengine,
                                    cb,
                                    cbdata,
                                    err);
@@ -0,0 +1,293 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE  // for fallocate() and posix_memalign()
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rcodes.h"
+#include "util.h"
+#include "filewriter_internal.h"
+
+struct _LrFileWriter {
+    int fd;         /*!< File descriptor */
+    gint64 offset;  /*!< Offset of the first byte of the buffer in the file */
+    char *buf;      /*!< Buffer (aligned) or NULL if not buffered */
+    size_t size;    /*!< Size of the buffer */
+    size_t used;    /*!< Number of bytes in the buffer */
+    LrIoUring *ring;        /*!< Ring which writes full buffers or NULL */
+    char *inflight;         /*!< Buffer being written by the ring or NULL */
+    size_t inflight_len;    /*!< Length of the data being written */
+    gint64 inflight_offset; /*!< Offset of the data being written */
+    char *spare;            /*!< Free second buffer or NULL */
+    int pending;            /*!< Number of writes in flight (0 or 1) */
+    GError *error;          /*!< Error of the asynchronous write or NULL */
+};
+
+LrFileWriter *
+lr_filewriter_new(int fd, gint64 offset, size_t bufsize)
+{
+    LrFileWriter *writer = lr_malloc0(sizeof(*writer));
+
+    assert(fd >= 0);
+    assert(offset >= 0);
+
+    writer->fd = fd;
+    writer->offset = offset;
+
+    if (bufsize > 0) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, LR_FILEWRITER_ALIGNMENT, bufsize) == 0) {
+            writer->buf = buf;
+            writer->size = bufsize;
+        } else {
+            g_debug("%s: Cannot allocate buffer of size %zu, "
+                    "data will be written unbuffered", __func__, bufsize);
+        }
+    }
+
+    return writer;
+}
+
+/** Write the whole data to the file at the offset.
+ */
+static gboolean
+pwrite_all(int fd, const char *buf, size_t len, gint64 offset, GError **err)
+{
+    while (len > 0) {
+        ssize_t rc = pwrite(fd, buf, len, (off_t) offset);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "pwrite(%d) failed: %s", fd, strerror(errno));
+            return FALSE;
+        }
+        buf += rc;
+        len -= rc;
+        offset += rc;
+    }
+
+    return TRUE;
+}
+
+void
+lr_filewriter_set_iouring(LrFileWriter *writer, LrIoUring *ring)
+{
+    assert(writer);
+    assert(!writer->pending);
+    writer->ring = ring;
+}
+
+/** Called when the asynchronous write of the ring is completed.
+ */
+static void
+filewriter_write_done(void *data, int res)
+{
+    LrFileWriter *writer = data;
+
+    if (res < 0) {
+        g_set_error(&writer->error, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "pwrite(%d) failed: %s", writer->fd, strerror(-res));
+    } else if ((size_t) res < writer->inflight_len) {
+        // Short write, write the rest directly
+        pwrite_all(writer->fd,
+                   writer->inflight + res,
+                   writer->inflight_len - res,
+                   writer->inflight_offset + res,
+                   &writer->error);
+    }
+
+    writer->spare = writer->inflight;
+    writer->inflight = NULL;
+    writer->pending = 0;
+}
+
+/** Wait for the asynchronous write in flight and report its error.
+ */
+static gboolean
+filewriter_wait(LrFileWriter *writer, GError **err)
+{
+    if (writer->pending && !lr_iouring_wait(writer->ring, &writer->pending)) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
+                    "Asynchronous write to %d failed", writer->fd);
+        return FALSE;
+    }
+
+    if (writer->error) {
+        g_propagate_error(err, writer->error);
+        writer->error = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/** Write the buffered data to the file - asynchronously if the writer
+ * uses a ring, the second buffer is filled in the meantime.
+ */
+static gboolean
+filewriter_write_back(LrFileWriter *writer, GError **err)
+{
+    if (!writer->ring)
+        return lr_filewriter_flush(writer, err);
+
+    if (writer->used == 0)
+        return TRUE;
+
+    // Only one write is in flight
+    if (!filewriter_wait(writer, err))
+        return FALSE;
+
+    if (!writer->spare) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, LR_FILEWRITER_ALIGNMENT, writer->size) != 0)
+            return lr_filewriter_flush(writer, err);
+        writer->spare = buf;
+    }
+
+    writer->inflight = writer->buf;
+    writer->inflight_len = writer->used;
+    writer->inflight_offset = writer->offset;
+    writer->buf = writer->spare;
+    writer->spare = NULL;
+    writer->offset += writer->used;
+    writer->used = 0;
+    writer->pending = 1;
+
+    lr_iouring_write(writer->ring,
+                     writer->fd,
+                     writer->inflight,
+                     writer->inflight_len,
+                     writer->inflight_offset,
+                     filewriter_write_done,
+                     writer);
+
+    return TRUE;
+}
+
+gboolean
+lr_filewriter_write(LrFileWriter *writer,
+                    const void *buf,
+                    size_t len,
+                    GError **err)
+{
+    assert(writer);
+    assert(!err || *err == NULL);
+
+    if (writer->used + len <= writer->size) {
+        // Fits to the buffer
+        memcpy(writer->buf + writer->used, buf, len);
+        writer->used += len;
+        if (writer->used < writer->size)
+            return TRUE;
+        // Buffer is full
+        return filewriter_write_back(writer, err);
+    }
+
+    if (!filewriter_write_back(writer, err))
+        return FALSE;
+
+    if (len < writer->size) {
+        memcpy(writer->buf, buf, len);
+        writer->used = len;
+        return TRUE;
+    }
+
+    // Data are bigger than the buffer, don't copy them
+    if (!pwrite_all(writer->fd, buf, len, writer->offset, err))
+        return FALSE;
+    writer->offset += len;
+
+    return TRUE;
+}
+
+gboolean
+lr_filewriter_flush(LrFileWriter *writer, GError **err)
+{
+    assert(writer);
+    assert(!err || *err == NULL);
+
+    if (!filewriter_wait(writer, err))
+        return FALSE;
+
+    if (writer->used == 0)
+        return TRUE;
+
+    if (!pwrite_all(writer->fd, writer->buf, writer->used, writer->offset, err))
+        return FALSE;
+
+    writer->offset += writer->used;
+    writer->used = 0;
+
+    return TRUE;
+}
+
+gint64
+lr_filewriter_offset(LrFileWriter *writer)
+{
+    assert(writer);
+    return writer->offset + writer->used;
+}
+
+void
+lr_filewriter_free(LrFileWriter *writer)
+{
+    if (!writer)
+        return;
+
+    if (writer->used > 0)
+        g_debug("%s: %zu bytes of unflushed data lost", __func__, writer->used);
+
+    if (writer->pending && !lr_iouring_wait(writer->ring, &writer->pending)) {
+        // The buffer could be still used by the kernel
+        g_debug("%s: Asynchronous write to %d not finished", __func__, writer->fd);
+        writer->inflight = NULL;
+    }
+
+    if (writer->error)
+        g_error_free(writer->error);
+    free(writer->inflight);
+    free(writer->spare);
+    free(writer->buf);
+    lr_free(writer);
+}
+
+void
+lr_file_preallocate(int fd, gint64 offset, gint64 len)
+{
+    if (len <= 0)
+        return;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    // Keep the file size untouched - downloader relies on the size
+    // of the file (resume, truncation of failed transfers, ...)
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) len) == -1)
+        g_debug("%s: fallocate(%d) failed: %s", __func__, fd, strerror(errno));
+#else
+    (void) fd;
+    (void) offset;
+#endif
+}
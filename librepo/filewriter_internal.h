@@ -0,0 +1,108 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_FILEWRITER_INTERNAL_H__
+#define __LR_FILEWRITER_INTERNAL_H__
+
+#include <glib.h>
+
+#include "iouring_internal.h"
+
+G_BEGIN_DECLS
+
+/** Alignment of the buffer of the file writer */
+#define LR_FILEWRITER_ALIGNMENT     4096
+
+/** Buffered writer of the downloaded data.
+ * Data are collected in a buffer and written by pwrite() at the
+ * tracked offset, so the writer doesn't depend on (and doesn't change)
+ * the position of the file descriptor.
+ */
+typedef struct _LrFileWriter LrFileWriter;
+
+/** Create new file writer.
+ * @param fd        File descriptor (not owned by the writer)
+ * @param offset    Offset in the file where the first byte is written
+ * @param bufsize   Size of the buffer. 0 means no buffering - every
+ *                  write goes directly to the file.
+ * @return          New file writer
+ */
+LrFileWriter *
+lr_filewriter_new(int fd, gint64 offset, size_t bufsize);
+
+/** Write full buffers asynchronously by the io_uring. The writer then
+ * uses two buffers - one is being filled while the other one is being
+ * written. Queued writes are passed to the kernel by the owner of
+ * the ring (::lr_iouring_submit). ::lr_filewriter_flush and
+ * ::lr_filewriter_free wait for the write in flight.
+ * @param writer    File writer
+ * @param ring      Ring which outlives the writer or NULL
+ */
+void
+lr_filewriter_set_iouring(LrFileWriter *writer, LrIoUring *ring);
+
+/** Append data to the file.
+ * @param writer    File writer
+ * @param buf       Data
+ * @param len       Length of the data
+ * @param err       GError **
+ * @return          TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_filewriter_write(LrFileWriter *writer,
+                    const void *buf,
+                    size_t len,
+                    GError **err);
+
+/** Write all buffered data to the file.
+ * @param writer    File writer
+ * @param err       GError **
+ * @return          TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_filewriter_flush(LrFileWriter *writer, GError **err);
+
+/** Offset in the file where the next byte will be written.
+ * Includes buffered data.
+ * @param writer    File writer
+ * @return          Offset
+ */
+gint64
+lr_filewriter_offset(LrFileWriter *writer);
+
+/** Free the writer. Buffered data which were not flushed are lost.
+ * @param writer    File writer or NULL
+ */
+void
+lr_filewriter_free(LrFileWriter *writer);
+
+/** Preallocate disk space for the region of the file.
+ * The size of the file is not changed. This is only a hint
+ * to the filesystem to keep the file contiguous, errors are ignored.
+ * @param fd        File descriptor
+ * @param offset    Start of the region
+ * @param len       Length of the region
+ */
+void
+lr_file_preallocate(int fd, gint64 offset, gint64 len);
+
+G_END_DECLS
+
+#endif
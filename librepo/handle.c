@@ -47,6 +47,9 @@
 #include "downloader.h"
 #include "fastestmirror_internal.h"
 #include "cleanup.h"
+#include "share_internal.h"
+#include "dnsprefetch_internal.h"
+#include "downloadsession_internal.h"
 
 CURL *
 lr_get_curl_handle()
@@ -66,6 +69,78 @@ lr_get_curl_handle()
     return h;
 }
 
+/** Free all easy handles in the pool of the handle and make the easy
+ * handles which are currently in use obsolete.
+ */
+static void
+lr_handle_curl_handle_pool_clear(LrHandle *handle)
+{
+    g_slist_free_full(handle->curl_handle_pool,
+                      (GDestroyNotify) curl_easy_cleanup);
+    handle->curl_handle_pool = NULL;
+    handle->curl_handle_generation++;
+}
+
+CURL *
+lr_handle_curl_handle_acquire(LrHandle *handle, guint *generation)
+{
+    CURL *curl;
+
+    *generation = handle->curl_handle_generation;
+
+    if (handle->curl_handle_pool) {
+        GSList *first = handle->curl_handle_pool;
+        curl = first->data;
+        handle->curl_handle_pool = g_slist_delete_link(first, first);
+    } else {
+        curl = curl_easy_duphandle(handle->curl_handle);
+    }
+
+    if (curl)
+        handle->curl_handles_in_use++;
+    return curl;
+}
+
+/** Account the end of use of an acquired easy handle. The replaced
+ * CURLOPT_RESOLVE lists are freed when no easy handle uses them.
+ */
+static void
+lr_handle_curl_handle_unuse(LrHandle *handle)
+{
+    assert(handle->curl_handles_in_use > 0);
+
+    if (--handle->curl_handles_in_use > 0)
+        return;
+
+    g_slist_free_full(handle->dns_resolve_old,
+                      (GDestroyNotify) curl_slist_free_all);
+    handle->dns_resolve_old = NULL;
+}
+
+void
+lr_handle_curl_handle_release(LrHandle *handle,
+                              CURL *curl,
+                              guint generation)
+{
+    if (!curl)
+        return;
+
+    if (generation != handle->curl_handle_generation)
+        curl_easy_cleanup(curl);
+    else
+        handle->curl_handle_pool = g_slist_prepend(handle->curl_handle_pool,
+                                                   curl);
+
+    lr_handle_curl_handle_unuse(handle);
+}
+
+void
+lr_handle_curl_handle_discard(LrHandle *handle, CURL *curl)
+{
+    curl_easy_cleanup(curl);
+    lr_handle_curl_handle_unuse(handle);
+}
+
 void
 lr_handle_free_list(char ***list)
 {
@@ -81,13 +156,22 @@ LrHandle *
 lr_handle_init()
 {
     LrHandle *handle;
+    LrDownloadSession *session;
     CURL *curl = lr_get_curl_handle();
 
     if (!curl)
         return NULL;
 
+    session = lr_downloadsession_new(NULL);
+    if (!session) {
+        curl_easy_cleanup(curl);
+        return NULL;
+    }
+
     handle = lr_malloc0(sizeof(LrHandle));
     handle->curl_handle = curl;
+    handle->downloadsession = session;
+    handle->downloadsession_owned = TRUE;
     handle->fastestmirrormaxage = LRO_FASTESTMIRRORMAXAGE_DEFAULT;
     handle->mirrorlist_fd = -1;
     handle->metalink_fd = -1;
@@ -103,6 +187,25 @@ lr_handle_init()
     handle->gnupghomedir = g_strdup(LRO_GNUPGHOMEDIR_DEFAULT);
     handle->fastestmirrortimeout = LRO_FASTESTMIRRORTIMEOUT_DEFAULT;
     handle->offline = LRO_OFFLINE_DEFAULT;
+    handle->eventengine = LRO_EVENTENGINE_DEFAULT;
+    handle->http2 = LRO_HTTP2_DEFAULT;
+    handle->maxstreamspermirror = LRO_MAXSTREAMSPERMIRROR_DEFAULT;
+    handle->maxsegments = LRO_MAXSEGMENTS_DEFAULT;
+    handle->minsegmentsize = LRO_MINSEGMENTSIZE_DEFAULT;
+    handle->writebuffersize = LRO_WRITEBUFFERSIZE_DEFAULT;
+    handle->adaptiveconcurrency = LRO_ADAPTIVECONCURRENCY_DEFAULT;
+    handle->adaptivemaxparalleldownloads = LRO_ADAPTIVEMAXPARALLELDOWNLOADS_DEFAULT;
+    handle->schedulingpolicy = LRO_SCHEDULINGPOLICY_DEFAULT;
+    handle->hedgedrequests = LRO_HEDGEDREQUESTS_DEFAULT;
+    handle->migrateslowtransfers = LRO_MIGRATESLOWTRANSFERS_DEFAULT;
+    handle->conditionalrequests = LRO_CONDITIONALREQUESTS_DEFAULT;
+    handle->workerthreads = LRO_WORKERTHREADS_DEFAULT;
+    handle->iouring = LRO_IOURING_DEFAULT;
+    handle->progressinterval = LRO_PROGRESSINTERVAL_DEFAULT;
+    handle->progressdelta = LRO_PROGRESSDELTA_DEFAULT;
+    handle->dnsprefetch = LRO_DNSPREFETCH_DEFAULT;
+    handle->happyeyeballstimeout = LRO_HAPPYEYEBALLSTIMEOUT_DEFAULT;
+    handle->prewarmmirrors = LRO_PREWARMMIRRORS_DEFAULT;
 
     return handle;
 }
@@ -112,8 +215,14 @@ lr_handle_free(LrHandle *handle)
 {
     if (!handle)
         return;
+    // Pre-warm requests use options (lists) of the handle
+    lr_downloadsession_prewarm_stop(handle->downloadsession);
+    lr_handle_curl_handle_pool_clear(handle);
     if (handle->curl_handle)
         curl_easy_cleanup(handle->curl_handle);
+    curl_slist_free_all(handle->dns_resolve);
+    g_slist_free_full(handle->dns_resolve_old,
+                      (GDestroyNotify) curl_slist_free_all);
     if (handle->mirrorlist_fd != -1)
         close(handle->mirrorlist_fd);
     if (handle->metalink_fd != -1)
@@ -141,6 +250,8 @@ lr_handle_free(LrHandle *handle)
     lr_free(handle->gnupghomedir);
     lr_handle_free_list(&handle->httpheader);
     curl_slist_free_all(handle->curl_httpheader);
+    if (handle->downloadsession_owned)
+        lr_downloadsession_free(handle->downloadsession);
     lr_free(handle);
 }
 
@@ -168,6 +279,7 @@ lr_handle_remote_sources_changed(LrHandle *handle, LrChangedRemoteSource type)
     // Internal mirrorlist is no more valid
     lr_lrmirrorlist_free(handle->internal_mirrorlist);
     handle->internal_mirrorlist = NULL;
+    handle->dnsprefetched = 0;
 
     // Mirrors reported via mirrors are no more valid too
     lr_lrmirrorlist_free(handle->mirrors);
@@ -222,6 +334,11 @@ lr_handle_setopt(LrHandle *handle,
 
     c_h = handle->curl_handle;
 
+    // Pooled easy handles and pre-warm requests were duplicated from
+    // the curl_handle and could use outdated options
+    lr_downloadsession_prewarm_stop(handle->downloadsession);
+    lr_handle_curl_handle_pool_clear(handle);
+
     va_start(arg, option);
 
     switch (option) {
@@ -283,9 +400,12 @@ lr_handle_setopt(LrHandle *handle,
         c_rc = curl_easy_setopt(c_h, CURLOPT_USERPWD, va_arg(arg, char *));
         break;
 
-    case LRO_PROXY:
-        c_rc = curl_easy_setopt(c_h, CURLOPT_PROXY, va_arg(arg, char *));
+    case LRO_PROXY: {
+        char *proxy = va_arg(arg, char *);
+        handle->proxy = proxy && *proxy;
+        c_rc = curl_easy_setopt(c_h, CURLOPT_PROXY, proxy);
         break;
+    }
 
     case LRO_PROXYPORT: {
         c_rc = curl_easy_setopt(c_h, CURLOPT_PROXYPORT,va_arg(arg, long));
@@ -625,6 +745,8 @@ lr_handle_setopt(LrHandle *handle,
             ret = FALSE;
         } else {
             handle->ipresolve = lr_type;
+            // Addresses of the other type could be prefetched
+            handle->dnsprefetched = 0;
             c_rc = curl_easy_setopt(c_h, CURLOPT_IPRESOLVE, type);
         }
         break;
@@ -654,6 +776,241 @@ lr_handle_setopt(LrHandle *handle,
         handle->offline = va_arg(arg, long) ? 1 : 0;
         break;
 
+    case LRO_EVENTENGINE: {
+        long engine = va_arg(arg, LrEventEngine);
+        if (engine != LR_EVENTENGINE_SELECT &&
+            engine != LR_EVENTENGINE_EPOLL)
+        {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad LRO_EVENTENGINE value");
+            ret = FALSE;
+        } else {
+            handle->eventengine = engine;
+        }
+        break;
+    }
+
+    case LRO_DOWNLOADSESSION: {
+        LrDownloadSession *session = va_arg(arg, LrDownloadSession *);
+        GError *tmp_err = NULL;
+
+        if (session && session == handle->downloadsession)
+            break;  // Already used
+
+        if (!session) {
+            if (handle->downloadsession_owned)
+                break;  // Nothing to do
+            session = lr_downloadsession_new(&tmp_err);
+            if (!session) {
+                g_propagate_error(err, tmp_err);
+                ret = FALSE;
+                break;
+            }
+            handle->downloadsession = session;
+            handle->downloadsession_owned = TRUE;
+            break;
+        }
+
+        if (handle->downloadsession_owned)
+            lr_downloadsession_free(handle->downloadsession);
+        handle->downloadsession = session;
+        handle->downloadsession_owned = FALSE;
+        break;
+    }
+
+    case LRO_SHARE: {
+        LrShare *share = va_arg(arg, LrShare *);
+        handle->share = share;
+        c_rc = curl_easy_setopt(c_h, CURLOPT_SHARE,
+                                share ? share->share_handle : NULL);
+        break;
+    }
+
+    case LRO_HTTP2:
+        handle->http2 = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_MAXSTREAMSPERMIRROR:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_MAXSTREAMSPERMIRROR_MIN ||
+            val_long > LRO_MAXSTREAMSPERMIRROR_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_MAXSTREAMSPERMIRROR.");
+            ret = FALSE;
+        } else {
+            handle->maxstreamspermirror = val_long;
+        }
+
+        break;
+
+    case LRO_MAXSEGMENTS:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_MAXSEGMENTS_MIN ||
+            val_long > LRO_MAXSEGMENTS_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_MAXSEGMENTS.");
+            ret = FALSE;
+        } else {
+            handle->maxsegments = val_long;
+        }
+
+        break;
+
+    case LRO_MINSEGMENTSIZE:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_MINSEGMENTSIZE_MIN) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Value of LRO_MINSEGMENTSIZE is too low.");
+            ret = FALSE;
+        } else {
+            handle->minsegmentsize = val_long;
+        }
+
+        break;
+
+    case LRO_WRITEBUFFERSIZE:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_WRITEBUFFERSIZE_MIN ||
+            val_long > LRO_WRITEBUFFERSIZE_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_WRITEBUFFERSIZE.");
+            ret = FALSE;
+        } else {
+            handle->writebuffersize = val_long;
+        }
+
+        break;
+
+    case LRO_ADAPTIVECONCURRENCY:
+        handle->adaptiveconcurrency = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_ADAPTIVEMAXPARALLELDOWNLOADS:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_ADAPTIVEMAXPARALLELDOWNLOADS_MIN ||
+            val_long > LRO_ADAPTIVEMAXPARALLELDOWNLOADS_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_ADAPTIVEMAXPARALLELDOWNLOADS.");
+            ret = FALSE;
+        } else {
+            handle->adaptivemaxparalleldownloads = val_long;
+        }
+
+        break;
+
+    case LRO_SCHEDULINGPOLICY: {
+        long policy = va_arg(arg, LrSchedulingPolicy);
+        if (policy != LR_SCHEDULING_FIFO &&
+            policy != LR_SCHEDULING_LARGESTFIRST &&
+            policy != LR_SCHEDULING_BALANCED)
+        {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad LRO_SCHEDULINGPOLICY value");
+            ret = FALSE;
+        } else {
+            handle->schedulingpolicy = policy;
+        }
+        break;
+    }
+
+    case LRO_HEDGEDREQUESTS:
+        handle->hedgedrequests = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_MIGRATESLOWTRANSFERS:
+        handle->migrateslowtransfers = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_CONDITIONALREQUESTS:
+        handle->conditionalrequests = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_WORKERTHREADS:
+        val_long = va_arg(arg, long);
+
+        if (val_long < LRO_WORKERTHREADS_MIN ||
+            val_long > LRO_WORKERTHREADS_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_WORKERTHREADS.");
+            ret = FALSE;
+        } else {
+            handle->workerthreads = val_long;
+        }
+
+        break;
+
+    case LRO_IOURING:
+        handle->iouring = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_PROGRESSINTERVAL:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_PROGRESSINTERVAL.");
+            ret = FALSE;
+        } else {
+            handle->progressinterval = val_long;
+        }
+
+        break;
+
+    case LRO_PROGRESSDELTA:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_PROGRESSDELTA.");
+            ret = FALSE;
+        } else {
+            handle->progressdelta = val_long;
+        }
+
+        break;
+
+    case LRO_DNSPREFETCH:
+        handle->dnsprefetch = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_HAPPYEYEBALLSTIMEOUT:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_HAPPYEYEBALLSTIMEOUT.");
+            ret = FALSE;
+            break;
+        }
+
+        handle->happyeyeballstimeout = val_long;
+#if LIBCURL_VERSION_NUM >= 0x073B00  // 7.59.0
+        c_rc = curl_easy_setopt(c_h, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS,
+                                val_long);
+#else
+        g_debug("%s: LRO_HAPPYEYEBALLSTIMEOUT is not supported by libcurl",
+                __func__);
+#endif
+        break;
+
+    case LRO_PREWARMMIRRORS:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0 || val_long > LRO_PREWARMMIRRORS_MAX) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Bad value of LRO_PREWARMMIRRORS.");
+            ret = FALSE;
+            break;
+        }
+
+        handle->prewarmmirrors = val_long;
+        break;
+
     default:
         g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
                     "Unknown option");
@@ -733,6 +1090,61 @@ lr_handle_prepare_urls(LrHandle *handle, GError **err)
     return TRUE;
 }
 
+/** Download remote mirrorlist or metalink. The file is downloaded
+ * to a temporary file. With LRO_CONDITIONALREQUESTS it is downloaded
+ * by a conditional request directly to the LRO_DESTDIR (where
+ * lr_yum_download_remote() stores it anyway) and the file downloaded
+ * by a previous lr_handle_perform() is kept if it wasn't modified.
+ * @return      Opened file descriptor or -1 on error
+ */
+static int
+lr_handle_download_list(LrHandle *handle,
+                        const char *url,
+                        const char *filename,
+                        GError **err)
+{
+    int fd;
+    _cleanup_free_ gchar *path = NULL;
+
+    if (handle->conditionalrequests && handle->destdir) {
+        path = lr_pathconcat(handle->destdir, filename, NULL);
+        fd = open(path, O_CREAT|O_RDWR, 0666);
+        if (fd < 0) {
+            g_debug("%s: Cannot open: %s", __func__, path);
+            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
+                        "Cannot open %s: %s", path, strerror(errno));
+            return -1;
+        }
+    } else {
+        fd = lr_gettmpfile();
+        if (fd < 0) {
+            g_debug("%s: Cannot create a temporary file", __func__);
+            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
+                        "Cannot create a temporary file");
+            return -1;
+        }
+    }
+
+    LrDownloadTarget *target = lr_downloadtarget_new(handle,
+                                                     url, NULL, fd, NULL,
+                                                     NULL, 0, 0, NULL, NULL,
+                                                     NULL, NULL, NULL, 0, 0);
+    target->conditional = (path != NULL);
+
+    gboolean ret = lr_download_target(target, err);
+    if (ret && target->notmodified)
+        g_debug("%s: %s was not modified", __func__, path);
+
+    lr_downloadtarget_free(target);
+
+    if (!ret) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 static gboolean
 lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
 {
@@ -782,19 +1194,10 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
         // Download remote mirrorlist
         _cleanup_free_ gchar *url = NULL;
 
-        fd = lr_gettmpfile();
-        if (fd < 0) {
-            g_debug("%s: Cannot create a temporary file", __func__);
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "Cannot create a temporary file");
-            return FALSE;
-        }
-
         url = lr_prepend_url_protocol(handle->mirrorlisturl);
-        if (!lr_download_url(handle, url, fd, err)) {
-            close(fd);
+        fd = lr_handle_download_list(handle, url, "mirrorlist", err);
+        if (fd < 0)
             return FALSE;
-        }
 
         if (lseek(fd, 0, SEEK_SET) != 0) {
             g_debug("%s: Seek error: %s", __func__, strerror(errno));
@@ -898,19 +1301,10 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
         // Download remote metalink
         _cleanup_free_ gchar *url = NULL;
 
-        fd = lr_gettmpfile();
-        if (fd < 0) {
-            g_debug("%s: Cannot create a temporary file", __func__);
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "Cannot create a temporary file");
-            return FALSE;
-        }
-
         url = lr_prepend_url_protocol(handle->metalinkurl);
-        if (!lr_download_url(handle, url, fd, err)) {
-            close(fd);
+        fd = lr_handle_download_list(handle, url, "metalink.xml", err);
+        if (fd < 0)
             return FALSE;
-        }
 
         if (lseek(fd, 0, SEEK_SET) != 0) {
             g_debug("%s: Seek error: %s", __func__, strerror(errno));
@@ -1084,9 +1478,171 @@ lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
                                             handle->mirrors,
                                             handle->metalink_mirrors);
 
+    // Resolve hosts of all the mirrors at once (LRO_DNSPREFETCH)
+    if (handle->dnsprefetch) {
+        GSList *handles = g_slist_prepend(NULL, handle);
+        lr_handles_prefetch_dns(handles);
+        g_slist_free(handles);
+    }
+
     return TRUE;
 }
 
+/** Are the transfers of the handle performed by a proxy?
+ * (Then the hosts of the mirrors are resolved by the proxy.)
+ */
+static gboolean
+lr_handle_uses_proxy(LrHandle *handle)
+{
+    static const char *env_proxies[] = {
+        "http_proxy", "HTTPS_PROXY", "https_proxy", "FTP_PROXY",
+        "ftp_proxy", "ALL_PROXY", "all_proxy", NULL,
+    };
+
+    if (handle->proxy)
+        return TRUE;
+
+    for (int x = 0; env_proxies[x]; x++) {
+        const char *value = g_getenv(env_proxies[x]);
+        if (value && *value)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+void
+lr_handles_prefetch_dns(GSList *handles)
+{
+    GSList *prefetched = NULL, *urls = NULL;
+    struct curl_slist *resolved = NULL;
+    LrIpResolveType ipresolve = LR_IPRESOLVE_WHATEVER;
+    gint64 now = g_get_monotonic_time();
+
+    for (GSList *elem = handles; elem; elem = g_slist_next(elem)) {
+        LrHandle *handle = elem->data;
+
+        // The prefetched entries time out from the DNS cache of curl,
+        // so the hosts are resolved again when they could be expired
+        if (!handle->dnsprefetch
+            || (handle->dnsprefetched
+                && now - handle->dnsprefetched
+                   < LR_DNS_PREFETCH_VALIDITY * G_USEC_PER_SEC)
+            || handle->offline
+            || !handle->internal_mirrorlist
+            || lr_handle_uses_proxy(handle))
+            continue;
+
+        // Addresses of all types are resolved if the handles differ,
+        // each handle gets only addresses of its type
+        if (!prefetched)
+            ipresolve = handle->ipresolve;
+        else if (ipresolve != handle->ipresolve)
+            ipresolve = LR_IPRESOLVE_WHATEVER;
+
+        for (LrInternalMirrorlist *m = handle->internal_mirrorlist;
+             m;
+             m = g_slist_next(m))
+        {
+            LrInternalMirror *mirror = m->data;
+            if (mirror->protocol == LR_PROTOCOL_HTTP
+                || mirror->protocol == LR_PROTOCOL_FTP)
+                urls = g_slist_prepend(urls, mirror->url);
+        }
+
+        handle->dnsprefetched = now;
+        prefetched = g_slist_prepend(prefetched, handle);
+    }
+
+    urls = g_slist_reverse(urls);
+    if (urls && lr_dns_prefetch(urls, ipresolve, &resolved)) {
+        for (GSList *elem = prefetched; elem; elem = g_slist_next(elem)) {
+            LrHandle *handle = elem->data;
+            struct curl_slist *resolve = NULL;
+
+            lr_dns_prefetch_filter(resolved, handle->ipresolve, &resolve);
+            for (struct curl_slist *e = resolve; e; e = e->next)
+                g_debug("%s: Passing %s to curl", __func__, e->data);
+
+            // Pre-warm requests and the pooled easy handles use the
+            // current list. Easy handles in use could still use it,
+            // so it is kept until all of them are released.
+            lr_downloadsession_prewarm_stop(handle->downloadsession);
+            lr_handle_curl_handle_pool_clear(handle);
+            curl_easy_setopt(handle->curl_handle, CURLOPT_RESOLVE, resolve);
+            if (handle->dns_resolve && handle->curl_handles_in_use > 0)
+                handle->dns_resolve_old = g_slist_prepend(
+                                                handle->dns_resolve_old,
+                                                handle->dns_resolve);
+            else
+                curl_slist_free_all(handle->dns_resolve);
+            handle->dns_resolve = resolve;
+        }
+    }
+
+    curl_slist_free_all(resolved);
+    g_slist_free(urls);
+    g_slist_free(prefetched);
+}
+
+void
+lr_handle_prewarm_connections(LrHandle *handle)
+{
+    GSList *requests = NULL;
+    long connections;
+    int mirrors = 0;
+
+    if (!handle->prewarmmirrors
+        || handle->offline
+        || !handle->downloadsession
+        || handle->downloadsession->in_use)
+        return;
+
+    // The limits of lr_download(), with HTTP/2 all transfers
+    // to a mirror are multiplexed over a single connection
+    connections = handle->maxparalleldownloads;
+    if (handle->maxdownloadspermirror > 0)
+        connections = MIN(connections, handle->maxdownloadspermirror);
+    if (handle->http2)
+        connections = 1;
+
+    for (LrInternalMirrorlist *m = handle->internal_mirrorlist;
+         m && mirrors < handle->prewarmmirrors;
+         m = g_slist_next(m))
+    {
+        LrInternalMirror *mirror = m->data;
+
+        if (mirror->protocol != LR_PROTOCOL_HTTP)
+            continue;
+        mirrors++;
+
+        // A HEAD request, a connection opened by CURLOPT_CONNECT_ONLY
+        // couldn't be reused by other transfers
+        char *url = lr_pathconcat(mirror->url, "repodata/repomd.xml", NULL);
+        for (long x = 0; x < connections; x++) {
+            CURL *h = curl_easy_duphandle(handle->curl_handle);
+            if (!h)
+                break;
+            curl_easy_setopt(h, CURLOPT_URL, url);
+            curl_easy_setopt(h, CURLOPT_NOBODY, 1L);
+            curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+            if (handle->http2 && g_str_has_prefix(url, "https://")) {
+#if LIBCURL_VERSION_NUM >= 0x072F00  // 7.47.0
+                curl_easy_setopt(h, CURLOPT_HTTP_VERSION,
+                                 CURL_HTTP_VERSION_2TLS);
+#else
+                curl_easy_setopt(h, CURLOPT_HTTP_VERSION,
+                                 CURL_HTTP_VERSION_2_0);
+#endif
+            }
+            requests = g_slist_prepend(requests, h);
+        }
+        lr_free(url);
+    }
+
+    lr_downloadsession_prewarm(handle->downloadsession, requests);
+}
+
 gboolean
 lr_handle_perform(LrHandle *handle, LrResult *result, GError **err)
 {
@@ -1199,6 +1755,9 @@ lr_handle_perform(LrHandle *handle, LrResult *result, GError **err)
 
     if (tmp_err)
         g_propagate_error(err, tmp_err);
+    else if (!handle->fetchmirrors)
+        // Packages are likely to be downloaded next
+        lr_handle_prewarm_connections(handle);
 
     return ret;
 }
@@ -1410,6 +1969,97 @@ lr_handle_getinfo(LrHandle *handle,
         *lnum = (long) (handle->adaptivemirrorsorting);
         break;
 
+    case LRI_HTTP2:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->http2);
+        break;
+
+    case LRI_MAXSTREAMSPERMIRROR:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->maxstreamspermirror);
+        break;
+
+    case LRI_MAXSEGMENTS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->maxsegments);
+        break;
+
+    case LRI_MINSEGMENTSIZE:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->minsegmentsize);
+        break;
+
+    case LRI_WRITEBUFFERSIZE:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->writebuffersize);
+        break;
+
+    case LRI_ADAPTIVECONCURRENCY:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->adaptiveconcurrency);
+        break;
+
+    case LRI_ADAPTIVEMAXPARALLELDOWNLOADS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->adaptivemaxparalleldownloads);
+        break;
+
+    case LRI_SCHEDULINGPOLICY: {
+        LrSchedulingPolicy *policy = va_arg(arg, LrSchedulingPolicy *);
+        *policy = handle->schedulingpolicy;
+        break;
+    }
+
+    case LRI_HEDGEDREQUESTS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->hedgedrequests);
+        break;
+
+    case LRI_MIGRATESLOWTRANSFERS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->migrateslowtransfers);
+        break;
+
+    case LRI_CONDITIONALREQUESTS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->conditionalrequests);
+        break;
+
+    case LRI_WORKERTHREADS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->workerthreads);
+        break;
+
+    case LRI_IOURING:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->iouring);
+        break;
+
+    case LRI_PROGRESSINTERVAL:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->progressinterval);
+        break;
+
+    case LRI_PROGRESSDELTA:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->progressdelta);
+        break;
+
+    case LRI_DNSPREFETCH:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->dnsprefetch);
+        break;
+
+    case LRI_HAPPYEYEBALLSTIMEOUT:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->happyeyeballstimeout);
+        break;
+
+    case LRI_PREWARMMIRRORS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) (handle->prewarmmirrors);
+        break;
+
     case LRI_GNUPGHOMEDIR:
         str = va_arg(arg, char **);
         *str = handle->gnupghomedir;
@@ -1425,6 +2075,24 @@ lr_handle_getinfo(LrHandle *handle,
         *lnum = (long) handle->offline;
         break;
 
+    case LRI_EVENTENGINE: {
+        LrEventEngine *engine = va_arg(arg, LrEventEngine *);
+        *engine = handle->eventengine;
+        break;
+    }
+
+    case LRI_DOWNLOADSESSION: {
+        LrDownloadSession **session = va_arg(arg, LrDownloadSession **);
+        *session = handle->downloadsession;
+        break;
+    }
+
+    case LRI_SHARE: {
+        LrShare **share = va_arg(arg, LrShare **);
+        *share = handle->share;
+        break;
+    }
+
     default:
         rc = FALSE;
         g_set_error(err, LR_HANDLE_ERROR, LRE_UNKNOWNOPT,
@@ -24,6 +24,8 @@
 #include <glib.h>
 
 #include "result.h"
+#include "downloadsession.h"
+#include "share.h"
 
 G_BEGIN_DECLS
 
@@ -106,6 +108,99 @@ typedef struct _LrHandle LrHandle;
 /** LRO_OFFLINE default value */
 #define LRO_OFFLINE_DEFAULT                 0L
 
+/** LRO_EVENTENGINE default value */
+#define LRO_EVENTENGINE_DEFAULT             LR_EVENTENGINE_SELECT
+
+/** LRO_HTTP2 default value */
+#define LRO_HTTP2_DEFAULT                   0L
+
+/** LRO_MAXSTREAMSPERMIRROR default value */
+#define LRO_MAXSTREAMSPERMIRROR_DEFAULT     32L
+
+/** LRO_MAXSTREAMSPERMIRROR minimal allowed value */
+#define LRO_MAXSTREAMSPERMIRROR_MIN         1L
+
+/** LRO_MAXSTREAMSPERMIRROR maximal allowed value */
+#define LRO_MAXSTREAMSPERMIRROR_MAX         1000L
+
+/** LRO_MAXSEGMENTS default value */
+#define LRO_MAXSEGMENTS_DEFAULT             1L
+
+/** LRO_MAXSEGMENTS minimal allowed value */
+#define LRO_MAXSEGMENTS_MIN                 1L
+
+/** LRO_MAXSEGMENTS maximal allowed value */
+#define LRO_MAXSEGMENTS_MAX                 64L
+
+/** LRO_MINSEGMENTSIZE default value */
+#define LRO_MINSEGMENTSIZE_DEFAULT          (16L*1024L*1024L)
+
+/** LRO_MINSEGMENTSIZE minimal allowed value */
+#define LRO_MINSEGMENTSIZE_MIN              1L
+
+/** LRO_WRITEBUFFERSIZE default value */
+#define LRO_WRITEBUFFERSIZE_DEFAULT         (1024L*1024L)
+
+/** LRO_WRITEBUFFERSIZE minimal allowed value */
+#define LRO_WRITEBUFFERSIZE_MIN             0L
+
+/** LRO_WRITEBUFFERSIZE maximal allowed value */
+#define LRO_WRITEBUFFERSIZE_MAX             (64L*1024L*1024L)
+
+/** LRO_ADAPTIVECONCURRENCY default value */
+#define LRO_ADAPTIVECONCURRENCY_DEFAULT     0L
+
+/** LRO_ADAPTIVEMAXPARALLELDOWNLOADS default value */
+#define LRO_ADAPTIVEMAXPARALLELDOWNLOADS_DEFAULT    64L
+
+/** LRO_ADAPTIVEMAXPARALLELDOWNLOADS minimal allowed value */
+#define LRO_ADAPTIVEMAXPARALLELDOWNLOADS_MIN        1L
+
+/** LRO_ADAPTIVEMAXPARALLELDOWNLOADS maximal allowed value */
+#define LRO_ADAPTIVEMAXPARALLELDOWNLOADS_MAX        1024L
+
+/** LRO_SCHEDULINGPOLICY default value */
+#define LRO_SCHEDULINGPOLICY_DEFAULT        LR_SCHEDULING_FIFO
+
+/** LRO_HEDGEDREQUESTS default value */
+#define LRO_HEDGEDREQUESTS_DEFAULT          0L
+
+/** LRO_MIGRATESLOWTRANSFERS default value */
+#define LRO_MIGRATESLOWTRANSFERS_DEFAULT    0L
+
+/** LRO_CONDITIONALREQUESTS default value */
+#define LRO_CONDITIONALREQUESTS_DEFAULT     0L
+
+/** LRO_WORKERTHREADS default value */
+#define LRO_WORKERTHREADS_DEFAULT           1L
+
+/** LRO_WORKERTHREADS minimal allowed value */
+#define LRO_WORKERTHREADS_MIN               1L
+
+/** LRO_WORKERTHREADS maximal allowed value */
+#define LRO_WORKERTHREADS_MAX               64L
+
+/** LRO_IOURING default value */
+#define LRO_IOURING_DEFAULT                 0L
+
+/** LRO_PROGRESSINTERVAL default value */
+#define LRO_PROGRESSINTERVAL_DEFAULT        0L
+
+/** LRO_PROGRESSDELTA default value */
+#define LRO_PROGRESSDELTA_DEFAULT           0L
+
+/** LRO_DNSPREFETCH default value */
+#define LRO_DNSPREFETCH_DEFAULT             0L
+
+/** LRO_HAPPYEYEBALLSTIMEOUT default value (the default of curl) */
+#define LRO_HAPPYEYEBALLSTIMEOUT_DEFAULT    200L
+
+/** LRO_PREWARMMIRRORS default value */
+#define LRO_PREWARMMIRRORS_DEFAULT          0L
+
+/** LRO_PREWARMMIRRORS maximal allowed value */
+#define LRO_PREWARMMIRRORS_MAX              64L
+
 /** Handle options for the ::lr_handle_setopt function. */
 typedef enum {
 
@@ -157,7 +252,9 @@ typedef enum {
 
     LRO_MAXSPEED,  /*!< (gint64)
         Maximum download speed in bytes per second. Default is 0 = unlimited
-        download speed. */
+        download speed. The limit applies to the aggregate speed of all
+        transfers of a download, bandwidth unused by slow transfers
+        is used by the others. See also ::lr_share_set_maxspeed. */
 
     LRO_DESTDIR,  /*!< (char *)
         Where to save downloaded files */
@@ -276,7 +373,8 @@ typedef enum {
         the server cert is for the server it is known as. */
 
     LRO_IPRESOLVE, /*!< (LrIpResolveType)
-        Sets what kind of IP addresses to use when resolving host names. */
+        Sets what kind of IP addresses to use when resolving host names.
+        See also LRO_DNSPREFETCH and LRO_HAPPYEYEBALLSTIMEOUT. */
 
     LRO_ALLOWEDMIRRORFAILURES, /*!< (long)
         If all transfers from a mirror failed (no successful transfer
@@ -327,6 +425,172 @@ typedef enum {
         Path to a file containing the list of PEM format trusted CA
         certificates. */
 
+    LRO_EVENTENGINE, /*!< (LrEventEngine)
+        Event engine used to drive transfers (and the fastest mirror
+        detection). LR_EVENTENGINE_SELECT is the default.
+        LR_EVENTENGINE_EPOLL services only sockets with some activity
+        and is not limited by FD_SETSIZE, so it scales better when
+        a lot of transfers run in parallel. */
+
+    LRO_DOWNLOADSESSION, /*!< (LrDownloadSession *)
+        Download session used by all downloads of the handle. By default
+        each handle owns its own session, which keeps live connections
+        between individual downloads (mirrorlist, metalink, repomd.xml,
+        metadata, packages). Use this option to share a single session
+        among more handles. The session is not freed by the handle and must
+        outlive it. NULL restores a session owned by the handle. */
+
+    LRO_SHARE, /*!< (LrShare *)
+        Share object used by the handle and all its transfers to share
+        the DNS cache, SSL session IDs and live connections with other
+        handles. Use ::lr_share_default for the process-wide object
+        or ::lr_share_new for a private one. The share object is not freed
+        by the handle and must outlive it. NULL (default) - no sharing. */
+
+    LRO_HTTP2, /*!< (long 1 or 0)
+        Enable HTTP/2 multiplexing. Transfers from a https mirror are
+        multiplexed as streams over a shared connection. Number of
+        parallel transfers from such mirror is limited by
+        LRO_MAXSTREAMSPERMIRROR instead of LRO_MAXDOWNLOADSPERMIRROR
+        and LRO_MAXPARALLELDOWNLOADS limits number of connections
+        instead of number of transfers. Mirrors which don't support
+        HTTP/2 fall back to the usual per connection limits. */
+
+    LRO_MAXSTREAMSPERMIRROR, /*!< (long)
+        Maximum number of parallel transfers (HTTP/2 streams) per mirror
+        when LRO_HTTP2 is enabled. */
+
+    LRO_MAXSEGMENTS, /*!< (long)
+        Maximum number of segments a single large file could be split
+        into. Segments are downloaded in parallel from different mirrors
+        and written directly to their place in the target file.
+        Only targets with a known expected size, without byte range and
+        resume, with at least two usable mirrors are segmented.
+        1 (default) disables segmented downloading. */
+
+    LRO_MINSEGMENTSIZE, /*!< (long)
+        Minimal size of a segment in bytes. A file is split into at most
+        expected size / LRO_MINSEGMENTSIZE segments. */
+
+    LRO_WRITEBUFFERSIZE, /*!< (long)
+        Size of the buffer (in bytes) used for writing of downloaded data
+        to the target file. Each running transfer has its own buffer.
+        Buffer is not bigger than the expected size of the target.
+        0 means that data are written as they arrive. */
+
+    LRO_ADAPTIVECONCURRENCY, /*!< (long 1 or 0)
+        Tune number of parallel transfers during the download.
+        LRO_MAXPARALLELDOWNLOADS is used as the initial value.
+        The number is increased by one while it limits the download and
+        the aggregate throughput doesn't drop, and it is decreased
+        multiplicatively when transfers fail by timeouts or network errors
+        or when the throughput collapses (AIMD).
+        Decisions are logged by g_debug(). */
+
+    LRO_ADAPTIVEMAXPARALLELDOWNLOADS, /*!< (long)
+        Upper bound of number of parallel transfers when
+        LRO_ADAPTIVECONCURRENCY is enabled. */
+
+    LRO_SCHEDULINGPOLICY, /*!< (LrSchedulingPolicy)
+        Order in which targets of a download are started.
+        LR_SCHEDULING_FIFO is the default. Priority of the targets
+        (see LrDownloadTarget and LrPackageTarget) is respected by all
+        policies. */
+
+    LRO_HEDGEDREQUESTS, /*!< (long 1 or 0)
+        Duplicate slow transfers at the end of the download. When there
+        are free slots and no waiting targets, a transfer whose projected
+        duration is much longer than the median of the other transfers
+        is started again from another mirror. The transfer which finishes
+        first wins and the other one is cancelled. Only targets
+        downloaded to a file given by its name (not by a file descriptor)
+        are hedged. The hedged transfer downloads to a temporary file
+        in the same directory which replaces the target file by rename(). */
+
+    LRO_MIGRATESLOWTRANSFERS, /*!< (long 1 or 0)
+        Move transfers to a free mirror if they are much slower than
+        the mirror is known to be (or than the other transfers if
+        the speed of the mirror is not known yet). Stalled transfers
+        are moved as well. The data already downloaded are kept and
+        the transfer continues from the current offset (even if resume
+        was not requested). HTTP transfers send the ETag or Last-Modified
+        of the data in If-Range header, if the file on the new mirror
+        differs, it is downloaded from the beginning. */
+
+    LRO_CONDITIONALREQUESTS, /*!< (long 1 or 0)
+        Reuse metadata downloaded to the LRO_DESTDIR by a previous
+        lr_handle_perform(). The repomd.xml, metadata files, mirrorlist
+        and metalink.xml are downloaded by HTTP conditional requests
+        (If-None-Match, If-Modified-Since) and the existing files
+        which were not modified on the server are kept. The LRO_DESTDIR
+        could already contain the repodata/ directory. */
+
+    LRO_WORKERTHREADS, /*!< (long)
+        Number of threads which perform the transfers of lr_download()
+        (and the functions built on it). Each thread has its own
+        connections and takes transfers from a shared queue. Callbacks
+        of the targets and the debug log handler are still called from
+        the thread which started the download. Hedged requests and migration of slow transfers
+        are not used with more than one thread. 1 (default) means that
+        the transfers are performed by the calling thread. */
+
+    LRO_IOURING, /*!< (long 1 or 0)
+        Use io_uring for file I/O if librepo was built with liburing
+        and the running kernel supports it (otherwise the plain system
+        calls are used). Downloaded data are written asynchronously
+        (writes and closes of all transfers are submitted in batches
+        once per iteration of the download loop) and files are read by
+        several parallel reads when their checksums are verified
+        (including lr_check_packages()). Not used for the transfers
+        when LRO_WORKERTHREADS is greater than 1. */
+
+    LRO_PROGRESSINTERVAL, /*!< (long)
+        Minimal interval (in milliseconds) between two calls of a progress
+        callback (LrProgressCb) of a target or of the aggregate progress
+        callback of lr_download_single_cb() (and the functions built
+        on it, e.g. lr_download_packages()). Reports in the meantime are
+        skipped. The first and the final report of a transfer and
+        reports of a restarted transfer are never skipped. 0 (default)
+        means that every progress reported by curl is passed to the
+        callback. */
+
+    LRO_PROGRESSDELTA, /*!< (long)
+        Minimal number of bytes downloaded between two calls of
+        a progress callback. Works together with LRO_PROGRESSINTERVAL
+        (a callback is called when both the interval elapsed and the
+        number of bytes was downloaded). 0 (default) means no limit. */
+
+    LRO_DNSPREFETCH, /*!< (long 1 or 0)
+        Resolve host names of all mirrors in parallel as soon as the
+        list of mirrors is known (and when lr_download_packages() starts)
+        and pass the addresses (of the type selected by LRO_IPRESOLVE)
+        to curl, so transfers from the mirrors don't wait for DNS.
+        Only the host of the first mirror is waited for (a short time),
+        hosts which are not resolved by then are left to curl.
+        The addresses expire like the ones resolved by curl and
+        the hosts are resolved again by the next downloads.
+        Not used when a proxy is set (by LRO_PROXY or by environment
+        variables). Requires curl 7.75.0 or newer. */
+
+    LRO_HAPPYEYEBALLSTIMEOUT, /*!< (long)
+        Time (in milliseconds) the connection to the first address
+        family of a host (IPv6 or IPv4) gets a head start before
+        a connection to the other family is tried in parallel
+        ("happy eyeballs"). Used when LRO_IPRESOLVE is
+        LR_IPRESOLVE_WHATEVER. Requires curl 7.59.0 or newer. */
+
+    LRO_PREWARMMIRRORS, /*!< (long)
+        Number of the first (best ranked) HTTP(S) mirrors to which
+        connections are opened in advance, in background, when there is
+        nothing to download: while repomd.xml is verified and parsed
+        by lr_handle_perform() and after it returns (e.g. while the caller
+        resolves dependencies). Up to LRO_MAXDOWNLOADSPERMIRROR connections
+        (one with LRO_HTTP2) are opened to each mirror and kept in the
+        cache of the download session (see LRO_DOWNLOADSESSION), so the
+        next transfers don't wait for TCP and TLS handshakes. Opening
+        of the connections stops as soon as the next download starts.
+        0 (default) disables the feature. */
+
     LRO_SENTINEL,    /*!< Sentinel */
 
 } LrHandleOption; /*!< Handle config options */
@@ -388,6 +652,27 @@ typedef enum {
     LRI_SSLCLIENTCERT,          /*!< (char **) */
     LRI_SSLCLIENTKEY,           /*!< (char **) */
     LRI_SSLCACERT,              /*!< (char **) */
+    LRI_EVENTENGINE,            /*!< (LrEventEngine *) */
+    LRI_DOWNLOADSESSION,        /*!< (LrDownloadSession **) */
+    LRI_SHARE,                  /*!< (LrShare **) */
+    LRI_HTTP2,                  /*!< (long *) */
+    LRI_MAXSTREAMSPERMIRROR,    /*!< (long *) */
+    LRI_MAXSEGMENTS,            /*!< (long *) */
+    LRI_MINSEGMENTSIZE,         /*!< (long *) */
+    LRI_WRITEBUFFERSIZE,        /*!< (long *) */
+    LRI_ADAPTIVECONCURRENCY,    /*!< (long *) */
+    LRI_ADAPTIVEMAXPARALLELDOWNLOADS, /*!< (long *) */
+    LRI_SCHEDULINGPOLICY,       /*!< (LrSchedulingPolicy *) */
+    LRI_HEDGEDREQUESTS,         /*!< (long *) */
+    LRI_MIGRATESLOWTRANSFERS,   /*!< (long *) */
+    LRI_CONDITIONALREQUESTS,    /*!< (long *) */
+    LRI_WORKERTHREADS,          /*!< (long *) */
+    LRI_IOURING,                /*!< (long *) */
+    LRI_PROGRESSINTERVAL,       /*!< (long *) */
+    LRI_PROGRESSDELTA,          /*!< (long *) */
+    LRI_DNSPREFETCH,            /*!< (long *) */
+    LRI_HAPPYEYEBALLSTIMEOUT,   /*!< (long *) */
+    LRI_PREWARMMIRRORS,         /*!< (long *) */
     LRI_SENTINEL,
 } LrHandleInfoOption; /*!< Handle info options */
 
@@ -28,6 +28,8 @@
 #include "handle.h"
 #include "lrmirrorlist.h"
 #include "url_substitution.h"
+#include "downloadsession.h"
+#include "share.h"
 
 G_BEGIN_DECLS
 
@@ -38,6 +40,19 @@ struct _LrHandle {
     CURL *curl_handle; /*!<
         CURL handle */
 
+    GSList *curl_handle_pool; /*!<
+        Easy handles (CURL *) duplicated from the curl_handle which are
+        ready to be reused by next transfers
+        (see lr_handle_curl_handle_acquire()) */
+
+    guint curl_handle_generation; /*!<
+        Incremented each time the options of the curl_handle could
+        change. Easy handles of older generations are not reused. */
+
+    guint curl_handles_in_use; /*!<
+        Number of easy handles acquired by lr_handle_curl_handle_acquire()
+        which were not released yet */
+
     int update; /*!<
         Just update existing repo */
 
@@ -205,6 +220,89 @@ struct _LrHandle {
     gboolean offline; /*!<
         If TRUE, librepo should work offline - ignore all
         non local URLs, etc. */
+
+    LrEventEngine eventengine; /*!<
+        Event engine used to drive transfers. */
+
+    LrDownloadSession *downloadsession; /*!<
+        Download session (keeps live connections between downloads) */
+
+    gboolean downloadsession_owned; /*!<
+        If TRUE, the downloadsession was created by the handle
+        and is freed together with the handle. */
+
+    LrShare *share; /*!<
+        Share object (DNS cache, SSL sessions, connections) or NULL */
+
+    long http2; /*!<
+        See LRO_HTTP2 */
+
+    long maxstreamspermirror; /*!<
+        See LRO_MAXSTREAMSPERMIRROR */
+
+    long maxsegments; /*!<
+        See LRO_MAXSEGMENTS */
+
+    long minsegmentsize; /*!<
+        See LRO_MINSEGMENTSIZE */
+
+    long writebuffersize; /*!<
+        See LRO_WRITEBUFFERSIZE */
+
+    gboolean adaptiveconcurrency; /*!<
+        See LRO_ADAPTIVECONCURRENCY */
+
+    long adaptivemaxparalleldownloads; /*!<
+        See LRO_ADAPTIVEMAXPARALLELDOWNLOADS */
+
+    LrSchedulingPolicy schedulingpolicy; /*!<
+        See LRO_SCHEDULINGPOLICY */
+
+    gboolean hedgedrequests; /*!<
+        See LRO_HEDGEDREQUESTS */
+
+    gboolean migrateslowtransfers; /*!<
+        See LRO_MIGRATESLOWTRANSFERS */
+
+    gboolean conditionalrequests; /*!<
+        See LRO_CONDITIONALREQUESTS */
+
+    long workerthreads; /*!<
+        See LRO_WORKERTHREADS */
+
+    gboolean iouring; /*!<
+        See LRO_IOURING */
+
+    long progressinterval; /*!<
+        See LRO_PROGRESSINTERVAL */
+
+    long progressdelta; /*!<
+        See LRO_PROGRESSDELTA */
+
+    gboolean dnsprefetch; /*!<
+        See LRO_DNSPREFETCH */
+
+    long happyeyeballstimeout; /*!<
+        See LRO_HAPPYEYEBALLSTIMEOUT */
+
+    long prewarmmirrors; /*!<
+        See LRO_PREWARMMIRRORS */
+
+    gboolean proxy; /*!<
+        LRO_PROXY is set */
+
+    gint64 dnsprefetched; /*!<
+        Monotonic time (in microseconds) when the hosts of the internal
+        mirrorlist were resolved or 0 */
+
+    struct curl_slist *dns_resolve; /*!<
+        Addresses of the resolved hosts (CURLOPT_RESOLVE) used by
+        the curl_handle and the easy handles duplicated from it */
+
+    GSList *dns_resolve_old; /*!<
+        Lists (struct curl_slist *) replaced by a newer dns_resolve
+        while some easy handles duplicated before were in use. They are
+        freed when no easy handle is in use anymore. */
 };
 
 /** Return new CURL easy handle with some default options setted.
@@ -212,6 +310,39 @@ struct _LrHandle {
 CURL *
 lr_get_curl_handle();
 
+/** Return an easy handle for a transfer which uses the handle.
+ * The easy handle is taken from the pool of the handle (it keeps its
+ * per-transfer options set by the previous user, the caller is expected
+ * to set them all) or duplicated from the handle curl_handle.
+ * @param handle        Librepo handle
+ * @param generation    Generation of the handle options, it has to be
+ *                      passed to lr_handle_curl_handle_release()
+ * @return              Easy handle or NULL on error
+ */
+CURL *
+lr_handle_curl_handle_acquire(LrHandle *handle, guint *generation);
+
+/** Return the easy handle of a finished transfer to the pool of the
+ * handle. The easy handle must not be in any multi handle. It is freed
+ * if the options of the handle were changed since it was acquired.
+ * @param handle        Librepo handle
+ * @param curl          Easy handle from lr_handle_curl_handle_acquire()
+ * @param generation    Generation returned by lr_handle_curl_handle_acquire()
+ */
+void
+lr_handle_curl_handle_release(LrHandle *handle,
+                              CURL *curl,
+                              guint generation);
+
+/** Free the easy handle acquired by lr_handle_curl_handle_acquire()
+ * instead of returning it to the pool (e.g. if its transfer couldn't
+ * be prepared).
+ * @param handle        Librepo handle
+ * @param curl          Easy handle from lr_handle_curl_handle_acquire()
+ */
+void
+lr_handle_curl_handle_discard(LrHandle *handle, CURL *curl);
+
 /**
  * Create (if do not exists) internal mirrorlist. Insert baseurl (if
  * specified) and download, parse and insert mirrors from mirrorlist url.
@@ -225,6 +356,24 @@ lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
                                       gboolean usefastestmirror,
                                       GError **err);
 
+/** Resolve hosts of the internal mirrorlists of the handles in parallel
+ * (only handles with LRO_DNSPREFETCH enabled and not resolved recently).
+ * The addresses (of the type selected by LRO_IPRESOLVE of each handle)
+ * replace the previously resolved ones and are used by the next
+ * transfers of the handles.
+ * @param handles           List of handles (LrHandle *)
+ */
+void
+lr_handles_prefetch_dns(GSList *handles);
+
+/** Start opening connections to the best mirrors of the internal
+ * mirrorlist in background (see LRO_PREWARMMIRRORS). Does nothing if
+ * the option is not set or the download session is in use.
+ * @param handle            Librepo handle
+ */
+void
+lr_handle_prewarm_connections(LrHandle *handle);
+
 
 G_END_DECLS
 
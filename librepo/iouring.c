@@ -0,0 +1,542 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WITH_IO_URING
+#include <liburing.h>
+#endif
+
+#include "cleanup.h"
+#include "rcodes.h"
+#include "util.h"
+#include "iouring_internal.h"
+#include "logqueue_internal.h"
+
+/** Number of entries of the submission queue */
+#define LR_IOURING_ENTRIES          256
+/** Number of reads in flight in lr_iouring_read_file() */
+#define LR_IOURING_READ_DEPTH       4
+/** Size of a single read in lr_iouring_read_file() */
+#define LR_IOURING_READ_SIZE        (256*1024)
+
+/** Read the data at the offset, retry short reads.
+ * @return      Number of read bytes (less than len only at the end
+ *              of the file) or -1 (errno is set)
+ */
+static ssize_t
+pread_all(int fd, char *buf, size_t len, gint64 offset)
+{
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t rc = pread(fd, buf + got, len - got, (off_t) (offset + got));
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (rc == 0)
+            break;  // End of the file
+        got += rc;
+    }
+
+    return (ssize_t) got;
+}
+
+/** Read the rest of the file from the offset by plain pread().
+ */
+static gboolean
+read_tail(int fd,
+          gint64 offset,
+          LrIoUringDataCb cb,
+          void *cbdata,
+          GQuark domain,
+          GError **err)
+{
+    _cleanup_free_ char *buf = g_malloc(LR_IOURING_READ_SIZE);
+    ssize_t rc;
+
+    while ((rc = pread_all(fd, buf, LR_IOURING_READ_SIZE, offset)) > 0) {
+        if (!cb(cbdata, buf, (size_t) rc, err))
+            return FALSE;
+        offset += rc;
+    }
+
+    if (rc == -1) {
+        g_set_error(err, domain, LRE_IO,
+                    "read(%d) failed: %s", fd, g_strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+#ifdef WITH_IO_URING
+
+/** io_uring is not supported by the running kernel */
+static gint lr_iouring_unsupported = 0;
+
+/** Queued operation with a completion callback */
+typedef struct {
+    LrIoUringCb cb;     /*!< Completion callback */
+    void *cbdata;       /*!< User data for the callback */
+} LrIoUringOp;
+
+struct _LrIoUring {
+    struct io_uring ring; /*!<
+        The ring */
+    gboolean can_close; /*!<
+        The kernel supports IORING_OP_CLOSE */
+    gboolean failed; /*!<
+        Submission failed, no more operations are passed to the kernel */
+    int inflight; /*!<
+        Number of queued and not completed operations */
+};
+
+LrIoUring *
+lr_iouring_new(void)
+{
+    struct io_uring_probe *probe;
+    LrIoUring *ring;
+    int rc;
+
+    if (g_atomic_int_get(&lr_iouring_unsupported))
+        return NULL;
+
+    ring = lr_malloc0(sizeof(*ring));
+
+    rc = io_uring_queue_init(LR_IOURING_ENTRIES, &ring->ring, 0);
+    if (rc < 0) {
+        // ENOSYS (old kernel), EPERM (disabled by sysctl or seccomp), ...
+        lr_log_debug("%s: io_uring is not available: %s",
+                     __func__, g_strerror(-rc));
+        if (rc == -ENOSYS || rc == -EPERM)
+            g_atomic_int_set(&lr_iouring_unsupported, 1);
+        lr_free(ring);
+        return NULL;
+    }
+
+    // IORING_OP_READ and IORING_OP_WRITE are available since 5.6,
+    // the probe itself since 5.6 too
+    probe = io_uring_get_probe_ring(&ring->ring);
+    if (!probe
+        || !io_uring_opcode_supported(probe, IORING_OP_READ)
+        || !io_uring_opcode_supported(probe, IORING_OP_WRITE))
+    {
+        lr_log_debug("%s: io_uring doesn't support the needed operations",
+                     __func__);
+        g_atomic_int_set(&lr_iouring_unsupported, 1);
+        if (probe)
+            io_uring_free_probe(probe);
+        io_uring_queue_exit(&ring->ring);
+        lr_free(ring);
+        return NULL;
+    }
+
+    ring->can_close = io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    io_uring_free_probe(probe);
+
+    return ring;
+}
+
+void
+lr_iouring_free(LrIoUring *ring)
+{
+    if (!ring)
+        return;
+
+    if (!lr_iouring_wait(ring, &ring->inflight))
+        lr_log_debug("%s: %d operations not completed",
+                     __func__, ring->inflight);
+
+    io_uring_queue_exit(&ring->ring);
+    lr_free(ring);
+}
+
+/** Call the callbacks of the completed operations.
+ */
+static void
+iouring_reap(LrIoUring *ring)
+{
+    struct io_uring_cqe *cqe;
+
+    while (io_uring_peek_cqe(&ring->ring, &cqe) == 0) {
+        LrIoUringOp *op = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+
+        io_uring_cqe_seen(&ring->ring, cqe);
+        ring->inflight--;
+
+        if (op) {
+            op->cb(op->cbdata, res);
+            g_free(op);
+        } else if (res < 0) {
+            lr_log_debug("%s: Asynchronous close failed: %s",
+                         __func__, g_strerror(-res));
+        }
+    }
+}
+
+/** Is the error returned by io_uring_submit() temporary?
+ */
+static gboolean
+iouring_submit_retry(int rc)
+{
+    return rc >= 0 || rc == -EINTR || rc == -EAGAIN || rc == -EBUSY;
+}
+
+/** Get a free entry of the submission queue. If the queue is full,
+ * the queued operations are submitted.
+ * @return      Entry or NULL if the ring cannot take more operations
+ */
+static struct io_uring_sqe *
+iouring_get_sqe(LrIoUring *ring)
+{
+    struct io_uring_sqe *sqe;
+
+    if (ring->failed)
+        return NULL;
+
+    sqe = io_uring_get_sqe(&ring->ring);
+    if (!sqe) {
+        lr_iouring_submit(ring);
+        sqe = io_uring_get_sqe(&ring->ring);
+    }
+
+    return sqe;
+}
+
+void
+lr_iouring_write(LrIoUring *ring,
+                 int fd,
+                 const void *buf,
+                 size_t len,
+                 gint64 offset,
+                 LrIoUringCb cb,
+                 void *cbdata)
+{
+    struct io_uring_sqe *sqe;
+    LrIoUringOp *op;
+
+    assert(ring);
+    assert(cb);
+
+    sqe = iouring_get_sqe(ring);
+    if (!sqe) {
+        // Fall back to the synchronous write
+        ssize_t rc = pwrite(fd, buf, len, (off_t) offset);
+        cb(cbdata, rc < 0 ? -errno : (int) rc);
+        return;
+    }
+
+    op = g_new(LrIoUringOp, 1);
+    op->cb = cb;
+    op->cbdata = cbdata;
+
+    io_uring_prep_write(sqe, fd, buf, (unsigned) len, (__u64) offset);
+    io_uring_sqe_set_data(sqe, op);
+    ring->inflight++;
+}
+
+void
+lr_iouring_close(LrIoUring *ring, int fd)
+{
+    struct io_uring_sqe *sqe = NULL;
+
+    assert(ring);
+
+    if (ring->can_close)
+        sqe = iouring_get_sqe(ring);
+    if (!sqe) {
+        close(fd);
+        return;
+    }
+
+    io_uring_prep_close(sqe, fd);
+    io_uring_sqe_set_data(sqe, NULL);
+    ring->inflight++;
+}
+
+void
+lr_iouring_submit(LrIoUring *ring)
+{
+    assert(ring);
+
+    if (!ring->failed) {
+        int rc = io_uring_submit(&ring->ring);
+        if (!iouring_submit_retry(rc)) {
+            lr_log_debug("%s: io_uring_submit() failed: %s",
+                         __func__, g_strerror(-rc));
+            ring->failed = TRUE;
+        }
+    }
+
+    iouring_reap(ring);
+}
+
+gboolean
+lr_iouring_wait(LrIoUring *ring, int *pending)
+{
+    assert(ring);
+    assert(pending);
+
+    iouring_reap(ring);
+
+    while (*pending > 0) {
+        if (ring->failed || ring->inflight == 0)
+            return FALSE;
+
+        int rc = io_uring_submit_and_wait(&ring->ring, 1);
+        if (!iouring_submit_retry(rc)) {
+            lr_log_debug("%s: io_uring_submit_and_wait() failed: %s",
+                         __func__, g_strerror(-rc));
+            ring->failed = TRUE;
+            return FALSE;
+        }
+
+        iouring_reap(ring);
+    }
+
+    return TRUE;
+}
+
+/** A read of lr_iouring_read_file() */
+typedef struct {
+    char *buf;          /*!< Buffer */
+    gint64 offset;      /*!< Offset of the read */
+    size_t len;         /*!< Requested length */
+    int res;            /*!< Result of the read */
+    int pending;        /*!< The read is in flight */
+} LrIoUringRead;
+
+static void
+iouring_read_done(void *cbdata, int res)
+{
+    LrIoUringRead *rd = cbdata;
+    rd->res = res;
+    rd->pending = 0;
+}
+
+static void
+iouring_queue_read(LrIoUring *ring,
+                   int fd,
+                   LrIoUringRead *rd,
+                   gint64 offset,
+                   size_t len)
+{
+    struct io_uring_sqe *sqe;
+    LrIoUringOp *op;
+
+    rd->offset = offset;
+    rd->len = len;
+    rd->pending = 1;
+
+    sqe = iouring_get_sqe(ring);
+    if (!sqe) {
+        // Fall back to the synchronous read
+        ssize_t rc = pread_all(fd, rd->buf, len, offset);
+        iouring_read_done(rd, rc < 0 ? -errno : (int) rc);
+        return;
+    }
+
+    op = g_new(LrIoUringOp, 1);
+    op->cb = iouring_read_done;
+    op->cbdata = rd;
+
+    io_uring_prep_read(sqe, fd, rd->buf, (unsigned) len, (__u64) offset);
+    io_uring_sqe_set_data(sqe, op);
+    ring->inflight++;
+}
+
+gboolean
+lr_iouring_read_file(LrIoUring *ring,
+                     int fd,
+                     LrIoUringDataCb cb,
+                     void *cbdata,
+                     GQuark domain,
+                     GError **err)
+{
+    LrIoUringRead reads[LR_IOURING_READ_DEPTH];
+    struct stat st;
+    gint64 size, next = 0, pos = 0;
+    gboolean ret = TRUE;
+    gboolean leak = FALSE;
+    int slot = 0;
+
+    assert(ring);
+    assert(!err || *err == NULL);
+
+    if (fstat(fd, &st) == -1) {
+        g_set_error(err, domain, LRE_IO,
+                    "fstat(%d) failed: %s", fd, g_strerror(errno));
+        return FALSE;
+    }
+    size = st.st_size;
+
+    // Keep LR_IOURING_READ_DEPTH reads in flight, the data are
+    // processed in order while the next reads are performed
+    memset(reads, 0, sizeof(reads));
+    for (int i = 0; i < LR_IOURING_READ_DEPTH; i++) {
+        reads[i].buf = g_malloc(LR_IOURING_READ_SIZE);
+        if (next < size) {
+            size_t len = (size_t) MIN(size - next, LR_IOURING_READ_SIZE);
+            iouring_queue_read(ring, fd, &reads[i], next, len);
+            next += len;
+        }
+    }
+    lr_iouring_submit(ring);
+
+    while (pos < size) {
+        LrIoUringRead *rd = &reads[slot];
+        size_t got;
+
+        if (!lr_iouring_wait(ring, &rd->pending)) {
+            g_set_error(err, domain, LRE_IO,
+                        "Read of file %d by io_uring failed", fd);
+            ret = FALSE;
+            leak = TRUE;  // The kernel could still use the buffers
+            break;
+        }
+
+        if (rd->res < 0) {
+            g_set_error(err, domain, LRE_IO,
+                        "read(%d) failed: %s", fd, g_strerror(-rd->res));
+            ret = FALSE;
+            break;
+        }
+
+        got = (size_t) rd->res;
+        if (got < rd->len) {
+            // Short read, read the rest of the chunk directly
+            ssize_t rc = pread_all(fd, rd->buf + got,
+                                   rd->len - got, rd->offset + got);
+            if (rc == -1) {
+                g_set_error(err, domain, LRE_IO,
+                            "read(%d) failed: %s", fd, g_strerror(errno));
+                ret = FALSE;
+                break;
+            }
+            got += rc;
+        }
+
+        if (got > 0 && !cb(cbdata, rd->buf, got, err)) {
+            ret = FALSE;
+            break;
+        }
+        pos += got;
+
+        if (got < rd->len) {
+            // The file was truncated in the meantime
+            size = pos;
+            break;
+        }
+
+        if (next < size) {
+            size_t len = (size_t) MIN(size - next, LR_IOURING_READ_SIZE);
+            iouring_queue_read(ring, fd, rd, next, len);
+            next += len;
+            lr_iouring_submit(ring);
+        }
+
+        slot = (slot + 1) % LR_IOURING_READ_DEPTH;
+    }
+
+    // Wait for the reads which are still in flight
+    for (int i = 0; i < LR_IOURING_READ_DEPTH && !leak; i++)
+        if (!lr_iouring_wait(ring, &reads[i].pending))
+            leak = TRUE;
+
+    if (!leak)
+        for (int i = 0; i < LR_IOURING_READ_DEPTH; i++)
+            g_free(reads[i].buf);
+
+    // The file could grow in the meantime
+    if (ret && pos == size)
+        ret = read_tail(fd, pos, cb, cbdata, domain, err);
+
+    return ret;
+}
+
+#else  // WITH_IO_URING
+
+// Built without liburing, no ring is ever created, so the operations
+// below are never called. They just perform the plain system calls.
+
+LrIoUring *
+lr_iouring_new(void)
+{
+    return NULL;
+}
+
+void
+lr_iouring_free(LrIoUring *ring)
+{
+    assert(!ring);
+}
+
+void
+lr_iouring_write(G_GNUC_UNUSED LrIoUring *ring,
+                 int fd,
+                 const void *buf,
+                 size_t len,
+                 gint64 offset,
+                 LrIoUringCb cb,
+                 void *cbdata)
+{
+    ssize_t rc = pwrite(fd, buf, len, (off_t) offset);
+    cb(cbdata, rc < 0 ? -errno : (int) rc);
+}
+
+void
+lr_iouring_close(G_GNUC_UNUSED LrIoUring *ring, int fd)
+{
+    close(fd);
+}
+
+void
+lr_iouring_submit(G_GNUC_UNUSED LrIoUring *ring)
+{
+}
+
+gboolean
+lr_iouring_wait(G_GNUC_UNUSED LrIoUring *ring, int *pending)
+{
+    return *pending == 0;
+}
+
+gboolean
+lr_iouring_read_file(G_GNUC_UNUSED LrIoUring *ring,
+                     int fd,
+                     LrIoUringDataCb cb,
+                     void *cbdata,
+                     GQuark domain,
+                     GError **err)
+{
+    return read_tail(fd, 0, cb, cbdata, domain, err);
+}
+
+#endif  // WITH_IO_URING
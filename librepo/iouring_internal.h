@@ -0,0 +1,134 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_IOURING_INTERNAL_H__
+#define __LR_IOURING_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** File I/O performed by io_uring (see LRO_IOURING).
+ * Operations are queued and passed to the kernel in batches by
+ * ::lr_iouring_submit (e.g. once per iteration of the download loop).
+ * The ring is not thread safe, it has to be used by a single thread.
+ * If librepo was built without liburing or the running kernel doesn't
+ * support io_uring, ::lr_iouring_new returns NULL and callers fall back
+ * to the plain system calls.
+ */
+typedef struct _LrIoUring LrIoUring;
+
+/** Called when the queued operation is completed.
+ * @param cbdata            User data
+ * @param res               Result of the operation (number of bytes
+ *                          or negative errno)
+ */
+typedef void (*LrIoUringCb)(void *cbdata, int res);
+
+/** Called with the data read by ::lr_iouring_read_file (in order).
+ * @param cbdata            User data
+ * @param buf               Data
+ * @param len               Length of the data
+ * @param err               GError **
+ * @return                  TRUE to continue, FALSE (with err set) to stop
+ */
+typedef gboolean (*LrIoUringDataCb)(void *cbdata,
+                                    const char *buf,
+                                    size_t len,
+                                    GError **err);
+
+/** Create a new ring.
+ * @return                  New ring or NULL if io_uring is not available
+ */
+LrIoUring *
+lr_iouring_new(void);
+
+/** Wait for all queued operations and free the ring.
+ * @param ring              Ring or NULL
+ */
+void
+lr_iouring_free(LrIoUring *ring);
+
+/** Queue write of the data to the file at the offset. The data
+ * must stay valid until the callback is called.
+ * @param ring              Ring
+ * @param fd                File descriptor
+ * @param buf               Data
+ * @param len               Length of the data
+ * @param offset            Offset in the file
+ * @param cb                Completion callback
+ * @param cbdata            User data for the callback
+ */
+void
+lr_iouring_write(LrIoUring *ring,
+                 int fd,
+                 const void *buf,
+                 size_t len,
+                 gint64 offset,
+                 LrIoUringCb cb,
+                 void *cbdata);
+
+/** Queue close of the file descriptor. The descriptor must not be
+ * used after the call. It is closed directly if the kernel doesn't
+ * support asynchronous close.
+ * @param ring              Ring
+ * @param fd                File descriptor
+ */
+void
+lr_iouring_close(LrIoUring *ring, int fd);
+
+/** Pass all queued operations to the kernel and call callbacks
+ * of the completed ones. Doesn't block.
+ * @param ring              Ring
+ */
+void
+lr_iouring_submit(LrIoUring *ring);
+
+/** Submit queued operations and wait until the counter drops to zero.
+ * The counter is expected to be decremented by completion callbacks.
+ * @param ring              Ring
+ * @param pending           Counter of pending operations
+ * @return                  TRUE if the counter dropped to zero, FALSE
+ *                          if the ring failed
+ */
+gboolean
+lr_iouring_wait(LrIoUring *ring, int *pending);
+
+/** Read the whole file (from its beginning) with several reads
+ * in flight and pass the data in order to the callback.
+ * @param ring              Ring
+ * @param fd                File descriptor
+ * @param cb                Data callback
+ * @param cbdata            User data for the callback
+ * @param domain            Error domain used for I/O errors
+ * @param err               GError **
+ * @return                  TRUE if the whole file was read
+ */
+gboolean
+lr_iouring_read_file(LrIoUring *ring,
+                     int fd,
+                     LrIoUringDataCb cb,
+                     void *cbdata,
+                     GQuark domain,
+                     GError **err);
+
+G_END_DECLS
+
+#endif
@@ -34,6 +34,7 @@
 #include "repomd.h"
 #include "repoutil_yum.h"
 #include "result.h"
+#include "share.h"
 #include "types.h"
 #include "url_substitution.h"
 #include "util.h"
@@ -45,6 +46,7 @@
 // (API could be changed significantly between two versions)
 
 #include "downloader.h"
+#include "downloadsession.h"
 #include "downloadtarget.h"
 
 #endif
@@ -0,0 +1,86 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "logqueue_internal.h"
+
+struct _LrLogQueue {
+    GAsyncQueue *messages; /*!<
+        Queued messages (gchar *) */
+};
+
+/** Queue the calling thread is attached to or NULL */
+static GPrivate lr_logqueue_current = G_PRIVATE_INIT(NULL);
+
+LrLogQueue *
+lr_logqueue_new(void)
+{
+    LrLogQueue *queue = lr_malloc0(sizeof(*queue));
+    queue->messages = g_async_queue_new_full(g_free);
+    return queue;
+}
+
+void
+lr_logqueue_free(LrLogQueue *queue)
+{
+    if (!queue)
+        return;
+
+    lr_logqueue_flush(queue);
+    g_async_queue_unref(queue->messages);
+    lr_free(queue);
+}
+
+void
+lr_logqueue_attach(LrLogQueue *queue)
+{
+    g_private_set(&lr_logqueue_current, queue);
+}
+
+void
+lr_logqueue_flush(LrLogQueue *queue)
+{
+    gchar *message;
+
+    if (!queue)
+        return;
+
+    while ((message = g_async_queue_try_pop(queue->messages))) {
+        g_debug("%s", message);
+        g_free(message);
+    }
+}
+
+void
+lr_log_debug(const char *format, ...)
+{
+    LrLogQueue *queue = g_private_get(&lr_logqueue_current);
+    va_list args;
+
+    va_start(args, format);
+    if (queue)
+        g_async_queue_push(queue->messages, g_strdup_vprintf(format, args));
+    else
+        g_logv(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, format, args);
+    va_end(args);
+}
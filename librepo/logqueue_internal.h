@@ -0,0 +1,73 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_LOGQUEUE_INTERNAL_H__
+#define __LR_LOGQUEUE_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** Queue of debug messages logged by threads started by librepo
+ * (verification pool, worker threads). Log handlers (e.g. of the Python
+ * bindings) may be called only from the thread which called librepo,
+ * so the messages are logged later by ::lr_logqueue_flush called
+ * from that thread.
+ */
+typedef struct _LrLogQueue LrLogQueue;
+
+/** Create a new queue.
+ * @return                  New queue
+ */
+LrLogQueue *
+lr_logqueue_new(void);
+
+/** Log the queued messages and free the queue. No thread may be
+ * attached to the queue anymore.
+ * @param queue             Queue or NULL
+ */
+void
+lr_logqueue_free(LrLogQueue *queue);
+
+/** Messages logged by ::lr_log_debug from the calling thread are put
+ * to the queue (instead of being logged) until the thread is detached.
+ * @param queue             Queue or NULL to detach the thread
+ */
+void
+lr_logqueue_attach(LrLogQueue *queue);
+
+/** Log the queued messages. Has to be called from the thread which
+ * called librepo.
+ * @param queue             Queue or NULL
+ */
+void
+lr_logqueue_flush(LrLogQueue *queue);
+
+/** Log the debug message, or put it to the queue the calling thread
+ * is attached to. Functions which could be called by threads started by
+ * librepo have to use this function instead of g_debug().
+ * @param format            printf() like format of the message
+ */
+void
+lr_log_debug(const char *format, ...) G_GNUC_PRINTF(1, 2);
+
+G_END_DECLS
+
+#endif
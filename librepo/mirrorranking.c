@@ -0,0 +1,215 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "mirrorranking_internal.h"
+
+/** Weight of the newest sample in the moving averages of mirror statistics */
+#define LR_MIRROR_EWMA_WEIGHT           0.3
+/** Size of a typical download used to combine throughput and latency
+ * of a mirror into a single score */
+#define LR_MIRROR_REFERENCE_SIZE        (1024.0*1024.0)
+/** Minimal size of a transfer which is used to measure throughput
+ * (smaller transfers are dominated by latency) */
+#define LR_MIRROR_MIN_THROUGHPUT_SAMPLE (64*1024)
+
+LrMirrorTier
+lr_mirror_tier(LrMirror *mirror)
+{
+    int successful = mirror->successful_transfers;
+    int failed = mirror->failed_transfers;
+
+    if (successful == 0 && mirror->serious_failure)
+        return LR_MT_BROKEN;
+    if (failed > successful)
+        return LR_MT_FAILING;
+    if (successful == 0)
+        return LR_MT_UNKNOWN;
+    return LR_MT_MEASURED;
+}
+
+/** Return mirror score (higher is better) or -1.0 if the score cannot
+ * be determined (e.g. when there are no successful transfers yet).
+ * Score is success rate for the mirror divided by the estimated time
+ * of a download of the reference size (time to first byte plus
+ * transfer time).
+ */
+gdouble
+lr_mirror_score(LrMirror *mirror)
+{
+    int successful = mirror->successful_transfers;
+    int failed = mirror->failed_transfers;
+    gdouble time;
+
+    if (successful == 0 || mirror->throughput <= 0.0)
+        return -1.0;
+
+    time = mirror->ttfb + LR_MIRROR_REFERENCE_SIZE / mirror->throughput;
+    if (time <= 0.0)
+        time = 1e-6;
+
+    return (successful / (gdouble) (successful + failed)) / time;
+}
+
+/** Compare mirrors.
+ * @return      Negative number if mirror a should be used before mirror b,
+ *              positive number otherwise.
+ */
+gint
+lr_mirror_cmp(LrMirror *a, LrMirror *b)
+{
+    LrMirrorTier tier_a = lr_mirror_tier(a);
+    LrMirrorTier tier_b = lr_mirror_tier(b);
+
+    if (tier_a != tier_b)
+        return (tier_a < tier_b) ? -1 : 1;
+
+    if (tier_a == LR_MT_MEASURED) {
+        gdouble score_a = lr_mirror_score(a);
+        gdouble score_b = lr_mirror_score(b);
+        if (score_a != score_b)
+            return (score_a > score_b) ? -1 : 1;
+    }
+
+    // Keep the original order (preference) of the mirrors
+    return (a->index < b->index) ? -1 : (a->index > b->index);
+}
+
+/** Add statistics of a successful transfer to the moving averages
+ * of the mirror.
+ * @param mirror        Mirror
+ * @param downloaded    Number of downloaded bytes
+ * @param ttfb          Time to the first byte (seconds)
+ * @param total         Total time of the transfer (seconds)
+ */
+void
+lr_mirror_update_stats(LrMirror *mirror,
+                       gdouble downloaded,
+                       gdouble ttfb,
+                       gdouble total)
+{
+    gdouble throughput = 0.0;
+    gdouble body_time = total - ttfb;
+
+    if (ttfb >= 0.0) {
+        if (mirror->ttfb_samples == 0)
+            mirror->ttfb = ttfb;
+        else
+            mirror->ttfb += LR_MIRROR_EWMA_WEIGHT * (ttfb - mirror->ttfb);
+        mirror->ttfb_samples++;
+    }
+
+    if (downloaded >= LR_MIRROR_MIN_THROUGHPUT_SAMPLE && body_time > 0.0)
+        throughput = downloaded / body_time;
+    else if (mirror->throughput <= 0.0 && downloaded > 0.0 && total > 0.0)
+        // No better estimation yet
+        throughput = downloaded / total;
+
+    if (throughput > 0.0) {
+        if (mirror->throughput <= 0.0)
+            mirror->throughput = throughput;
+        else
+            mirror->throughput += LR_MIRROR_EWMA_WEIGHT
+                                  * (throughput - mirror->throughput);
+    }
+}
+
+/** Sort mirrors. Penalize the error ones.
+ * Mirrors are kept ordered by lr_mirror_cmp(). Only the just finished
+ * mirror could be out of order, so its new position is found by binary
+ * search and the mirrors between its old and new position are shifted.
+ * @param mirrors   GPtrArray of mirrors
+ * @param mirror    Mirror of just finished transfer
+ * @param success   Was download from the mirror successful
+ * @param serious   If success is FALSE, serious mean that error was serious
+ *                  (like connection timeout), and the mirror should be
+ *                  penalized more that usual.
+ */
+gboolean
+lr_mirrors_sort(GPtrArray *mirrors,
+                LrMirror *mirror,
+                gboolean success,
+                gboolean serious)
+{
+    gpointer *pdata;
+    guint old_pos, new_pos, lo, hi;
+
+    assert(mirrors);
+    assert(mirror);
+    assert(mirror->position < mirrors->len);
+    assert(g_ptr_array_index(mirrors, mirror->position) == mirror);
+
+    if (!success && serious && mirror->successful_transfers == 0) {
+        // Mirror that encounter a serious error and has no successfull
+        // transfers should be moved at the end of the list
+        // (such mirror is probably down/broken/buggy)
+        mirror->serious_failure = TRUE;
+        g_debug("%s: Mirror %s is considered broken", __func__, mirror->mirror->url);
+    }
+
+    pdata = mirrors->pdata;
+    old_pos = mirror->position;
+
+    // Binary search of the new position in the array without the mirror
+    lo = 0;
+    hi = mirrors->len - 1;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        LrMirror *m = pdata[(mid < old_pos) ? mid : mid + 1];
+        if (lr_mirror_cmp(m, mirror) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    new_pos = lo;
+
+    if (new_pos < old_pos) {
+        memmove(pdata + new_pos + 1, pdata + new_pos,
+                (old_pos - new_pos) * sizeof(gpointer));
+        g_debug("%s: Mirror %s was awarded (%u -> %u)", __func__,
+                mirror->mirror->url, old_pos, new_pos);
+    } else if (new_pos > old_pos) {
+        memmove(pdata + old_pos, pdata + old_pos + 1,
+                (new_pos - old_pos) * sizeof(gpointer));
+        g_debug("%s: Mirror %s was penalized (%u -> %u)", __func__,
+                mirror->mirror->url, old_pos, new_pos);
+    }
+    pdata[new_pos] = mirror;
+
+    for (guint i = MIN(old_pos, new_pos); i <= MAX(old_pos, new_pos); i++)
+        ((LrMirror *) pdata[i])->position = i;
+
+    if (g_getenv("LIBREPO_DEBUG_ADAPTIVEMIRRORSORTING")) {
+        // Debug
+        g_debug("%s: Updated order of mirrors (for %p):", __func__, mirrors);
+        for (guint i = 0; i < mirrors->len; i++) {
+            LrMirror *m = pdata[i];
+            g_debug(" %s (s: %d f: %d score: %.2f ttfb: %.3fs speed: %.0fB/s)",
+                    m->mirror->url, m->successful_transfers,
+                    m->failed_transfers, lr_mirror_score(m), m->ttfb,
+                    m->throughput);
+        }
+    }
+
+    return TRUE;
+}
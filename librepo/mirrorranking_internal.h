@@ -0,0 +1,129 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_MIRRORRANKING_INTERNAL_H__
+#define __LR_MIRRORRANKING_INTERNAL_H__
+
+#include <glib.h>
+
+#include "lrmirrorlist.h"
+
+G_BEGIN_DECLS
+
+/** Mirror used by the downloader with its statistics.
+ * Mirrors of a handle are kept in an array ordered by lr_mirror_cmp().
+ */
+typedef struct {
+    LrInternalMirror *mirror; /*!<
+        Mirror */
+    int running_transfers; /*!<
+        How many transfers from this mirror are currently in progres. */
+    int successful_transfers; /*!<
+        How many transfers was finished successfully from the mirror. */
+    int failed_transfers; /*!<
+        How many transfers failed. */
+    gboolean multiplexed; /*!<
+        If TRUE, transfers from this mirror are multiplexed as HTTP/2
+        streams and running_transfers counts streams rather than
+        connections (see LRO_HTTP2). */
+    guint index; /*!<
+        Position of the mirror in the handle internal mirrorlist. */
+    guint position; /*!<
+        Current position of the mirror in the array of mirrors
+        ordered by the score. */
+    gboolean serious_failure; /*!<
+        A serious error (like connection timeout) was encountered. */
+    gdouble throughput; /*!<
+        Moving average of the download speed (bytes per second)
+        or 0.0 if unknown. */
+    gdouble ttfb; /*!<
+        Moving average of the time to the first byte (seconds). */
+    int ttfb_samples; /*!<
+        Number of transfers included in the ttfb. */
+} LrMirror;
+
+/** Groups of mirrors. A mirror from a lower group is always preferred.
+ */
+typedef enum {
+    LR_MT_MEASURED,     /*!< Mirror with successful transfers */
+    LR_MT_UNKNOWN,      /*!< Mirror without any finished transfer */
+    LR_MT_FAILING,      /*!< Mirror with more failed than successful transfers */
+    LR_MT_BROKEN,       /*!< Mirror with a serious error and no success */
+} LrMirrorTier;
+
+/** Get the group of the mirror.
+ * @param mirror    Mirror
+ * @return          Group of the mirror
+ */
+LrMirrorTier
+lr_mirror_tier(LrMirror *mirror);
+
+/** Return mirror score (higher is better) or -1.0 if the score cannot
+ * be determined (e.g. when there are no successful transfers yet).
+ * Score is success rate for the mirror divided by the estimated time
+ * of a download of the reference size (time to first byte plus
+ * transfer time).
+ * @param mirror    Mirror
+ * @return          Score of the mirror
+ */
+gdouble
+lr_mirror_score(LrMirror *mirror);
+
+/** Compare mirrors.
+ * @param a         Mirror
+ * @param b         Mirror
+ * @return          Negative number if mirror a should be used before
+ *                  mirror b, positive number otherwise.
+ */
+gint
+lr_mirror_cmp(LrMirror *a, LrMirror *b);
+
+/** Add statistics of a successful transfer to the moving averages
+ * of the mirror.
+ * @param mirror        Mirror
+ * @param downloaded    Number of downloaded bytes
+ * @param ttfb          Time to the first byte (seconds)
+ * @param total         Total time of the transfer (seconds)
+ */
+void
+lr_mirror_update_stats(LrMirror *mirror,
+                       gdouble downloaded,
+                       gdouble ttfb,
+                       gdouble total);
+
+/** Move the mirror of a just finished transfer to its position.
+ * Penalize the error ones.
+ * @param mirrors   GPtrArray of mirrors ordered by lr_mirror_cmp()
+ * @param mirror    Mirror of just finished transfer
+ * @param success   Was download from the mirror successful
+ * @param serious   If success is FALSE, serious mean that error was serious
+ *                  (like connection timeout), and the mirror should be
+ *                  penalized more that usual.
+ * @return          TRUE
+ */
+gboolean
+lr_mirrors_sort(GPtrArray *mirrors,
+                LrMirror *mirror,
+                gboolean success,
+                gboolean serious);
+
+G_END_DECLS
+
+#endif
@@ -35,6 +35,8 @@
 #include "handle_internal.h"
 #include "downloader.h"
 #include "fastestmirror_internal.h"
+#include "checksum_internal.h"
+#include "iouring_internal.h"
 
 /* Do NOT use resume on successfully downloaded files - download will fail */
 
@@ -164,6 +166,16 @@ lr_packagetarget_reset(LrPackageTarget *target)
 {
     target->local_path = NULL;
     target->err = NULL;
+    target->namelookup_time = 0.0;
+    target->connect_time = 0.0;
+    target->appconnect_time = 0.0;
+    target->starttransfer_time = 0.0;
+    target->total_time = 0.0;
+    target->average_speed = 0.0;
+    target->bytes_received = 0;
+    target->resumes = 0;
+    target->mirrors_tried = 0;
+    target->usedmirror = NULL;
 }
 
 void
@@ -238,6 +250,7 @@ lr_download_packages(GSList *targets,
 
     // List of handles for fastest mirror resolving
     GSList *fmr_handles = NULL;
+    GSList *dns_handles = NULL;
 
     // Prepare targets
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
@@ -304,12 +317,18 @@ lr_download_packages(GSList *targets,
             int fd_r = open(packagetarget->local_path, O_RDONLY);
             if (fd_r != -1) {
                 gboolean matches;
-                ret = lr_checksum_fd_cmp(packagetarget->checksum_type,
-                                         fd_r,
-                                         packagetarget->checksum,
-                                         1,
-                                         &matches,
-                                         NULL);
+                LrIoUring *ring = NULL;
+                if (packagetarget->handle && packagetarget->handle->iouring)
+                    ring = lr_iouring_new();
+                ret = lr_checksum_fd_compare_ring(packagetarget->checksum_type,
+                                                  fd_r,
+                                                  packagetarget->checksum,
+                                                  1,
+                                                  &matches,
+                                                  NULL,
+                                                  ring,
+                                                  NULL);
+                lr_iouring_free(ring);
                 close(fd_r);
                 if (ret && matches) {
                     // Checksum calculation was ok and checksum matches
@@ -366,6 +385,11 @@ lr_download_packages(GSList *targets,
             if (!ret)
                 goto cleanup;
 
+            if (packagetarget->handle->dnsprefetch
+                && !g_slist_find(dns_handles, packagetarget->handle))
+                dns_handles = g_slist_prepend(dns_handles,
+                                              packagetarget->handle);
+
             if (packagetarget->handle->fastestmirror) {
                 if (!g_slist_find(fmr_handles, packagetarget->handle))
                     fmr_handles = g_slist_prepend(fmr_handles,
@@ -394,8 +418,20 @@ lr_download_packages(GSList *targets,
                                                packagetarget,
                                                packagetarget->byterangestart,
                                                packagetarget->byterangeend);
+        downloadtarget->priority = packagetarget->priority;
+
+        downloadtargets = g_slist_prepend(downloadtargets, downloadtarget);
+    }
+
+    downloadtargets = g_slist_reverse(downloadtargets);
 
-        downloadtargets = g_slist_append(downloadtargets, downloadtarget);
+    // Resolve hosts of the mirrors of all handles in one shot
+    // (hosts of a handle are already resolved if its internal
+    // mirrorlist was prepared by this call)
+    if (dns_handles) {
+        lr_handles_prefetch_dns(dns_handles);
+        g_slist_free(dns_handles);
+        dns_handles = NULL;
     }
 
     // Do Fastest Mirror resolving for all handles in one shot
@@ -414,6 +450,8 @@ lr_download_packages(GSList *targets,
 
 cleanup:
 
+    g_slist_free(dns_handles);
+
     // Copy download statuses from downloadtargets to targets
     for (GSList *elem = downloadtargets; elem; elem = g_slist_next(elem)) {
         LrDownloadTarget *downloadtarget = elem->data;
@@ -421,6 +459,19 @@ cleanup:
         if (downloadtarget->err)
             packagetarget->err = g_string_chunk_insert(packagetarget->chunk,
                                                        downloadtarget->err);
+        packagetarget->namelookup_time = downloadtarget->namelookup_time;
+        packagetarget->connect_time = downloadtarget->connect_time;
+        packagetarget->appconnect_time = downloadtarget->appconnect_time;
+        packagetarget->starttransfer_time = downloadtarget->starttransfer_time;
+        packagetarget->total_time = downloadtarget->total_time;
+        packagetarget->average_speed = downloadtarget->average_speed;
+        packagetarget->bytes_received = downloadtarget->bytes_received;
+        packagetarget->resumes = downloadtarget->resumes;
+        packagetarget->mirrors_tried = downloadtarget->mirrors_tried;
+        if (downloadtarget->usedmirror)
+            packagetarget->usedmirror = g_string_chunk_insert(
+                                            packagetarget->chunk,
+                                            downloadtarget->usedmirror);
     }
 
     // Free downloadtargets list
@@ -492,6 +543,8 @@ lr_check_packages(GSList *targets,
     gboolean failfast = flags & LR_PACKAGECHECK_FAILFAST;
     struct sigaction old_sigact;
     gboolean interruptible = FALSE;
+    gboolean iouring = FALSE;
+    LrIoUring *ring = NULL;
 
     assert(!err || *err == NULL);
 
@@ -505,6 +558,9 @@ lr_check_packages(GSList *targets,
         if (packagetarget->handle->interruptible)
             interruptible = TRUE;
 
+        if (packagetarget->handle->iouring)
+            iouring = TRUE;
+
         if (!packagetarget->checksum
                 || packagetarget->checksum_type == LR_CHECKSUM_UNKNOWN)
         {
@@ -530,6 +586,10 @@ lr_check_packages(GSList *targets,
         }
     }
 
+    // All files are read by the same ring
+    if (iouring)
+        ring = lr_iouring_new();
+
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
         gchar *local_path;
         LrPackageTarget *packagetarget = elem->data;
@@ -560,12 +620,14 @@ lr_check_packages(GSList *targets,
             if (fd_r != -1) {
                 // File was successfully opened
                 gboolean matches;
-                ret = lr_checksum_fd_cmp(packagetarget->checksum_type,
-                                         fd_r,
-                                         packagetarget->checksum,
-                                         1,
-                                         &matches,
-                                         NULL);
+                ret = lr_checksum_fd_compare_ring(packagetarget->checksum_type,
+                                                  fd_r,
+                                                  packagetarget->checksum,
+                                                  1,
+                                                  &matches,
+                                                  NULL,
+                                                  ring,
+                                                  NULL);
                 close(fd_r);
                 if (ret && matches) {
                     // Checksum is ok
@@ -609,6 +671,8 @@ lr_check_packages(GSList *targets,
         }
     }
 
+    lr_iouring_free(ring);
+
     // Restore original signal handler
     if (interruptible) {
         g_debug("%s: Restoring an old SIGINT handler", __func__);
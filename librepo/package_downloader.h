@@ -131,6 +131,46 @@ typedef struct {
     GStringChunk *chunk; /*!<
         String chunk */
 
+    // Items added later are appended, so the layout of the items above
+    // stays compatible with existing binaries
+
+    int priority; /*!<
+        Targets with higher priority are downloaded first
+        (see LRO_SCHEDULINGPOLICY). 0 is default. The priority is not
+        a param of constructors, set it directly. */
+
+    // Statistics of the download, see ::LrDownloadTarget
+
+    double namelookup_time; /*!<
+        Time (in seconds) to resolve the host name */
+
+    double connect_time; /*!<
+        Time (in seconds) to connect */
+
+    double appconnect_time; /*!<
+        Time (in seconds) to finish the TLS handshake */
+
+    double starttransfer_time; /*!<
+        Time (in seconds) to the first byte */
+
+    double total_time; /*!<
+        Time (in seconds) of the last transfer */
+
+    double average_speed; /*!<
+        Average speed (bytes per second) of the last transfer */
+
+    gint64 bytes_received; /*!<
+        Bytes received by all transfers */
+
+    int resumes; /*!<
+        Number of resumed transfers */
+
+    int mirrors_tried; /*!<
+        Number of mirrors tried */
+
+    char *usedmirror; /*!<
+        Mirror the package was downloaded from or NULL */
+
 } LrPackageTarget;
 
 /** Create new LrPackageTarget object.
@@ -309,6 +309,7 @@ Version contants
 
     *Integer or None* Sets kind of IP addresses to use when resolving host
     names. Could be one of: :ref:`ipresolve-type-label`
+    See also :data:`.LRO_DNSPREFETCH` and :data:`.LRO_HAPPYEYEBALLSTIMEOUT`.
 
 .. data:: LRO_ALLOWEDMIRRORFAILURES
 
@@ -357,6 +358,157 @@ Version contants
     ignored. Remote mirrorlists/metalinks (if they are specified)
     are ignored. Fastest mirror check (if enabled) is skiped.
 
+.. data:: LRO_EVENTENGINE
+
+    *Integer or None* Event engine used to drive transfers and
+    the fastest mirror detection. Could be one of:
+    :ref:`eventengine-type-label`
+
+.. data:: LRO_SHARE
+
+    *Boolean or None* If True, the handle uses the process-wide share
+    object, so it shares the DNS cache, SSL session IDs and live
+    connections with all other handles with this option enabled.
+    Useful when a lot of repositories are served from the same hosts.
+
+.. data:: LRO_HTTP2
+
+    *Boolean or None* Enable HTTP/2 multiplexing. Transfers from a https
+    mirror are multiplexed as streams over a shared connection.
+    Number of parallel transfers from such mirror is limited by
+    :data:`.LRO_MAXSTREAMSPERMIRROR` instead of
+    :data:`.LRO_MAXDOWNLOADSPERMIRROR` and
+    :data:`.LRO_MAXPARALLELDOWNLOADS` limits number of connections.
+    Mirrors without HTTP/2 support use the usual limits.
+
+.. data:: LRO_MAXSTREAMSPERMIRROR
+
+    *Integer or None* Maximum number of parallel transfers (HTTP/2 streams)
+    per mirror when :data:`.LRO_HTTP2` is enabled.
+
+.. data:: LRO_MAXSEGMENTS
+
+    *Integer or None* Maximum number of segments a single large file could
+    be split into. Segments are downloaded in parallel from different
+    mirrors. Only targets with a known expected size, without byte range
+    and resume, with at least two usable mirrors are segmented.
+    1 (default) disables segmented downloading.
+
+.. data:: LRO_MINSEGMENTSIZE
+
+    *Integer or None* Minimal size of a segment in bytes.
+
+.. data:: LRO_WRITEBUFFERSIZE
+
+    *Integer or None* Size of the buffer (in bytes) used for writing
+    of downloaded data to the target file. 0 means that data are written
+    as they arrive. Default is 1 MiB.
+
+.. data:: LRO_ADAPTIVECONCURRENCY
+
+    *Boolean or None* Tune number of parallel transfers during
+    the download. :data:`.LRO_MAXPARALLELDOWNLOADS` is used as the initial
+    value. The number grows while it limits the download and the aggregate
+    throughput doesn't drop, and it shrinks when transfers fail by timeouts
+    or network errors or when the throughput collapses.
+
+.. data:: LRO_ADAPTIVEMAXPARALLELDOWNLOADS
+
+    *Integer or None* Upper bound of number of parallel transfers when
+    :data:`.LRO_ADAPTIVECONCURRENCY` is enabled.
+
+.. data:: LRO_SCHEDULINGPOLICY
+
+    *Integer or None* Order in which targets of a download are started.
+    Could be one of: :ref:`schedulingpolicy-type-label`. Priority of the
+    targets (see :class:`~librepo.PackageTarget`) is respected by all
+    policies.
+
+.. data:: LRO_HEDGEDREQUESTS
+
+    *Boolean or None* Duplicate slow transfers at the end of the download.
+    When there are free slots and no waiting targets, a transfer whose
+    projected duration is much longer than the median of the other
+    transfers is started again from another mirror. The transfer which
+    finishes first wins and the other one is cancelled. Only targets
+    downloaded to a file given by its name are hedged.
+
+.. data:: LRO_MIGRATESLOWTRANSFERS
+
+    *Boolean or None* Move transfers which are much slower than the other
+    transfers (or than a free mirror is known to be) to another mirror.
+    The data already downloaded are kept and the transfer continues from
+    the current offset. HTTP transfers check that the file on the new
+    mirror is the same (``If-Range`` header with ETag or Last-Modified),
+    otherwise the file is downloaded from the beginning.
+
+.. data:: LRO_CONDITIONALREQUESTS
+
+    *Boolean or None* Reuse metadata downloaded to the :data:`.LRO_DESTDIR`
+    by a previous :meth:`~.Handle.perform`. The repomd.xml, metadata files,
+    mirrorlist and metalink.xml are downloaded by HTTP conditional requests
+    (``If-None-Match``, ``If-Modified-Since``) and the existing files which
+    were not modified on the server are kept.
+
+.. data:: LRO_WORKERTHREADS
+
+    *Integer or None* Number of threads which perform the transfers.
+    Each thread has its own connections. Callbacks are still called from
+    the thread which started the download. Hedged requests and migration
+    of slow transfers are not used with more than one thread.
+    1 (default) means that the transfers are performed by the calling
+    thread.
+
+.. data:: LRO_IOURING
+
+    *Boolean or None* Use io_uring for file I/O if librepo was built
+    with liburing and the running kernel supports it. Downloaded data
+    are written asynchronously (in batches once per iteration of the
+    download loop) and files are read by several parallel reads when
+    their checksums are verified (including checks of already downloaded
+    packages). Not used for the transfers when :data:`.LRO_WORKERTHREADS`
+    is greater than 1.
+
+.. data:: LRO_PROGRESSINTERVAL
+
+    *Integer or None* Minimal interval (in milliseconds) between two calls
+    of a progress callback (of a target or the aggregate one of
+    :func:`~librepo.download_packages`). Reports in the meantime are
+    skipped, the first and the final report of a transfer are never
+    skipped. 0 (default) means that every report is passed to the
+    callback.
+
+.. data:: LRO_PROGRESSDELTA
+
+    *Integer or None* Minimal number of bytes downloaded between two calls
+    of a progress callback. Works together with
+    :data:`.LRO_PROGRESSINTERVAL`. 0 (default) means no limit.
+
+.. data:: LRO_DNSPREFETCH
+
+    *Boolean or None* Resolve host names of all mirrors in parallel as
+    soon as the list of mirrors is known (and when
+    :func:`~librepo.download_packages` starts), so transfers from the
+    mirrors don't wait for DNS. Addresses of the type selected by
+    :data:`.LRO_IPRESOLVE` are resolved. Not used when a proxy is set.
+
+.. data:: LRO_HAPPYEYEBALLSTIMEOUT
+
+    *Integer or None* Time (in milliseconds) the connection to the first
+    address family of a host gets a head start before a connection to
+    the other family (IPv6/IPv4) is tried in parallel. Used when
+    :data:`.LRO_IPRESOLVE` is :data:`.IPRESOLVE_WHATEVER`. Default is 200.
+
+.. data:: LRO_PREWARMMIRRORS
+
+    *Integer or None* Number of the first (best ranked) HTTP(S) mirrors
+    to which connections are opened in advance, in background, while
+    repomd.xml is verified and parsed and after :meth:`~.Handle.perform`
+    returns (e.g. while dependencies are resolved). Up to
+    :data:`.LRO_MAXDOWNLOADSPERMIRROR` connections are opened to each
+    mirror and reused by the next downloads of the handle. Opening stops
+    as soon as the next download starts. 0 (default) disables it.
+
 
 .. _handle-info-options-label:
 
@@ -402,6 +554,26 @@ Version contants
 .. data:: LRI_FASTESTMIRRORTIMEOUT
 .. data:: LRI_HTTPHEADER
 .. data:: LRI_OFFLINE
+.. data:: LRI_EVENTENGINE
+.. data:: LRI_SHARE
+.. data:: LRI_HTTP2
+.. data:: LRI_MAXSTREAMSPERMIRROR
+.. data:: LRI_MAXSEGMENTS
+.. data:: LRI_MINSEGMENTSIZE
+.. data:: LRI_WRITEBUFFERSIZE
+.. data:: LRI_ADAPTIVECONCURRENCY
+.. data:: LRI_ADAPTIVEMAXPARALLELDOWNLOADS
+.. data:: LRI_SCHEDULINGPOLICY
+.. data:: LRI_HEDGEDREQUESTS
+.. data:: LRI_MIGRATESLOWTRANSFERS
+.. data:: LRI_CONDITIONALREQUESTS
+.. data:: LRI_WORKERTHREADS
+.. data:: LRI_IOURING
+.. data:: LRI_PROGRESSINTERVAL
+.. data:: LRI_PROGRESSDELTA
+.. data:: LRI_DNSPREFETCH
+.. data:: LRI_HAPPYEYEBALLSTIMEOUT
+.. data:: LRI_PREWARMMIRRORS
 
 .. _proxy-type-label:
 
@@ -433,6 +605,41 @@ Supported IP resolving
 
     Resolve to IPv6 addresses.
 
+.. _eventengine-type-label:
+
+Event engines
+-------------
+
+.. data:: EVENTENGINE_SELECT
+
+    Default value, transfers are driven by a select() based loop.
+
+.. data:: EVENTENGINE_EPOLL
+
+    Transfers are driven by an epoll based loop which services only
+    sockets with some activity. Recommended when a lot of transfers
+    run in parallel.
+
+.. _schedulingpolicy-type-label:
+
+Scheduling policies
+-------------------
+
+Targets with unknown expected size are considered to be the smallest ones.
+
+.. data:: SCHEDULING_FIFO
+
+    Default value, targets are started in order in which they were passed.
+
+.. data:: SCHEDULING_LARGESTFIRST
+
+    The largest targets are started first, so no large target is left
+    to the end of the download.
+
+.. data:: SCHEDULING_BALANCED
+
+    The largest and the smallest targets are started alternately.
+
 .. _repotype-constants-label:
 
 Repo type constants
@@ -899,12 +1106,58 @@ class PackageTarget(_librepo.PackageTarget):
     """
     Represent a single package that will be downloaded by
     :func:`~librepo.download_packages`.
+
+    Statistics of the download are available after
+    :func:`~librepo.download_packages` returns. Times are in seconds
+    from the start of the last transfer, phases skipped thanks to
+    a reused connection are reported as 0.
+
+    .. attribute:: namelookup_time:
+
+        Time when the host name was resolved
+
+    .. attribute:: connect_time:
+
+        Time when the connection was established
+
+    .. attribute:: appconnect_time:
+
+        Time when the TLS handshake was done (0 without TLS)
+
+    .. attribute:: starttransfer_time:
+
+        Time when the first byte was received
+
+    .. attribute:: total_time:
+
+        Duration of the last transfer
+
+    .. attribute:: average_speed:
+
+        Average speed of the last transfer (bytes per second)
+
+    .. attribute:: bytes_received:
+
+        Bytes received by all transfers, including the unsuccessful ones
+
+    .. attribute:: resumes:
+
+        Number of transfers which continued a partially downloaded file
+
+    .. attribute:: mirrors_tried:
+
+        Number of mirrors the package was tried from
+
+    .. attribute:: usedmirror:
+
+        URL of the mirror the package was downloaded from
     """
 
     def __init__(self, relative_url, dest=None, checksum_type=CHECKSUM_UNKNOWN,
                  checksum=None, expectedsize=0, base_url=None, resume=False,
                  progresscb=None, cbdata=None, handle=None, endcb=None,
-                 mirrorfailurecb=None, byterangestart=0, byterangeend=0):
+                 mirrorfailurecb=None, byterangestart=0, byterangeend=0,
+                 priority=0):
         """
         :param relative_url: Target URL. If *handle* or *base_url* specified,
             the *url* can be (and logically should be) only a relative part of path.
@@ -928,12 +1181,14 @@ class PackageTarget(_librepo.PackageTarget):
         :param byterangeend: Stop downloading at the specified byte.
             *Note: If the byterangeend is less or equal to byterangestart,
             then it is ignored!*
+        :param priority: Targets with higher priority are started before
+            targets with lower priority. 0 is default.
         """
         _librepo.PackageTarget.__init__(self, handle, relative_url, dest,
                                         checksum_type, checksum, expectedsize,
                                         base_url, resume, progresscb, cbdata,
                                         endcb, mirrorfailurecb, byterangestart,
-                                        byterangeend)
+                                        byterangeend, priority)
 
 
 class Handle(_librepo.Handle):
@@ -1155,6 +1410,86 @@ class Handle(_librepo.Handle):
 
         See :data:`.LRO_OFFLINE`
 
+    .. attribute:: eventengine:
+
+        See :data:`.LRO_EVENTENGINE`
+
+    .. attribute:: share:
+
+        See :data:`.LRO_SHARE`
+
+    .. attribute:: http2:
+
+        See :data:`.LRO_HTTP2`
+
+    .. attribute:: maxstreamspermirror:
+
+        See :data:`.LRO_MAXSTREAMSPERMIRROR`
+
+    .. attribute:: maxsegments:
+
+        See :data:`.LRO_MAXSEGMENTS`
+
+    .. attribute:: minsegmentsize:
+
+        See :data:`.LRO_MINSEGMENTSIZE`
+
+    .. attribute:: writebuffersize:
+
+        See :data:`.LRO_WRITEBUFFERSIZE`
+
+    .. attribute:: adaptiveconcurrency:
+
+        See :data:`.LRO_ADAPTIVECONCURRENCY`
+
+    .. attribute:: adaptivemaxparalleldownloads:
+
+        See :data:`.LRO_ADAPTIVEMAXPARALLELDOWNLOADS`
+
+    .. attribute:: schedulingpolicy:
+
+        See :data:`.LRO_SCHEDULINGPOLICY`
+
+    .. attribute:: hedgedrequests:
+
+        See :data:`.LRO_HEDGEDREQUESTS`
+
+    .. attribute:: migrateslowtransfers:
+
+        See :data:`.LRO_MIGRATESLOWTRANSFERS`
+
+    .. attribute:: conditionalrequests:
+
+        See :data:`.LRO_CONDITIONALREQUESTS`
+
+    .. attribute:: workerthreads:
+
+        See :data:`.LRO_WORKERTHREADS`
+
+    .. attribute:: iouring:
+
+        See :data:`.LRO_IOURING`
+
+    .. attribute:: progressinterval:
+
+        See :data:`.LRO_PROGRESSINTERVAL`
+
+    .. attribute:: progressdelta:
+
+        See :data:`.LRO_PROGRESSDELTA`
+
+    .. attribute:: dnsprefetch:
+
+        See :data:`.LRO_DNSPREFETCH`
+
+    .. attribute:: happyeyeballstimeout:
+
+        See :data:`.LRO_HAPPYEYEBALLSTIMEOUT`
+
+    .. attribute:: prewarmmirrors:
+
+        See :data:`.LRO_PREWARMMIRRORS`
+
     """
 
     def setopt(self, option, val):
@@ -385,6 +385,13 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_SSLVERIFYHOST:
     case LRO_ADAPTIVEMIRRORSORTING:
     case LRO_OFFLINE:
+    case LRO_HTTP2:
+    case LRO_ADAPTIVECONCURRENCY:
+    case LRO_HEDGEDREQUESTS:
+    case LRO_MIGRATESLOWTRANSFERS:
+    case LRO_CONDITIONALREQUESTS:
+    case LRO_IOURING:
+    case LRO_DNSPREFETCH:
     {
         long d;
 
@@ -422,6 +429,8 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_LOWSPEEDLIMIT:
     case LRO_IPRESOLVE:
     case LRO_ALLOWEDMIRRORFAILURES:
+    case LRO_EVENTENGINE:
+    case LRO_SCHEDULINGPOLICY:
     {
         int badarg = 0;
         long d;
@@ -453,6 +462,12 @@ py_setopt(_HandleObject *self, PyObject *args)
             case LRO_ALLOWEDMIRRORFAILURES:
                 d = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
                 break;
+            case LRO_EVENTENGINE:
+                d = LRO_EVENTENGINE_DEFAULT;
+                break;
+            case LRO_SCHEDULINGPOLICY:
+                d = LRO_SCHEDULINGPOLICY_DEFAULT;
+                break;
             default:
                 badarg = 1;
             }
@@ -479,6 +494,16 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_MAXMIRRORTRIES:
     case LRO_MAXPARALLELDOWNLOADS:
     case LRO_MAXDOWNLOADSPERMIRROR:
+    case LRO_MAXSTREAMSPERMIRROR:
+    case LRO_MAXSEGMENTS:
+    case LRO_MINSEGMENTSIZE:
+    case LRO_WRITEBUFFERSIZE:
+    case LRO_ADAPTIVEMAXPARALLELDOWNLOADS:
+    case LRO_WORKERTHREADS:
+    case LRO_PROGRESSINTERVAL:
+    case LRO_PROGRESSDELTA:
+    case LRO_HAPPYEYEBALLSTIMEOUT:
+    case LRO_PREWARMMIRRORS:
     {
         long d;
 
@@ -500,6 +525,26 @@ py_setopt(_HandleObject *self, PyObject *args)
                 d = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
             else if (option == LRO_MAXDOWNLOADSPERMIRROR)
                 d = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
+            else if (option == LRO_MAXSTREAMSPERMIRROR)
+                d = LRO_MAXSTREAMSPERMIRROR_DEFAULT;
+            else if (option == LRO_MAXSEGMENTS)
+                d = LRO_MAXSEGMENTS_DEFAULT;
+            else if (option == LRO_MINSEGMENTSIZE)
+                d = LRO_MINSEGMENTSIZE_DEFAULT;
+            else if (option == LRO_WRITEBUFFERSIZE)
+                d = LRO_WRITEBUFFERSIZE_DEFAULT;
+            else if (option == LRO_ADAPTIVEMAXPARALLELDOWNLOADS)
+                d = LRO_ADAPTIVEMAXPARALLELDOWNLOADS_DEFAULT;
+            else if (option == LRO_WORKERTHREADS)
+                d = LRO_WORKERTHREADS_DEFAULT;
+            else if (option == LRO_PROGRESSINTERVAL)
+                d = LRO_PROGRESSINTERVAL_DEFAULT;
+            else if (option == LRO_PROGRESSDELTA)
+                d = LRO_PROGRESSDELTA_DEFAULT;
+            else if (option == LRO_HAPPYEYEBALLSTIMEOUT)
+                d = LRO_HAPPYEYEBALLSTIMEOUT_DEFAULT;
+            else if (option == LRO_PREWARMMIRRORS)
+                d = LRO_PREWARMMIRRORS_DEFAULT;
             else
                 assert(0);
         } else {
@@ -812,6 +857,28 @@ py_setopt(_HandleObject *self, PyObject *args)
     }
 
 
+    /*
+     * Share object (only the process-wide one is available from Python)
+     */
+    case LRO_SHARE: {
+        LrShare *share;
+
+        if (obj == Py_None || PyObject_IsTrue(obj) == 0)
+            share = NULL;
+        else if (PyObject_IsTrue(obj) == 1)
+            share = lr_share_default();
+        else {
+            PyErr_SetString(PyExc_TypeError, "Only Bool or None are supported with this option");
+            return NULL;
+        }
+
+        res = lr_handle_setopt(self->handle,
+                               &tmp_err,
+                               (LrHandleOption)option,
+                               share);
+        break;
+    }
+
     /*
      * Options with callback data
      */
@@ -907,6 +974,23 @@ py_getinfo(_HandleObject *self, PyObject *args)
     case LRI_ALLOWEDMIRRORFAILURES:
     case LRI_ADAPTIVEMIRRORSORTING:
     case LRI_OFFLINE:
+    case LRI_HTTP2:
+    case LRI_MAXSTREAMSPERMIRROR:
+    case LRI_MAXSEGMENTS:
+    case LRI_MINSEGMENTSIZE:
+    case LRI_WRITEBUFFERSIZE:
+    case LRI_ADAPTIVECONCURRENCY:
+    case LRI_ADAPTIVEMAXPARALLELDOWNLOADS:
+    case LRI_HEDGEDREQUESTS:
+    case LRI_MIGRATESLOWTRANSFERS:
+    case LRI_CONDITIONALREQUESTS:
+    case LRI_WORKERTHREADS:
+    case LRI_IOURING:
+    case LRI_PROGRESSINTERVAL:
+    case LRI_PROGRESSDELTA:
+    case LRI_DNSPREFETCH:
+    case LRI_HAPPYEYEBALLSTIMEOUT:
+    case LRI_PREWARMMIRRORS:
         res = lr_handle_getinfo(self->handle,
                                 &tmp_err,
                                 (LrHandleInfoOption)option,
@@ -927,6 +1011,42 @@ py_getinfo(_HandleObject *self, PyObject *args)
         return PyLong_FromLong((long) type);
     }
 
+    /* LrEventEngine* option */
+    case LRI_EVENTENGINE: {
+        LrEventEngine type;
+        res = lr_handle_getinfo(self->handle,
+                                &tmp_err,
+                                (LrHandleInfoOption)option,
+                                &type);
+        if (!res)
+            RETURN_ERROR(&tmp_err, -1, NULL);
+        return PyLong_FromLong((long) type);
+    }
+
+    /* LrSchedulingPolicy* option */
+    case LRI_SCHEDULINGPOLICY: {
+        LrSchedulingPolicy policy;
+        res = lr_handle_getinfo(self->handle,
+                                &tmp_err,
+                                (LrHandleInfoOption)option,
+                                &policy);
+        if (!res)
+            RETURN_ERROR(&tmp_err, -1, NULL);
+        return PyLong_FromLong((long) policy);
+    }
+
+    /* LrShare** option */
+    case LRI_SHARE: {
+        LrShare *share = NULL;
+        res = lr_handle_getinfo(self->handle,
+                                &tmp_err,
+                                (LrHandleInfoOption)option,
+                                &share);
+        if (!res)
+            RETURN_ERROR(&tmp_err, -1, NULL);
+        return PyBool_FromLong(share != NULL);
+    }
+
     /* List option */
     case LRI_VARSUB: {
         LrUrlVars *vars;
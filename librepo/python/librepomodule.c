@@ -285,6 +285,26 @@ init_librepo(void)
     PYMODULE_ADDINTCONSTANT(LRO_FASTESTMIRRORTIMEOUT);
     PYMODULE_ADDINTCONSTANT(LRO_HTTPHEADER);
     PYMODULE_ADDINTCONSTANT(LRO_OFFLINE);
+    PYMODULE_ADDINTCONSTANT(LRO_EVENTENGINE);
+    PYMODULE_ADDINTCONSTANT(LRO_SHARE);
+    PYMODULE_ADDINTCONSTANT(LRO_HTTP2);
+    PYMODULE_ADDINTCONSTANT(LRO_MAXSTREAMSPERMIRROR);
+    PYMODULE_ADDINTCONSTANT(LRO_MAXSEGMENTS);
+    PYMODULE_ADDINTCONSTANT(LRO_MINSEGMENTSIZE);
+    PYMODULE_ADDINTCONSTANT(LRO_WRITEBUFFERSIZE);
+    PYMODULE_ADDINTCONSTANT(LRO_ADAPTIVECONCURRENCY);
+    PYMODULE_ADDINTCONSTANT(LRO_ADAPTIVEMAXPARALLELDOWNLOADS);
+    PYMODULE_ADDINTCONSTANT(LRO_SCHEDULINGPOLICY);
+    PYMODULE_ADDINTCONSTANT(LRO_HEDGEDREQUESTS);
+    PYMODULE_ADDINTCONSTANT(LRO_MIGRATESLOWTRANSFERS);
+    PYMODULE_ADDINTCONSTANT(LRO_CONDITIONALREQUESTS);
+    PYMODULE_ADDINTCONSTANT(LRO_WORKERTHREADS);
+    PYMODULE_ADDINTCONSTANT(LRO_IOURING);
+    PYMODULE_ADDINTCONSTANT(LRO_PROGRESSINTERVAL);
+    PYMODULE_ADDINTCONSTANT(LRO_PROGRESSDELTA);
+    PYMODULE_ADDINTCONSTANT(LRO_DNSPREFETCH);
+    PYMODULE_ADDINTCONSTANT(LRO_HAPPYEYEBALLSTIMEOUT);
+    PYMODULE_ADDINTCONSTANT(LRO_PREWARMMIRRORS);
     PYMODULE_ADDINTCONSTANT(LRO_SENTINEL);
 
     // Handle info options
@@ -324,6 +344,26 @@ init_librepo(void)
     PYMODULE_ADDINTCONSTANT(LRI_FASTESTMIRRORTIMEOUT);
     PYMODULE_ADDINTCONSTANT(LRI_HTTPHEADER);
     PYMODULE_ADDINTCONSTANT(LRI_OFFLINE);
+    PYMODULE_ADDINTCONSTANT(LRI_EVENTENGINE);
+    PYMODULE_ADDINTCONSTANT(LRI_SHARE);
+    PYMODULE_ADDINTCONSTANT(LRI_HTTP2);
+    PYMODULE_ADDINTCONSTANT(LRI_MAXSTREAMSPERMIRROR);
+    PYMODULE_ADDINTCONSTANT(LRI_MAXSEGMENTS);
+    PYMODULE_ADDINTCONSTANT(LRI_MINSEGMENTSIZE);
+    PYMODULE_ADDINTCONSTANT(LRI_WRITEBUFFERSIZE);
+    PYMODULE_ADDINTCONSTANT(LRI_ADAPTIVECONCURRENCY);
+    PYMODULE_ADDINTCONSTANT(LRI_ADAPTIVEMAXPARALLELDOWNLOADS);
+    PYMODULE_ADDINTCONSTANT(LRI_SCHEDULINGPOLICY);
+    PYMODULE_ADDINTCONSTANT(LRI_HEDGEDREQUESTS);
+    PYMODULE_ADDINTCONSTANT(LRI_MIGRATESLOWTRANSFERS);
+    PYMODULE_ADDINTCONSTANT(LRI_CONDITIONALREQUESTS);
+    PYMODULE_ADDINTCONSTANT(LRI_WORKERTHREADS);
+    PYMODULE_ADDINTCONSTANT(LRI_IOURING);
+    PYMODULE_ADDINTCONSTANT(LRI_PROGRESSINTERVAL);
+    PYMODULE_ADDINTCONSTANT(LRI_PROGRESSDELTA);
+    PYMODULE_ADDINTCONSTANT(LRI_DNSPREFETCH);
+    PYMODULE_ADDINTCONSTANT(LRI_HAPPYEYEBALLSTIMEOUT);
+    PYMODULE_ADDINTCONSTANT(LRI_PREWARMMIRRORS);
     PYMODULE_ADDINTCONSTANT(LRI_SENTINEL);
 
     // Check options
@@ -349,6 +389,15 @@ init_librepo(void)
     PYMODULE_ADDINTCONSTANT(LR_IPRESOLVE_V4);
     PYMODULE_ADDINTCONSTANT(LR_IPRESOLVE_V6);
 
+    // Event engine
+    PYMODULE_ADDINTCONSTANT(LR_EVENTENGINE_SELECT);
+    PYMODULE_ADDINTCONSTANT(LR_EVENTENGINE_EPOLL);
+
+    // Scheduling policies
+    PYMODULE_ADDINTCONSTANT(LR_SCHEDULING_FIFO);
+    PYMODULE_ADDINTCONSTANT(LR_SCHEDULING_LARGESTFIRST);
+    PYMODULE_ADDINTCONSTANT(LR_SCHEDULING_BALANCED);
+
     // Return codes
     PYMODULE_ADDINTCONSTANT(LRE_OK);
     PYMODULE_ADDINTCONSTANT(LRE_BADFUNCARG);
@@ -268,7 +268,7 @@ packagetarget_init(_PackageTargetObject *self,
                    PyObject *kwds G_GNUC_UNUSED)
 {
     char *relative_url, *dest, *checksum, *base_url;
-    int checksum_type, resume;
+    int checksum_type, resume, priority = 0;
     PY_LONG_LONG expectedsize, byterangestart, byterangeend;
     PyObject *pyhandle, *py_progresscb, *py_cbdata;
     PyObject *py_endcb, *py_mirrorfailurecb;
@@ -280,12 +280,12 @@ packagetarget_init(_PackageTargetObject *self,
     PyObject *py_dest = NULL;
     PyObject *tmp_py_str = NULL;
 
-    if (!PyArg_ParseTuple(args, "OsOizLziOOOOLL:packagetarget_init",
+    if (!PyArg_ParseTuple(args, "OsOizLziOOOOLL|i:packagetarget_init",
                           &pyhandle, &relative_url, &py_dest, &checksum_type,
                           &checksum, &expectedsize, &base_url, &resume,
                           &py_progresscb, &py_cbdata, &py_endcb,
                           &py_mirrorfailurecb, &byterangestart,
-                          &byterangeend))
+                          &byterangeend, &priority))
         return -1;
 
     dest = PyAnyStr_AsString(py_dest, &tmp_py_str);
@@ -359,6 +359,9 @@ packagetarget_init(_PackageTargetObject *self,
         g_error_free(tmp_err);
         return -1;
     }
+
+    self->target->priority = priority;
+
     return 0;
 }
 
@@ -403,6 +406,16 @@ get_int(_PackageTargetObject *self, void *member_offset)
     return PyLong_FromLong((long) val);
 }
 
+static PyObject *
+get_double(_PackageTargetObject *self, void *member_offset)
+{
+    if (check_PackageTargetStatus(self))
+        return NULL;
+    LrPackageTarget *target = self->target;
+    double val = *((double *) ((size_t)target + (size_t) member_offset));
+    return PyFloat_FromDouble(val);
+}
+
 static PyObject *
 get_str(_PackageTargetObject *self, void *member_offset)
 {
@@ -468,12 +481,23 @@ static PyGetSetDef packagetarget_getsetters[] = {
     {"checksum",      (getter)get_str,       NULL, NULL, OFFSET(checksum)},
     {"expectedsize",  (getter)get_gint64,    NULL, NULL, OFFSET(expectedsize)},
     {"resume",        (getter)get_int,       NULL, NULL, OFFSET(resume)},
+    {"priority",      (getter)get_int,       NULL, NULL, OFFSET(priority)},
     {"cbdata",        (getter)get_pythonobj, NULL, NULL, OFFSET(cbdata)},
     {"progresscb",    (getter)get_pythonobj, NULL, NULL, OFFSET(progresscb)},
     {"endcb",         (getter)get_pythonobj, NULL, NULL, OFFSET(endcb)},
     {"mirrorfailurecb",(getter)get_pythonobj,NULL, NULL, OFFSET(mirrorfailurecb)},
     {"local_path",    (getter)get_str,       NULL, NULL, OFFSET(local_path)},
     {"err",           (getter)get_str,       NULL, NULL, OFFSET(err)},
+    {"namelookup_time",   (getter)get_double, NULL, NULL, OFFSET(namelookup_time)},
+    {"connect_time",      (getter)get_double, NULL, NULL, OFFSET(connect_time)},
+    {"appconnect_time",   (getter)get_double, NULL, NULL, OFFSET(appconnect_time)},
+    {"starttransfer_time",(getter)get_double, NULL, NULL, OFFSET(starttransfer_time)},
+    {"total_time",        (getter)get_double, NULL, NULL, OFFSET(total_time)},
+    {"average_speed",     (getter)get_double, NULL, NULL, OFFSET(average_speed)},
+    {"bytes_received",    (getter)get_gint64, NULL, NULL, OFFSET(bytes_received)},
+    {"resumes",           (getter)get_int,    NULL, NULL, OFFSET(resumes)},
+    {"mirrors_tried",     (getter)get_int,    NULL, NULL, OFFSET(mirrors_tried)},
+    {"usedmirror",        (getter)get_str,    NULL, NULL, OFFSET(usedmirror)},
     {NULL, NULL, NULL, NULL, NULL} /* sentinel */
 };
 
@@ -0,0 +1,135 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+
+#include "util.h"
+#include "ratelimiter_internal.h"
+
+/** Time (in microseconds) of transfer at full rate which the bucket
+ * could hold. Bigger value allows bigger bursts. */
+#define LR_RATELIMITER_BURST_TIME       100000
+
+/** Minimal capacity of the bucket (size of the biggest chunk
+ * usually passed by curl to the write callback) */
+#define LR_RATELIMITER_MIN_CAPACITY     16384
+
+struct _LrRateLimiter {
+    GMutex lock;        /*!< Lock of the limiter */
+    gint64 rate;        /*!< Rate in bytes per second (0 - unlimited) */
+    double capacity;    /*!< Capacity of the bucket in bytes */
+    double tokens;      /*!< Available tokens (could be negative) */
+    gint64 last_refill; /*!< Time of the last refill (monotonic, in us) */
+};
+
+static void
+lr_ratelimiter_refill(LrRateLimiter *limiter)
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = now - limiter->last_refill;
+
+    limiter->last_refill = now;
+    if (elapsed <= 0 || limiter->rate <= 0)
+        return;
+
+    limiter->tokens += (double) limiter->rate * elapsed / G_USEC_PER_SEC;
+    if (limiter->tokens > limiter->capacity)
+        limiter->tokens = limiter->capacity;
+}
+
+LrRateLimiter *
+lr_ratelimiter_new(gint64 rate)
+{
+    LrRateLimiter *limiter = lr_malloc0(sizeof(*limiter));
+    g_mutex_init(&limiter->lock);
+    limiter->last_refill = g_get_monotonic_time();
+    lr_ratelimiter_set_rate(limiter, rate);
+    limiter->tokens = limiter->capacity;
+    return limiter;
+}
+
+void
+lr_ratelimiter_set_rate(LrRateLimiter *limiter, gint64 rate)
+{
+    assert(limiter);
+    assert(rate >= 0);
+
+    g_mutex_lock(&limiter->lock);
+    lr_ratelimiter_refill(limiter);
+    limiter->rate = rate;
+    limiter->capacity = MAX((double) rate * LR_RATELIMITER_BURST_TIME
+                                / G_USEC_PER_SEC,
+                            LR_RATELIMITER_MIN_CAPACITY);
+    if (limiter->tokens > limiter->capacity)
+        limiter->tokens = limiter->capacity;
+    g_mutex_unlock(&limiter->lock);
+}
+
+gint64
+lr_ratelimiter_get_rate(LrRateLimiter *limiter)
+{
+    gint64 rate;
+
+    assert(limiter);
+
+    g_mutex_lock(&limiter->lock);
+    rate = limiter->rate;
+    g_mutex_unlock(&limiter->lock);
+    return rate;
+}
+
+gint64
+lr_ratelimiter_delay(LrRateLimiter *limiter)
+{
+    gint64 delay = 0;
+
+    assert(limiter);
+
+    g_mutex_lock(&limiter->lock);
+    if (limiter->rate > 0) {
+        lr_ratelimiter_refill(limiter);
+        if (limiter->tokens <= 0)
+            delay = (gint64) ((1.0 - limiter->tokens) * G_USEC_PER_SEC
+                              / limiter->rate) + 1;
+    }
+    g_mutex_unlock(&limiter->lock);
+    return delay;
+}
+
+void
+lr_ratelimiter_consume(LrRateLimiter *limiter, size_t len)
+{
+    assert(limiter);
+
+    g_mutex_lock(&limiter->lock);
+    if (limiter->rate > 0)
+        limiter->tokens -= len;
+    g_mutex_unlock(&limiter->lock);
+}
+
+void
+lr_ratelimiter_free(LrRateLimiter *limiter)
+{
+    if (!limiter)
+        return;
+    g_mutex_clear(&limiter->lock);
+    lr_free(limiter);
+}
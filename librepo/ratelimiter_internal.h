@@ -0,0 +1,82 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_RATELIMITER_INTERNAL_H__
+#define __LR_RATELIMITER_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** Token bucket which limits the aggregate speed of transfers.
+ * Tokens (bytes) are refilled with the configured rate. A transfer
+ * may take data only if the bucket is not empty, the bucket can go
+ * into debt by the last taken chunk. The limiter is thread safe,
+ * so one limiter could be shared by several concurrent downloads.
+ */
+typedef struct _LrRateLimiter LrRateLimiter;
+
+/** Create new rate limiter.
+ * @param rate      Rate in bytes per second, 0 means unlimited
+ * @return          New rate limiter
+ */
+LrRateLimiter *
+lr_ratelimiter_new(gint64 rate);
+
+/** Change the rate of the limiter.
+ * @param limiter   Rate limiter
+ * @param rate      Rate in bytes per second, 0 means unlimited
+ */
+void
+lr_ratelimiter_set_rate(LrRateLimiter *limiter, gint64 rate);
+
+/** Get the rate of the limiter.
+ * @param limiter   Rate limiter
+ * @return          Rate in bytes per second, 0 means unlimited
+ */
+gint64
+lr_ratelimiter_get_rate(LrRateLimiter *limiter);
+
+/** Time until some tokens are available.
+ * @param limiter   Rate limiter
+ * @return          0 if data could be taken right now or time
+ *                  in microseconds until they could be taken
+ */
+gint64
+lr_ratelimiter_delay(LrRateLimiter *limiter);
+
+/** Take tokens for the data from the bucket. The data are always
+ * taken (the bucket could go into debt), check lr_ratelimiter_delay()
+ * before.
+ * @param limiter   Rate limiter
+ * @param len       Length of the data
+ */
+void
+lr_ratelimiter_consume(LrRateLimiter *limiter, size_t len);
+
+/** Free the rate limiter.
+ * @param limiter   Rate limiter or NULL
+ */
+void
+lr_ratelimiter_free(LrRateLimiter *limiter);
+
+G_END_DECLS
+
+#endif
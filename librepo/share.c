@@ -0,0 +1,164 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <glib.h>
+#include <assert.h>
+#include <curl/curl.h>
+
+#include "rcodes.h"
+#include "util.h"
+#include "share.h"
+#include "share_internal.h"
+
+static void
+lr_share_lockcb(G_GNUC_UNUSED CURL *handle,
+                curl_lock_data data,
+                G_GNUC_UNUSED curl_lock_access access,
+                void *userptr)
+{
+    LrShare *share = userptr;
+    assert(data < CURL_LOCK_DATA_LAST);
+    g_mutex_lock(&share->locks[data]);
+}
+
+static void
+lr_share_unlockcb(G_GNUC_UNUSED CURL *handle,
+                  curl_lock_data data,
+                  void *userptr)
+{
+    LrShare *share = userptr;
+    assert(data < CURL_LOCK_DATA_LAST);
+    g_mutex_unlock(&share->locks[data]);
+}
+
+static gboolean
+lr_share_setopt_share(CURLSH *sh, curl_lock_data data, GError **err)
+{
+    CURLSHcode sh_rc = curl_share_setopt(sh, CURLSHOPT_SHARE, data);
+    if (sh_rc != CURLSHE_OK) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_CURL,
+                    "curl_share_setopt(CURLSHOPT_SHARE, %d) failed: %s",
+                    (int) data, curl_share_strerror(sh_rc));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+LrShare *
+lr_share_new(GError **err)
+{
+    LrShare *share;
+    CURLSH *sh;
+
+    assert(!err || *err == NULL);
+
+    lr_global_init();
+
+    sh = curl_share_init();
+    if (!sh) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_CURL,
+                    "curl_share_init() call failed");
+        return NULL;
+    }
+
+    share = lr_malloc0(sizeof(*share));
+    share->share_handle = sh;
+    for (int x = 0; x < CURL_LOCK_DATA_LAST; x++)
+        g_mutex_init(&share->locks[x]);
+
+    curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, lr_share_lockcb);
+    curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, lr_share_unlockcb);
+    curl_share_setopt(sh, CURLSHOPT_USERDATA, share);
+
+    share->ratelimiter = lr_ratelimiter_new(0);
+
+    if (!lr_share_setopt_share(sh, CURL_LOCK_DATA_DNS, err)
+        || !lr_share_setopt_share(sh, CURL_LOCK_DATA_SSL_SESSION, err))
+    {
+        lr_share_free(share);
+        return NULL;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // Sharing of the connection cache is supported since curl 7.57.0
+    if (!lr_share_setopt_share(sh, CURL_LOCK_DATA_CONNECT, NULL))
+        g_debug("%s: Connection cache cannot be shared", __func__);
+#endif
+
+    return share;
+}
+
+static gpointer
+lr_share_default_once_cb(G_GNUC_UNUSED gpointer data)
+{
+    LrShare *share = lr_share_new(NULL);
+    if (!share)
+        lr_out_of_memory();
+    share->is_default = TRUE;
+    return share;
+}
+
+LrShare *
+lr_share_default(void)
+{
+    static GOnce default_once = G_ONCE_INIT;
+    g_once(&default_once, lr_share_default_once_cb, NULL);
+    return default_once.retval;
+}
+
+gboolean
+lr_share_set_maxspeed(LrShare *share, gint64 maxspeed, GError **err)
+{
+    assert(share);
+    assert(!err || *err == NULL);
+
+    if (maxspeed < 0) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_BADFUNCARG,
+                    "Bad value of maxspeed");
+        return FALSE;
+    }
+
+    lr_ratelimiter_set_rate(share->ratelimiter, maxspeed);
+    return TRUE;
+}
+
+void
+lr_share_free(LrShare *share)
+{
+    CURLSHcode sh_rc;
+
+    if (!share)
+        return;
+
+    assert(!share->is_default);
+
+    sh_rc = curl_share_cleanup(share->share_handle);
+    if (sh_rc != CURLSHE_OK) {
+        // The share is still used by some curl handle, the locks
+        // must stay valid, so leak the object rather than crash.
+        g_warning("%s: curl_share_cleanup() failed: %s (share is still "
+                  "used by some handle?)", __func__, curl_share_strerror(sh_rc));
+        return;
+    }
+
+    for (int x = 0; x < CURL_LOCK_DATA_LAST; x++)
+        g_mutex_clear(&share->locks[x]);
+    lr_ratelimiter_free(share->ratelimiter);
+    lr_free(share);
+}
@@ -0,0 +1,89 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#ifndef __LR_SHARE_H__
+#define __LR_SHARE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** \defgroup   share    Share object
+ *  \addtogroup share
+ *  @{
+ */
+
+/** Share object.
+ * Share object lets several ::LrHandle (and all transfers started from
+ * them) share the DNS cache, SSL session IDs and the pool of live
+ * connections. It is useful when a lot of handles download from
+ * the same hosts (e.g. one handle per repository, all the repositories
+ * on the same CDN).
+ *
+ * The share object is attached to a handle by LRO_SHARE option.
+ * Access to the shared data is protected by locks, so handles
+ * sharing the same object could be used from different threads.
+ *
+ * The share object could also limit the aggregate download speed
+ * of all downloads which use it (see ::lr_share_set_maxspeed).
+ */
+typedef struct _LrShare LrShare;
+
+/** Create new share object.
+ * @param err       GError **
+ * @return          New share object or NULL if err is set
+ */
+LrShare *
+lr_share_new(GError **err);
+
+/** Get the process-wide share object.
+ * The object is created on the first call and lives until the process
+ * exits. It must not be freed by ::lr_share_free.
+ * @return          Process-wide share object
+ */
+LrShare *
+lr_share_default(void);
+
+/** Limit the aggregate speed of all downloads which use the share
+ * object (including concurrent downloads from different threads).
+ * The limit is applied together with LRO_MAXSPEED of the handles.
+ * The limit applies to a download only if it is set before the download
+ * starts, a change of a non-zero limit takes effect immediately.
+ * @param share     Share object
+ * @param maxspeed  Maximal speed in bytes per second, 0 means unlimited
+ * @param err       GError **
+ * @return          TRUE if everything is ok, FALSE if err is set
+ */
+gboolean
+lr_share_set_maxspeed(LrShare *share, gint64 maxspeed, GError **err);
+
+/** Free the share object.
+ * No handle could use the share object at this moment. Handles using
+ * the object must be freed (or detached via LRO_SHARE set to NULL)
+ * before.
+ * @param share     Share object or NULL
+ */
+void
+lr_share_free(LrShare *share);
+
+/** @} */
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,48 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#ifndef __LR_SHARE_INTERNAL_H__
+#define __LR_SHARE_INTERNAL_H__
+
+#include <glib.h>
+#include <curl/curl.h>
+
+#include "share.h"
+#include "ratelimiter_internal.h"
+
+G_BEGIN_DECLS
+
+struct _LrShare {
+
+    CURLSH *share_handle; /*!<
+        Curl share handle */
+
+    GMutex locks[CURL_LOCK_DATA_LAST]; /*!<
+        One lock per type of shared data */
+
+    gboolean is_default; /*!<
+        TRUE for the process-wide share object */
+
+    LrRateLimiter *ratelimiter; /*!<
+        Limiter of the aggregate speed of downloads using the share */
+};
+
+G_END_DECLS
+
+#endif
@@ -65,6 +65,32 @@ typedef enum {
     LR_IPRESOLVE_V6,        /*!< Resolve to IPv6 addresses */
 } LrIpResolveType;
 
+/** Event engines used to drive transfers */
+typedef enum {
+    LR_EVENTENGINE_SELECT,  /*!< Default - select() based loop */
+    LR_EVENTENGINE_EPOLL,   /*!< epoll based loop which uses
+                                 curl_multi_socket_action() */
+} LrEventEngine;
+
+/** Policies of ordering of targets passed to a single download.
+ * Targets with higher priority are always started first, the policy
+ * only orders targets with the same priority. Expected size of a target
+ * (or size of its byte range) is used as its size, targets with unknown
+ * size are considered to be the smallest ones.
+ */
+typedef enum {
+    LR_SCHEDULING_FIFO,         /*!< Default - targets are started in order
+                                     in which they were passed */
+    LR_SCHEDULING_LARGESTFIRST, /*!< The largest targets are started first,
+                                     so no large target is left to the end
+                                     of the download */
+    LR_SCHEDULING_BALANCED,     /*!< The largest and the smallest targets
+                                     are started alternately, so the large
+                                     targets are started early and small
+                                     targets keep finishing in the
+                                     meantime */
+} LrSchedulingPolicy;
+
 /* Some common used arrays for LRO_YUMDLIST */
 
 /** Predefined value for LRO_YUMDLIST option - Download whole repo. */
@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #define _XOPEN_SOURCE 500
 #include <glib.h>
@@ -25,6 +26,7 @@
 #include <curl/curl.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -32,6 +34,11 @@
 #include <sys/types.h>
 #include <stdarg.h>
 #include <ftw.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 #include "util.h"
 #include "version.h"
@@ -282,19 +289,66 @@ lr_remove_dir(const char *path)
     return nftw(path, lr_remove_dir_cb, 64, FTW_DEPTH | FTW_PHYS);
 }
 
+/** Errors which mean that the copy method is not usable for the
+ * given pair of files and the next one should be tried */
+static gboolean
+copy_method_unsupported(int errnum)
+{
+    return errnum == EXDEV || errnum == EINVAL || errnum == ENOSYS
+           || errnum == EOPNOTSUPP || errnum == ENOTTY
+           || errnum == EBADF || errnum == EPERM;
+}
+
 int
 lr_copy_content(int source, int dest)
 {
-    const int bufsize = 2048;
-    char buf[bufsize];
+    const int bufsize = 65536;
+    char *buf;
     ssize_t size;
 
-    lseek(source, 0, SEEK_SET);
-    lseek(dest, 0, SEEK_SET);
+    if (lseek(source, 0, SEEK_SET) == -1 || lseek(dest, 0, SEEK_SET) == -1)
+        return -1;
 
+#ifdef FICLONE
+    // Share the extents of the source file (reflink) if the filesystem
+    // supports it (Btrfs, XFS, ...), nothing is copied at all
+    if (ioctl(dest, FICLONE, source) == 0) {
+        if (lseek(source, 0, SEEK_END) == -1 || lseek(dest, 0, SEEK_END) == -1)
+            return -1;
+        return 0;
+    } else if (!copy_method_unsupported(errno)) {
+        return -1;
+    }
+#endif
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 27)
+    // In-kernel copy, the current offsets of both files are used
+    // and updated, so the fallbacks below continue where this stopped
+    while ((size = copy_file_range(source, NULL, dest, NULL,
+                                   SSIZE_MAX, 0)) > 0)
+        ;
+    if (size == 0)
+        return 0;
+    if (!copy_method_unsupported(errno))
+        return -1;
+#endif
+#endif
+
+    while ((size = sendfile(dest, source, NULL, SSIZE_MAX)) > 0)
+        ;
+    if (size == 0)
+        return 0;
+    if (errno != EINVAL && errno != ENOSYS)
+        return -1;
+
+    buf = g_malloc(bufsize);
     while ((size = read(source, buf, bufsize)) > 0)
-        if (write(dest, buf, size) == -1)
+        if (write(dest, buf, size) == -1) {
+            g_free(buf);
             return -1;
+        }
+    g_free(buf);
 
     return (size < 0) ? -1 : 0;
 }
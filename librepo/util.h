@@ -112,6 +112,10 @@ char *lr_pathconcat(const char *str, ...) G_GNUC_NULL_TERMINATED;
 int lr_remove_dir(const char *path);
 
 /** Copy content from source file descriptor to the dest file descriptor.
+ * The content is copied from the beginning of the source file to the
+ * beginning of the dest file. Reflink (FICLONE), copy_file_range() and
+ * sendfile() are tried in this order to avoid copying the data through
+ * userspace, plain read()/write() is used as the last resort.
  * @param source        Source opened file descriptor
  * @param dest          Destination openede file descriptor
  * @return              0 on succes, -1 on error
@@ -0,0 +1,546 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <curl/curl.h>
+
+#include "rcodes.h"
+#include "util.h"
+#include "workerpool_internal.h"
+#include "logqueue_internal.h"
+
+/** Max time (in milliseconds) a worker waits for its sockets */
+#define LR_WORKER_MAX_WAIT          1000
+/** Time (in microseconds) a failed worker sleeps between iterations */
+#define LR_WORKER_FAILURE_SLEEP     10000
+
+typedef struct _LrWorker LrWorker;
+
+/** Transfer of an easy handle added to the pool.
+ * All fields except of handle are protected by the lock of the pool.
+ */
+typedef struct {
+    CURL *handle; /*!<
+        Easy handle */
+    LrWorker *worker; /*!<
+        Worker which performs the transfer or NULL if the transfer
+        is waiting in the queue or if it is finished */
+    gboolean remove; /*!<
+        Removal of the transfer was requested */
+    gboolean finished; /*!<
+        The transfer is in the queue of finished transfers */
+    CURLcode result; /*!<
+        Result of the finished transfer */
+} LrWorkerTransfer;
+
+struct _LrWorker {
+    LrWorkerPool *pool; /*!<
+        Pool of the worker */
+    GThread *thread; /*!<
+        Thread of the worker */
+    CURLM *multi_handle; /*!<
+        Multi handle of the worker */
+    int wakeup_pipe[2]; /*!<
+        Pipe used to wake up the worker from curl_multi_wait() */
+    guint running; /*!<
+        Number of transfers taken by the worker (protected by the lock
+        of the pool) */
+    GPtrArray *transfers; /*!<
+        Transfers in the multi handle of the worker (accessed only by
+        the worker thread) */
+};
+
+struct _LrWorkerPool {
+    GMutex lock; /*!<
+        Lock of the pool */
+    GCond cond; /*!<
+        Signalled when a transfer is finished or removed by a worker
+        or when the pool is woken up by lr_workerpool_wakeup() */
+    LrWorker *workers; /*!<
+        Array of workers */
+    int workers_count; /*!<
+        Number of workers */
+    GHashTable *transfers; /*!<
+        All transfers in the pool (CURL * -> LrWorkerTransfer *) */
+    GQueue waiting; /*!<
+        Transfers not taken by any worker yet */
+    GQueue finished; /*!<
+        Finished transfers not popped yet */
+    guint active; /*!<
+        Number of waiting and running transfers */
+    gboolean stop; /*!<
+        Workers should exit */
+    gboolean woken; /*!<
+        lr_workerpool_wait() should return (see lr_workerpool_wakeup()) */
+    GError *error; /*!<
+        Error of a failed worker or NULL */
+    LrWorkerPoolTickCb tickcb; /*!<
+        Tick callback or NULL */
+    void *cbdata; /*!<
+        User data for the callbacks */
+    LrLogQueue *log; /*!<
+        Queue of debug messages of the workers or NULL */
+    GQuark domain; /*!<
+        Error domain for errors reported by the pool */
+};
+
+static void
+lr_worker_wakeup(LrWorker *worker)
+{
+    // The pipe is non-blocking, if it is full the worker is going
+    // to wake up anyway
+    if (write(worker->wakeup_pipe[1], "x", 1) == -1 && errno != EAGAIN)
+        lr_log_debug("%s: write() failed: %s", __func__, strerror(errno));
+}
+
+static void
+lr_worker_drain_wakeup(LrWorker *worker)
+{
+    char buf[64];
+
+    while (read(worker->wakeup_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+/** Remember the first error of the workers. Must be called with
+ * the lock of the pool held.
+ */
+static void
+lr_worker_set_error(LrWorker *worker, const char *func, CURLMcode code)
+{
+    LrWorkerPool *pool = worker->pool;
+
+    lr_log_debug("%s: %s() error: %s",
+                 __func__, func, curl_multi_strerror(code));
+
+    if (!pool->error)
+        g_set_error(&pool->error, pool->domain, LRE_CURLM,
+                    "%s() error: %s", func, curl_multi_strerror(code));
+    g_cond_broadcast(&pool->cond);
+}
+
+/** Take waiting transfers from the shared queue (at most a fair share of
+ * all active transfers) and collect the transfers which should be removed.
+ * Must be called with the lock of the pool held.
+ */
+static void
+lr_worker_take_transfers(LrWorker *worker, GPtrArray *taken, GPtrArray *removed)
+{
+    LrWorkerPool *pool = worker->pool;
+    guint share = (pool->active + pool->workers_count - 1)
+                  / pool->workers_count;
+
+    while (!g_queue_is_empty(&pool->waiting)
+           && (worker->running < share || worker->running == 0))
+    {
+        LrWorkerTransfer *transfer = g_queue_pop_head(&pool->waiting);
+        transfer->worker = worker;
+        worker->running++;
+        g_ptr_array_add(taken, transfer);
+    }
+
+    for (guint i = 0; i < worker->transfers->len; i++) {
+        LrWorkerTransfer *transfer = g_ptr_array_index(worker->transfers, i);
+        if (transfer->remove)
+            g_ptr_array_add(removed, transfer);
+    }
+}
+
+/** Move the transfers finished by curl to the queue of finished transfers.
+ */
+static void
+lr_worker_check_finished(LrWorker *worker)
+{
+    LrWorkerPool *pool = worker->pool;
+    int msgs_in_queue;
+    CURLMsg *msg;
+
+    while ((msg = curl_multi_info_read(worker->multi_handle, &msgs_in_queue))) {
+        LrWorkerTransfer *transfer = NULL;
+        CURLcode result = msg->data.result;
+
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        for (guint i = 0; i < worker->transfers->len; i++) {
+            transfer = g_ptr_array_index(worker->transfers, i);
+            if (transfer->handle == msg->easy_handle)
+                break;
+            transfer = NULL;
+        }
+
+        assert(transfer);
+
+        // Note: msg is not valid after curl_multi_remove_handle()
+        curl_multi_remove_handle(worker->multi_handle, transfer->handle);
+        g_ptr_array_remove_fast(worker->transfers, transfer);
+
+        g_mutex_lock(&pool->lock);
+        transfer->result = result;
+        transfer->worker = NULL;
+        transfer->finished = TRUE;
+        worker->running--;
+        pool->active--;
+        g_queue_push_tail(&pool->finished, transfer);
+        g_cond_broadcast(&pool->cond);
+        g_mutex_unlock(&pool->lock);
+    }
+}
+
+static gpointer
+lr_worker_thread(gpointer data)
+{
+    LrWorker *worker = data;
+    LrWorkerPool *pool = worker->pool;
+    GPtrArray *taken = g_ptr_array_new();
+    GPtrArray *removed = g_ptr_array_new();
+    gboolean failed = FALSE;
+
+    lr_logqueue_attach(pool->log);
+
+    while (TRUE) {
+        CURLMcode cm_rc;
+        int still_running, numfds;
+        long timeout = LR_WORKER_MAX_WAIT;
+        struct curl_waitfd wakeup;
+
+        g_mutex_lock(&pool->lock);
+        if (pool->stop) {
+            g_mutex_unlock(&pool->lock);
+            break;
+        }
+        lr_worker_take_transfers(worker, taken, removed);
+        g_mutex_unlock(&pool->lock);
+
+        for (guint i = 0; i < removed->len; i++) {
+            LrWorkerTransfer *transfer = g_ptr_array_index(removed, i);
+            curl_multi_remove_handle(worker->multi_handle, transfer->handle);
+            g_ptr_array_remove_fast(worker->transfers, transfer);
+        }
+
+        if (removed->len) {
+            // The transfers are not touched by the worker anymore
+            g_mutex_lock(&pool->lock);
+            for (guint i = 0; i < removed->len; i++) {
+                LrWorkerTransfer *transfer = g_ptr_array_index(removed, i);
+                worker->running--;
+                pool->active--;
+                g_hash_table_remove(pool->transfers, transfer->handle);
+            }
+            g_cond_broadcast(&pool->cond);
+            g_mutex_unlock(&pool->lock);
+            g_ptr_array_set_size(removed, 0);
+        }
+
+        for (guint i = 0; i < taken->len; i++) {
+            LrWorkerTransfer *transfer = g_ptr_array_index(taken, i);
+            curl_multi_add_handle(worker->multi_handle, transfer->handle);
+            g_ptr_array_add(worker->transfers, transfer);
+        }
+        g_ptr_array_set_size(taken, 0);
+
+        if (failed) {
+            // The multi handle doesn't work, just serve the removals
+            // until the owner of the pool stops the download
+            lr_worker_drain_wakeup(worker);
+            g_usleep(LR_WORKER_FAILURE_SLEEP);
+            continue;
+        }
+
+        if (pool->tickcb) {
+            for (guint i = 0; i < worker->transfers->len; i++) {
+                LrWorkerTransfer *transfer = g_ptr_array_index(worker->transfers, i);
+                long t = pool->tickcb(transfer->handle, pool->cbdata);
+                if (t >= 0 && t < timeout)
+                    timeout = t;
+            }
+        }
+
+        do { // Before version 7.20.0 CURLM_CALL_MULTI_PERFORM can appear
+            cm_rc = curl_multi_perform(worker->multi_handle, &still_running);
+        } while (cm_rc == CURLM_CALL_MULTI_PERFORM);
+
+        if (cm_rc != CURLM_OK) {
+            g_mutex_lock(&pool->lock);
+            lr_worker_set_error(worker, "curl_multi_perform", cm_rc);
+            g_mutex_unlock(&pool->lock);
+            failed = TRUE;
+            continue;
+        }
+
+        lr_worker_check_finished(worker);
+
+        memset(&wakeup, 0, sizeof(wakeup));
+        wakeup.fd = worker->wakeup_pipe[0];
+        wakeup.events = CURL_WAIT_POLLIN;
+
+        cm_rc = curl_multi_wait(worker->multi_handle, &wakeup, 1,
+                                (int) timeout, &numfds);
+        if (cm_rc != CURLM_OK) {
+            g_mutex_lock(&pool->lock);
+            lr_worker_set_error(worker, "curl_multi_wait", cm_rc);
+            g_mutex_unlock(&pool->lock);
+            failed = TRUE;
+            continue;
+        }
+
+        lr_worker_drain_wakeup(worker);
+    }
+
+    g_ptr_array_free(taken, TRUE);
+    g_ptr_array_free(removed, TRUE);
+
+    return NULL;
+}
+
+LrWorkerPool *
+lr_workerpool_new(int workers,
+                  LrWorkerPoolSetupCb setupcb,
+                  LrWorkerPoolTickCb tickcb,
+                  void *cbdata,
+                  LrLogQueue *log,
+                  GQuark domain,
+                  GError **err)
+{
+    LrWorkerPool *pool;
+
+    assert(workers > 0);
+    assert(!err || *err == NULL);
+
+    pool = lr_malloc0(sizeof(*pool));
+    g_mutex_init(&pool->lock);
+    g_cond_init(&pool->cond);
+    pool->transfers = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            NULL, lr_free);
+    g_queue_init(&pool->waiting);
+    g_queue_init(&pool->finished);
+    pool->tickcb = tickcb;
+    pool->cbdata = cbdata;
+    pool->log = log;
+    pool->domain = domain;
+    pool->workers = lr_malloc0(workers * sizeof(LrWorker));
+
+    for (int x = 0; x < workers; x++) {
+        LrWorker *worker = &pool->workers[x];
+        GError *tmp_err = NULL;
+
+        worker->pool = pool;
+        worker->transfers = g_ptr_array_new();
+
+        if (!g_unix_open_pipe(worker->wakeup_pipe, FD_CLOEXEC, &tmp_err)
+            || !g_unix_set_fd_nonblocking(worker->wakeup_pipe[0], TRUE, &tmp_err)
+            || !g_unix_set_fd_nonblocking(worker->wakeup_pipe[1], TRUE, &tmp_err))
+        {
+            g_set_error(err, domain, LRE_IO,
+                        "Cannot create a pipe: %s", tmp_err->message);
+            g_error_free(tmp_err);
+            g_ptr_array_free(worker->transfers, TRUE);
+            lr_workerpool_free(pool);
+            return NULL;
+        }
+
+        worker->multi_handle = curl_multi_init();
+        if (!worker->multi_handle) {
+            g_set_error(err, domain, LRE_CURLM,
+                        "curl_multi_init() call failed");
+            close(worker->wakeup_pipe[0]);
+            close(worker->wakeup_pipe[1]);
+            g_ptr_array_free(worker->transfers, TRUE);
+            lr_workerpool_free(pool);
+            return NULL;
+        }
+
+        if (setupcb)
+            setupcb(worker->multi_handle, cbdata);
+
+        g_mutex_lock(&pool->lock);
+        pool->workers_count++;
+        g_mutex_unlock(&pool->lock);
+
+        worker->thread = g_thread_new("librepo-worker", lr_worker_thread, worker);
+    }
+
+    return pool;
+}
+
+void
+lr_workerpool_free(LrWorkerPool *pool)
+{
+    if (!pool)
+        return;
+
+    g_mutex_lock(&pool->lock);
+    assert(pool->active == 0);
+    pool->stop = TRUE;
+    g_mutex_unlock(&pool->lock);
+
+    for (int x = 0; x < pool->workers_count; x++) {
+        LrWorker *worker = &pool->workers[x];
+        lr_worker_wakeup(worker);
+        g_thread_join(worker->thread);
+        curl_multi_cleanup(worker->multi_handle);
+        close(worker->wakeup_pipe[0]);
+        close(worker->wakeup_pipe[1]);
+        g_ptr_array_free(worker->transfers, TRUE);
+    }
+
+    g_queue_clear(&pool->waiting);
+    g_queue_clear(&pool->finished);
+    g_hash_table_destroy(pool->transfers);
+    g_clear_error(&pool->error);
+    g_cond_clear(&pool->cond);
+    g_mutex_clear(&pool->lock);
+    lr_free(pool->workers);
+    lr_free(pool);
+}
+
+void
+lr_workerpool_add_handle(LrWorkerPool *pool, CURL *handle)
+{
+    LrWorkerTransfer *transfer;
+
+    assert(pool);
+    assert(handle);
+
+    transfer = lr_malloc0(sizeof(*transfer));
+    transfer->handle = handle;
+
+    g_mutex_lock(&pool->lock);
+    g_hash_table_insert(pool->transfers, handle, transfer);
+    g_queue_push_tail(&pool->waiting, transfer);
+    pool->active++;
+    g_mutex_unlock(&pool->lock);
+
+    // Any idle worker could take the transfer
+    for (int x = 0; x < pool->workers_count; x++)
+        lr_worker_wakeup(&pool->workers[x]);
+}
+
+void
+lr_workerpool_remove_handle(LrWorkerPool *pool, CURL *handle)
+{
+    LrWorkerTransfer *transfer;
+
+    assert(pool);
+
+    g_mutex_lock(&pool->lock);
+
+    transfer = g_hash_table_lookup(pool->transfers, handle);
+    if (!transfer) {
+        // Unknown or already popped handle
+        g_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    if (transfer->finished) {
+        g_queue_remove(&pool->finished, transfer);
+        g_hash_table_remove(pool->transfers, handle);
+    } else if (!transfer->worker) {
+        g_queue_remove(&pool->waiting, transfer);
+        g_hash_table_remove(pool->transfers, handle);
+        pool->active--;
+    } else {
+        // Ask the worker to remove the handle from its multi handle
+        // and wait until it is done
+        LrWorker *worker = transfer->worker;
+        transfer->remove = TRUE;
+        lr_worker_wakeup(worker);
+        while (g_hash_table_lookup(pool->transfers, handle) == transfer
+               && !transfer->finished)
+            g_cond_wait(&pool->cond, &pool->lock);
+
+        // The transfer could be finished before the worker noticed
+        // the request
+        if (g_hash_table_lookup(pool->transfers, handle) == transfer) {
+            g_queue_remove(&pool->finished, transfer);
+            g_hash_table_remove(pool->transfers, handle);
+        }
+    }
+
+    g_mutex_unlock(&pool->lock);
+}
+
+gboolean
+lr_workerpool_wait(LrWorkerPool *pool, long max_wait_ms, GError **err)
+{
+    gboolean ret = TRUE;
+    gint64 end_time = g_get_monotonic_time() + max_wait_ms * 1000;
+
+    assert(pool);
+    assert(!err || *err == NULL);
+
+    g_mutex_lock(&pool->lock);
+
+    while (g_queue_is_empty(&pool->finished) && !pool->error && !pool->woken)
+        if (!g_cond_wait_until(&pool->cond, &pool->lock, end_time))
+            break;
+    pool->woken = FALSE;
+
+    if (pool->error) {
+        g_propagate_error(err, g_error_copy(pool->error));
+        ret = FALSE;
+    }
+
+    g_mutex_unlock(&pool->lock);
+
+    return ret;
+}
+
+void
+lr_workerpool_wakeup(LrWorkerPool *pool)
+{
+    assert(pool);
+
+    g_mutex_lock(&pool->lock);
+    pool->woken = TRUE;
+    g_cond_broadcast(&pool->cond);
+    g_mutex_unlock(&pool->lock);
+}
+
+gboolean
+lr_workerpool_pop_finished(LrWorkerPool *pool,
+                           CURL **handle,
+                           CURLcode *result)
+{
+    LrWorkerTransfer *transfer;
+
+    assert(pool);
+    assert(handle);
+    assert(result);
+
+    g_mutex_lock(&pool->lock);
+
+    transfer = g_queue_pop_head(&pool->finished);
+    if (transfer) {
+        *handle = transfer->handle;
+        *result = transfer->result;
+        g_hash_table_remove(pool->transfers, transfer->handle);
+    }
+
+    g_mutex_unlock(&pool->lock);
+
+    return transfer != NULL;
+}
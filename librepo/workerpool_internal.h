@@ -0,0 +1,130 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_WORKERPOOL_INTERNAL_H__
+#define __LR_WORKERPOOL_INTERNAL_H__
+
+#include <glib.h>
+#include <curl/curl.h>
+
+#include "logqueue_internal.h"
+
+G_BEGIN_DECLS
+
+/** Pool of worker threads which perform transfers of curl easy handles.
+ * Each worker has its own multi handle. Added easy handles are put to
+ * a shared queue and idle workers take them from it, so the transfers
+ * are spread evenly over the workers. Write, header and progress
+ * callbacks of the easy handles are called from the worker threads.
+ * Finished transfers are collected by the thread which owns the pool.
+ * Debug messages of the workers are put to the log queue of the pool.
+ */
+typedef struct _LrWorkerPool LrWorkerPool;
+
+/** Called for each multi handle of the pool before the workers start.
+ * @param multi_handle      Multi handle of a worker
+ * @param cbdata            User data
+ */
+typedef void (*LrWorkerPoolSetupCb)(CURLM *multi_handle, void *cbdata);
+
+/** Called by a worker thread for each of its easy handles in every
+ * iteration of its loop (e.g. to resume paused transfers).
+ * @param handle            Easy handle
+ * @param cbdata            User data
+ * @return                  Max time in milliseconds until the next call
+ *                          or -1 if there is no such limit
+ */
+typedef long (*LrWorkerPoolTickCb)(CURL *handle, void *cbdata);
+
+/** Create a new pool and start its worker threads.
+ * @param workers           Number of worker threads
+ * @param setupcb           Setup callback or NULL
+ * @param tickcb            Tick callback or NULL
+ * @param cbdata            User data for the callbacks
+ * @param log               Queue for debug messages of the worker threads
+ *                          or NULL to log them directly
+ * @param domain            Error domain used for errors reported by the pool
+ * @param err               GError **
+ * @return                  New pool or NULL if err is set
+ */
+LrWorkerPool *
+lr_workerpool_new(int workers,
+                  LrWorkerPoolSetupCb setupcb,
+                  LrWorkerPoolTickCb tickcb,
+                  void *cbdata,
+                  LrLogQueue *log,
+                  GQuark domain,
+                  GError **err);
+
+/** Stop the worker threads and free the pool. All added handles have
+ * to be popped by ::lr_workerpool_pop_finished or removed by
+ * ::lr_workerpool_remove_handle before.
+ * @param pool              Pool or NULL
+ */
+void
+lr_workerpool_free(LrWorkerPool *pool);
+
+/** Add the easy handle to the queue of transfers. The handle must
+ * not be touched by the caller until it is finished or removed.
+ * @param pool              Pool
+ * @param handle            Easy handle
+ */
+void
+lr_workerpool_add_handle(LrWorkerPool *pool, CURL *handle);
+
+/** Stop the transfer of the easy handle. When the function returns,
+ * the handle is not used by any worker. Unknown handles are ignored.
+ * @param pool              Pool
+ * @param handle            Easy handle
+ */
+void
+lr_workerpool_remove_handle(LrWorkerPool *pool, CURL *handle);
+
+/** Wait until some transfer is finished (at most max_wait_ms).
+ * @param pool              Pool
+ * @param max_wait_ms       Max time to wait in milliseconds
+ * @param err               GError **
+ * @return                  TRUE if everything is ok, FALSE if some worker
+ *                          failed and err is set
+ */
+gboolean
+lr_workerpool_wait(LrWorkerPool *pool, long max_wait_ms, GError **err);
+
+/** Let the current (or the next) ::lr_workerpool_wait call return
+ * immediately. Could be called from any thread.
+ * @param pool              Pool
+ */
+void
+lr_workerpool_wakeup(LrWorkerPool *pool);
+
+/** Pop the next finished transfer.
+ * @param pool              Pool
+ * @param handle            Easy handle of the finished transfer
+ * @param result            Result of the transfer
+ * @return                  TRUE if a finished transfer was popped
+ */
+gboolean
+lr_workerpool_pop_finished(LrWorkerPool *pool,
+                           CURL **handle,
+                           CURLcode *result);
+
+G_END_DECLS
+
+#endif
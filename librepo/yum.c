@@ -206,6 +206,20 @@ hmfcb(void *clientp, const char *msg, const char *url)
     return LR_CB_OK;
 }
 
+/** Is the file descriptor an opened file from the directory?
+ */
+static gboolean
+lr_yum_is_fd_of(int fd, const char *dir, const char *filename)
+{
+    struct stat fd_st, path_st;
+    _cleanup_free_ gchar *path = lr_pathconcat(dir, filename, NULL);
+
+    return fstat(fd, &fd_st) == 0
+           && stat(path, &path_st) == 0
+           && fd_st.st_dev == path_st.st_dev
+           && fd_st.st_ino == path_st.st_ino;
+}
+
 static gboolean
 lr_yum_download_repomd(LrHandle *handle,
                        LrMetalink *metalink,
@@ -274,6 +288,7 @@ lr_yum_download_repomd(LrHandle *handle,
                                                      NULL,
                                                      0,
                                                      0);
+    target->conditional = handle->conditionalrequests;
 
     ret = lr_download_target(target, &tmp_err);
     assert((ret && !tmp_err) || (!ret && tmp_err));
@@ -294,6 +309,8 @@ lr_yum_download_repomd(LrHandle *handle,
         // TODO: Get rid of use_mirror attr
         lr_free(handle->used_mirror);
         handle->used_mirror = g_strdup(target->usedmirror);
+        if (target->notmodified)
+            g_debug("%s: repomd.xml was not modified", __func__);
     }
 
     lr_downloadtarget_free(target);
@@ -325,6 +342,7 @@ lr_yum_download_repo(LrHandle *handle,
 
     for (GSList *elem = repomd->records; elem; elem = g_slist_next(elem)) {
         int fd;
+        int open_flags;
         char *path;
         LrDownloadTarget *target;
         LrYumRepoMdRecord *record = elem->data;
@@ -336,7 +354,11 @@ lr_yum_download_repo(LrHandle *handle,
             continue;
 
         path = lr_pathconcat(destdir, record->location_href, NULL);
-        fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0666);
+        open_flags = O_CREAT|O_TRUNC|O_RDWR;
+        if (handle->conditionalrequests)
+            // Existing file is kept if it wasn't modified
+            open_flags &= ~O_TRUNC;
+        fd = open(path, open_flags, 0666);
         if (fd < 0) {
             g_debug("%s: Cannot create/open %s (%s)",
                     __func__, path, strerror(errno));
@@ -380,6 +402,7 @@ lr_yum_download_repo(LrHandle *handle,
                                        NULL,
                                        0,
                                        0);
+        target->conditional = handle->conditionalrequests;
 
         targets = g_slist_append(targets, target);
 
@@ -732,7 +755,8 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
 
     path_to_repodata = lr_pathconcat(handle->destdir, "repodata", NULL);
 
-    if (handle->update) {  /* Check if should create repodata/ subdir */
+    if (handle->update || handle->conditionalrequests) {
+        /* Check if should create repodata/ subdir */
         struct stat buf;
         if (stat(path_to_repodata, &buf) != -1)
             if (S_ISDIR(buf.st_mode))
@@ -758,7 +782,11 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
         char *path;
 
         /* Store mirrorlist file(s) */
-        if (handle->mirrorlist_fd != -1) {
+        if (handle->mirrorlist_fd != -1
+            && lr_yum_is_fd_of(handle->mirrorlist_fd, handle->destdir, "mirrorlist")) {
+            // Already downloaded to the destdir (LRO_CONDITIONALREQUESTS)
+            repo->mirrorlist = lr_pathconcat(handle->destdir, "mirrorlist", NULL);
+        } else if (handle->mirrorlist_fd != -1) {
             char *ml_file_path = lr_pathconcat(handle->destdir,
                                                "mirrorlist", NULL);
             fd = open(ml_file_path, O_CREAT|O_TRUNC|O_RDWR, 0666);
@@ -782,7 +810,11 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
             repo->mirrorlist = ml_file_path;
         }
 
-        if (handle->metalink_fd != -1) {
+        if (handle->metalink_fd != -1
+            && lr_yum_is_fd_of(handle->metalink_fd, handle->destdir, "metalink.xml")) {
+            // Already downloaded to the destdir (LRO_CONDITIONALREQUESTS)
+            repo->metalink = lr_pathconcat(handle->destdir, "metalink.xml", NULL);
+        } else if (handle->metalink_fd != -1) {
             char *ml_file_path = lr_pathconcat(handle->destdir,
                                                "metalink.xml", NULL);
             fd = open(ml_file_path, O_CREAT|O_TRUNC|O_RDWR, 0666);
@@ -808,7 +840,11 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
 
         /* Prepare repomd.xml file */
         path = lr_pathconcat(handle->destdir, "/repodata/repomd.xml", NULL);
-        fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0666);
+        int open_flags = O_CREAT|O_TRUNC|O_RDWR;
+        if (handle->conditionalrequests)
+            // Existing repomd.xml is kept if it wasn't modified
+            open_flags &= ~O_TRUNC;
+        fd = open(path, open_flags, 0666);
         if (fd == -1) {
             g_set_error(err, LR_YUM_ERROR, LRE_IO,
                         "Cannot open %s: %s", path, strerror(errno));
@@ -867,6 +903,8 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
             } else {
                 // Signature downloaded
                 repo->signature = g_strdup(signature);
+                // Open connections for the next downloads meanwhile
+                lr_handle_prewarm_connections(handle);
                 ret = lr_gpg_check_signature(signature,
                                              path,
                                              handle->gnupghomedir,
@@ -887,6 +925,10 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
 
         lseek(fd, 0, SEEK_SET);
 
+        /* Open connections for the next downloads while parsing
+         * (see LRO_PREWARMMIRRORS) */
+        lr_handle_prewarm_connections(handle);
+
         /* Parse repomd */
         g_debug("%s: Parsing repomd.xml", __func__);
         ret = lr_yum_repomd_parse_file(repomd, fd, lr_xml_parser_warning_logger,
@@ -5,6 +5,10 @@ BADURL = "yum/badurl/"
 BADGPG = "yum/badgpg/"
 AUTHBASIC = "yum/auth_basic/"
 PARTIAL = "yum/partial/"
+THROTTLE = "yum/throttle/%s/"
+CHANGEDETAG = "yum/changed_etag/"
+CONNECTIONS = "yum/connections/%s/"
+CONNECTIONS_LOG = "yum/connections_log/%s"
 
 AUTH_USER = "admin"
 AUTH_PASS = "secret"
@@ -1,4 +1,6 @@
 import os
+import time
+import hashlib
 from flask import Blueprint, render_template, abort, send_file, request, Response
 from flask import current_app
 from functools import wraps
@@ -95,6 +97,95 @@ def badgpg(path):
         # File probably doesn't exist or we can't read it
         abort(404)
 
+# Throttling and ranges
+
+THROTTLE_CHUNK = 8192       # Bytes sent at once by a throttled response
+THROTTLE_INTERVAL = 0.25    # Seconds between two chunks (32 KiB/s)
+
+def serve_ranges(data, etag, throttled):
+    """Serve data with the strong ETag. Single byte range (Range header)
+    is supported, it is ignored if If-Range doesn't match the ETag.
+    Throttled data are sent slowly in small chunks."""
+    status = 200
+    headers = {"ETag": etag, "Accept-Ranges": "bytes"}
+
+    match = None
+    if_range = request.headers.get("If-Range")
+    if "Range" in request.headers and (if_range is None or if_range == etag):
+        match = request.headers["Range"].strip()
+    if match and match.startswith("bytes="):
+        first, _, last = match[len("bytes="):].partition("-")
+        first = int(first)
+        last = int(last) if last else len(data) - 1
+        if first >= len(data):
+            abort(416)
+        last = min(last, len(data) - 1)
+        headers["Content-Range"] = "bytes %d-%d/%d" % (first, last, len(data))
+        data = data[first:last+1]
+        status = 206
+
+    headers["Content-Length"] = str(len(data))
+
+    if not throttled:
+        return Response(data, status, headers)
+
+    def generate():
+        for x in range(0, len(data), THROTTLE_CHUNK):
+            yield data[x:x+THROTTLE_CHUNK]
+            time.sleep(THROTTLE_INTERVAL)
+
+    return Response(generate(), status, headers)
+
+def read_static(path):
+    if "static/" not in path:
+        abort(400)
+    path = path[path.find("static/"):]
+
+    try:
+        with yum_mock.open_resource(path) as f:
+            return path, f.read()
+    except IOError:
+        # File probably doesn't exist or we can't read it
+        abort(404)
+
+@yum_mock.route("/throttle/<keyword>/<path:path>")
+def throttle(keyword, path):
+    """Files with the keyword in the filename are sent slowly.
+    Byte ranges are supported, ETag is based on the content."""
+    path, data = read_static(path)
+    etag = '"%s"' % hashlib.sha1(data).hexdigest()
+    return serve_ranges(data, etag, keyword in os.path.basename(path))
+
+@yum_mock.route("/changed_etag/<path:path>")
+def changed_etag(path):
+    """The same as throttle (without throttling), but ETag of the files
+    is different, so the ranges requested with If-Range are ignored."""
+    path, data = read_static(path)
+    etag = '"%s-changed"' % hashlib.sha1(data).hexdigest()
+    return serve_ranges(data, etag, False)
+
+# Connection tracking
+
+CONNECTIONS = {}    # Keyword -> ["METHOD PORT FILENAME", ...]
+
+@yum_mock.route("/connections/<keyword>/<path:path>")
+def connections(keyword, path):
+    """Files are served as usual, the method and the client port
+    (which identifies the connection) of each request are recorded
+    under the keyword."""
+    path, data = read_static(path)
+    CONNECTIONS.setdefault(keyword, []).append("%s %s %s" % (
+        request.method,
+        request.environ.get("REMOTE_PORT"),
+        os.path.basename(path)))
+    return Response(data, 200)
+
+@yum_mock.route("/connections_log/<keyword>")
+def connections_log(keyword):
+    """Requests recorded under the keyword, one per line."""
+    return Response("\n".join(CONNECTIONS.get(keyword, [])), 200,
+                    {"Content-Type": "text/plain"})
+
 # Basic Auth
 
 def check_auth(username, password):
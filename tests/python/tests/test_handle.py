@@ -182,6 +182,32 @@ class TestCaseHandle(unittest.TestCase):
         h.setopt(librepo.LRO_IPRESOLVE, None)
         self.assertEqual(h.getinfo(librepo.LRI_IPRESOLVE), librepo.IPRESOLVE_WHATEVER)
 
+        self.assertEqual(h.getinfo(librepo.LRI_EVENTENGINE), librepo.EVENTENGINE_SELECT)
+        h.setopt(librepo.LRO_EVENTENGINE, librepo.EVENTENGINE_EPOLL)
+        self.assertEqual(h.getinfo(librepo.LRI_EVENTENGINE), librepo.EVENTENGINE_EPOLL)
+        h.setopt(librepo.LRO_EVENTENGINE, None)
+        self.assertEqual(h.getinfo(librepo.LRI_EVENTENGINE), librepo.EVENTENGINE_SELECT)
+        self.assertRaises(librepo.LibrepoException, h.setopt, librepo.LRO_EVENTENGINE, 999)
+
+        self.assertEqual(h.getinfo(librepo.LRI_SHARE), False)
+        h.setopt(librepo.LRO_SHARE, True)
+        self.assertEqual(h.getinfo(librepo.LRI_SHARE), True)
+        h.setopt(librepo.LRO_SHARE, None)
+        self.assertEqual(h.getinfo(librepo.LRI_SHARE), False)
+
+        self.assertEqual(h.getinfo(librepo.LRI_HTTP2), 0)
+        h.setopt(librepo.LRO_HTTP2, True)
+        self.assertEqual(h.getinfo(librepo.LRI_HTTP2), 1)
+        h.setopt(librepo.LRO_HTTP2, None)
+        self.assertEqual(h.getinfo(librepo.LRI_HTTP2), 0)
+
+        self.assertEqual(h.getinfo(librepo.LRI_MAXSTREAMSPERMIRROR), 32)
+        h.setopt(librepo.LRO_MAXSTREAMSPERMIRROR, 100)
+        self.assertEqual(h.getinfo(librepo.LRI_MAXSTREAMSPERMIRROR), 100)
+        h.setopt(librepo.LRO_MAXSTREAMSPERMIRROR, None)
+        self.assertEqual(h.getinfo(librepo.LRI_MAXSTREAMSPERMIRROR), 32)
+        self.assertRaises(librepo.LibrepoException, h.setopt, librepo.LRO_MAXSTREAMSPERMIRROR, 0)
+
         self.assertEqual(h.getinfo(librepo.LRI_ALLOWEDMIRRORFAILURES), 4)
         h.setopt(librepo.LRO_ALLOWEDMIRRORFAILURES, 1)
         self.assertEqual(h.getinfo(librepo.LRI_ALLOWEDMIRRORFAILURES), 1)
@@ -338,6 +364,24 @@ class TestCaseHandle(unittest.TestCase):
         h.ipresolve = None
         self.assertEqual(h.ipresolve, librepo.IPRESOLVE_WHATEVER)
 
+        self.assertEqual(h.eventengine, librepo.EVENTENGINE_SELECT)
+        h.eventengine = librepo.EVENTENGINE_EPOLL
+        self.assertEqual(h.eventengine, librepo.EVENTENGINE_EPOLL)
+        h.eventengine = None
+        self.assertEqual(h.eventengine, librepo.EVENTENGINE_SELECT)
+
+        self.assertEqual(h.share, False)
+        h.share = True
+        self.assertEqual(h.share, True)
+        h.share = False
+        self.assertEqual(h.share, False)
+
+        self.assertEqual(h.http2, 0)
+        h.http2 = True
+        self.assertEqual(h.http2, 1)
+        h.maxstreamspermirror = 64
+        self.assertEqual(h.maxstreamspermirror, 64)
+
         self.assertEqual(h.allowedmirrorfailures, 4)
         h.allowedmirrorfailures = 1
         self.assertEqual(h.allowedmirrorfailures, 1)
@@ -1,4 +1,5 @@
 import os
+import time
 import shutil
 import os.path
 import librepo
@@ -6,10 +7,18 @@ import hashlib
 import unittest
 import tempfile
 import xattr
+try:
+    from urllib.request import urlopen
+except ImportError:
+    from urllib2 import urlopen
+try:
+    from threading import get_ident
+except ImportError:
+    from thread import get_ident
 
 import tests.servermock.yum_mock.config as config
 
-from tests.base import TestCaseWithFlask
+from tests.base import TestCaseWithFlask, TEST_DATA
 from tests.servermock.server import app
 
 
@@ -233,6 +242,28 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
             self.assertTrue(pkg.err is None)
             self.assertTrue(os.path.isfile(pkg.local_path))
 
+    def test_download_packages_statistics(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        pkg = librepo.PackageTarget(config.PACKAGE_01_01,
+                                    handle=h,
+                                    dest=self.tmpdir)
+
+        librepo.download_packages([pkg])
+
+        self.assertTrue(pkg.err is None)
+        self.assertEqual(pkg.bytes_received, os.path.getsize(pkg.local_path))
+        self.assertEqual(pkg.mirrors_tried, 1)
+        self.assertEqual(pkg.resumes, 0)
+        self.assertTrue(pkg.total_time > 0)
+        self.assertTrue(pkg.average_speed > 0)
+        self.assertTrue(pkg.namelookup_time <= pkg.connect_time
+                        <= pkg.starttransfer_time <= pkg.total_time)
+
     def test_download_packages_02(self):
         h = librepo.Handle()
 
@@ -257,6 +288,560 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
 
         self.assertTrue(os.path.isfile(dest))
 
+    def test_download_packages_with_epoll_engine(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.eventengine = librepo.EVENTENGINE_EPOLL
+
+        pkgs = []
+        pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                          handle=h,
+                                          dest=self.tmpdir))
+        dest = os.path.join(self.tmpdir, "foo-haha-lol.rpm")
+        pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                          handle=h,
+                                          dest=dest))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+        self.assertTrue(os.path.isfile(dest))
+
+    def test_download_packages_with_http2_enabled(self):
+        # Mock server speaks only HTTP/1.1, transfers must fall back
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.http2 = True
+        h.maxstreamspermirror = 2
+
+        pkgs = []
+        for x in range(4):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+    def test_download_packages_with_adaptive_concurrency(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.maxparalleldownloads = 1
+        h.adaptiveconcurrency = True
+        h.adaptivemaxparalleldownloads = 30
+        self.assertEqual(h.adaptivemaxparalleldownloads, 30)
+
+        pkgs = []
+        for x in range(8):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+    def test_download_packages_segmented(self):
+        # Two local mirrors of the same repository
+        repo = os.path.join(TEST_DATA, "repo_yum_01")
+        relative = "repodata/aeca08fccd3c1ab831e1df1a62711a44ba1922c9-filelists.xml.gz"
+        with open(os.path.join(repo, relative), "rb") as f:
+            data = f.read()
+
+        h = librepo.Handle()
+        h.urls = [repo, repo + "/"]
+        h.repotype = librepo.LR_YUMREPO
+        h.maxsegments = 4
+        h.minsegmentsize = 10000
+        self.assertEqual(h.maxsegments, 4)
+        self.assertEqual(h.minsegmentsize, 10000)
+
+        progress = []
+        def progresscb(data, total, downloaded):
+            progress.append((total, downloaded))
+
+        dest = os.path.join(self.tmpdir, "filelists.xml.gz")
+        pkg = librepo.PackageTarget(relative,
+                                    handle=h,
+                                    dest=dest,
+                                    expectedsize=len(data),
+                                    checksum_type=librepo.SHA256,
+                                    checksum=hashlib.sha256(data).hexdigest(),
+                                    progresscb=progresscb)
+
+        librepo.download_packages([pkg])
+
+        self.assertTrue(pkg.err is None)
+        with open(dest, "rb") as f:
+            self.assertEqual(f.read(), data)
+        self.assertTrue(progress)
+        self.assertEqual(progress[-1][0], len(data))
+
+    def test_download_packages_segmented_over_http(self):
+        # Segments request their byte ranges from the server
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h = librepo.Handle()
+        h.urls = [url, url + "/"]
+        h.repotype = librepo.LR_YUMREPO
+        h.maxsegments = 4
+        h.minsegmentsize = 100000
+
+        dest = os.path.join(self.tmpdir, "pkg.rpm")
+        pkg = librepo.PackageTarget(config.PACKAGE_01_01,
+                                    handle=h,
+                                    dest=dest,
+                                    expectedsize=1057084,
+                                    checksum_type=librepo.SHA256,
+                                    checksum=config.PACKAGE_01_01_SHA256)
+
+        librepo.download_packages([pkg])
+
+        self.assertTrue(pkg.err is None)
+        self.assertEqual(os.path.getsize(dest), 1057084)
+
+    def test_download_packages_with_scheduling_policy(self):
+        repo = os.path.join(TEST_DATA, "repo_yum_01")
+        files = ["repodata/4543ad62e4d86337cd1949346f9aec976b847b58-primary.xml.gz",
+                 "repodata/aeca08fccd3c1ab831e1df1a62711a44ba1922c9-filelists.xml.gz",
+                 "repodata/a8977cdaa0b14321d9acfab81ce8a85e869eee32-other.xml.gz",
+                 "repodata/735cd6294df08bdf28e2ba113915ca05a151118e-primary.sqlite.bz2"]
+        sizes = dict((f, os.path.getsize(os.path.join(repo, f))) for f in files)
+
+        h = librepo.Handle()
+        h.urls = [repo]
+        h.repotype = librepo.LR_YUMREPO
+        h.maxparalleldownloads = 1
+        h.schedulingpolicy = librepo.SCHEDULING_LARGESTFIRST
+        self.assertEqual(h.schedulingpolicy, librepo.SCHEDULING_LARGESTFIRST)
+
+        finished = []
+        def endcb(data, status, msg):
+            finished.append(data)
+
+        pkgs = []
+        for x, relative in enumerate(files):
+            dest = os.path.join(self.tmpdir, "file-%d" % x)
+            pkgs.append(librepo.PackageTarget(relative,
+                                              handle=h,
+                                              dest=dest,
+                                              expectedsize=sizes[relative],
+                                              cbdata=relative,
+                                              endcb=endcb))
+        # Target with a priority is downloaded first
+        pkgs.append(librepo.PackageTarget(files[0],
+                                          handle=h,
+                                          dest=os.path.join(self.tmpdir, "first"),
+                                          cbdata="first",
+                                          endcb=endcb,
+                                          priority=1))
+        self.assertEqual(pkgs[-1].priority, 1)
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+        expected = ["first"] + sorted(files, key=lambda f: -sizes[f])
+        self.assertEqual(finished, expected)
+
+    def test_download_packages_local_copy_with_debug_log(self):
+        repo = os.path.join(TEST_DATA, "repo_yum_01")
+        relative = "repodata/4543ad62e4d86337cd1949346f9aec976b847b58-primary.xml.gz"
+        with open(os.path.join(repo, relative), "rb") as f:
+            checksum = hashlib.sha256(f.read()).hexdigest()
+
+        h = librepo.Handle()
+        h.urls = [repo]
+        h.repotype = librepo.LR_YUMREPO
+
+        pkg = librepo.PackageTarget(relative,
+                                    handle=h,
+                                    dest=os.path.join(self.tmpdir, "primary.xml.gz"),
+                                    checksum_type=librepo.SHA256,
+                                    checksum=checksum)
+
+        # The local copy and its verification are done by the verification
+        # pool, its messages are logged by the calling thread
+        threads = set()
+        messages = []
+        def debug_function(msg, _):
+            threads.add(get_ident())
+            messages.append(msg)
+        librepo.set_debug_log_handler(debug_function)
+        try:
+            librepo.download_packages([pkg])
+        finally:
+            librepo.set_debug_log_handler(None)
+
+        self.assertTrue(pkg.err is None)
+        self.assertTrue(os.path.isfile(pkg.local_path))
+        self.assertTrue(any("Copying" in msg for msg in messages))
+        self.assertTrue(any("is OK" in msg for msg in messages))
+        self.assertEqual(threads, set([get_ident()]))
+
+    def test_download_packages_with_hedged_requests(self):
+        # Two local mirrors of the same repository
+        repo = os.path.join(TEST_DATA, "repo_yum_01")
+        files = ["repodata/4543ad62e4d86337cd1949346f9aec976b847b58-primary.xml.gz",
+                 "repodata/aeca08fccd3c1ab831e1df1a62711a44ba1922c9-filelists.xml.gz",
+                 "repodata/a8977cdaa0b14321d9acfab81ce8a85e869eee32-other.xml.gz"]
+
+        h = librepo.Handle()
+        h.urls = [repo, repo + "/"]
+        h.repotype = librepo.LR_YUMREPO
+        h.hedgedrequests = True
+        self.assertEqual(h.hedgedrequests, 1)
+
+        pkgs = []
+        for x, relative in enumerate(files):
+            dest = os.path.join(self.tmpdir, "file-%d" % x)
+            size = os.path.getsize(os.path.join(repo, relative))
+            pkgs.append(librepo.PackageTarget(relative,
+                                              handle=h,
+                                              dest=dest,
+                                              expectedsize=size))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+        # No temporary files of hedged transfers are left behind
+        self.assertEqual(sorted(os.listdir(self.tmpdir)),
+                         ["file-%d" % x for x in range(len(files))])
+
+    def _download_from_slow_and_fast_mirror(self, slow, fast, **options):
+        # The first package is downloaded from the slow mirror,
+        # the second one from the fast mirror (which is free)
+        h = librepo.Handle()
+        h.urls = [slow, fast]
+        h.repotype = librepo.LR_YUMREPO
+        h.maxdownloadspermirror = 1
+        for name, value in options.items():
+            setattr(h, name, value)
+
+        pkgs = []
+        for x in range(2):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              expectedsize=1057084,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=config.PACKAGE_01_01_SHA256))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertEqual(os.path.getsize(pkg.local_path), 1057084)
+            self.assertEqual(pkg.usedmirror, fast)
+
+        return pkgs
+
+    def test_download_packages_with_hedged_requests_from_slow_mirror(self):
+        slow = "%s%s%s" % (self.MOCKURL, config.THROTTLE % "filesystem",
+                           config.REPO_YUM_01_PATH)
+        fast = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+
+        # The slow transfer is hedged by a transfer from the fast mirror
+        # which wins
+        self._download_from_slow_and_fast_mirror(slow, fast,
+                                                 hedgedrequests=True)
+
+        # No temporary files of hedged transfers are left behind
+        self.assertEqual(sorted(os.listdir(self.tmpdir)),
+                         ["pkg-0.rpm", "pkg-1.rpm"])
+
+    def test_download_packages_with_migration_of_slow_transfers(self):
+        slow = "%s%s%s" % (self.MOCKURL, config.THROTTLE % "filesystem",
+                           config.REPO_YUM_01_PATH)
+        fast = "%s%s%s" % (self.MOCKURL, config.THROTTLE % "nothing",
+                           config.REPO_YUM_01_PATH)
+
+        # The slow transfer continues from the fast mirror, the data
+        # downloaded from the slow one are kept (ETags of mirrors match)
+        pkgs = self._download_from_slow_and_fast_mirror(
+                        slow, fast, migrateslowtransfers=True)
+        self.assertEqual(pkgs[0].resumes, 1)
+        self.assertEqual(pkgs[0].mirrors_tried, 2)
+        self.assertEqual(pkgs[1].resumes, 0)
+
+    def test_download_packages_with_migration_to_changed_file(self):
+        slow = "%s%s%s" % (self.MOCKURL, config.THROTTLE % "filesystem",
+                           config.REPO_YUM_01_PATH)
+        fast = "%s%s%s" % (self.MOCKURL, config.CHANGEDETAG,
+                           config.REPO_YUM_01_PATH)
+
+        # ETag of the file on the fast mirror differs, so the server
+        # ignores the range (If-Range) and the whole file is downloaded
+        # from the fast mirror again
+        pkgs = self._download_from_slow_and_fast_mirror(
+                        slow, fast, migrateslowtransfers=True)
+        self.assertEqual(pkgs[0].resumes, 1)
+        self.assertEqual(pkgs[1].resumes, 0)
+
+    def test_download_packages_with_worker_threads(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.workerthreads = 3
+        self.assertEqual(h.workerthreads, 3)
+
+        cbdata = {'called': 0}
+        def cb(cbdata, total, downloaded):
+            cbdata["called"] += 1
+
+        pkgs = []
+        for x in range(6):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=config.PACKAGE_01_01_SHA256,
+                                              progresscb=cb,
+                                              cbdata=cbdata))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+        self.assertTrue(cbdata["called"] > 0)
+
+    def test_download_packages_with_worker_threads_and_debug_log(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.workerthreads = 3
+
+        pkgs = []
+        for x in range(6):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              expectedsize=1057084,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=config.PACKAGE_01_01_SHA256))
+
+        # The header callbacks run in the worker threads, their messages
+        # are logged by the calling thread
+        threads = set()
+        messages = []
+        def debug_function(msg, _):
+            threads.add(get_ident())
+            messages.append(msg)
+        librepo.set_debug_log_handler(debug_function)
+        try:
+            librepo.download_packages(pkgs)
+        finally:
+            librepo.set_debug_log_handler(None)
+
+        self.assertEqual(threads, set([get_ident()]))
+        self.assertTrue(any("Content-Length" in msg for msg in messages))
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+    def test_download_packages_with_iouring(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.iouring = True
+        self.assertEqual(h.iouring, 1)
+
+        pkgs = []
+        for x in range(4):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=config.PACKAGE_01_01_SHA256))
+
+        # The downloader reports whether io_uring is available
+        messages = []
+        def debug_function(msg, _):
+            messages.append(msg)
+        librepo.set_debug_log_handler(debug_function)
+        try:
+            librepo.download_packages(pkgs)
+        finally:
+            librepo.set_debug_log_handler(None)
+
+        if any("io_uring is not available" in msg for msg in messages):
+            self.skipTest("io_uring is not available")
+        self.assertTrue(any("performed by io_uring" in msg for msg in messages))
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+        # Already downloaded files are checked (and not downloaded again)
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertEqual(pkg.err, "Already downloaded")
+
+    def test_download_packages_with_progressinterval(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.progressinterval = 60000
+        h.progressdelta = 1024
+        self.assertEqual(h.progressinterval, 60000)
+        self.assertEqual(h.progressdelta, 1024)
+
+        progress = []
+        def progresscb(data, total, downloaded):
+            progress.append((total, downloaded))
+
+        pkg = librepo.PackageTarget(config.PACKAGE_01_01,
+                                    handle=h,
+                                    dest=self.tmpdir,
+                                    progresscb=progresscb)
+
+        librepo.download_packages([pkg])
+
+        self.assertTrue(pkg.err is None)
+        # Reports are coalesced, but the final one is always passed
+        self.assertTrue(progress)
+        self.assertTrue(len(progress) <= 4)
+        self.assertEqual(progress[-1][1], os.path.getsize(pkg.local_path))
+
+    def test_download_packages_with_dnsprefetch(self):
+        h = librepo.Handle()
+
+        # Addresses are prefetched for host names only
+        mockurl = self.MOCKURL.replace("127.0.0.1", "localhost")
+        url = "%s%s" % (mockurl, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.ipresolve = librepo.IPRESOLVE_V4
+        h.dnsprefetch = True
+        h.happyeyeballstimeout = 100
+        self.assertEqual(h.dnsprefetch, 1)
+        self.assertEqual(h.happyeyeballstimeout, 100)
+
+        pkg = librepo.PackageTarget(config.PACKAGE_01_01,
+                                    handle=h,
+                                    dest=self.tmpdir,
+                                    checksum_type=librepo.SHA256,
+                                    checksum=config.PACKAGE_01_01_SHA256)
+
+        messages = []
+        def debug_function(msg, _):
+            messages.append(msg)
+        librepo.set_debug_log_handler(debug_function)
+        try:
+            librepo.download_packages([pkg])
+        finally:
+            librepo.set_debug_log_handler(None)
+
+        self.assertTrue(pkg.err is None)
+        self.assertTrue(os.path.isfile(pkg.local_path))
+
+        if any("older than 7.75.0" in msg for msg in messages):
+            self.skipTest("DNS prefetch is not supported by curl")
+
+        # Only the IPv4 address was passed to curl
+        entry = "+localhost:%d:127.0.0.1" % self.PORT
+        passed = [msg for msg in messages
+                  if "Passing " in msg and msg.endswith(" to curl")]
+        self.assertTrue(passed)
+        for msg in passed:
+            self.assertTrue(msg.endswith("Passing %s to curl" % entry))
+
+    def _requests_on_connections(self, keyword):
+        """Requests recorded by the server as (method, port, filename)"""
+        url = "%s%s" % (self.MOCKURL, config.CONNECTIONS_LOG % keyword)
+        log = urlopen(url).read().decode("utf-8")
+        return [tuple(line.split(" ")) for line in log.splitlines()]
+
+    def test_download_packages_with_prewarmmirrors(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s%s" % (self.MOCKURL, config.CONNECTIONS % "prewarm",
+                          config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = os.path.join(self.tmpdir, "repo")
+        h.maxparalleldownloads = 2
+        h.prewarmmirrors = 2
+        self.assertEqual(h.prewarmmirrors, 2)
+        self.assertRaises(librepo.LibrepoException,
+                          h.setopt, librepo.LRO_PREWARMMIRRORS, -1)
+        os.mkdir(h.destdir)
+        h.perform(r)
+
+        # Connections are opened while the packages are being selected,
+        # one HEAD request per allowed parallel download
+        deadline = time.time() + 5
+        while time.time() < deadline:
+            heads = [req for req in self._requests_on_connections("prewarm")
+                     if req[0] == "HEAD"]
+            if len(heads) >= 2:
+                break
+            time.sleep(0.1)
+        self.assertEqual(len(heads), 2)
+
+        pkgs = []
+        for x in range(2):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=config.PACKAGE_01_01_SHA256))
+
+        librepo.download_packages(pkgs)
+
+        for pkg in pkgs:
+            self.assertTrue(pkg.err is None)
+            self.assertTrue(os.path.isfile(pkg.local_path))
+
+        # The parallel downloads reused the pre-warmed connections
+        # instead of opening new ones
+        prewarmed = set(req[1] for req in heads)
+        gets = [req for req in self._requests_on_connections("prewarm")
+                if req[0] == "GET" and req[2] == config.PACKAGE_01_01]
+        self.assertEqual(len(gets), 2)
+        for req in gets:
+            self.assertTrue(req[1] in prewarmed)
+
     def test_download_packages_02_with_failfast(self):
         h = librepo.Handle()
 
@@ -381,6 +966,32 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
         pkg = pkgs[0]
         self.assertTrue(pkg.err)
 
+    def test_download_packages_with_good_and_bad_checksums(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        pkgs = []
+        for x in range(6):
+            dest = os.path.join(self.tmpdir, "pkg-%d.rpm" % x)
+            checksum = config.PACKAGE_01_01_SHA256 if x % 2 else "badchecksum"
+            pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                              handle=h,
+                                              dest=dest,
+                                              checksum_type=librepo.SHA256,
+                                              checksum=checksum))
+
+        librepo.download_packages(pkgs)
+
+        for x, pkg in enumerate(pkgs):
+            if x % 2:
+                self.assertTrue(pkg.err is None)
+                self.assertTrue(os.path.isfile(pkg.local_path))
+            else:
+                self.assertTrue(pkg.err)
+
     def test_download_packages_with_bad_checksum_with_failfast(self):
         h = librepo.Handle()
 
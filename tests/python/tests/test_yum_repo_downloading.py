@@ -495,6 +495,40 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertTrue(yum_repo)
         self.assertTrue(yum_repomd)
 
+    def test_download_repo_01_with_conditional_requests(self):
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.checksum = True
+        h.conditionalrequests = True
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(yum_repo)
+        mtimes = dict((key, os.stat(path).st_mtime)
+                      for key, path in yum_repo.items()
+                      if path and key not in ("url", "destdir"))
+        self.assertTrue(mtimes)
+
+        # Download the repo again to the same directory,
+        # not modified files are kept untouched
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.checksum = True
+        h.conditionalrequests = True
+        h.perform(r)
+
+        self.assertEqual(r.getinfo(librepo.LRR_YUM_REPO), yum_repo)
+        for key, mtime in mtimes.items():
+            self.assertEqual(os.stat(yum_repo[key]).st_mtime, mtime)
+
     def test_download_corrupted_repo_01_with_checksum_check(self):
         h = librepo.Handle()
         r = librepo.Result()
@@ -150,6 +150,24 @@ class TestCaseYumRepoLocating(TestCase):
         self.assertEqual(yum_repo, yum_repo_downloaded)
         self.assertEqual(yum_repomd, yum_repomd_downloaded)
 
+    def test_copy_repo_01_from_local_mirror(self):
+        # Files of a local repository are copied (not downloaded by curl)
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.urls = [REPO_YUM_01_PATH]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        for key in ("primary", "filelists", "other"):
+            path = yum_repo[key]
+            self.assertTrue(path.startswith(self.tmpdir))
+            orig = os.path.join(REPO_YUM_01_PATH, "repodata",
+                                os.path.basename(path))
+            self.assertEqual(open(path, "rb").read(), open(orig, "rb").read())
+
     def test_locate_repo_02(self):
         # At first, download whole repository
         h = librepo.Handle()
@@ -10,6 +10,7 @@
 
 #include "librepo/util.h"
 #include "librepo/checksum.h"
+#include "librepo/checksum_internal.h"
 
 #include "fixtures.h"
 #include "testsys.h"
@@ -169,6 +170,43 @@ exit_label:
 }
 END_TEST
 
+START_TEST(test_checksumctx)
+{
+    LrChecksumCtx *ctx;
+    char *checksum;
+    GError *tmp_err = NULL;
+    const char *content = CHKS_CONTENT_01;
+
+    // Data added in more parts
+    ctx = lr_checksumctx_new(LR_CHECKSUM_SHA256, &tmp_err);
+    fail_if(ctx == NULL);
+    fail_if(tmp_err);
+    fail_if(lr_checksumctx_type(ctx) != LR_CHECKSUM_SHA256);
+    fail_if(!lr_checksumctx_update(ctx, content, 4, &tmp_err));
+    fail_if(!lr_checksumctx_update(ctx, content+4, strlen(content)-4, &tmp_err));
+    checksum = lr_checksumctx_final(ctx, &tmp_err);
+    fail_if(checksum == NULL);
+    fail_if(strcmp(checksum, CHKS_VAL_01_SHA256),
+        "Checksum is %s instead of %s", checksum, CHKS_VAL_01_SHA256);
+    lr_free(checksum);
+    lr_checksumctx_free(ctx);
+
+    // No data
+    ctx = lr_checksumctx_new(LR_CHECKSUM_MD5, &tmp_err);
+    fail_if(ctx == NULL);
+    checksum = lr_checksumctx_final(ctx, &tmp_err);
+    fail_if(strcmp(checksum, CHKS_VAL_00_MD5));
+    lr_free(checksum);
+    lr_checksumctx_free(ctx);
+
+    // Unknown checksum
+    ctx = lr_checksumctx_new(LR_CHECKSUM_UNKNOWN, &tmp_err);
+    fail_if(ctx != NULL);
+    fail_if(tmp_err == NULL);
+    g_error_free(tmp_err);
+}
+END_TEST
+
 Suite *
 checksum_suite(void)
 {
@@ -176,6 +214,7 @@ checksum_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_checksum_fd);
     tcase_add_test(tc, test_cached_checksum);
+    tcase_add_test(tc, test_checksumctx);
     suite_add_tcase(s, tc);
     return s;
 }
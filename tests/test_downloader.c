@@ -7,12 +7,17 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "librepo/librepo.h"
 #include "librepo/rcodes.h"
 #include "librepo/util.h"
 #include "librepo/downloader.h"
 #include "librepo/handle_internal.h"
+#include "librepo/filewriter_internal.h"
+#include "librepo/ratelimiter_internal.h"
+#include "librepo/mirrorranking_internal.h"
+#include "librepo/workerpool_internal.h"
 
 #include "fixtures.h"
 #include "testsys.h"
@@ -290,6 +295,521 @@ START_TEST(test_downloader_three_files_with_error)
 }
 END_TEST
 
+START_TEST(test_downloader_filewriter)
+{
+    int fd;
+    char buf[32];
+    struct stat st;
+    gboolean ret;
+    LrFileWriter *writer;
+    GError *tmp_err = NULL;
+    char *path;
+
+    path = lr_pathconcat(test_globals.tmpdir, "/test_filewriter", NULL);
+    fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd < 0);
+    fail_if(write(fd, "XXXX", 4) != 4);
+
+    // Write behind the existing data
+    writer = lr_filewriter_new(fd, 2, 8);
+    ret = lr_filewriter_write(writer, "abc", 3, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(lr_filewriter_offset(writer) != 5);
+
+    // Data are only buffered
+    fail_if(fstat(fd, &st) != 0);
+    fail_if(st.st_size != 4);
+
+    // Data which don't fit to the buffer
+    ret = lr_filewriter_write(writer, "defghijkl", 9, &tmp_err);
+    fail_if(!ret);
+    fail_if(lr_filewriter_offset(writer) != 14);
+    ret = lr_filewriter_write(writer, "mn", 2, &tmp_err);
+    fail_if(!ret);
+    ret = lr_filewriter_flush(writer, &tmp_err);
+    fail_if(!ret);
+    fail_if(lr_filewriter_offset(writer) != 16);
+    lr_filewriter_free(writer);
+
+    // Position of the file descriptor is not changed
+    fail_if(lseek(fd, 0, SEEK_CUR) != 4);
+
+    fail_if(lseek(fd, 0, SEEK_SET) != 0);
+    fail_if(read(fd, buf, sizeof(buf)) != 16);
+    fail_if(memcmp(buf, "XXabcdefghijklmn", 16));
+
+    // Unbuffered writer
+    writer = lr_filewriter_new(fd, 16, 0);
+    ret = lr_filewriter_write(writer, "op", 2, &tmp_err);
+    fail_if(!ret);
+    fail_if(fstat(fd, &st) != 0);
+    fail_if(st.st_size != 18);
+    lr_filewriter_free(writer);
+
+    close(fd);
+    fail_if(remove(path) != 0, "Cannot delete temporary test file");
+    lr_free(path);
+}
+END_TEST
+
+START_TEST(test_downloader_ratelimiter)
+{
+    LrRateLimiter *limiter;
+    gint64 delay;
+
+    // Unlimited
+    limiter = lr_ratelimiter_new(0);
+    lr_ratelimiter_consume(limiter, 1024*1024);
+    fail_if(lr_ratelimiter_delay(limiter) != 0);
+
+    // 100 KiB/s, the bucket is full at the beginning
+    lr_ratelimiter_set_rate(limiter, 100*1024);
+    fail_if(lr_ratelimiter_get_rate(limiter) != 100*1024);
+    fail_if(lr_ratelimiter_delay(limiter) != 0);
+
+    // Take much more than the bucket holds - the bucket is in debt
+    // for about 1 sec
+    lr_ratelimiter_consume(limiter, 200*1024);
+    delay = lr_ratelimiter_delay(limiter);
+    fail_if(delay < 500000);
+    fail_if(delay > 2 * G_USEC_PER_SEC);
+
+    // Unlimited again
+    lr_ratelimiter_set_rate(limiter, 0);
+    fail_if(lr_ratelimiter_delay(limiter) != 0);
+
+    lr_ratelimiter_free(limiter);
+}
+END_TEST
+
+/** Create a file of the given size in the temporary directory
+ * and return its path */
+static char *
+create_test_file(const char *name, size_t size)
+{
+    char *path = lr_pathconcat(test_globals.tmpdir, name, NULL);
+    char *data = g_malloc0(size);
+    int fd;
+
+    fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd < 0);
+    fail_if(write(fd, data, size) != (ssize_t) size);
+    close(fd);
+    g_free(data);
+
+    return path;
+}
+
+START_TEST(test_downloader_maxspeed)
+{
+    gboolean ret;
+    gint64 start, elapsed;
+    char *src, *dst, *url;
+    struct stat st;
+    LrHandle *handle;
+    LrDownloadTarget *t1;
+    GSList *list = NULL;
+    GError *tmp_err = NULL;
+
+    src = create_test_file("/test_maxspeed_src", 150*1024);
+    dst = lr_pathconcat(test_globals.tmpdir, "/test_maxspeed_dst", NULL);
+    url = g_strconcat("file://", src, NULL);
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+    ret = lr_handle_setopt(handle, &tmp_err, LRO_MAXSPEED,
+                           (gint64) 100*1024);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    t1 = lr_downloadtarget_new(handle, url, NULL, -1, dst, NULL, 0, 0,
+                               NULL, NULL, NULL, NULL, NULL, 0, 0);
+    list = g_slist_append(list, t1);
+
+    // 150 KiB at 100 KiB/s take about 1.5 s
+    start = g_get_monotonic_time();
+    ret = lr_download(list, FALSE, &tmp_err);
+    elapsed = g_get_monotonic_time() - start;
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t1->err);
+    fail_if(elapsed < G_USEC_PER_SEC);
+
+    fail_if(stat(dst, &st) != 0);
+    fail_if(st.st_size != 150*1024);
+
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+    fail_if(remove(src) != 0, "Cannot delete temporary test file");
+    fail_if(remove(dst) != 0, "Cannot delete temporary test file");
+    g_free(url);
+    lr_free(src);
+    lr_free(dst);
+}
+END_TEST
+
+START_TEST(test_downloader_shared_maxspeed)
+{
+    gboolean ret;
+    gint64 start, elapsed;
+    char *src, *url;
+    char *dst[2];
+    struct stat st;
+    LrShare *share;
+    LrHandle *handles[2];
+    LrAsyncDownload *ads[2];
+    LrDownloadTarget *targets[2];
+    GError *tmp_err = NULL;
+
+    src = create_test_file("/test_shared_maxspeed_src", 100*1024);
+    url = g_strconcat("file://", src, NULL);
+
+    share = lr_share_new(&tmp_err);
+    fail_if(!share);
+    fail_if(tmp_err);
+
+    for (int i = 0; i < 2; i++) {
+        char *name = g_strdup_printf("/test_shared_maxspeed_dst_%d", i);
+        dst[i] = lr_pathconcat(test_globals.tmpdir, name, NULL);
+        g_free(name);
+
+        handles[i] = lr_handle_init();
+        fail_if(handles[i] == NULL);
+        ret = lr_handle_setopt(handles[i], &tmp_err, LRO_SHARE, share);
+        fail_if(!ret);
+        fail_if(tmp_err);
+
+        ads[i] = lr_asyncdownload_new(handles[i], FALSE, &tmp_err);
+        fail_if(!ads[i]);
+        fail_if(tmp_err);
+
+        targets[i] = lr_downloadtarget_new(NULL, url, NULL, -1, dst[i],
+                                           NULL, 0, 0, NULL, NULL, NULL,
+                                           NULL, NULL, 0, 0);
+        ret = lr_asyncdownload_add_target(ads[i], targets[i], &tmp_err);
+        fail_if(!ret);
+        fail_if(tmp_err);
+    }
+
+    // The limit is set after the downloads were created, it has to be
+    // applied anyway. Both downloads (200 KiB together) share 100 KiB/s
+    // and take about 2 s.
+    ret = lr_share_set_maxspeed(share, 100*1024, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    start = g_get_monotonic_time();
+    while (lr_asyncdownload_is_running(ads[0])
+           || lr_asyncdownload_is_running(ads[1]))
+    {
+        struct pollfd pfds[2];
+        long timeout = -1;
+
+        for (int i = 0; i < 2; i++) {
+            long t = lr_asyncdownload_get_timeout(ads[i]);
+            pfds[i].fd = lr_asyncdownload_get_fd(ads[i]);
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+            if (t >= 0 && (timeout < 0 || t < timeout))
+                timeout = t;
+        }
+
+        fail_if(timeout < 0);
+        fail_if(poll(pfds, 2, (int) timeout) < 0);
+        for (int i = 0; i < 2; i++) {
+            ret = lr_asyncdownload_process(ads[i], &tmp_err);
+            fail_if(!ret);
+            fail_if(tmp_err);
+        }
+    }
+    elapsed = g_get_monotonic_time() - start;
+    fail_if(elapsed < 3 * G_USEC_PER_SEC / 2);
+
+    for (int i = 0; i < 2; i++) {
+        fail_if(lr_asyncdownload_pop_finished(ads[i]) != targets[i]);
+        fail_if(targets[i]->rcode != LRE_OK);
+        fail_if(targets[i]->err);
+        fail_if(stat(dst[i], &st) != 0);
+        fail_if(st.st_size != 100*1024);
+
+        lr_asyncdownload_free(ads[i]);
+        lr_downloadtarget_free(targets[i]);
+        lr_handle_free(handles[i]);
+        fail_if(remove(dst[i]) != 0, "Cannot delete temporary test file");
+        lr_free(dst[i]);
+    }
+
+    lr_share_free(share);
+    fail_if(remove(src) != 0, "Cannot delete temporary test file");
+    g_free(url);
+    lr_free(src);
+}
+END_TEST
+
+typedef struct {
+    GMutex lock;
+    GThread *main_thread;
+    int setups;
+    gsize received;
+    int calls_in_main_thread;
+    GHashTable *threads;
+} WorkerPoolTestData;
+
+static void
+workerpool_setupcb(G_GNUC_UNUSED CURLM *multi_handle, void *cbdata)
+{
+    WorkerPoolTestData *data = cbdata;
+    data->setups++;
+}
+
+static size_t
+workerpool_writecb(G_GNUC_UNUSED char *ptr, size_t size, size_t nmemb,
+                   void *userdata)
+{
+    WorkerPoolTestData *data = userdata;
+
+    g_mutex_lock(&data->lock);
+    if (g_thread_self() == data->main_thread)
+        data->calls_in_main_thread++;
+    g_hash_table_add(data->threads, g_thread_self());
+    data->received += size * nmemb;
+    g_mutex_unlock(&data->lock);
+
+    return size * nmemb;
+}
+
+START_TEST(test_downloader_workerpool)
+{
+    char *src, *url;
+    CURL *handles[6];
+    int finished = 0;
+    LrWorkerPool *pool;
+    WorkerPoolTestData data;
+    GError *tmp_err = NULL;
+
+    src = create_test_file("/test_workerpool_src", 64*1024);
+    url = g_strconcat("file://", src, NULL);
+
+    memset(&data, 0, sizeof(data));
+    g_mutex_init(&data.lock);
+    data.main_thread = g_thread_self();
+    data.threads = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    pool = lr_workerpool_new(3, workerpool_setupcb, NULL, &data, NULL,
+                             LR_DOWNLOADER_ERROR, &tmp_err);
+    fail_if(!pool);
+    fail_if(tmp_err);
+    // Each worker has its own multi handle
+    fail_if(data.setups != 3);
+
+    for (int i = 0; i < 6; i++) {
+        handles[i] = curl_easy_init();
+        fail_if(!handles[i]);
+        curl_easy_setopt(handles[i], CURLOPT_URL, url);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, workerpool_writecb);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEDATA, &data);
+        lr_workerpool_add_handle(pool, handles[i]);
+    }
+
+    while (finished < 6) {
+        CURL *handle;
+        CURLcode result;
+
+        fail_if(!lr_workerpool_wait(pool, 1000, &tmp_err));
+        fail_if(tmp_err);
+        while (lr_workerpool_pop_finished(pool, &handle, &result)) {
+            fail_if(result != CURLE_OK);
+            curl_easy_cleanup(handle);
+            finished++;
+        }
+    }
+
+    lr_workerpool_free(pool);
+
+    // All data were received by the worker threads
+    fail_if(data.received != 6*64*1024);
+    fail_if(data.calls_in_main_thread != 0);
+    fail_if(g_hash_table_size(data.threads) < 1);
+    fail_if(g_hash_table_size(data.threads) > 3);
+
+    g_hash_table_destroy(data.threads);
+    g_mutex_clear(&data.lock);
+    fail_if(remove(src) != 0, "Cannot delete temporary test file");
+    g_free(url);
+    lr_free(src);
+}
+END_TEST
+
+START_TEST(test_downloader_mirror_ranking)
+{
+    LrInternalMirror imirrors[4] = {
+        { "http://a/", 100, LR_PROTOCOL_HTTP },
+        { "http://b/", 100, LR_PROTOCOL_HTTP },
+        { "http://c/", 100, LR_PROTOCOL_HTTP },
+        { "http://d/", 100, LR_PROTOCOL_HTTP },
+    };
+    LrMirror mirrors[4];
+    LrMirror *a = &mirrors[0], *b = &mirrors[1];
+    LrMirror *c = &mirrors[2], *d = &mirrors[3];
+    GPtrArray *array = g_ptr_array_new();
+    gdouble mib = 1024.0*1024.0;
+
+    memset(mirrors, 0, sizeof(mirrors));
+    for (guint i = 0; i < 4; i++) {
+        mirrors[i].mirror = &imirrors[i];
+        mirrors[i].index = i;
+        mirrors[i].position = i;
+        g_ptr_array_add(array, &mirrors[i]);
+    }
+
+    // Without any finished transfer the original order is kept
+    for (guint i = 0; i < 4; i++)
+        fail_if(lr_mirror_tier(&mirrors[i]) != LR_MT_UNKNOWN);
+    fail_if(lr_mirror_cmp(a, b) >= 0);
+    fail_if(lr_mirror_score(a) != -1.0);
+
+    // Measured mirror goes before the unknown ones (1 MiB/s)
+    d->successful_transfers++;
+    lr_mirror_update_stats(d, mib, 0.1, 1.1);
+    fail_if(d->ttfb != 0.1);
+    fail_if(d->throughput != mib);
+    lr_mirrors_sort(array, d, TRUE, FALSE);
+    fail_if(lr_mirror_tier(d) != LR_MT_MEASURED);
+    fail_if(g_ptr_array_index(array, 0) != d);
+    fail_if(g_ptr_array_index(array, 1) != a);
+    fail_if(g_ptr_array_index(array, 2) != b);
+    fail_if(g_ptr_array_index(array, 3) != c);
+
+    // Faster measured mirror goes first (4 MiB/s)
+    c->successful_transfers++;
+    lr_mirror_update_stats(c, mib, 0.05, 0.3);
+    lr_mirrors_sort(array, c, TRUE, FALSE);
+    fail_if(lr_mirror_score(c) <= lr_mirror_score(d));
+    fail_if(g_ptr_array_index(array, 0) != c);
+    fail_if(g_ptr_array_index(array, 1) != d);
+    fail_if(g_ptr_array_index(array, 2) != a);
+    fail_if(g_ptr_array_index(array, 3) != b);
+
+    // Serious error without any success - the mirror is broken
+    a->failed_transfers++;
+    lr_mirrors_sort(array, a, FALSE, TRUE);
+    fail_if(lr_mirror_tier(a) != LR_MT_BROKEN);
+    fail_if(g_ptr_array_index(array, 3) != a);
+
+    // Ordinary error - the mirror is failing, but still before the broken one
+    b->failed_transfers++;
+    lr_mirrors_sort(array, b, FALSE, FALSE);
+    fail_if(lr_mirror_tier(b) != LR_MT_FAILING);
+    fail_if(g_ptr_array_index(array, 0) != c);
+    fail_if(g_ptr_array_index(array, 1) != d);
+    fail_if(g_ptr_array_index(array, 2) != b);
+    fail_if(g_ptr_array_index(array, 3) != a);
+
+    // One fast transfer (10 MiB/s) moves the moving average of d
+    // only partially, it is still slower than c
+    d->successful_transfers++;
+    lr_mirror_update_stats(d, mib, 0.01, 0.11);
+    fail_if(d->throughput < 3.69 * mib || d->throughput > 3.71 * mib);
+    fail_if(d->ttfb < 0.072 || d->ttfb > 0.074);
+    lr_mirrors_sort(array, d, TRUE, FALSE);
+    fail_if(g_ptr_array_index(array, 0) != c);
+    fail_if(g_ptr_array_index(array, 1) != d);
+
+    // The second one makes it the best mirror
+    d->successful_transfers++;
+    lr_mirror_update_stats(d, mib, 0.01, 0.11);
+    lr_mirrors_sort(array, d, TRUE, FALSE);
+    fail_if(g_ptr_array_index(array, 0) != d);
+    fail_if(g_ptr_array_index(array, 1) != c);
+    fail_if(g_ptr_array_index(array, 2) != b);
+    fail_if(g_ptr_array_index(array, 3) != a);
+
+    // Positions are kept in sync with the array
+    for (guint i = 0; i < 4; i++)
+        fail_if(((LrMirror *) g_ptr_array_index(array, i))->position != i);
+
+    // Success of the failing mirror makes it measured, but it is
+    // penalized by its success rate
+    b->successful_transfers++;
+    lr_mirror_update_stats(b, mib, 0.05, 0.3);
+    lr_mirrors_sort(array, b, TRUE, FALSE);
+    fail_if(lr_mirror_tier(b) != LR_MT_MEASURED);
+    fail_if(lr_mirror_score(b) >= lr_mirror_score(c));
+    fail_if(g_ptr_array_index(array, 2) != b);
+    fail_if(g_ptr_array_index(array, 3) != a);
+
+    g_ptr_array_free(array, TRUE);
+}
+END_TEST
+
+START_TEST(test_downloader_async)
+{
+    int fd;
+    gboolean ret;
+    char buf[32];
+    char *src, *dst, *url;
+    LrAsyncDownload *ad;
+    LrDownloadTarget *t1, *finished = NULL;
+    GError *tmp_err = NULL;
+
+    src = lr_pathconcat(test_globals.tmpdir, "/test_async_src", NULL);
+    dst = lr_pathconcat(test_globals.tmpdir, "/test_async_dst", NULL);
+    url = g_strconcat("file://", src, NULL);
+
+    fd = open(src, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd < 0);
+    fail_if(write(fd, "0123456789", 10) != 10);
+    close(fd);
+
+    ad = lr_asyncdownload_new(NULL, FALSE, &tmp_err);
+    fail_if(!ad);
+    fail_if(tmp_err);
+    fail_if(lr_asyncdownload_get_fd(ad) < 0);
+    fail_if(lr_asyncdownload_is_running(ad));
+    fail_if(lr_asyncdownload_get_timeout(ad) != -1);
+
+    t1 = lr_downloadtarget_new(NULL, url, NULL, -1, dst, NULL, 0, 0,
+                               NULL, NULL, NULL, NULL, NULL, 0, 0);
+    ret = lr_asyncdownload_add_target(ad, t1, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    // Drive the download by poll() as an external event loop would do
+    while (lr_asyncdownload_is_running(ad)) {
+        struct pollfd pfd = { lr_asyncdownload_get_fd(ad), POLLIN, 0 };
+        long timeout = lr_asyncdownload_get_timeout(ad);
+        fail_if(timeout < 0);
+        fail_if(timeout > 1000);
+        fail_if(poll(&pfd, 1, (int) timeout) < 0);
+        ret = lr_asyncdownload_process(ad, &tmp_err);
+        fail_if(!ret);
+        fail_if(tmp_err);
+    }
+
+    finished = lr_asyncdownload_pop_finished(ad);
+    fail_if(finished != t1);
+    fail_if(lr_asyncdownload_pop_finished(ad));
+    fail_if(t1->rcode != LRE_OK);
+    fail_if(t1->err);
+
+    lr_asyncdownload_free(ad);
+
+    fd = open(dst, O_RDONLY);
+    fail_if(fd < 0);
+    fail_if(read(fd, buf, sizeof(buf)) != 10);
+    fail_if(memcmp(buf, "0123456789", 10));
+    close(fd);
+
+    lr_downloadtarget_free(t1);
+    fail_if(remove(src) != 0, "Cannot delete temporary test file");
+    fail_if(remove(dst) != 0, "Cannot delete temporary test file");
+    g_free(url);
+    lr_free(src);
+    lr_free(dst);
+}
+END_TEST
+
 Suite *
 downloader_suite(void)
 {
@@ -300,6 +820,13 @@ downloader_suite(void)
     tcase_add_test(tc, test_downloader_single_file_2);
     tcase_add_test(tc, test_downloader_two_files);
     tcase_add_test(tc, test_downloader_three_files_with_error);
+    tcase_add_test(tc, test_downloader_filewriter);
+    tcase_add_test(tc, test_downloader_ratelimiter);
+    tcase_add_test(tc, test_downloader_maxspeed);
+    tcase_add_test(tc, test_downloader_shared_maxspeed);
+    tcase_add_test(tc, test_downloader_mirror_ranking);
+    tcase_add_test(tc, test_downloader_workerpool);
+    tcase_add_test(tc, test_downloader_async);
     suite_add_tcase(s, tc);
     return s;
 }
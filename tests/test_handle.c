@@ -10,6 +10,7 @@
 #include "librepo/librepo.h"
 #include "librepo/rcodes.h"
 #include "librepo/handle.h"
+#include "librepo/handle_internal.h"
 #include "librepo/url_substitution.h"
 
 #include "fixtures.h"
@@ -137,6 +138,101 @@ START_TEST(test_handle_getinfo)
 }
 END_TEST
 
+START_TEST(test_handle_downloadsession)
+{
+    LrHandle *h;
+    LrDownloadSession *session, *owned = NULL, *tmp = NULL;
+    GError *err = NULL;
+
+    h = lr_handle_init();
+    fail_if(h == NULL);
+
+    // Handle owns a session by default
+    fail_if(!lr_handle_getinfo(h, NULL, LRI_DOWNLOADSESSION, &owned));
+    fail_if(owned == NULL);
+
+    // Attach a shared session
+    session = lr_downloadsession_new(&err);
+    fail_if(session == NULL);
+    fail_if(err);
+    fail_if(!lr_handle_setopt(h, NULL, LRO_DOWNLOADSESSION, session));
+    fail_if(!lr_handle_getinfo(h, NULL, LRI_DOWNLOADSESSION, &tmp));
+    fail_if(tmp != session);
+
+    // Back to a session owned by the handle
+    fail_if(!lr_handle_setopt(h, NULL, LRO_DOWNLOADSESSION, NULL));
+    tmp = NULL;
+    fail_if(!lr_handle_getinfo(h, NULL, LRI_DOWNLOADSESSION, &tmp));
+    fail_if(tmp == NULL);
+    fail_if(tmp == session);
+
+    lr_handle_free(h);
+    lr_downloadsession_free(session);
+}
+END_TEST
+
+START_TEST(test_handle_share)
+{
+    LrHandle *h1, *h2;
+    LrShare *share, *tmp = NULL;
+    GError *err = NULL;
+
+    share = lr_share_new(&err);
+    fail_if(share == NULL);
+    fail_if(err);
+
+    h1 = lr_handle_init();
+    h2 = lr_handle_init();
+    fail_if(!lr_handle_getinfo(h1, NULL, LRI_SHARE, &tmp));
+    fail_if(tmp != NULL);
+
+    fail_if(!lr_handle_setopt(h1, NULL, LRO_SHARE, share));
+    fail_if(!lr_handle_setopt(h2, NULL, LRO_SHARE, share));
+    fail_if(!lr_handle_getinfo(h2, NULL, LRI_SHARE, &tmp));
+    fail_if(tmp != share);
+
+    fail_if(!lr_handle_setopt(h1, NULL, LRO_SHARE, lr_share_default()));
+    fail_if(!lr_handle_getinfo(h1, NULL, LRI_SHARE, &tmp));
+    fail_if(tmp != lr_share_default());
+    fail_if(lr_share_default() == share);
+
+    lr_handle_free(h1);
+    lr_handle_free(h2);
+    lr_share_free(share);
+}
+END_TEST
+
+START_TEST(test_handle_curl_handle_pool)
+{
+    LrHandle *h;
+    CURL *c1, *c2, *c3;
+    guint gen1, gen2, gen3;
+
+    h = lr_handle_init();
+
+    // Released easy handle is reused
+    c1 = lr_handle_curl_handle_acquire(h, &gen1);
+    fail_if(c1 == NULL);
+    fail_if(c1 == h->curl_handle);
+    lr_handle_curl_handle_release(h, c1, gen1);
+    c2 = lr_handle_curl_handle_acquire(h, &gen2);
+    fail_if(c2 != c1);
+    fail_if(gen2 != gen1);
+
+    // Easy handles acquired before a change of options are not reused
+    fail_if(!lr_handle_setopt(h, NULL, LRO_USERAGENT, "librepo-test"));
+    lr_handle_curl_handle_release(h, c2, gen2);
+    fail_if(h->curl_handle_pool != NULL);
+    c3 = lr_handle_curl_handle_acquire(h, &gen3);
+    fail_if(c3 == NULL);
+    fail_if(gen3 == gen2);
+    lr_handle_curl_handle_release(h, c3, gen3);
+    fail_if(h->curl_handle_pool == NULL);
+
+    lr_handle_free(h);
+}
+END_TEST
+
 Suite *
 handle_suite(void)
 {
@@ -144,6 +240,9 @@ handle_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_handle);
     tcase_add_test(tc, test_handle_getinfo);
+    tcase_add_test(tc, test_handle_downloadsession);
+    tcase_add_test(tc, test_handle_share);
+    tcase_add_test(tc, test_handle_curl_handle_pool);
     suite_add_tcase(s, tc);
     return s;
 }